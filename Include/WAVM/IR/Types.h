@@ -319,6 +319,7 @@ namespace WAVM { namespace IR {
 	template<> constexpr ValueType inferValueType<U64>() { return ValueType::i64; }
 	template<> constexpr ValueType inferValueType<F32>() { return ValueType::f32; }
 	template<> constexpr ValueType inferValueType<F64>() { return ValueType::f64; }
+	template<> constexpr ValueType inferValueType<V128>() { return ValueType::v128; }
 	template<> constexpr ValueType inferValueType<Runtime::Object*>() { return ValueType::anyref; }
 	template<> constexpr ValueType inferValueType<Runtime::Function*>()
 	{
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <atomic>
+#include <type_traits>
+
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Platform/Intrinsic.h"
+#include "WAVM/Platform/Thread.h"
+
+namespace WAVM {
+	// A map from non-overlapping address intervals to values, which can be queried without taking
+	// a lock or allocating memory, so it may be used by signal handlers.
+	//
+	// The intervals are stored in a sorted array that is never modified after it is published:
+	// adding or removing an interval copies the array, and atomically replaces the published array
+	// with the copy. Each copy takes O(N) time, but lookups take O(log N) time and never block.
+	// Replaced arrays are only freed when no thread holds a hazard pointer to them, so a lookup
+	// can't read an array that was freed. Removing an interval waits for the lookups that may have
+	// found it to finish, so the value may be freed after its interval is removed. A value returned
+	// by get may be removed concurrently, so to use a value that may be freed, look it up with
+	// visit instead.
+	template<typename Value> struct ConcurrentIntervalMap
+	{
+		static_assert(std::is_trivially_copyable<Value>::value,
+					  "ConcurrentIntervalMap values must be trivially copyable");
+
+		ConcurrentIntervalMap() = default;
+		ConcurrentIntervalMap(const ConcurrentIntervalMap&) = delete;
+		ConcurrentIntervalMap& operator=(const ConcurrentIntervalMap&) = delete;
+
+		~ConcurrentIntervalMap()
+		{
+			freeSnapshots(snapshot.load(std::memory_order_relaxed));
+			freeSnapshots(retiredSnapshots.load(std::memory_order_relaxed));
+		}
+
+		// Adds the interval [begin, end) to the map. Fails if it overlaps an interval that is
+		// already in the map.
+		void addOrFail(Uptr begin, Uptr end, Value value)
+		{
+			WAVM_ASSERT(begin < end);
+			update([begin, end, value](const Snapshot* oldSnapshot) {
+				const Uptr numOldIntervals = oldSnapshot ? oldSnapshot->numIntervals : 0;
+				const Uptr insertIndex = lowerBound(oldSnapshot, begin);
+				WAVM_ERROR_UNLESS(insertIndex == 0
+								  || oldSnapshot->intervals[insertIndex - 1].end <= begin);
+				WAVM_ERROR_UNLESS(insertIndex == numOldIntervals
+								  || end <= oldSnapshot->intervals[insertIndex].begin);
+
+				Snapshot* newSnapshot = allocateSnapshot(numOldIntervals + 1);
+				for(Uptr index = 0; index < insertIndex; ++index)
+				{ newSnapshot->intervals[index] = oldSnapshot->intervals[index]; }
+				newSnapshot->intervals[insertIndex] = {begin, end, value};
+				for(Uptr index = insertIndex; index < numOldIntervals; ++index)
+				{ newSnapshot->intervals[index + 1] = oldSnapshot->intervals[index]; }
+				return newSnapshot;
+			});
+		}
+
+		// Removes the interval that starts at begin from the map. Fails if there isn't one. When
+		// this returns, no call to visit is still using the interval's value.
+		void removeOrFail(Uptr begin)
+		{
+			const Snapshot* newSnapshot = update([begin](const Snapshot* oldSnapshot) -> Snapshot* {
+				const Uptr removeIndex = lowerBound(oldSnapshot, begin);
+				WAVM_ERROR_UNLESS(oldSnapshot && removeIndex < oldSnapshot->numIntervals
+								  && oldSnapshot->intervals[removeIndex].begin == begin);
+
+				const Uptr numNewIntervals = oldSnapshot->numIntervals - 1;
+				if(!numNewIntervals) { return nullptr; }
+
+				Snapshot* newSnapshot = allocateSnapshot(numNewIntervals);
+				for(Uptr index = 0; index < removeIndex; ++index)
+				{ newSnapshot->intervals[index] = oldSnapshot->intervals[index]; }
+				for(Uptr index = removeIndex; index < numNewIntervals; ++index)
+				{ newSnapshot->intervals[index] = oldSnapshot->intervals[index + 1]; }
+				return newSnapshot;
+			});
+			waitForReadersOfOlderSnapshots(newSnapshot);
+		}
+
+		// Finds the interval that contains an address. If there is one, writes its value and the
+		// address it begins at to outValue and outBegin, and returns true. This is lock-free and
+		// async-signal-safe.
+		bool get(Uptr address, Value& outValue, Uptr& outBegin) const
+		{
+			return visit(address, [&](Value value, Uptr begin) {
+				outValue = value;
+				outBegin = begin;
+			});
+		}
+
+		// Finds the interval that contains an address. If there is one, calls visitor with its
+		// value and the address it begins at, and returns true. The interval can't be removed
+		// until the visitor returns, so the visitor may use a value that is freed after its
+		// interval is removed. This is lock-free, and async-signal-safe if the visitor is.
+		template<typename Visitor> bool visit(Uptr address, Visitor&& visitor) const
+		{
+			bool result = false;
+			HazardSlot* slot = claimHazardSlot();
+			const Snapshot* currentSnapshot = protectSnapshot(slot);
+			if(currentSnapshot)
+			{
+				// Find the last interval that begins at or before the address.
+				const Uptr upperBoundIndex = lowerBound(currentSnapshot, address + 1);
+				if(upperBoundIndex > 0)
+				{
+					const Interval& interval = currentSnapshot->intervals[upperBoundIndex - 1];
+					if(address < interval.end)
+					{
+						visitor(interval.value, interval.begin);
+						result = true;
+					}
+				}
+			}
+			releaseHazardSlot(slot);
+			return result;
+		}
+
+	private:
+		struct Interval
+		{
+			Uptr begin;
+			Uptr end;
+			Value value;
+		};
+
+		struct Snapshot
+		{
+			Uptr numIntervals;
+			Snapshot* nextRetiredSnapshot;
+			Interval intervals[1];
+		};
+
+		// A hazard pointer: while a thread reads a snapshot, it stores a pointer to it in a slot it
+		// has claimed, and snapshots that are pointed to by a slot aren't freed.
+		struct alignas(WAVM::numCacheLineBytes) HazardSlot
+		{
+			std::atomic<bool> isClaimed{false};
+			std::atomic<const Snapshot*> snapshot{nullptr};
+		};
+
+		static constexpr Uptr numHazardSlots = 64;
+
+		std::atomic<Snapshot*> snapshot{nullptr};
+		std::atomic<Snapshot*> retiredSnapshots{nullptr};
+		mutable HazardSlot hazardSlots[numHazardSlots];
+		mutable std::atomic<Uptr> nextHazardSlotIndex{0};
+
+		static Snapshot* allocateSnapshot(Uptr numIntervals)
+		{
+			Snapshot* result = (Snapshot*)malloc(offsetof(Snapshot, intervals)
+												 + sizeof(Interval) * numIntervals);
+			if(!result) { Errors::fatal("Failed to allocate ConcurrentIntervalMap snapshot"); }
+			result->numIntervals = numIntervals;
+			result->nextRetiredSnapshot = nullptr;
+			return result;
+		}
+
+		static void freeSnapshots(Snapshot* firstSnapshot)
+		{
+			while(firstSnapshot)
+			{
+				Snapshot* nextSnapshot = firstSnapshot->nextRetiredSnapshot;
+				free(firstSnapshot);
+				firstSnapshot = nextSnapshot;
+			}
+		}
+
+		// Returns the index of the first interval that begins at or after an address.
+		static Uptr lowerBound(const Snapshot* snapshot, Uptr address)
+		{
+			Uptr lowIndex = 0;
+			Uptr highIndex = snapshot ? snapshot->numIntervals : 0;
+			while(lowIndex < highIndex)
+			{
+				const Uptr middleIndex = lowIndex + (highIndex - lowIndex) / 2;
+				if(snapshot->intervals[middleIndex].begin < address) { lowIndex = middleIndex + 1; }
+				else
+				{
+					highIndex = middleIndex;
+				}
+			}
+			return lowIndex;
+		}
+
+		// Claims a hazard slot, spinning if they are all claimed by other threads.
+		HazardSlot* claimHazardSlot() const
+		{
+			Uptr slotIndex = nextHazardSlotIndex.fetch_add(1, std::memory_order_relaxed);
+			while(true)
+			{
+				HazardSlot* slot = &hazardSlots[slotIndex % numHazardSlots];
+				if(!slot->isClaimed.load(std::memory_order_relaxed)
+				   && !slot->isClaimed.exchange(true, std::memory_order_acquire))
+				{ return slot; }
+				++slotIndex;
+			}
+		}
+
+		static void releaseHazardSlot(HazardSlot* slot)
+		{
+			slot->snapshot.store(nullptr, std::memory_order_release);
+			slot->isClaimed.store(false, std::memory_order_release);
+		}
+
+		// Stores the published snapshot in a hazard slot, and returns it. The snapshot is published
+		// again after it is stored, so any thread that replaces it afterward will see it in the
+		// slot before freeing it.
+		const Snapshot* protectSnapshot(HazardSlot* slot) const
+		{
+			const Snapshot* protectedSnapshot = snapshot.load(std::memory_order_seq_cst);
+			while(true)
+			{
+				slot->snapshot.store(protectedSnapshot, std::memory_order_seq_cst);
+				const Snapshot* currentSnapshot = snapshot.load(std::memory_order_seq_cst);
+				if(currentSnapshot == protectedSnapshot) { return protectedSnapshot; }
+				protectedSnapshot = currentSnapshot;
+			}
+		}
+
+		bool isSnapshotProtected(const Snapshot* retiredSnapshot) const
+		{
+			for(Uptr slotIndex = 0; slotIndex < numHazardSlots; ++slotIndex)
+			{
+				if(hazardSlots[slotIndex].snapshot.load(std::memory_order_seq_cst)
+				   == retiredSnapshot)
+				{ return true; }
+			}
+			return false;
+		}
+
+		void pushRetiredSnapshots(Snapshot* firstSnapshot, Snapshot* lastSnapshot)
+		{
+			Snapshot* firstRetiredSnapshot = retiredSnapshots.load(std::memory_order_relaxed);
+			do
+			{
+				lastSnapshot->nextRetiredSnapshot = firstRetiredSnapshot;
+			} while(!retiredSnapshots.compare_exchange_weak(
+				firstRetiredSnapshot, firstSnapshot, std::memory_order_seq_cst));
+		}
+
+		// Waits until no hazard slot protects a snapshot that was published before newSnapshot. A
+		// reader only uses a snapshot that was still published after it stored it in its slot, so
+		// any reader that could be using an older snapshot has stored it in its slot before
+		// newSnapshot was published. Each slot that holds a snapshot other than newSnapshot is
+		// waited on until it changes: it may hold a newer snapshot, but lookups are short, so
+		// waiting for it too is simpler than telling which snapshots are older.
+		void waitForReadersOfOlderSnapshots(const Snapshot* newSnapshot) const
+		{
+			for(Uptr slotIndex = 0; slotIndex < numHazardSlots; ++slotIndex)
+			{
+				const HazardSlot& slot = hazardSlots[slotIndex];
+				const Snapshot* protectedSnapshot = slot.snapshot.load(std::memory_order_seq_cst);
+				if(!protectedSnapshot || protectedSnapshot == newSnapshot) { continue; }
+				while(slot.snapshot.load(std::memory_order_seq_cst) == protectedSnapshot)
+				{ Platform::yieldToAnotherThread(); }
+			}
+		}
+
+		// Replaces the published snapshot with a copy made by createSnapshot, retrying if another
+		// thread replaces it first. Returns the snapshot that was published.
+		template<typename CreateSnapshot> const Snapshot* update(CreateSnapshot&& createSnapshot)
+		{
+			// Protect the published snapshot with a hazard slot, so it can't be freed while it is
+			// copied.
+			HazardSlot* slot = claimHazardSlot();
+			Snapshot* oldSnapshot = const_cast<Snapshot*>(protectSnapshot(slot));
+			Snapshot* newSnapshot;
+			while(true)
+			{
+				newSnapshot = createSnapshot(oldSnapshot);
+				Snapshot* expectedSnapshot = oldSnapshot;
+				if(snapshot.compare_exchange_strong(
+					   expectedSnapshot, newSnapshot, std::memory_order_seq_cst))
+				{ break; }
+				free(newSnapshot);
+				oldSnapshot = const_cast<Snapshot*>(protectSnapshot(slot));
+			}
+			releaseHazardSlot(slot);
+
+			if(oldSnapshot)
+			{
+				oldSnapshot->nextRetiredSnapshot = nullptr;
+				pushRetiredSnapshots(oldSnapshot, oldSnapshot);
+			}
+			freeRetiredSnapshots();
+			return newSnapshot;
+		}
+
+		// Frees the retired snapshots that aren't protected by a hazard slot. A thread that reads
+		// a snapshot protects it before the snapshot is replaced, so any retired snapshot that
+		// isn't protected can't be read.
+		void freeRetiredSnapshots()
+		{
+			Snapshot* retiredSnapshot = retiredSnapshots.exchange(nullptr, std::memory_order_seq_cst);
+			Snapshot* firstProtectedSnapshot = nullptr;
+			Snapshot* lastProtectedSnapshot = nullptr;
+			while(retiredSnapshot)
+			{
+				Snapshot* nextSnapshot = retiredSnapshot->nextRetiredSnapshot;
+				if(!isSnapshotProtected(retiredSnapshot)) { free(retiredSnapshot); }
+				else
+				{
+					retiredSnapshot->nextRetiredSnapshot = firstProtectedSnapshot;
+					firstProtectedSnapshot = retiredSnapshot;
+					if(!lastProtectedSnapshot) { lastProtectedSnapshot = retiredSnapshot; }
+				}
+				retiredSnapshot = nextSnapshot;
+			}
+
+			// Put the snapshots that are still protected back to be freed by a later update.
+			if(firstProtectedSnapshot)
+			{ pushRetiredSnapshots(firstProtectedSnapshot, lastProtectedSnapshot); }
+		}
+	};
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -42,23 +43,127 @@ namespace WAVM { namespace LLVMJIT {
 
 	LLVMJIT_API TargetSpec getHostTargetSpec();
 
+	// Returns a string that identifies the object code format version emitted by the compiler and
+	// the version of LLVM it uses. Object code is only guaranteed to be loadable by a compiler that
+	// returns the same version string.
+	LLVMJIT_API std::string getCompilerVersion();
+
 	LLVMJIT_API TargetValidationResult validateTarget(const TargetSpec& targetSpec,
 													  const IR::FeatureSpec& featureSpec);
 
+	// The optimization levels the compiler supports.
+	enum class OptLevel
+	{
+		// Doesn't optimize the IR, and uses the fastest code generator settings.
+		O0,
+		// Runs a short pipeline of per-function optimizations.
+		O1,
+		// Runs LLVM's standard module pipeline, including inlining across function boundaries and
+		// global dead code elimination.
+		O2,
+		// Like O2, but inlines and unrolls more aggressively, and uses the aggressive code
+		// generator settings.
+		O3,
+		// Like O2, but favors smaller code over faster code.
+		Os,
+	};
+
+	// Parses an optimization level name ("O0", "O1", "O2", "O3" or "Os"). Returns false if the
+	// string doesn't name an optimization level.
+	LLVMJIT_API bool parseOptLevel(const char* string, OptLevel& outOptLevel);
+	LLVMJIT_API const char* getOptLevelName(OptLevel optLevel);
+
+	// The execution counts collected by code compiled with CompileOptions::instrumentProfile for
+	// one function definition. Branches are identified by the index of the operator in the
+	// function's code, which is the same index used by FunctionMutableData::offsetToOpIndexMap.
+	struct FunctionProfile
+	{
+		U64 entryCount = 0;
+
+		// The number of times each successor of an if, br_if, or br_table operator was taken. For
+		// if and br_if, the counts are for the condition being false and true. For br_table, the
+		// counts are for each target in the table, followed by the default target.
+		std::map<Uptr, std::vector<U64>> branchCounts;
+	};
+
+	struct ModuleProfile
+	{
+		std::vector<FunctionProfile> functionDefs;
+	};
+
+	// Converts a profile to and from a text format that can be written to a file. parseProfile
+	// returns false if the string isn't a valid profile.
+	LLVMJIT_API std::string serializeProfile(const ModuleProfile& profile);
+	LLVMJIT_API bool parseProfile(const std::string& string, ModuleProfile& outProfile);
+
+	// Options that control how a module is compiled.
+	struct CompileOptions
+	{
+		// The optimization level to compile the module at. If the module is compiled with tiering,
+		// this is the optimization level used to recompile the functions that are called often.
+		OptLevel optLevel = OptLevel::O1;
+
+		// The number of shards to split the module's function definitions into. Each shard is
+		// compiled to a separate object on its own thread, and the objects are bundled into a
+		// single image that is linked when loaded. 0 chooses a shard count based on the number of
+		// hardware threads and the size of the module.
+		Uptr numShards = 0;
+
+		// If true, the module is compiled by a fast baseline tier that doesn't optimize the code.
+		// Functions that are called tierUpCallThreshold times are recompiled with optimization on
+		// a background thread, and calls to the baseline code are forwarded to the optimized code.
+		bool tiered = false;
+		U32 tierUpCallThreshold = 1000;
+
+		// If true, only a small stub is compiled for each function definition, and the function's
+		// code is compiled at optLevel the first time the stub is called. If
+		// lazyCompileDirectCallees is also true, the functions it calls directly are compiled with
+		// it. Takes precedence over tiered.
+		bool lazy = false;
+		bool lazyCompileDirectCallees = false;
+
+		// If true, the code counts the calls to each function definition and how often each
+		// branch goes each way. The counts are shared by all instances of the module, and may be
+		// read with getModuleProfile.
+		bool instrumentProfile = false;
+
+		// If true, the code checks for a call to Runtime::interruptContext on entry to each
+		// function and on each loop iteration, and traps if there was one.
+		bool interruptible = false;
+
+		// If true, the code subtracts a fixed cost from its context's fuel on entry to each basic
+		// block, and calls the runtime when the fuel runs out. The cost of a block is the number
+		// of WebAssembly operators in it, so the fuel used by a module doesn't depend on how it
+		// was compiled.
+		bool meterFuel = false;
+
+		// If true, the code checks that the addresses it accesses are within the memory, instead of
+		// relying on the memory to reserve enough address space for any address. Modules compiled
+		// with this may use memories that only reserve address space for their maximum size: see
+		// Runtime::setCompartmentMaxMemoryReservation.
+		bool boundsCheckMemories = false;
+
+		// If non-null, a profile of the module collected by instrumented code. The counts are
+		// added to the code as function entry counts and branch weights, so the optimizer
+		// favors the paths the profile found to be hot.
+		std::shared_ptr<const ModuleProfile> profile;
+	};
+
 	// Compile a module to object code with the host target spec.
 	// Cannot fail if validateTarget(targetSpec, irModule.featureSpec) == valid.
 	LLVMJIT_API std::vector<U8> compileModule(const IR::Module& irModule,
-											  const TargetSpec& targetSpec);
+											  const TargetSpec& targetSpec,
+											  const CompileOptions& options = CompileOptions());
 
 	LLVMJIT_API std::string emitLLVMIR(const IR::Module& irModule,
 									   const TargetSpec& targetSpec,
-									   bool optimize);
+									   OptLevel optLevel);
 
-	// An opaque type that can be used to reference a loaded JIT module.
+	// An opaque type that can be used to reference a loaded JIT module, or an instance of one.
 	struct Module;
 
 	//
-	// Structs that are passed to loadModule to bind undefined symbols in object code to values.
+	// Structs that are passed to instantiateModule to bind a loaded module to values.
 	//
 
 	struct ModuleInstanceBinding
@@ -97,27 +202,102 @@ namespace WAVM { namespace LLVMJIT {
 		Uptr id;
 	};
 
-	// Loads a module from object code, and binds its undefined symbols to the provided bindings.
+	// Loads a module from object code. The loaded code doesn't depend on the module's imports or
+	// definitions, and may be shared by any number of instances created by instantiateModule.
+	// functionDefMutableDatas are used for the loaded code's Runtime::Function objects, which are
+	// only used to describe the code: each instance has its own Runtime::Function objects.
+	// If the object code was compiled with CompileOptions::tiered, tierUpIRModule should be the
+	// module it was compiled from, which is used to recompile its functions at tierUpOptLevel, and
+	// with CompileOptions::interruptible, meterFuel, and boundsCheckMemories if
+	// tierUpInterruptible, tierUpMeterFuel, and tierUpBoundsCheckMemories are true.
 	LLVMJIT_API std::shared_ptr<Module> loadModule(
 		const std::vector<U8>& objectFileBytes,
 		HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
 		std::vector<IR::FunctionType>&& types,
+		Uptr tableReferenceBias,
+		const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas,
+		std::shared_ptr<const IR::Module> tierUpIRModule = nullptr,
+		OptLevel tierUpOptLevel = OptLevel::O1,
+		bool tierUpInterruptible = false,
+		bool tierUpMeterFuel = false,
+		bool tierUpBoundsCheckMemories = false);
+
+	// Creates an instance of a loaded module that binds its code to the provided bindings. This
+	// doesn't copy or relink the loaded code: it creates a table of the bindings, and a small stub
+	// for each function definition that calls the loaded code with the address of the table.
+	// The instance's Runtime::Function for each function definition is written to the function
+	// pointer of the corresponding element of functionDefMutableDatas.
+	LLVMJIT_API std::shared_ptr<Module> instantiateModule(
+		const std::shared_ptr<Module>& loadedModule,
 		std::vector<FunctionBinding>&& functionImports,
 		std::vector<TableBinding>&& tables,
 		std::vector<MemoryBinding>&& memories,
 		std::vector<GlobalBinding>&& globals,
 		std::vector<ExceptionTypeBinding>&& exceptionTypes,
 		ModuleInstanceBinding moduleInstance,
-		Uptr tableReferenceBias,
 		const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas);
 
+	// Creates an instance of a module whose functions are executed by an interpreter instead of
+	// compiled code. A stub is created for each function definition that calls interpreterEntry
+	// with the stub's Runtime::Function and a context whose thunkArgAndReturnData contains the
+	// function's arguments. interpreterEntry must write the function's results to the same place in
+	// the context it returns, like an invoke thunk. The instance's Runtime::Function for each
+	// function definition is written to the function pointer of the corresponding element of
+	// functionDefMutableDatas.
+	LLVMJIT_API std::shared_ptr<Module> instantiateInterpretedModule(
+		Runtime::InvokeThunkPointer interpreterEntry,
+		const std::vector<IR::FunctionType>& functionDefTypes,
+		ModuleInstanceBinding moduleInstance,
+		const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas);
+
+	// Queues a function compiled by the baseline tier to be recompiled with optimization on a
+	// background thread. Called by the baseline code when the function reaches its call threshold.
+	LLVMJIT_API void requestTierUp(const Runtime::Function* function, Uptr functionDefIndex);
+
+	// Compiles a function definition of a module compiled with CompileOptions::lazy, and optionally
+	// the functions it calls directly. Called by the function's stub the first time it is called,
+	// and returns once the function's code has been compiled.
+	LLVMJIT_API void compileLazyFunction(const Runtime::Function* function,
+										 Uptr functionDefIndex,
+										 bool shouldCompileDirectCallees);
+
+	// Reads the counts collected by a loaded module that was compiled with
+	// CompileOptions::instrumentProfile from irModule. Returns false if the module wasn't
+	// instrumented.
+	LLVMJIT_API bool getModuleProfile(const std::shared_ptr<Module>& loadedModule,
+									  const IR::Module& irModule,
+									  ModuleProfile& outProfile);
+
 	// Finds the JIT function whose code contains the given address. If no JIT function contains the
-	// given address, returns null.
+	// given address, returns null. The lookup is safe while modules are concurrently unloaded, but
+	// the returned function is freed with its module, so the caller must ensure the module stays
+	// loaded while it uses the function (e.g. because the address is on the current call stack).
 	LLVMJIT_API Runtime::Function* getFunctionByAddress(Uptr address);
 
+	// Sets a function that is called with each address range of JIT code that is about to be
+	// unloaded. getFunctionByAddress may be used on addresses in the range until the callback
+	// returns, so the callback can describe the functions it contains before they are freed.
+	typedef void (*CodeUnloadCallback)(Uptr beginAddress, Uptr endAddress);
+	LLVMJIT_API void setCodeUnloadCallback(CodeUnloadCallback callback);
+
+	// Writes the address, size, and name of all JIT code that is loaded after the call to
+	// /tmp/perf-<pid>.map, which Linux perf uses to symbolize samples in JIT code. This includes
+	// the code of WebAssembly functions, their per-instance stubs, and the invoke and intrinsic
+	// thunks. Returns false if the file couldn't be opened, or if the host isn't Linux.
+	LLVMJIT_API bool enablePerfMap();
+
+	// Backs the code and data of JIT modules that are loaded after the call with huge pages where
+	// the platform supports them, which reduces the TLB misses of large modules. Only the objects
+	// that are at least as large as a huge page are aligned to one. Returns false if the platform
+	// doesn't support huge pages.
+	LLVMJIT_API bool enableHugePagesForCode();
+
 	// Generates an invoke thunk for a specific function type.
 	LLVMJIT_API Runtime::InvokeThunkPointer getInvokeThunk(IR::FunctionType functionType);
 
+	// Generates a thunk that invokes a function of a specific type once for each row of arguments.
+	LLVMJIT_API Runtime::InvokeBatchThunkPointer getInvokeBatchThunk(IR::FunctionType functionType);
+
 	// Generates a thunk to call a native function from generated code.
 	LLVMJIT_API Runtime::Function* getIntrinsicThunk(void* nativeFunction,
 													 IR::FunctionType functionType,
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Platform/Defines.h"
 
@@ -20,6 +23,14 @@ namespace WAVM { namespace Platform {
 	// Returns the number of bytes in the smallest virtual page.
 	inline Uptr getBytesPerPage() { return Uptr(1) << getBytesPerPageLog2(); }
 
+	// Returns the base 2 logarithm of the number of bytes in a huge page, or 0 if the platform
+	// can't back virtual pages with huge pages.
+	PLATFORM_API Uptr getBytesPerHugePageLog2();
+
+	// Returns whether the platform can back virtual pages that are mapped from a SharedMemory with
+	// huge pages. If it can't, adviseHugeVirtualPages has no effect on them.
+	PLATFORM_API bool canUseHugePagesForSharedMemory();
+
 	// Allocates virtual addresses without commiting physical pages to them.
 	// Returns the base virtual address of the allocated addresses, or nullptr if the virtual
 	// address space has been exhausted.
@@ -46,10 +57,69 @@ namespace WAVM { namespace Platform {
 										   Uptr numPages,
 										   MemoryAccess access);
 
+	// Sets whether the platform should back the specified virtual pages with huge pages. Only the
+	// huge-page-aligned parts of the range can be backed by huge pages. The setting applies to
+	// pages that are committed later by commitVirtualPages, but is reset for pages that are
+	// remapped by decommitVirtualPages or mapSharedMemoryPages.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Return true if successful, or false if the platform doesn't support huge pages.
+	PLATFORM_API bool adviseHugeVirtualPages(U8* baseVirtualAddress,
+											 Uptr numPages,
+											 bool useHugePages);
+
 	// Decommits the physical memory that was committed to the specified virtual pages.
 	// baseVirtualAddress must be a multiple of the preferred page size.
 	PLATFORM_API void decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages);
 
+	// Discards the contents of the specified committed virtual pages, leaving them committed with
+	// read-write access. Pages mapped copy-on-write from a shared memory object revert to the
+	// object's contents, and other pages are filled with zeroes.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	PLATFORM_API void resetVirtualPages(U8* baseVirtualAddress, Uptr numPages);
+
+	// Finds which of the specified virtual pages may have been written since they were committed,
+	// or mapped copy-on-write from a shared memory object. The pages that haven't been written are
+	// still filled with zeroes, or identical to the shared memory object's pages. The pages must
+	// not be mapped from a shared memory object without copy-on-write.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Return true if successful, or false if the platform can't tell which pages were written.
+	PLATFORM_API bool getWrittenVirtualPages(U8* baseVirtualAddress,
+											 Uptr numPages,
+											 std::vector<bool>& outIsPageWritten);
+
+	// A resizable block of physical memory that can be mapped to virtual pages, either shared or
+	// copy-on-write.
+	struct SharedMemory;
+
+	// Creates a shared memory object with no pages. Returns nullptr if shared memory objects
+	// aren't supported on this platform, or if the object couldn't be created.
+	PLATFORM_API SharedMemory* createSharedMemory();
+
+	// Opens a file as a shared memory object that may only be mapped read-only or copy-on-write,
+	// and can't be resized. Returns nullptr if this isn't supported on this platform, or if the
+	// file couldn't be opened.
+	PLATFORM_API SharedMemory* openSharedMemoryFile(const std::string& path);
+
+	// Destroys a shared memory object. Virtual pages that it is mapped to remain mapped.
+	PLATFORM_API void destroySharedMemory(SharedMemory* sharedMemory);
+
+	// Sets the number of pages in a shared memory object. Pages that are added are filled with
+	// zeroes, and the contents of pages that are removed are discarded.
+	// Return true if successful, or false if physical memory has been exhausted.
+	PLATFORM_API bool resizeSharedMemory(SharedMemory* sharedMemory, Uptr numPages);
+
+	// Maps pages of a shared memory object to the specified virtual pages, replacing their previous
+	// mapping. If copyOnWrite is true, writes to the virtual pages are private to the mapping;
+	// otherwise, they are written to the shared memory object.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Return true if successful, or false if the pages could not be mapped.
+	PLATFORM_API bool mapSharedMemoryPages(SharedMemory* sharedMemory,
+										   Uptr firstPageIndex,
+										   U8* baseVirtualAddress,
+										   Uptr numPages,
+										   MemoryAccess access,
+										   bool copyOnWrite);
+
 	// Frees virtual addresses. baseVirtualAddress must also be the address returned by
 	// allocateVirtualPages.
 	PLATFORM_API void freeVirtualPages(U8* baseVirtualAddress, Uptr numPages);
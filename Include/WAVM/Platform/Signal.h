@@ -30,6 +30,19 @@ namespace WAVM { namespace Platform {
 								   bool (*filter)(void*, Signal, CallStack&&),
 								   void* argument);
 
+	// Calls sampleHandler from a signal handler on a thread that is using CPU time whenever the
+	// process has used another intervalMicroseconds of CPU time, until stopCPUTimeSampling is
+	// called. sampleHandler is passed the instruction pointers of the interrupted call stack, from
+	// innermost to outermost, found by following its frame pointers. sampleHandler must be
+	// async-signal-safe. Returns false if CPU time sampling isn't supported by the platform.
+	PLATFORM_API bool startCPUTimeSampling(U64 intervalMicroseconds,
+										   void (*sampleHandler)(const Uptr* frameIPs,
+																 Uptr numFrames));
+
+	// Stops CPU time sampling, and waits for any calls to the sample handler that are running on
+	// other threads to return.
+	PLATFORM_API void stopCPUTimeSampling();
+
 	PLATFORM_API void registerEHFrames(const U8* imageBase, const U8* ehFrames, Uptr numBytes);
 	PLATFORM_API void deregisterEHFrames(const U8* imageBase, const U8* ehFrames, Uptr numBytes);
 }}
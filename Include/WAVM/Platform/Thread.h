@@ -16,4 +16,11 @@ namespace WAVM { namespace Platform {
 	PLATFORM_API Uptr getNumberOfHardwareThreads();
 
 	PLATFORM_API void yieldToAnotherThread();
+
+	// Makes every thread in the process that is running execute a full memory barrier. This lets a
+	// thread synchronize with other threads that only order their memory accesses with compiler
+	// barriers: after it returns, the caller's prior writes are visible to the other threads, and
+	// their prior writes are visible to the caller. It is much slower than a memory barrier on the
+	// calling thread.
+	PLATFORM_API void flushProcessWriteBuffers();
 }}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "WAVM/IR/Types.h"
@@ -15,6 +17,12 @@ namespace WAVM { namespace IR {
 	struct Module;
 }}
 
+// Declare LLVMJIT::CompileOptions and LLVMJIT::ModuleProfile to avoid including the definitions.
+namespace WAVM { namespace LLVMJIT {
+	struct CompileOptions;
+	struct ModuleProfile;
+}}
+
 // Declare the different kinds of objects. They are only declared as incomplete struct types here,
 // and Runtime clients will only handle opaque pointers to them.
 #define WAVM_DECLARE_OBJECT_TYPE(kindId, kindName, Type)                                           \
@@ -122,12 +130,21 @@ namespace WAVM { namespace Runtime {
 		ObjectType* value;
 	};
 
-	// Increments the object's counter of root references.
+	// Increments the object's counter of root references. The change is recorded by the calling
+	// thread, and only applied to the object's counter when garbage is collected, so threads that
+	// add roots to the same object don't contend for it.
 	RUNTIME_API void addGCRoot(const Object* object);
 
-	// Decrements the object's counter of root referencers.
+	// Decrements the object's counter of root referencers. Like addGCRoot, the change is deferred
+	// until garbage is collected.
 	RUNTIME_API void removeGCRoot(const Object* object);
 
+	// Sets whether addGCRoot and removeGCRoot defer their changes until garbage is collected. If
+	// not, they change the object's counter immediately, which is cheaper when a single thread
+	// uses the object, but contends for the counter when many threads do. They are deferred by
+	// default.
+	RUNTIME_API void setGCRootReferenceCountsDeferred(bool deferred);
+
 	// Frees any unreferenced objects owned by a compartment.
 	RUNTIME_API void collectCompartmentGarbage(Compartment* compartment);
 
@@ -162,7 +179,10 @@ namespace WAVM { namespace Runtime {
 	visit(calledUnimplementedIntrinsic);                                                           \
 	visit(outOfMemory);                                                                            \
 	visit(misalignedAtomicMemoryAccess, WAVM::IR::ValueType::i64);                                 \
-	visit(invalidArgument);
+	visit(invalidArgument);                                                                        \
+	visit(interrupted);                                                                            \
+	visit(outOfFuel);                                                                              \
+	visit(importRequiresBoundsChecks);
 
 	// Information about a runtime exception.
 	namespace ExceptionTypes {
@@ -261,6 +281,20 @@ namespace WAVM { namespace Runtime {
 	// Describes a call stack.
 	RUNTIME_API std::vector<std::string> describeCallStack(const Platform::CallStack& callStack);
 
+	// Starts sampling the call stacks of the threads that are using CPU time, samplesPerSecond
+	// times per second of CPU time. Each thread records its samples in its own buffer without
+	// locking. Returns false if the profiler is already running, or if the platform doesn't
+	// support CPU time sampling.
+	RUNTIME_API bool startSamplingProfiler(U64 samplesPerSecond = 1000);
+	RUNTIME_API void stopSamplingProfiler();
+
+	// Returns the WebAssembly call stacks sampled since the profiler was last started, in the
+	// collapsed stack format read by flame graph tools: a line for each distinct call stack, with
+	// its function names from outermost to innermost separated by semicolons, followed by the
+	// number of samples. If includeOpIndices is true, each function name is followed by the index
+	// of the operator that was executing in it.
+	RUNTIME_API std::string getSampledCallStacks(bool includeOpIndices = false);
+
 	//
 	// Functions
 	//
@@ -281,9 +315,29 @@ namespace WAVM { namespace Runtime {
 													 const Function* function,
 													 const std::vector<IR::Value>& arguments);
 
+	// Invokes a Function once for each of numRows rows of arguments, from a loop in generated code
+	// that runs inside a single scope that catches runtime exceptions. argRows contains an untagged
+	// value for each of the function's parameters per row, and the results of each row are written
+	// to resultRows, which must have room for an untagged value for each of the function's results
+	// per row. Like invokeFunctionUnchecked, the arguments' types aren't checked.
+	// Returns the index of the first row that threw a runtime exception, or numRows if none did.
+	// The rows after a row that threw an exception aren't invoked. If outException is non-null,
+	// the exception is written to it, and the caller must destroy it with destroyException;
+	// otherwise, it is destroyed.
+	RUNTIME_API Uptr invokeFunctionBatch(Context* context,
+										 const Function* function,
+										 const IR::UntaggedValue* argRows,
+										 Uptr numRows,
+										 IR::UntaggedValue* resultRows,
+										 Exception** outException = nullptr);
+
 	// Returns the type of a Function.
 	RUNTIME_API IR::FunctionType getFunctionType(const Function* function);
 
+	// Returns the address of a Function's code, which takes a ContextRuntimeData pointer followed
+	// by the function's parameters, and returns the ContextRuntimeData pointer and its results.
+	RUNTIME_API const void* getFunctionCode(const Function* function);
+
 	//
 	// Tables
 	//
@@ -334,6 +388,20 @@ namespace WAVM { namespace Runtime {
 	// Returns the type of a memory.
 	RUNTIME_API IR::MemoryType getMemoryType(const Memory* memory);
 
+	// Returns whether a memory doesn't reserve enough address space to be accessed without bounds
+	// checks. Such a memory may only be imported by modules compiled with
+	// LLVMJIT::CompileOptions::boundsCheckMemories: instantiating any other module that imports it
+	// throws ExceptionTypes::importRequiresBoundsChecks. See setCompartmentMaxMemoryReservation.
+	RUNTIME_API bool getMemoryRequiresBoundsChecks(const Memory* memory);
+
+	// Sets whether a memory is backed by huge pages. Huge pages reduce the TLB misses of code with
+	// a large working set in the memory, but may commit more physical memory than the pages it
+	// touches. Memories created with huge pages have huge-page-aligned base addresses, so all of
+	// their pages may be backed by huge pages. Returns false if the platform doesn't support huge
+	// pages, or if the memory's pages are shared copy-on-write with its clones and the platform
+	// can't back shared pages with huge pages.
+	RUNTIME_API bool setMemoryHugePages(Memory* memory, bool useHugePages);
+
 	// Grows or shrinks the size of a memory by numPages. Returns the previous size of the memory.
 	RUNTIME_API bool growMemory(Memory* memory, Uptr numPages, Uptr* outOldNumPages = nullptr);
 
@@ -397,6 +465,15 @@ namespace WAVM { namespace Runtime {
 
 	// Compiles an IR module to object code.
 	RUNTIME_API ModuleRef compileModule(const IR::Module& irModule);
+	RUNTIME_API ModuleRef compileModule(const IR::Module& irModule,
+										const LLVMJIT::CompileOptions& options);
+
+	// Translates an IR module for the interpreter instead of compiling it to object code. This is
+	// much faster than compiling the module, but the module's code runs much slower, so it's
+	// intended for short-running modules where compilation would dominate. Interpreted and compiled
+	// modules may be linked together. Returns null if the module uses a feature the interpreter
+	// doesn't support: SIMD, atomics, or exception handling.
+	RUNTIME_API ModuleRef createInterpretedModule(const IR::Module& irModule);
 
 	// Extracts the compiled object code for a module. This may be used as an input to
 	// loadPrecompiledModule to bypass redundant compilations of the module.
@@ -407,9 +484,23 @@ namespace WAVM { namespace Runtime {
 	RUNTIME_API ModuleRef loadPrecompiledModule(const IR::Module& irModule,
 												const std::vector<U8>& objectCode);
 
+	// Enables a persistent cache of compiled object code in the given directory. compileModule
+	// looks up modules in the cache before compiling them, and adds the object code it compiles to
+	// the cache. When the cache holds more than maxBytes, the least recently used entries are
+	// deleted. Returns false if the directory couldn't be created.
+	RUNTIME_API bool enableObjectCache(const std::string& directoryPath, U64 maxBytes);
+	RUNTIME_API void disableObjectCache();
+
 	// Accesses the IR for a compiled module.
 	RUNTIME_API const IR::Module& getModuleIR(ModuleConstRefParam module);
 
+	// Reads the profile collected by a module that was compiled with
+	// CompileOptions::instrumentProfile, summed over all its instances. The profile may be passed
+	// to a later compile of the module as CompileOptions::profile. Returns false if the module
+	// isn't instrumented, or hasn't been instantiated yet.
+	RUNTIME_API bool getModuleProfile(ModuleConstRefParam module,
+									  LLVMJIT::ModuleProfile& outProfile);
+
 	//
 	// Instances
 	//
@@ -417,7 +508,8 @@ namespace WAVM { namespace Runtime {
 	typedef std::vector<Object*> ImportBindings;
 
 	// Instantiates a compiled module, bindings its imports to the specified objects. May throw a
-	// runtime exception for bad segment offsets.
+	// runtime exception for bad segment offsets, or ExceptionTypes::importRequiresBoundsChecks if
+	// a memory import requires bounds checks that the module wasn't compiled with.
 	RUNTIME_API ModuleInstance* instantiateModule(Compartment* compartment,
 												  ModuleConstRefParam module,
 												  ImportBindings&& imports,
@@ -441,12 +533,39 @@ namespace WAVM { namespace Runtime {
 	RUNTIME_API const std::vector<Object*>& getInstanceExports(
 		const ModuleInstance* moduleInstance);
 
+	// Pre-initializes a module: instantiates it with stubs for its function imports that trap if
+	// they are called, runs its start function and the export named initExportName if it isn't
+	// null, and then rewrites the module so its data segments and global initializers produce the
+	// resulting state, without a start function or the init export. Returns false and sets
+	// outError without changing the module if the initialization traps, or changes state that
+	// data segments and global initializers can't express: modules that import tables, memories,
+	// or globals, or that have shared memories or passive segments, are rejected.
+	RUNTIME_API bool preinitializeModule(IR::Module& irModule,
+										 const char* initExportName,
+										 std::string& outError);
+
 	//
 	// Compartments
 	//
 
 	RUNTIME_API Compartment* createCompartment();
 
+	// Limits the address space reserved by each memory subsequently created in the compartment.
+	// By default, a memory reserves 8GB of address space, so any 32-bit address plus a 32-bit
+	// offset is within it, and code can access the memory without checking bounds. If
+	// maxReservedBytes is non-zero, a memory only reserves enough address space for its maximum
+	// size, and can't grow beyond maxReservedBytes. Such a memory may only be accessed by modules
+	// compiled with LLVMJIT::CompileOptions::boundsCheckMemories (see
+	// getMemoryRequiresBoundsChecks). The memories defined by other modules ignore the limit.
+	RUNTIME_API void setCompartmentMaxMemoryReservation(Compartment* compartment,
+														Uptr maxReservedBytes);
+
+	// Sets whether memories subsequently created in the compartment are backed by huge pages where
+	// the platform supports them. See setMemoryHugePages. If the platform can't back shared pages
+	// with huge pages, the memories don't share their pages copy-on-write with their clones, so
+	// cloning them copies their non-zero pages.
+	RUNTIME_API void setCompartmentHugePages(Compartment* compartment, bool useHugePages);
+
 	RUNTIME_API Compartment* cloneCompartment(const Compartment* compartment);
 
 	RUNTIME_API Object* remapToClonedCompartment(Object* object, const Compartment* newCompartment);
@@ -463,6 +582,21 @@ namespace WAVM { namespace Runtime {
 	RUNTIME_API Compartment* getCompartment(const Object* object);
 	RUNTIME_API bool isInCompartment(const Object* object, const Compartment* compartment);
 
+	// Writes the state of a compartment to a file: the contents of its memories and tables, the
+	// values of its mutable globals in each of its contexts, and the identities of its module
+	// instances. Zero pages of memories aren't stored in the file. No code may run in the
+	// compartment while it is snapshotted. Returns false if the file couldn't be written, or if
+	// a table contains an object that can't be identified in the compartment.
+	RUNTIME_API bool snapshotCompartment(const Compartment* compartment, const std::string& path);
+
+	// Restores the state written by snapshotCompartment to a compartment. The compartment must
+	// contain the same module instances, memories, tables, globals, and contexts as the
+	// snapshotted compartment: usually by instantiating the same modules in the same order,
+	// without running their initializers. Where the platform supports it, the contents of the
+	// memories are mapped copy-on-write from the file, which must not be modified while they are
+	// in use. Returns false if the file couldn't be read, or doesn't match the compartment.
+	RUNTIME_API bool restoreCompartment(Compartment* compartment, const std::string& path);
+
 	//
 	// Contexts
 	//
@@ -477,6 +611,184 @@ namespace WAVM { namespace Runtime {
 	// Creates a new context, initializing its mutable global state from the given context.
 	RUNTIME_API Context* cloneContext(const Context* context, Compartment* newCompartment);
 
+	// Makes code compiled with CompileOptions::interruptible that is running in the context trap
+	// with ExceptionTypes::interrupted at its next function entry or loop iteration. May be called
+	// from any thread. If no code is running in the context, the next interruptible code that is
+	// called in it traps. The request is cleared when the trap is thrown.
+	RUNTIME_API void interruptContext(Context* context);
+
+	// Code compiled with CompileOptions::meterFuel subtracts a fixed cost from its context's fuel
+	// on entry to each basic block, and calls the context's out-of-fuel callback if the fuel runs
+	// out. If the callback doesn't add enough fuel for the block, the code traps with
+	// ExceptionTypes::outOfFuel. Contexts are created with no fuel. These functions may only be
+	// called by the thread that is running code in the context, or while no code is running in it.
+	RUNTIME_API void setContextFuel(Context* context, U64 fuel);
+	RUNTIME_API void addContextFuel(Context* context, U64 additionalFuel);
+	RUNTIME_API U64 getContextFuel(const Context* context);
+	RUNTIME_API void setContextOutOfFuelCallback(Context* context,
+												 std::function<void(Context*)>&& callback);
+
+	//
+	// Typed functions
+	//
+
+	namespace TypedFunctionImpl {
+		// The C++ types that may be used in a TypedFunction signature. Types narrower than 32 bits
+		// aren't allowed: the C calling convention doesn't define the upper bits of the register
+		// they are passed in, but the WebAssembly code would read them as part of an I32.
+		template<typename T> constexpr bool isSupportedType() { return false; }
+		template<> constexpr bool isSupportedType<I32>() { return true; }
+		template<> constexpr bool isSupportedType<U32>() { return true; }
+		template<> constexpr bool isSupportedType<I64>() { return true; }
+		template<> constexpr bool isSupportedType<U64>() { return true; }
+		template<> constexpr bool isSupportedType<F32>() { return true; }
+		template<> constexpr bool isSupportedType<F64>() { return true; }
+		template<> constexpr bool isSupportedType<V128>() { return true; }
+		template<> constexpr bool isSupportedType<Object*>() { return true; }
+		template<> constexpr bool isSupportedType<Function*>() { return true; }
+
+		constexpr bool allOf() { return true; }
+		template<typename... Bools> constexpr bool allOf(bool first, Bools... rest)
+		{
+			return first && allOf(rest...);
+		}
+
+		template<typename Result> struct CodeResult
+		{
+			ContextRuntimeData* contextRuntimeData;
+			Result result;
+		};
+
+		template<typename Result, typename... Args> struct Caller
+		{
+			static Result callCode(const void* code,
+								   ContextRuntimeData* contextRuntimeData,
+								   Args... args)
+			{
+				typedef CodeResult<Result> (*CodePointer)(ContextRuntimeData*, Args...);
+				CodePointer codePointer = reinterpret_cast<CodePointer>(const_cast<void*>(code));
+				return (*codePointer)(contextRuntimeData, args...).result;
+			}
+
+			static Result getResult(const IR::UntaggedValue* results)
+			{
+				Result result;
+				memcpy(&result, results, sizeof(Result));
+				return result;
+			}
+		};
+
+		template<typename... Args> struct Caller<void, Args...>
+		{
+			static void callCode(const void* code,
+								 ContextRuntimeData* contextRuntimeData,
+								 Args... args)
+			{
+				typedef ContextRuntimeData* (*CodePointer)(ContextRuntimeData*, Args...);
+				CodePointer codePointer = reinterpret_cast<CodePointer>(const_cast<void*>(code));
+				(*codePointer)(contextRuntimeData, args...);
+			}
+
+			static void getResult(const IR::UntaggedValue*) {}
+		};
+	}
+
+	// A Function bound to a C++ signature, such as TypedFunction<I32(I32, F64)>. The function's
+	// type is checked once when it is bound, so it can be called without checking, boxing, or
+	// copying its arguments and results. The parameter and result types may be I32, U32, I64, U64,
+	// F32, F64, V128, Object*, or Function*.
+	//
+	// On X86-64 System V, the function's code is called directly if its type doesn't contain
+	// V128s. The wasm calling convention is LLVM's fastcc, which passes arguments like the C calling
+	// convention on X86-64 System V, and returns the {ContextRuntimeData*, result} pair in the same
+	// registers as a C function returning TypedFunctionImpl::CodeResult. On other targets, and
+	// for V128s, it is called through invokeFunctionUnchecked. Like invokeFunctionUnchecked,
+	// calling it doesn't check that the function is in the context's compartment.
+	template<typename Signature> struct TypedFunction;
+
+	template<typename Result, typename... Args> struct TypedFunction<Result(Args...)>
+	{
+		static_assert(TypedFunctionImpl::allOf(TypedFunctionImpl::isSupportedType<Args>()...),
+					  "TypedFunction parameters must be I32, U32, I64, U64, F32, F64, V128, "
+					  "Object*, or Function*");
+		static_assert(std::is_void<Result>::value || TypedFunctionImpl::isSupportedType<Result>(),
+					  "TypedFunction results must be void, I32, U32, I64, U64, F32, F64, V128, "
+					  "Object*, or Function*");
+
+		TypedFunction() : function(nullptr), code(nullptr), callsCodeDirectly(false) {}
+
+		// Binds a function to the signature, or throws ExceptionTypes::invokeSignatureMismatch if
+		// the function's type doesn't match it.
+		TypedFunction(Function* inFunction)
+		: function(inFunction), code(getFunctionCode(inFunction)), callsCodeDirectly(false)
+		{
+			const IR::FunctionType type = getFunctionType(function);
+			if(!isSubtype(IR::TypeTuple{IR::inferValueType<Args>()...}, type.params())
+			   || !isSubtype(type.results(), IR::inferResultType<Result>()))
+			{ throwException(ExceptionTypes::invokeSignatureMismatch); }
+
+#if defined(__x86_64__) && !defined(_WIN32)
+			callsCodeDirectly = true;
+			for(IR::ValueType param : type.params())
+			{
+				if(param == IR::ValueType::v128) { callsCodeDirectly = false; }
+			}
+			for(IR::ValueType result : type.results())
+			{
+				if(result == IR::ValueType::v128) { callsCodeDirectly = false; }
+			}
+#endif
+		}
+
+		Result operator()(Context* context, Args... args) const
+		{
+			WAVM_ASSERT(function);
+			typedef TypedFunctionImpl::Caller<Result, Args...> Caller;
+			if(callsCodeDirectly)
+			{ return Caller::callCode(code, getContextRuntimeData(context), args...); }
+
+			const IR::UntaggedValue untaggedArgs[sizeof...(Args) + 1]
+				= {IR::UntaggedValue(args)...};
+			return Caller::getResult(invokeFunctionUnchecked(context, function, untaggedArgs));
+		}
+
+		Function* getFunction() const { return function; }
+
+	private:
+		Function* function;
+		const void* code;
+		bool callsCodeDirectly;
+	};
+
+	//
+	// Instance pools
+	//
+
+	// A pool of copies of a module instance and context, which are reset to their original state
+	// when they are released, so they can be reused without instantiating the module again.
+	struct InstancePool;
+
+	// Creates a pool of numInstances copies of a module instance and a context in the same
+	// compartment. Each copy is in its own clone of the compartment, and is reset to the state of
+	// the compartment and context when the pool was created each time it is released: memories
+	// and tables are shrunk to their original size and their contents restored, and the context's
+	// mutable globals and fuel are restored. Other objects created in the copy's compartment are
+	// not removed.
+	RUNTIME_API InstancePool* createInstancePool(ModuleInstance* moduleInstance,
+												 const Context* context,
+												 Uptr numInstances);
+
+	// Destroys a pool. All the pool's instances must have been released.
+	RUNTIME_API void destroyInstancePool(InstancePool* pool);
+
+	// Takes an instance from a pool, returning its module instance and context. If all the pool's
+	// instances are in use, a new copy is added to the pool. May be called from any thread.
+	RUNTIME_API ModuleInstance* acquirePooledInstance(InstancePool* pool, Context*& outContext);
+
+	// Resets an instance acquired from a pool, and returns it to the pool. No code may be running
+	// in the instance. May be called from any thread.
+	RUNTIME_API void releasePooledInstance(InstancePool* pool, ModuleInstance* moduleInstance);
+
 	//
 	// Foreign objects
 	//
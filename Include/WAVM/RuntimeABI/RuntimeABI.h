@@ -21,6 +21,7 @@ namespace WAVM { namespace Runtime {
 	struct Compartment;
 	struct Context;
 	struct ExceptionType;
+	struct InterpretedFunction;
 	struct Object;
 	struct Table;
 	struct Memory;
@@ -60,10 +61,11 @@ namespace WAVM { namespace Runtime {
 	enum
 	{
 		maxThunkArgAndReturnBytes = 256,
-		maxGlobalBytes = 4096 - maxThunkArgAndReturnBytes,
+		contextControlBytes = 16,
+		maxGlobalBytes = 4096 - maxThunkArgAndReturnBytes - contextControlBytes,
 		maxMutableGlobals = maxGlobalBytes / sizeof(IR::UntaggedValue),
 		maxMemories = 255,
-		maxTables = 128 * 1024 - maxMemories - 1,
+		maxTables = 128 * 1024 - maxMemories * 2 - 1,
 		compartmentRuntimeDataAlignmentLog2 = 31,
 		contextRuntimeDataAlignment = 4096
 	};
@@ -75,6 +77,16 @@ namespace WAVM { namespace Runtime {
 	struct ContextRuntimeData
 	{
 		U8 thunkArgAndReturnData[maxThunkArgAndReturnBytes];
+
+		// Set by Runtime::interruptContext to make code compiled with CompileOptions::interruptible
+		// trap at the next function entry or loop iteration.
+		std::atomic<U32> interruptRequested;
+		U32 controlPadding;
+
+		// The fuel left for code compiled with CompileOptions::meterFuel. It's negative if the code
+		// has used more fuel than it was given.
+		I64 fuel;
+
 		IR::UntaggedValue mutableGlobals[maxMutableGlobals];
 	};
 
@@ -84,6 +96,11 @@ namespace WAVM { namespace Runtime {
 	{
 		Compartment* compartment;
 		void* memoryBases[maxMemories];
+
+		// The number of bytes in each memory, which code compiled with
+		// CompileOptions::boundsCheckMemories checks the addresses it accesses against.
+		std::atomic<Uptr> memoryNumBytes[maxMemories];
+
 		void* tableBases[maxTables];
 		ContextRuntimeData contexts[1]; // Actually [maxContexts], but at least MSVC doesn't allow
 										// declaring arrays that large.
@@ -142,6 +159,24 @@ namespace WAVM { namespace Runtime {
 	typedef Runtime::ContextRuntimeData* (*InvokeThunkPointer)(const Runtime::Function*,
 															   Runtime::ContextRuntimeData*);
 
+	// Calls a function once for each row of arguments, and writes the index of the row it is
+	// calling to outRowIndex before each call, and numRows after the last call.
+	typedef Runtime::ContextRuntimeData* (*InvokeBatchThunkPointer)(
+		const Runtime::Function*,
+		Runtime::ContextRuntimeData*,
+		const IR::UntaggedValue* argRows,
+		Uptr numRows,
+		IR::UntaggedValue* resultRows,
+		Uptr* outRowIndex);
+
+	// Used by functions compiled by the baseline tier to count their calls, and to forward calls to
+	// an optimized version of the function once it has been compiled.
+	struct FunctionTierUpState
+	{
+		std::atomic<const U8*> optimizedCode{nullptr};
+		std::atomic<U32> numCalls{0};
+	};
+
 	// Metadata about a function, used to hold data that can't be emitted directly in an object
 	// file, or must be mutable.
 	struct FunctionMutableData
@@ -155,6 +190,10 @@ namespace WAVM { namespace Runtime {
 		std::atomic<InvokeThunkPointer> invokeThunk{nullptr};
 		void* userData{nullptr};
 		void (*finalizeUserData)(void*);
+		FunctionTierUpState tierUpState;
+
+		// If the function is executed by the interpreter, its interpreted code.
+		const InterpretedFunction* interpretedFunction = nullptr;
 
 		FunctionMutableData(std::string&& inDebugName)
 		: debugName(inDebugName), userData(nullptr), finalizeUserData(nullptr)
@@ -22,13 +22,16 @@ namespace WAVM { namespace LLVMJIT {
 
 		llvm::Value* contextPointerVariable;
 		llvm::Value* memoryBasePointerVariable;
+		llvm::Value* memoryNumBytesVariable;
 
-		EmitContext(LLVMContext& inLLVMContext, llvm::Constant* inDefaultMemoryOffset)
+		EmitContext(LLVMContext& inLLVMContext, llvm::Value* inDefaultMemoryOffset)
 		: llvmContext(inLLVMContext)
 		, irBuilder(inLLVMContext)
 		, contextPointerVariable(nullptr)
 		, memoryBasePointerVariable(nullptr)
+		, memoryNumBytesVariable(nullptr)
 		, defaultMemoryOffset(inDefaultMemoryOffset)
+		, defaultMemoryNumBytesOffset(nullptr)
 		{
 		}
 
@@ -77,24 +80,44 @@ namespace WAVM { namespace LLVMJIT {
 						sizeof(U8*)),
 					memoryBasePointerVariable);
 			}
+
+			// If the code checks the bounds of memory accesses, load the size of the default
+			// memory, which may have changed if the memory was grown.
+			if(defaultMemoryNumBytesOffset)
+			{
+				irBuilder.CreateStore(
+					loadFromUntypedPointer(
+						irBuilder.CreateInBoundsGEP(compartmentAddress,
+													{defaultMemoryNumBytesOffset}),
+						llvmContext.i64Type,
+						sizeof(U64)),
+					memoryNumBytesVariable);
+			}
 		}
 
 		void initContextVariables(llvm::Value* initialContextPointer)
 		{
 			memoryBasePointerVariable
 				= irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "memoryBase");
+			if(defaultMemoryNumBytesOffset)
+			{
+				memoryNumBytesVariable
+					= irBuilder.CreateAlloca(llvmContext.i64Type, nullptr, "memoryNumBytes");
+			}
 			contextPointerVariable
 				= irBuilder.CreateAlloca(llvmContext.i8PtrType, nullptr, "context");
 			irBuilder.CreateStore(initialContextPointer, contextPointerVariable);
 			reloadMemoryBase();
 		}
 
-		// Creates either a call or an invoke if the call occurs inside a try.
+		// Creates either a call or an invoke if the call occurs inside a try. If nestArgument is
+		// non-null, it is passed to a wasm callee in a nest parameter preceding the context.
 		ValueVector emitCallOrInvoke(llvm::Value* callee,
 									 llvm::ArrayRef<llvm::Value*> args,
 									 IR::FunctionType calleeType,
 									 IR::CallingConvention callingConvention,
-									 llvm::BasicBlock* unwindToBlock = nullptr)
+									 llvm::BasicBlock* unwindToBlock = nullptr,
+									 llvm::Value* nestArgument = nullptr)
 		{
 			llvm::ArrayRef<llvm::Value*> callArgs = args;
 
@@ -127,13 +150,18 @@ namespace WAVM { namespace LLVMJIT {
 			}
 			else if(callingConvention != IR::CallingConvention::c)
 			{
-				// Augment the argument list with the context pointer.
+				// Augment the argument list with the context pointer, and the nest argument if
+				// there is one.
+				WAVM_ASSERT(!nestArgument || callingConvention == IR::CallingConvention::wasm);
+				const Uptr numPrefixArgs = nestArgument ? 2 : 1;
 				auto callArgsAlloca
-					= (llvm::Value**)alloca(sizeof(llvm::Value*) * (args.size() + 1));
-				callArgs = llvm::ArrayRef<llvm::Value*>(callArgsAlloca, args.size() + 1);
-				callArgsAlloca[0] = irBuilder.CreateLoad(contextPointerVariable);
+					= (llvm::Value**)alloca(sizeof(llvm::Value*) * (args.size() + numPrefixArgs));
+				callArgs
+					= llvm::ArrayRef<llvm::Value*>(callArgsAlloca, args.size() + numPrefixArgs);
+				if(nestArgument) { callArgsAlloca[0] = nestArgument; }
+				callArgsAlloca[numPrefixArgs - 1] = irBuilder.CreateLoad(contextPointerVariable);
 				for(Uptr argIndex = 0; argIndex < args.size(); ++argIndex)
-				{ callArgsAlloca[1 + argIndex] = args[argIndex]; }
+				{ callArgsAlloca[numPrefixArgs + argIndex] = args[argIndex]; }
 			}
 
 			// Call or invoke the callee.
@@ -142,6 +170,7 @@ namespace WAVM { namespace LLVMJIT {
 			{
 				auto call = irBuilder.CreateCall(callee, callArgs);
 				call->setCallingConv(asLLVMCallingConv(callingConvention));
+				if(nestArgument) { call->addParamAttr(0, llvm::Attribute::Nest); }
 				returnValue = call;
 			}
 			else
@@ -150,6 +179,7 @@ namespace WAVM { namespace LLVMJIT {
 					llvmContext, "invokeReturn", irBuilder.GetInsertBlock()->getParent());
 				auto invoke = irBuilder.CreateInvoke(callee, returnBlock, unwindToBlock, callArgs);
 				invoke->setCallingConv(asLLVMCallingConv(callingConvention));
+				if(nestArgument) { invoke->addParamAttr(0, llvm::Attribute::Nest); }
 				irBuilder.SetInsertPoint(returnBlock);
 				returnValue = invoke;
 			}
@@ -304,7 +334,8 @@ namespace WAVM { namespace LLVMJIT {
 			irBuilder.CreateRet(returnStruct);
 		}
 
-	private:
-		llvm::Constant* defaultMemoryOffset;
+	protected:
+		llvm::Value* defaultMemoryOffset;
+		llvm::Value* defaultMemoryNumBytesOffset;
 	};
 }}
@@ -75,6 +75,10 @@ void EmitFunctionContext::loop(ControlStructureImm imm)
 	irBuilder.CreateBr(loopBodyBlock);
 	irBuilder.SetInsertPoint(loopBodyBlock);
 
+	// Check for an interrupt and charge the loop body's fuel on each iteration of the loop.
+	if(moduleContext.isInterruptible) { emitInterruptCheck(); }
+	emitFuelCharge();
+
 	// Push a control context that ends at the end block/phi.
 	pushControlStack(ControlContext::Type::loop, blockType.results(), endBlock, endPHIs);
 
@@ -96,7 +100,9 @@ void EmitFunctionContext::if_(ControlStructureImm imm)
 
 	// Pop the if condition from the operand stack.
 	auto condition = pop();
-	irBuilder.CreateCondBr(coerceI32ToBool(condition), thenBlock, elseBlock);
+	llvm::Value* conditionBool = coerceI32ToBool(condition);
+	emitBranchProfileCount(irBuilder.CreateZExt(conditionBool, llvmContext.i32Type));
+	irBuilder.CreateCondBr(conditionBool, thenBlock, elseBlock, getProfileBranchWeights(2));
 
 	// Pop the arguments from the operand stack.
 	ValueVector args;
@@ -106,6 +112,7 @@ void EmitFunctionContext::if_(ControlStructureImm imm)
 
 	// Switch the IR builder to emit the then block.
 	irBuilder.SetInsertPoint(thenBlock);
+	emitFuelCharge();
 
 	// Push an ifThen control context that ultimately ends at the end block/phi, but may be
 	// terminated by an else operator that changes the control context to the else block.
@@ -130,6 +137,7 @@ void EmitFunctionContext::else_(NoImm imm)
 	WAVM_ASSERT(currentContext.type == ControlContext::Type::ifThen);
 	currentContext.elseBlock->moveAfter(irBuilder.GetInsertBlock());
 	irBuilder.SetInsertPoint(currentContext.elseBlock);
+	emitFuelCharge();
 
 	// Push the if arguments back on the operand stack.
 	for(llvm::Value* argument : currentContext.elseArgs) { push(argument); }
@@ -199,6 +207,10 @@ void EmitFunctionContext::end(NoImm)
 
 	// Pop this control context.
 	controlStack.pop_back();
+
+	// Charge the fuel for the code following the control structure, unless it's the end of the
+	// function.
+	if(controlStack.size()) { emitFuelCharge(); }
 }
 
 void EmitFunctionContext::br_if(BranchImm imm)
@@ -221,10 +233,13 @@ void EmitFunctionContext::br_if(BranchImm imm)
 	auto falseBlock = llvm::BasicBlock::Create(llvmContext, "br_ifElse", function);
 
 	// Emit a conditional branch to either the falseBlock or the target block.
-	irBuilder.CreateCondBr(coerceI32ToBool(condition), target.block, falseBlock);
+	llvm::Value* conditionBool = coerceI32ToBool(condition);
+	emitBranchProfileCount(irBuilder.CreateZExt(conditionBool, llvmContext.i32Type));
+	irBuilder.CreateCondBr(conditionBool, target.block, falseBlock, getProfileBranchWeights(2));
 
 	// Resume emitting instructions in the falseBlock.
 	irBuilder.SetInsertPoint(falseBlock);
+	emitFuelCharge();
 }
 
 void EmitFunctionContext::br(BranchImm imm)
@@ -270,8 +285,20 @@ void EmitFunctionContext::br_table(BranchTableImm imm)
 	// Create a LLVM switch instruction.
 	WAVM_ASSERT(imm.branchTableIndex < functionDef.branchTables.size());
 	const std::vector<Uptr>& targetDepths = functionDef.branchTables[imm.branchTableIndex];
-	auto llvmSwitch
-		= irBuilder.CreateSwitch(index, defaultTarget.block, (unsigned int)targetDepths.size());
+	WAVM_ERROR_UNLESS(targetDepths.size() < UINT32_MAX);
+
+	// Count the target that is taken, with out-of-range indices counted for the default target.
+	if(profileCounters)
+	{
+		llvm::Value* numTargets = emitLiteral(llvmContext, U32(targetDepths.size()));
+		emitBranchProfileCount(
+			irBuilder.CreateSelect(irBuilder.CreateICmpULT(index, numTargets), index, numTargets));
+	}
+
+	auto llvmSwitch = irBuilder.CreateSwitch(index,
+											 defaultTarget.block,
+											 (unsigned int)targetDepths.size(),
+											 getProfileBranchWeights(targetDepths.size() + 1));
 
 	for(Uptr targetIndex = 0; targetIndex < targetDepths.size(); ++targetIndex)
 	{
@@ -327,9 +354,27 @@ void EmitFunctionContext::call(FunctionImm imm)
 	WAVM_ASSERT(imm.functionIndex < moduleContext.functions.size());
 	WAVM_ASSERT(imm.functionIndex < irModule.functions.size());
 
-	llvm::Value* callee = moduleContext.functions[imm.functionIndex];
 	FunctionType calleeType = irModule.types[irModule.functions.getType(imm.functionIndex).index];
 
+	// Function definitions are called directly, passing on this function's binding table. Imported
+	// functions are called through the code pointer of the Runtime::Function bound to them.
+	llvm::Value* callee;
+	llvm::Value* nestArgument;
+	if(imm.functionIndex >= irModule.functions.imports.size())
+	{
+		callee = moduleContext.functions[imm.functionIndex];
+		nestArgument = bindingTable;
+	}
+	else
+	{
+		callee = irBuilder.CreateIntToPtr(
+			irBuilder.CreateAdd(
+				getFunctionObject(imm.functionIndex),
+				emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code)))),
+			asLLVMType(llvmContext, calleeType, CallingConvention::wasm)->getPointerTo());
+		nestArgument = nullptr;
+	}
+
 	// Pop the call arguments from the operand stack.
 	const Uptr numArguments = calleeType.params().size();
 	auto llvmArgs = (llvm::Value**)alloca(sizeof(llvm::Value*) * numArguments);
@@ -344,7 +389,8 @@ void EmitFunctionContext::call(FunctionImm imm)
 										   llvm::ArrayRef<llvm::Value*>(llvmArgs, numArguments),
 										   calleeType,
 										   CallingConvention::wasm,
-										   getInnermostUnwindToBlock());
+										   getInnermostUnwindToBlock(),
+										   nestArgument);
 
 	// Push the results on the operand stack.
 	for(llvm::Value* result : results) { push(result); }
@@ -371,8 +417,7 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 	auto functionIndexZExt = zext(tableElementIndex, llvmContext.iptrType);
 
 	auto tableBasePointer = loadFromUntypedPointer(
-		irBuilder.CreateInBoundsGEP(getCompartmentAddress(),
-									{moduleContext.tableOffsets[imm.tableIndex]}),
+		irBuilder.CreateInBoundsGEP(getCompartmentAddress(), {getTableOffset(imm.tableIndex)}),
 		llvmContext.iptrType->getPointerTo(),
 		sizeof(Uptr));
 
@@ -402,7 +447,7 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 								ValueType::funcref,
 								inferValueType<Uptr>()})),
 		{tableElementIndex,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex]),
+		 getTableId(imm.tableIndex),
 		 irBuilder.CreatePointerCast(runtimeFunction, llvmContext.anyrefType),
 		 calleeTypeId});
 
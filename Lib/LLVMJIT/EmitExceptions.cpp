@@ -239,9 +239,9 @@ void EmitFunctionContext::catch_(ExceptionTypeImm imm)
 	branchToEndOfControlContext();
 
 	// Look up the exception type instance to be caught
-	WAVM_ASSERT(imm.exceptionTypeIndex < moduleContext.exceptionTypeIds.size());
+	WAVM_ASSERT(imm.exceptionTypeIndex < irModule.exceptionTypes.size());
 	const IR::ExceptionType catchType = irModule.exceptionTypes.getType(imm.exceptionTypeIndex);
-	llvm::Constant* catchTypeId = moduleContext.exceptionTypeIds[imm.exceptionTypeIndex];
+	llvm::Value* catchTypeId = getExceptionTypeId(imm.exceptionTypeIndex);
 
 	irBuilder.SetInsertPoint(catchContext.nextHandlerBlock);
 	auto isExceptionType = irBuilder.CreateICmpEQ(catchContext.exceptionTypeId, catchTypeId);
@@ -267,6 +267,8 @@ void EmitFunctionContext::catch_(ExceptionTypeImm imm)
 		push(argument);
 	}
 
+	emitFuelCharge();
+
 	// Change the top of the control stack to a catch clause.
 	controlContext.type = ControlContext::Type::catch_;
 	controlContext.isReachable = true;
@@ -306,6 +308,8 @@ void EmitFunctionContext::catch_all(NoImm)
 	catchContext.nextHandlerBlock = unhandledBlock;
 	irBuilder.SetInsertPoint(catchBlock);
 
+	emitFuelCharge();
+
 	// Change the top of the control stack to a catch clause.
 	controlContext.type = ControlContext::Type::catch_;
 	controlContext.isReachable = true;
@@ -335,7 +339,7 @@ void EmitFunctionContext::throw_(ExceptionTypeImm imm)
 			sizeof(UntaggedValue));
 	}
 
-	llvm::Value* exceptionTypeId = moduleContext.exceptionTypeIds[imm.exceptionTypeIndex];
+	llvm::Value* exceptionTypeId = getExceptionTypeId(imm.exceptionTypeIndex);
 	llvm::Value* argsPointerAsInt = irBuilder.CreatePtrToInt(argBaseAddress, llvmContext.iptrType);
 
 	llvm::Value* exceptionPointer = emitRuntimeIntrinsic(
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <algorithm>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -31,6 +32,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
@@ -320,6 +322,265 @@ private:
 	Uptr unreachableControlDepth;
 };
 
+llvm::Value* EmitFunctionContext::loadForwardedCode()
+{
+	WAVM_ASSERT(tierUpState);
+
+	// The code pointer is set by the compiler once it has compiled the function.
+	const Uptr optimizedCodeOffset = offsetof(Runtime::FunctionTierUpState, optimizedCode);
+	llvm::LoadInst* optimizedCode = irBuilder.CreateLoad(irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(tierUpState, {emitLiteral(llvmContext, optimizedCodeOffset)}),
+		llvmContext.i8PtrType->getPointerTo()));
+	optimizedCode->setAtomic(llvm::AtomicOrdering::Acquire);
+	optimizedCode->setAlignment(sizeof(U8*));
+	return optimizedCode;
+}
+
+void EmitFunctionContext::emitForwardingTailCall(llvm::Value* code)
+{
+	// The compiled code has the same signature as this function, so it can be a guaranteed tail
+	// call.
+	llvm::SmallVector<llvm::Value*, 8> args;
+	for(llvm::Argument& arg : function->args()) { args.push_back(&arg); }
+	llvm::CallInst* forwardedCall
+		= irBuilder.CreateCall(irBuilder.CreatePointerCast(code, function->getType()), args);
+	forwardedCall->setCallingConv(function->getCallingConv());
+	forwardedCall->addParamAttr(0, llvm::Attribute::Nest);
+	forwardedCall->setTailCallKind(llvm::CallInst::TCK_MustTail);
+	irBuilder.CreateRet(forwardedCall);
+}
+
+llvm::Constant* EmitFunctionContext::getSharedFunctionObject()
+{
+	return llvm::ConstantExpr::getIntToPtr(
+		llvm::ConstantExpr::getSub(
+			llvm::ConstantExpr::getPtrToInt(function, llvmContext.iptrType),
+			emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code)))),
+		llvmContext.anyrefType);
+}
+
+void EmitFunctionContext::emitTierUpPrologue()
+{
+	WAVM_ASSERT(tierUpState);
+
+	auto callOptimizedBlock = llvm::BasicBlock::Create(llvmContext, "callOptimized", function);
+	auto countCallBlock = llvm::BasicBlock::Create(llvmContext, "countCall", function);
+	auto requestTierUpBlock = llvm::BasicBlock::Create(llvmContext, "requestTierUp", function);
+	auto bodyBlock = llvm::BasicBlock::Create(llvmContext, "body", function);
+
+	// Load the function's optimized code pointer, which is set by the background compiler once it
+	// has compiled the function with optimization.
+	llvm::Value* optimizedCode = loadForwardedCode();
+	irBuilder.CreateCondBr(
+		irBuilder.CreateIsNotNull(optimizedCode), callOptimizedBlock, countCallBlock);
+
+	// If the optimized code has been compiled, forward the call to it.
+	irBuilder.SetInsertPoint(callOptimizedBlock);
+	emitForwardingTailCall(optimizedCode);
+
+	// Otherwise, increment the function's call count. The increment is a separate load and store,
+	// so concurrent calls may occasionally be undercounted, which only delays the recompilation.
+	irBuilder.SetInsertPoint(countCallBlock);
+	const Uptr numCallsOffset = offsetof(Runtime::FunctionTierUpState, numCalls);
+	llvm::Value* numCallsPointer = irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(tierUpState, {emitLiteral(llvmContext, numCallsOffset)}),
+		llvmContext.i32Type->getPointerTo());
+	llvm::LoadInst* numCalls = irBuilder.CreateLoad(numCallsPointer);
+	numCalls->setAtomic(llvm::AtomicOrdering::Monotonic);
+	numCalls->setAlignment(sizeof(U32));
+	llvm::Value* newNumCalls = irBuilder.CreateAdd(numCalls, emitLiteral(llvmContext, U32(1)));
+	llvm::StoreInst* numCallsStore = irBuilder.CreateStore(newNumCalls, numCallsPointer);
+	numCallsStore->setAtomic(llvm::AtomicOrdering::Monotonic);
+	numCallsStore->setAlignment(sizeof(U32));
+
+	// When the call count reaches the threshold, ask the runtime to recompile the function.
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpEQ(newNumCalls,
+							   emitLiteral(llvmContext, moduleContext.tierUpCallThreshold)),
+		requestTierUpBlock,
+		bodyBlock,
+		moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(requestTierUpBlock);
+	emitRuntimeIntrinsic(
+		"requestTierUp",
+		FunctionType({}, {ValueType::funcref, ValueType::i32}),
+		{getSharedFunctionObject(), emitLiteral(llvmContext, U32(functionDefIndex))});
+	irBuilder.CreateBr(bodyBlock);
+
+	irBuilder.SetInsertPoint(bodyBlock);
+}
+
+void EmitFunctionContext::emitInterruptCheck()
+{
+	auto interruptBlock = llvm::BasicBlock::Create(llvmContext, "interrupt", function);
+	auto continueBlock = llvm::BasicBlock::Create(llvmContext, "interruptCheckContinue", function);
+
+	// The interrupt request is written by another thread, so it must be loaded atomically, but
+	// it doesn't order any other memory accesses.
+	llvm::LoadInst* interruptRequested = irBuilder.CreateLoad(irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(
+			irBuilder.CreateLoad(contextPointerVariable),
+			{emitLiteral(llvmContext,
+						 Uptr(offsetof(Runtime::ContextRuntimeData, interruptRequested)))}),
+		llvmContext.i32Type->getPointerTo()));
+	interruptRequested->setAtomic(llvm::AtomicOrdering::Monotonic);
+	interruptRequested->setAlignment(sizeof(U32));
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpNE(interruptRequested, emitLiteral(llvmContext, U32(0))),
+		interruptBlock,
+		continueBlock,
+		moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(interruptBlock);
+	emitRuntimeIntrinsic("interruptTrap", FunctionType(), {});
+	irBuilder.CreateUnreachable();
+
+	irBuilder.SetInsertPoint(continueBlock);
+}
+
+void EmitFunctionContext::emitFuelCharge()
+{
+	if(!moduleContext.meterFuel) { return; }
+	finishFuelCharge();
+
+	auto outOfFuelBlock = llvm::BasicBlock::Create(llvmContext, "outOfFuel", function);
+	auto continueBlock = llvm::BasicBlock::Create(llvmContext, "fuelChargeContinue", function);
+
+	// Subtract the block's cost from the context's fuel. The cost isn't known until all the
+	// block's operators have been emitted, so it's set by finishFuelCharge.
+	llvm::Value* fuelPointer = irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(
+			irBuilder.CreateLoad(contextPointerVariable),
+			{emitLiteral(llvmContext, Uptr(offsetof(Runtime::ContextRuntimeData, fuel)))}),
+		llvmContext.i64Type->getPointerTo());
+	llvm::LoadInst* fuel = irBuilder.CreateLoad(fuelPointer);
+	fuel->setAlignment(sizeof(I64));
+	currentFuelCharge
+		= irBuilder.Insert(llvm::BinaryOperator::CreateSub(fuel, emitLiteral(llvmContext, U64(0))));
+	numFuelChargedOps = 0;
+	llvm::StoreInst* fuelStore = irBuilder.CreateStore(currentFuelCharge, fuelPointer);
+	fuelStore->setAlignment(sizeof(I64));
+
+	// If the fuel is exhausted, call the runtime, which traps unless the context's out-of-fuel
+	// callback adds more fuel.
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpSLT(currentFuelCharge, emitLiteral(llvmContext, U64(0))),
+		outOfFuelBlock,
+		continueBlock,
+		moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(outOfFuelBlock);
+	emitRuntimeIntrinsic("outOfFuel", FunctionType(), {});
+	irBuilder.CreateBr(continueBlock);
+
+	irBuilder.SetInsertPoint(continueBlock);
+}
+
+void EmitFunctionContext::finishFuelCharge()
+{
+	if(currentFuelCharge)
+	{
+		currentFuelCharge->setOperand(1, emitLiteral(llvmContext, numFuelChargedOps));
+		currentFuelCharge = nullptr;
+	}
+}
+
+void EmitFunctionContext::emitProfileCounterIncrement(llvm::Value* counterIndex)
+{
+	WAVM_ASSERT(profileCounters);
+
+	// The increment is a separate load and store, so concurrent calls may occasionally be
+	// undercounted, which only makes the profile slightly less accurate.
+	llvm::Value* counterPointer = irBuilder.CreateInBoundsGEP(
+		profileCounters, {irBuilder.CreateZExt(counterIndex, llvmContext.iptrType)});
+	llvm::LoadInst* count = irBuilder.CreateLoad(counterPointer);
+	count->setAtomic(llvm::AtomicOrdering::Monotonic);
+	count->setAlignment(sizeof(U64));
+	llvm::StoreInst* countStore = irBuilder.CreateStore(
+		irBuilder.CreateAdd(count, emitLiteral(llvmContext, U64(1))), counterPointer);
+	countStore->setAtomic(llvm::AtomicOrdering::Monotonic);
+	countStore->setAlignment(sizeof(U64));
+}
+
+void EmitFunctionContext::emitBranchProfileCount(llvm::Value* successorIndex)
+{
+	if(!profileCounters) { return; }
+
+	const ProfileCounterSite* site = opIndexToProfileCounterSiteMap.get(currentOpIndex);
+	WAVM_ASSERT(site);
+	emitProfileCounterIncrement(irBuilder.CreateAdd(
+		emitLiteral(llvmContext, U32(site->firstCounterIndex)), successorIndex));
+}
+
+llvm::MDNode* EmitFunctionContext::getProfileBranchWeights(Uptr numSuccessors)
+{
+	if(!functionProfile) { return nullptr; }
+
+	// Ignore profile counts that don't match the operator, which may happen if the profile was
+	// collected from a different version of the module.
+	auto countsIt = functionProfile->branchCounts.find(currentOpIndex);
+	if(countsIt == functionProfile->branchCounts.end()) { return nullptr; }
+	const std::vector<U64>& counts = countsIt->second;
+	if(counts.size() != numSuccessors) { return nullptr; }
+
+	// Scale the counts down to fit in the 32-bit branch weights.
+	U64 maxCount = 0;
+	for(U64 count : counts) { maxCount = std::max(maxCount, count); }
+	if(!maxCount) { return nullptr; }
+	const U64 scale = maxCount / UINT32_MAX + 1;
+
+	// The profile puts the count for the false successor of a conditional branch first, and the
+	// count for the default target of a branch table last, but LLVM expects the weight of the
+	// true successor or the default target first.
+	std::vector<U32> weights;
+	weights.push_back(U32(counts.back() / scale));
+	for(Uptr successorIndex = 0; successorIndex + 1 < numSuccessors; ++successorIndex)
+	{ weights.push_back(U32(counts[successorIndex] / scale)); }
+	return llvm::MDBuilder(llvmContext).createBranchWeights(weights);
+}
+
+void EmitFunctionContext::emitLazyCompileStub()
+{
+	WAVM_ASSERT(tierUpState);
+
+	auto entryBlock = llvm::BasicBlock::Create(llvmContext, "entry", function);
+	auto compileBlock = llvm::BasicBlock::Create(llvmContext, "compile", function);
+	auto callCompiledBlock = llvm::BasicBlock::Create(llvmContext, "callCompiled", function);
+	irBuilder.SetInsertPoint(entryBlock);
+
+	// The stub doesn't access any of the module instance's bindings, but the context is needed to
+	// call the compiler intrinsic.
+	auto llvmArgIt = function->arg_begin();
+	bindingTable = &*llvmArgIt++;
+	initContextVariables(&*llvmArgIt);
+
+	// If the function has already been compiled, forward the call to its code.
+	llvm::Value* compiledCode = loadForwardedCode();
+	irBuilder.CreateCondBr(irBuilder.CreateIsNull(compiledCode),
+						   compileBlock,
+						   callCompiledBlock,
+						   moduleContext.likelyFalseBranchWeights);
+
+	// Otherwise, compile it. The intrinsic doesn't return until the code has been compiled.
+	irBuilder.SetInsertPoint(compileBlock);
+	emitRuntimeIntrinsic(
+		"compileLazyFunction",
+		FunctionType({}, {ValueType::funcref, ValueType::i32, ValueType::i32}),
+		{getSharedFunctionObject(),
+		 emitLiteral(llvmContext, U32(functionDefIndex)),
+		 emitLiteral(llvmContext, U32(moduleContext.lazyCompileDirectCallees ? 1 : 0))});
+	llvm::Value* newlyCompiledCode = loadForwardedCode();
+	llvm::BasicBlock* compileEndBlock = irBuilder.GetInsertBlock();
+	irBuilder.CreateBr(callCompiledBlock);
+
+	irBuilder.SetInsertPoint(callCompiledBlock);
+	llvm::PHINode* code = irBuilder.CreatePHI(llvmContext.i8PtrType, 2);
+	code->addIncoming(compiledCode, entryBlock);
+	code->addIncoming(newlyCompiledCode, compileEndBlock);
+	emitForwardingTailCall(code);
+}
+
 void EmitFunctionContext::emit()
 {
 	// Create debug info for the function.
@@ -358,8 +619,17 @@ void EmitFunctionContext::emit()
 		ControlContext::Type::function, functionType.results(), returnBlock, returnPHIs);
 	pushBranchTarget(functionType.results(), returnBlock, returnPHIs);
 
-	// Create and initialize allocas for the memory and table base parameters.
+	// The first parameter is the address of the module instance's binding table.
 	auto llvmArgIt = function->arg_begin();
+	bindingTable = &*llvmArgIt++;
+	if(irModule.memories.size())
+	{
+		defaultMemoryOffset = getMemoryOffset(0);
+		if(moduleContext.boundsCheckMemories)
+		{ defaultMemoryNumBytesOffset = getMemoryNumBytesOffset(0); }
+	}
+
+	// Create and initialize allocas for the memory and table base parameters.
 	initContextVariables(&*llvmArgIt++);
 
 	// Create and initialize allocas for all the locals and parameters.
@@ -387,6 +657,15 @@ void EmitFunctionContext::emit()
 		}
 	}
 
+	if(moduleContext.isBaselineTier) { emitTierUpPrologue(); }
+
+	// The first profile counter counts the function's calls.
+	if(profileCounters) { emitProfileCounterIncrement(emitLiteral(llvmContext, U32(0))); }
+
+	if(moduleContext.isInterruptible) { emitInterruptCheck(); }
+
+	emitFuelCharge();
+
 	if(EMIT_ENTER_EXIT_HOOKS)
 	{
 		emitRuntimeIntrinsic(
@@ -407,15 +686,23 @@ void EmitFunctionContext::emit()
 	{
 		if(enableTracing) { traceOperator(decoder.decodeOpWithoutConsume(operatorPrinter)); }
 
+		currentOpIndex = opIndex++;
 		irBuilder.SetCurrentDebugLocation(
-			llvm::DILocation::get(llvmContext, (unsigned int)opIndex++, 0, diFunction));
+			llvm::DILocation::get(llvmContext, (unsigned int)currentOpIndex, 0, diFunction));
 
-		if(controlStack.back().isReachable) { decoder.decodeOp(*this); }
+		// Each reachable operator adds one to the fuel cost of the basic block it is in. Control
+		// operators that start a new block are charged to the block they end.
+		if(controlStack.back().isReachable)
+		{
+			++numFuelChargedOps;
+			decoder.decodeOp(*this);
+		}
 		else
 		{
 			decoder.decodeOp(unreachableOpVisitor);
 		}
 	};
+	finishFuelCharge();
 	WAVM_ASSERT(irBuilder.GetInsertBlock() == returnBlock);
 
 	if(EMIT_ENTER_EXIT_HOOKS)
@@ -5,6 +5,7 @@
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/HashMap.h"
 #include "WAVM/Logging/Logging.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
@@ -26,6 +27,31 @@ namespace WAVM { namespace LLVMJIT {
 
 		llvm::DISubprogram* diFunction;
 
+		// The address of the module instance's binding table, and the values that have been loaded
+		// from it.
+		llvm::Value* bindingTable = nullptr;
+		HashMap<Uptr, llvm::Value*> bindingValues;
+
+		// If the function is compiled by the baseline tier or as a lazy compilation stub, the
+		// address of its FunctionTierUpState and its index in the module's function definitions.
+		llvm::Constant* tierUpState = nullptr;
+		Uptr functionDefIndex = UINTPTR_MAX;
+
+		// If the function is instrumented to collect a profile, the address of its profile
+		// counters. If it is compiled with a profile, the profile's counts for the function.
+		llvm::Value* profileCounters = nullptr;
+		const FunctionProfile* functionProfile = nullptr;
+		HashMap<Uptr, ProfileCounterSite> opIndexToProfileCounterSiteMap;
+
+		// The index of the operator that is being emitted.
+		Uptr currentOpIndex = 0;
+
+		// If the function meters fuel, the subtraction of the current basic block's cost from the
+		// context's fuel, whose cost operand is set when the block ends, and the number of
+		// operators that have been emitted in the block.
+		llvm::Instruction* currentFuelCharge = nullptr;
+		U64 numFuelChargedOps = 0;
+
 		// Information about an in-scope control structure.
 		struct ControlContext
 		{
@@ -67,7 +93,7 @@ namespace WAVM { namespace LLVMJIT {
 							const IR::Module& inIRModule,
 							const IR::FunctionDef& inFunctionDef,
 							llvm::Function* inLLVMFunction)
-		: EmitContext(inLLVMContext, inModuleContext.defaultMemoryOffset)
+		: EmitContext(inLLVMContext, nullptr)
 		, moduleContext(inModuleContext)
 		, irModule(inIRModule)
 		, functionDef(inFunctionDef)
@@ -78,6 +104,125 @@ namespace WAVM { namespace LLVMJIT {
 
 		void emit();
 
+		// Emits the baseline tier's function prologue, which forwards calls to the function's
+		// optimized code if it has been compiled, and otherwise counts the call.
+		void emitTierUpPrologue();
+
+		// Emits a stub in place of the function's code, which compiles the function the first time
+		// it is called, and forwards calls to the compiled code.
+		void emitLazyCompileStub();
+
+		// Emits a check for a call to Runtime::interruptContext, which traps if there was one.
+		void emitInterruptCheck();
+
+		// If the function meters fuel, ends the current basic block's fuel charge, and emits the
+		// charge for a new block that starts at the current operator.
+		void emitFuelCharge();
+		void finishFuelCharge();
+
+		// Increments one of the function's profile counters, if it is instrumented.
+		void emitProfileCounterIncrement(llvm::Value* counterIndex);
+
+		// Increments the profile counter for the successor taken by the current branch operator.
+		void emitBranchProfileCount(llvm::Value* successorIndex);
+
+		// Returns branch weight metadata for the current branch operator from the profile it is
+		// compiled with, or null if there is no profile for it. The successors are ordered as the
+		// profile's counts for the operator.
+		llvm::MDNode* getProfileBranchWeights(Uptr numSuccessors);
+
+		// Loads the address of the code that calls to this function should be forwarded to from
+		// its FunctionTierUpState, or null if it hasn't been compiled yet.
+		llvm::Value* loadForwardedCode();
+
+		// Forwards the call to this function to the given code with a guaranteed tail call.
+		void emitForwardingTailCall(llvm::Value* code);
+
+		// Returns the address of the Runtime::Function for this function's shared code.
+		llvm::Constant* getSharedFunctionObject();
+
+		// Loads a value from the module instance's binding table. The load is emitted once, at the
+		// start of the function's entry block, so it dominates all uses of the value.
+		llvm::Value* loadBinding(Uptr slotIndex)
+		{
+			if(llvm::Value** cachedValue = bindingValues.get(slotIndex)) { return *cachedValue; }
+
+			llvm::BasicBlock* entryBlock = &function->getEntryBlock();
+			llvm::IRBuilder<> entryIRBuilder(entryBlock, entryBlock->begin());
+			auto load = entryIRBuilder.CreateLoad(entryIRBuilder.CreateInBoundsGEP(
+				bindingTable, {emitLiteral(llvmContext, slotIndex)}));
+			load->setAlignment(sizeof(Uptr));
+			load->setMetadata(llvm::LLVMContext::MD_invariant_load,
+							  llvm::MDNode::get(llvmContext, {}));
+
+			bindingValues.add(slotIndex, load);
+			return load;
+		}
+
+		llvm::Value* getModuleInstanceId()
+		{
+			return loadBinding(BindingTableLayout::moduleInstanceIdSlot);
+		}
+
+		// Returns the address of a function's Runtime::Function.
+		llvm::Value* getFunctionObject(Uptr functionIndex)
+		{
+			return loadBinding(moduleContext.bindingTableLayout.functionsBaseSlot + functionIndex);
+		}
+
+		llvm::Value* getTableId(Uptr tableIndex)
+		{
+			return loadBinding(moduleContext.bindingTableLayout.tablesBaseSlot + tableIndex);
+		}
+
+		// Returns the offset of a table's base pointer in CompartmentRuntimeData.
+		llvm::Value* getTableOffset(Uptr tableIndex)
+		{
+			return irBuilder.CreateAdd(
+				emitLiteral(llvmContext,
+							Uptr(offsetof(Runtime::CompartmentRuntimeData, tableBases))),
+				irBuilder.CreateMul(getTableId(tableIndex),
+									emitLiteral(llvmContext, Uptr(sizeof(Uptr)))));
+		}
+
+		llvm::Value* getMemoryId(Uptr memoryIndex)
+		{
+			return loadBinding(moduleContext.bindingTableLayout.memoriesBaseSlot + memoryIndex);
+		}
+
+		// Returns the offset of a memory's base pointer in CompartmentRuntimeData.
+		llvm::Value* getMemoryOffset(Uptr memoryIndex)
+		{
+			return irBuilder.CreateAdd(
+				emitLiteral(llvmContext,
+							Uptr(offsetof(Runtime::CompartmentRuntimeData, memoryBases))),
+				irBuilder.CreateMul(getMemoryId(memoryIndex),
+									emitLiteral(llvmContext, Uptr(sizeof(Uptr)))));
+		}
+
+		// Returns the offset of a memory's size in bytes in CompartmentRuntimeData.
+		llvm::Value* getMemoryNumBytesOffset(Uptr memoryIndex)
+		{
+			return irBuilder.CreateAdd(
+				emitLiteral(llvmContext,
+							Uptr(offsetof(Runtime::CompartmentRuntimeData, memoryNumBytes))),
+				irBuilder.CreateMul(getMemoryId(memoryIndex),
+									emitLiteral(llvmContext, Uptr(sizeof(Uptr)))));
+		}
+
+		// Returns either the offset of a mutable global's value in
+		// ContextRuntimeData::mutableGlobals, or the address of an immutable global's value.
+		llvm::Value* getGlobalBinding(Uptr globalIndex)
+		{
+			return loadBinding(moduleContext.bindingTableLayout.globalsBaseSlot + globalIndex);
+		}
+
+		llvm::Value* getExceptionTypeId(Uptr exceptionTypeIndex)
+		{
+			return loadBinding(moduleContext.bindingTableLayout.exceptionTypesBaseSlot
+							   + exceptionTypeIndex);
+		}
+
 		// Operand stack manipulation
 		llvm::Value* pop()
 		{
@@ -24,7 +24,8 @@ using namespace WAVM::LLVMJIT;
 
 // Bounds checks a sandboxed memory address + offset, and returns an offset relative to the memory
 // base address that is guaranteed to be within the virtual address space allocated for the linear
-// memory object.
+// memory object, unless the memory is accessed with explicit bounds checks: see
+// coerceAddressToPointer.
 static llvm::Value* getOffsetAndBoundedAddress(EmitContext& emitContext,
 											   llvm::Value* address,
 											   U32 offset)
@@ -46,7 +47,8 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitContext& emitContext,
 
 	// If HAS_64BIT_ADDRESS_SPACE, the memory has enough virtual address space allocated to ensure
 	// that any 32-bit byte index + 32-bit offset will fall within the virtual address sandbox, so
-	// no explicit bounds check is necessary.
+	// no explicit bounds check is necessary unless the module is compiled with
+	// CompileOptions::boundsCheckMemories.
 
 	return address;
 }
@@ -54,6 +56,38 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitContext& emitContext,
 llvm::Value* EmitFunctionContext::coerceAddressToPointer(llvm::Value* boundedAddress,
 														 llvm::Type* memoryType)
 {
+	// If the memory may only reserve address space for its maximum size, check that the accessed
+	// bytes are within the memory. The address is less than 2^33, so adding the size of the
+	// access to it can't overflow.
+	if(memoryNumBytesVariable)
+	{
+		llvm::Value* memoryNumBytes;
+		if(irModule.memories.getType(0).isShared)
+		{
+			// Other threads may grow a shared memory, so load its size on each access.
+			auto memoryNumBytesLoad = irBuilder.CreateLoad(irBuilder.CreatePointerCast(
+				irBuilder.CreateInBoundsGEP(getCompartmentAddress(),
+											{defaultMemoryNumBytesOffset}),
+				llvmContext.i64Type->getPointerTo()));
+			memoryNumBytesLoad->setAlignment(sizeof(U64));
+			memoryNumBytesLoad->setAtomic(llvm::AtomicOrdering::Acquire);
+			memoryNumBytes = memoryNumBytesLoad;
+		}
+		else
+		{
+			memoryNumBytes = irBuilder.CreateLoad(memoryNumBytesVariable);
+		}
+
+		const U64 numAccessBytes = memoryType->getPrimitiveSizeInBits() / 8;
+		emitConditionalTrapIntrinsic(
+			irBuilder.CreateICmpUGT(
+				irBuilder.CreateAdd(boundedAddress, emitLiteral(llvmContext, numAccessBytes)),
+				memoryNumBytes),
+			"outOfBoundsMemoryAccessTrap",
+			FunctionType({}, TypeTuple({ValueType::i64, inferValueType<Uptr>()})),
+			{boundedAddress, getMemoryId(0)});
+	}
+
 	llvm::Value* memoryBasePointer = irBuilder.CreateLoad(memoryBasePointerVariable);
 	llvm::Value* bytePointer = irBuilder.CreateInBoundsGEP(memoryBasePointer, boundedAddress);
 
@@ -75,10 +109,12 @@ void EmitFunctionContext::memory_grow(MemoryImm imm)
 		"memory.grow",
 		FunctionType(TypeTuple(ValueType::i32),
 					 TypeTuple({ValueType::i32, inferValueType<Uptr>()})),
-		{deltaNumPages,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
+		{deltaNumPages, getMemoryId(imm.memoryIndex)});
 	WAVM_ASSERT(previousNumPages.size() == 1);
 	push(previousNumPages[0]);
+
+	// Reload the memory's size after growing it.
+	if(memoryNumBytesVariable) { reloadMemoryBase(); }
 }
 void EmitFunctionContext::memory_size(MemoryImm imm)
 {
@@ -86,7 +122,7 @@ void EmitFunctionContext::memory_size(MemoryImm imm)
 	ValueVector currentNumPages = emitRuntimeIntrinsic(
 		"memory.size",
 		FunctionType(TypeTuple(ValueType::i32), TypeTuple(inferValueType<Uptr>())),
-		{getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
+		{getMemoryId(imm.memoryIndex)});
 	WAVM_ASSERT(currentNumPages.size() == 1);
 	push(currentNumPages[0]);
 }
@@ -112,8 +148,8 @@ void EmitFunctionContext::memory_init(DataSegmentAndMemImm imm)
 		{destAddress,
 		 sourceOffset,
 		 numBytes,
-		 moduleContext.moduleInstanceId,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex]),
+		 getModuleInstanceId(),
+		 getMemoryId(imm.memoryIndex),
 		 emitLiteral(llvmContext, imm.dataSegmentIndex)});
 }
 
@@ -122,7 +158,7 @@ void EmitFunctionContext::data_drop(DataSegmentImm imm)
 	emitRuntimeIntrinsic(
 		"data.drop",
 		FunctionType({}, TypeTuple({inferValueType<Uptr>(), inferValueType<Uptr>()})),
-		{moduleContext.moduleInstanceId, emitLiteral(llvmContext, imm.dataSegmentIndex)});
+		{getModuleInstanceId(), emitLiteral(llvmContext, imm.dataSegmentIndex)});
 }
 
 void EmitFunctionContext::memory_copy(MemoryCopyImm imm)
@@ -142,8 +178,8 @@ void EmitFunctionContext::memory_copy(MemoryCopyImm imm)
 		{destAddress,
 		 sourceAddress,
 		 numBytes,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.sourceMemoryIndex]),
-		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.destMemoryIndex])});
+		 getMemoryId(imm.sourceMemoryIndex),
+		 getMemoryId(imm.destMemoryIndex)});
 }
 
 void EmitFunctionContext::memory_fill(MemoryImm imm)
@@ -157,10 +193,7 @@ void EmitFunctionContext::memory_fill(MemoryImm imm)
 		FunctionType(
 			{},
 			TypeTuple({ValueType::i32, ValueType::i32, ValueType::i32, inferValueType<Uptr>()})),
-		{destAddress,
-		 value,
-		 numBytes,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.memoryOffsets[imm.memoryIndex])});
+		{destAddress, value, numBytes, getMemoryId(imm.memoryIndex)});
 }
 
 //
@@ -254,9 +287,7 @@ void EmitFunctionContext::atomic_notify(AtomicLoadOrStoreImm<2> imm)
 		"atomic_notify",
 		FunctionType(TypeTuple{ValueType::i32},
 					 TypeTuple{ValueType::i32, ValueType::i32, ValueType::i64}),
-		{address,
-		 numWaiters,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
+		{address, numWaiters, getMemoryId(0)})[0]);
 }
 void EmitFunctionContext::i32_atomic_wait(AtomicLoadOrStoreImm<2> imm)
 {
@@ -270,10 +301,7 @@ void EmitFunctionContext::i32_atomic_wait(AtomicLoadOrStoreImm<2> imm)
 		FunctionType(
 			TypeTuple{ValueType::i32},
 			TypeTuple{ValueType::i32, ValueType::i32, ValueType::i64, inferValueType<Uptr>()}),
-		{address,
-		 expectedValue,
-		 timeout,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
+		{address, expectedValue, timeout, getMemoryId(0)})[0]);
 }
 void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm)
 {
@@ -287,10 +315,7 @@ void EmitFunctionContext::i64_atomic_wait(AtomicLoadOrStoreImm<3> imm)
 		FunctionType(
 			TypeTuple{ValueType::i32},
 			TypeTuple{ValueType::i32, ValueType::i64, ValueType::i64, inferValueType<Uptr>()}),
-		{address,
-		 expectedValue,
-		 timeout,
-		 getMemoryIdFromOffset(llvmContext, moduleContext.defaultMemoryOffset)})[0]);
+		{address, expectedValue, timeout, getMemoryId(0)})[0]);
 }
 
 void EmitFunctionContext::atomic_fence(NoImm)
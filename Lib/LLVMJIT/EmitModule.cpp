@@ -6,6 +6,7 @@
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Timing.h"
 
@@ -41,8 +42,7 @@ EmitModuleContext::EmitModuleContext(const IR::Module& inIRModule,
 , llvmContext(inLLVMContext)
 , llvmModule(inLLVMModule)
 , targetMachine(inTargetMachine)
-, defaultMemoryOffset(nullptr)
-, defaultTableOffset(nullptr)
+, bindingTableLayout(inIRModule)
 , diBuilder(*inLLVMModule)
 {
 	useWindowsSEH = targetMachine->getTargetTriple().getOS() == llvm::Triple::Win32;
@@ -96,10 +96,21 @@ static llvm::Constant* createImportedConstant(llvm::Module& llvmModule, llvm::Tw
 void LLVMJIT::emitModule(const IR::Module& irModule,
 						 LLVMContext& llvmContext,
 						 llvm::Module& outLLVMModule,
-						 llvm::TargetMachine* targetMachine)
+						 llvm::TargetMachine* targetMachine,
+						 const std::vector<Uptr>* functionDefIndices,
+						 const CompileOptions& options)
 {
 	Timing::Timer emitTimer;
 	EmitModuleContext moduleContext(irModule, llvmContext, &outLLVMModule, targetMachine);
+	moduleContext.isBaselineTier = options.tiered && !options.lazy;
+	moduleContext.tierUpCallThreshold = options.tierUpCallThreshold;
+	moduleContext.isLazy = options.lazy;
+	moduleContext.lazyCompileDirectCallees = options.lazyCompileDirectCallees;
+	moduleContext.instrumentProfile = options.instrumentProfile && !options.lazy;
+	moduleContext.profile = options.lazy ? nullptr : options.profile.get();
+	moduleContext.isInterruptible = options.interruptible;
+	moduleContext.meterFuel = options.meterFuel;
+	moduleContext.boundsCheckMemories = options.boundsCheckMemories;
 
 	// Set the module data layout for the target machine.
 	outLLVMModule.setDataLayout(targetMachine->createDataLayout());
@@ -120,57 +131,6 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 			llvmContext.iptrType));
 	}
 
-	// Create LLVM external globals corresponding to offsets to table base pointers in
-	// CompartmentRuntimeData for the module's declared table objects.
-	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
-	{
-		moduleContext.tableOffsets.push_back(llvm::ConstantExpr::getPtrToInt(
-			createImportedConstant(outLLVMModule, getExternalName("tableOffset", tableIndex)),
-			llvmContext.iptrType));
-	}
-	if(moduleContext.tableOffsets.size())
-	{ moduleContext.defaultTableOffset = moduleContext.tableOffsets[0]; }
-
-	// Create LLVM external globals corresponding to offsets to memory base pointers in
-	// CompartmentRuntimeData for the module's declared memory objects.
-	for(Uptr memoryIndex = 0; memoryIndex < irModule.memories.size(); ++memoryIndex)
-	{
-		moduleContext.memoryOffsets.push_back(llvm::ConstantExpr::getPtrToInt(
-			createImportedConstant(outLLVMModule, getExternalName("memoryOffset", memoryIndex)),
-			llvmContext.iptrType));
-	}
-	if(moduleContext.memoryOffsets.size())
-	{ moduleContext.defaultMemoryOffset = moduleContext.memoryOffsets[0]; }
-
-	// Create LLVM external globals for the module's globals.
-	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
-	{
-		moduleContext.globals.push_back(
-			createImportedConstant(outLLVMModule, getExternalName("global", globalIndex)));
-	}
-
-	// Create LLVM external globals corresponding to pointers to ExceptionTypes for the
-	// module's declared exception types.
-	for(Uptr exceptionTypeIndex = 0; exceptionTypeIndex < irModule.exceptionTypes.size();
-		++exceptionTypeIndex)
-	{
-		llvm::Constant* biasedExceptionTypeIdAsPointer = createImportedConstant(
-			outLLVMModule, getExternalName("biasedExceptionTypeId", exceptionTypeIndex));
-		llvm::Constant* biasedExceptionTypeId
-			= llvm::ConstantExpr::getPtrToInt(biasedExceptionTypeIdAsPointer, llvmContext.iptrType);
-		llvm::Constant* exceptionTypeId
-			= llvm::ConstantExpr::getSub(biasedExceptionTypeId, emitLiteral(llvmContext, Uptr(1)));
-		moduleContext.exceptionTypeIds.push_back(exceptionTypeId);
-	}
-
-	// Create a LLVM external global that will point to the ModuleInstance.
-	llvm::Constant* biasedModuleInstanceIdAsPointer
-		= createImportedConstant(outLLVMModule, "biasedModuleInstanceId");
-	llvm::Constant* biasedModuleInstanceId
-		= llvm::ConstantExpr::getPtrToInt(biasedModuleInstanceIdAsPointer, llvmContext.iptrType);
-	moduleContext.moduleInstanceId
-		= llvm::ConstantExpr::getSub(biasedModuleInstanceId, emitLiteral(llvmContext, Uptr(1)));
-
 	// Create a LLVM external global that will be a bias applied to all references in a table.
 	moduleContext.tableReferenceBias = llvm::ConstantExpr::getPtrToInt(
 		createImportedConstant(outLLVMModule, "tableReferenceBias"), llvmContext.iptrType);
@@ -210,27 +170,35 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 			llvmContext.i8PtrType);
 	}
 
-	// Create the LLVM functions.
-	moduleContext.functions.resize(irModule.functions.size());
-	for(Uptr functionIndex = 0; functionIndex < irModule.functions.size(); ++functionIndex)
+	// Create the LLVM functions for the module's function definitions. They take the address of
+	// the binding table as a nest parameter, which is passed in a register that isn't otherwise
+	// used by the calling convention, so the per-instance stubs that call them can set it without
+	// moving the other arguments.
+	moduleContext.functions.resize(irModule.functions.size(), nullptr);
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
 	{
-		FunctionType functionType = irModule.types[irModule.functions.getType(functionIndex).index];
+		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
+		FunctionType functionType = irModule.types[functionDef.type.index];
 
-		llvm::Function* function = llvm::Function::Create(
-			asLLVMType(llvmContext, functionType, CallingConvention::wasm),
-			llvm::Function::ExternalLinkage,
-			functionIndex >= irModule.functions.imports.size()
-				? getExternalName("functionDef", functionIndex - irModule.functions.imports.size())
-				: getExternalName("functionImport", functionIndex),
-			&outLLVMModule);
+		llvm::Function* function
+			= llvm::Function::Create(getSharedFunctionType(llvmContext, functionType),
+									 llvm::Function::ExternalLinkage,
+									 getExternalName("functionDef", functionDefIndex),
+									 &outLLVMModule);
 		function->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
-		moduleContext.functions[functionIndex] = function;
+		function->addParamAttr(0, llvm::Attribute::Nest);
+		moduleContext.functions[irModule.functions.imports.size() + functionDefIndex] = function;
 	}
 
-	// Compile each function in the module.
-	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
-		++functionDefIndex)
+	// Compile each function in the module, or only the requested subset of them.
+	const Uptr numEmittedFunctionDefs
+		= functionDefIndices ? functionDefIndices->size() : irModule.functions.defs.size();
+	for(Uptr emitIndex = 0; emitIndex < numEmittedFunctionDefs; ++emitIndex)
 	{
+		const Uptr functionDefIndex
+			= functionDefIndices ? (*functionDefIndices)[emitIndex] : emitIndex;
+		WAVM_ASSERT(functionDefIndex < irModule.functions.defs.size());
 		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
 		llvm::Function* function
 			= moduleContext.functions[irModule.functions.imports.size() + functionDefIndex];
@@ -242,18 +210,66 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 		llvm::Constant* functionDefMutableDataAsIptr
 			= llvm::ConstantExpr::getPtrToInt(functionDefMutableData, llvmContext.iptrType);
 
+		// The shared code isn't owned by any module instance: each instance's stubs have their
+		// own Runtime::Function.
 		setRuntimeFunctionPrefix(llvmContext,
 								 function,
 								 functionDefMutableDataAsIptr,
-								 moduleContext.moduleInstanceId,
+								 emitLiteral(llvmContext, Uptr(UINTPTR_MAX)),
 								 moduleContext.typeIds[functionDef.type.index]);
 		setFunctionAttributes(targetMachine, function);
 
-		EmitFunctionContext(llvmContext, moduleContext, irModule, functionDef, function).emit();
+		EmitFunctionContext functionContext(
+			llvmContext, moduleContext, irModule, functionDef, function);
+		if(moduleContext.isBaselineTier || moduleContext.isLazy)
+		{
+			functionContext.tierUpState = createImportedConstant(
+				outLLVMModule, getExternalName("functionDefTierUpState", functionDefIndex));
+			functionContext.functionDefIndex = functionDefIndex;
+		}
+		if(moduleContext.instrumentProfile)
+		{
+			// Each function's profile counters are in a zero-initialized global that the loader
+			// looks up by name, so the counts can be read after the module has run.
+			Uptr numProfileCounters = 0;
+			for(const ProfileCounterSite& site :
+				getProfileCounterSites(functionDef, numProfileCounters))
+			{ functionContext.opIndexToProfileCounterSiteMap.addOrFail(site.opIndex, site); }
+
+			llvm::ArrayType* profileCountersType
+				= llvm::ArrayType::get(llvmContext.i64Type, numProfileCounters);
+			functionContext.profileCounters = llvm::ConstantExpr::getPointerCast(
+				new llvm::GlobalVariable(
+					outLLVMModule,
+					profileCountersType,
+					false,
+					llvm::GlobalVariable::ExternalLinkage,
+					llvm::ConstantAggregateZero::get(profileCountersType),
+					getExternalName("functionDefProfileCounters", functionDefIndex)),
+				llvmContext.i64Type->getPointerTo());
+		}
+		if(moduleContext.profile && functionDefIndex < moduleContext.profile->functionDefs.size())
+		{
+			const FunctionProfile& functionProfile
+				= moduleContext.profile->functionDefs[functionDefIndex];
+			functionContext.functionProfile = &functionProfile;
+#if LLVM_VERSION_MAJOR >= 7
+			function->setEntryCount(llvm::Function::ProfileCount(functionProfile.entryCount,
+																 llvm::Function::PCT_Real));
+#else
+			function->setEntryCount(functionProfile.entryCount);
+#endif
+		}
+		if(moduleContext.isLazy) { functionContext.emitLazyCompileStub(); }
+		else
+		{
+			functionContext.emit();
+		}
 	}
 
 	// Finalize the debug info.
 	moduleContext.diBuilder.finalize();
 
-	Timing::logRatePerSecond("Emitted LLVM IR", emitTimer, (F64)outLLVMModule.size(), "functions");
+	Timing::logRatePerSecond(
+		"Emitted LLVM IR", emitTimer, (F64)numEmittedFunctionDefs, "functions");
 }
@@ -17,16 +17,13 @@ namespace WAVM { namespace LLVMJIT {
 		llvm::TargetMachine* targetMachine;
 		bool useWindowsSEH;
 		std::vector<llvm::Constant*> typeIds;
+		// The LLVM functions for the module's function definitions. The entries for imported
+		// functions are null: they are called through the binding table.
 		std::vector<llvm::Function*> functions;
-		std::vector<llvm::Constant*> tableOffsets;
-		std::vector<llvm::Constant*> memoryOffsets;
-		std::vector<llvm::Constant*> globals;
-		std::vector<llvm::Constant*> exceptionTypeIds;
 
-		llvm::Constant* defaultMemoryOffset;
-		llvm::Constant* defaultTableOffset;
+		// The layout of the binding table that is passed to the module's functions.
+		BindingTableLayout bindingTableLayout;
 
-		llvm::Constant* moduleInstanceId;
 		llvm::Constant* tableReferenceBias;
 
 		llvm::DIBuilder diBuilder;
@@ -45,6 +42,30 @@ namespace WAVM { namespace LLVMJIT {
 		llvm::Function* cxaEndCatchFunction = nullptr;
 		llvm::Constant* runtimeExceptionTypeInfo = nullptr;
 
+		// Whether the functions are compiled by the baseline tier, and the number of calls after
+		// which they are recompiled with optimization.
+		bool isBaselineTier = false;
+		U32 tierUpCallThreshold = 0;
+
+		// Whether only lazy compilation stubs are emitted for the functions, and whether the stubs
+		// ask for the functions' direct callees to be compiled with them.
+		bool isLazy = false;
+		bool lazyCompileDirectCallees = false;
+
+		// Whether the functions are instrumented to collect a profile, and the profile they are
+		// compiled with, if any.
+		bool instrumentProfile = false;
+		const ModuleProfile* profile = nullptr;
+
+		// Whether the functions check for Runtime::interruptContext on entry and in loops.
+		bool isInterruptible = false;
+
+		// Whether the functions charge the cost of each basic block to the context's fuel.
+		bool meterFuel = false;
+
+		// Whether the functions check that the addresses they access are within the memory.
+		bool boundsCheckMemories = false;
+
 		EmitModuleContext(const IR::Module& inModule,
 						  LLVMContext& inLLVMContext,
 						  llvm::Module* inLLVMModule,
@@ -37,10 +37,9 @@ void EmitFunctionContext::ref_is_null(NoImm)
 
 void EmitFunctionContext::ref_func(FunctionImm imm)
 {
-	llvm::Value* referencedFunction = moduleContext.functions[imm.functionIndex];
-	llvm::Value* codeAddress = irBuilder.CreatePtrToInt(referencedFunction, llvmContext.iptrType);
-	llvm::Value* functionAddress = irBuilder.CreateSub(
-		codeAddress, emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code))));
+	// The binding table contains the module instance's Runtime::Function for each of its
+	// functions, which for function definitions is the instance's stub rather than the shared code.
+	llvm::Value* functionAddress = getFunctionObject(imm.functionIndex);
 	llvm::Value* anyref = irBuilder.CreateIntToPtr(functionAddress, llvmContext.anyrefType);
 	push(anyref);
 }
@@ -51,7 +50,7 @@ void EmitFunctionContext::table_get(TableImm imm)
 	llvm::Value* result = emitRuntimeIntrinsic(
 		"table.get",
 		FunctionType({ValueType::anyref}, TypeTuple({ValueType::i32, inferValueType<Uptr>()})),
-		{index, getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])})[0];
+		{index, getTableId(imm.tableIndex)})[0];
 	push(result);
 }
 
@@ -62,9 +61,7 @@ void EmitFunctionContext::table_set(TableImm imm)
 	emitRuntimeIntrinsic(
 		"table.set",
 		FunctionType({}, TypeTuple({ValueType::i32, ValueType::anyref, inferValueType<Uptr>()})),
-		{index,
-		 value,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])});
+		{index, value, getTableId(imm.tableIndex)});
 }
 
 void EmitFunctionContext::table_init(ElemSegmentAndTableImm imm)
@@ -84,8 +81,8 @@ void EmitFunctionContext::table_init(ElemSegmentAndTableImm imm)
 		{destOffset,
 		 sourceOffset,
 		 numElements,
-		 moduleContext.moduleInstanceId,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex]),
+		 getModuleInstanceId(),
+		 getTableId(imm.tableIndex),
 		 emitLiteral(llvmContext, imm.elemSegmentIndex)});
 }
 
@@ -94,7 +91,7 @@ void EmitFunctionContext::elem_drop(ElemSegmentImm imm)
 	emitRuntimeIntrinsic(
 		"elem.drop",
 		FunctionType({}, TypeTuple({inferValueType<Uptr>(), inferValueType<Uptr>()})),
-		{moduleContext.moduleInstanceId, emitLiteral(llvmContext, imm.elemSegmentIndex)});
+		{getModuleInstanceId(), emitLiteral(llvmContext, imm.elemSegmentIndex)});
 }
 
 void EmitFunctionContext::table_copy(TableCopyImm imm)
@@ -114,8 +111,8 @@ void EmitFunctionContext::table_copy(TableCopyImm imm)
 		{destOffset,
 		 sourceOffset,
 		 numElements,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.sourceTableIndex]),
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.destTableIndex])});
+		 getTableId(imm.sourceTableIndex),
+		 getTableId(imm.destTableIndex)});
 }
 
 void EmitFunctionContext::table_fill(TableImm imm)
@@ -129,10 +126,7 @@ void EmitFunctionContext::table_fill(TableImm imm)
 		FunctionType(
 			{},
 			TypeTuple({ValueType::i32, ValueType::anyref, ValueType::i32, inferValueType<Uptr>()})),
-		{destOffset,
-		 value,
-		 numElements,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])});
+		{destOffset, value, numElements, getTableId(imm.tableIndex)});
 }
 
 void EmitFunctionContext::table_grow(TableImm imm)
@@ -143,9 +137,7 @@ void EmitFunctionContext::table_grow(TableImm imm)
 		"table.grow",
 		FunctionType(TypeTuple(ValueType::i32),
 					 TypeTuple({ValueType::anyref, ValueType::i32, inferValueType<Uptr>()})),
-		{value,
-		 deltaNumElements,
-		 getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])});
+		{value, deltaNumElements, getTableId(imm.tableIndex)});
 	WAVM_ASSERT(previousNumElements.size() == 1);
 	push(previousNumElements[0]);
 }
@@ -154,7 +146,7 @@ void EmitFunctionContext::table_size(TableImm imm)
 	ValueVector currentNumElements = emitRuntimeIntrinsic(
 		"table.size",
 		FunctionType(TypeTuple(ValueType::i32), TypeTuple(inferValueType<Uptr>())),
-		{getTableIdFromOffset(llvmContext, moduleContext.tableOffsets[imm.tableIndex])});
+		{getTableId(imm.tableIndex)});
 	WAVM_ASSERT(currentNumElements.size() == 1);
 	push(currentNumElements[0]);
 }
@@ -52,9 +52,11 @@ static llvm::Value* getImportedImmutableGlobalValue(EmitFunctionContext& functio
 													Uptr importedGlobalIndex,
 													ValueType valueType)
 {
-	// The symbol for an imported global will point to the global's immutable value.
+	// The binding for an imported global will point to the global's immutable value.
 	return functionContext.loadFromUntypedPointer(
-		functionContext.moduleContext.globals[importedGlobalIndex],
+		functionContext.irBuilder.CreateIntToPtr(
+			functionContext.getGlobalBinding(importedGlobalIndex),
+			functionContext.llvmContext.i8PtrType),
 		asLLVMType(functionContext.llvmContext, valueType),
 		getTypeByteWidth(valueType));
 }
@@ -67,10 +69,9 @@ void EmitFunctionContext::global_get(GetOrSetVariableImm<true> imm)
 	llvm::Value* value = nullptr;
 	if(globalType.isMutable)
 	{
-		// If the global is mutable, the symbol will be bound to an offset into the
+		// If the global is mutable, it will be bound to an offset into the
 		// ContextRuntimeData::globalData that its value is stored at.
-		llvm::Value* globalDataOffset = irBuilder.CreatePtrToInt(
-			moduleContext.globals[imm.variableIndex], llvmContext.iptrType);
+		llvm::Value* globalDataOffset = getGlobalBinding(imm.variableIndex);
 		llvm::Value* globalPointer = irBuilder.CreateInBoundsGEP(
 			irBuilder.CreateLoad(contextPointerVariable), {globalDataOffset});
 		value = loadFromUntypedPointer(globalPointer,
@@ -115,11 +116,7 @@ void EmitFunctionContext::global_get(GetOrSetVariableImm<true> imm)
 			value = llvm::Constant::getNullValue(llvmContext.anyrefType);
 			break;
 		case InitializerExpression::Type::ref_func: {
-			llvm::Value* referencedFunction = moduleContext.functions[globalDef.initializer.ref];
-			llvm::Value* codeAddress
-				= irBuilder.CreatePtrToInt(referencedFunction, llvmContext.iptrType);
-			llvm::Value* functionAddress = irBuilder.CreateSub(
-				codeAddress, emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code))));
+			llvm::Value* functionAddress = getFunctionObject(globalDef.initializer.ref);
 			llvm::Value* anyref = irBuilder.CreateIntToPtr(functionAddress, llvmContext.anyrefType);
 			value = anyref;
 			break;
@@ -141,10 +138,9 @@ void EmitFunctionContext::global_set(GetOrSetVariableImm<true> imm)
 
 	llvm::Value* value = irBuilder.CreateBitCast(pop(), llvmValueType);
 
-	// If the global is mutable, the symbol will be bound to an offset into the
+	// If the global is mutable, it will be bound to an offset into the
 	// ContextRuntimeData::globalData that its value is stored at.
-	llvm::Value* globalDataOffset
-		= irBuilder.CreatePtrToInt(moduleContext.globals[imm.variableIndex], llvmContext.iptrType);
+	llvm::Value* globalDataOffset = getGlobalBinding(imm.variableIndex);
 	llvm::Value* globalPointer = irBuilder.CreateInBoundsGEP(
 		irBuilder.CreateLoad(contextPointerVariable), {globalDataOffset});
 	storeToUntypedPointer(value, globalPointer);
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <system_error>
@@ -10,16 +12,19 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Serialization.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Thread.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ADT/ilist_iterator.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/CodeGen/TargetSubtargetInfo.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/IR/LegacyPassManager.h"
@@ -30,6 +35,8 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include "llvm/Support/Host.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
 #if LLVM_VERSION_MAJOR >= 7
 #include "llvm/Transforms/Utils.h"
@@ -87,11 +94,47 @@ private:
 	std::vector<U8> output;
 };
 
-static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
+bool LLVMJIT::parseOptLevel(const char* string, OptLevel& outOptLevel)
 {
-	// Run some optimization on the module's functions.
-	Timing::Timer optimizationTimer;
+	if(!strcmp(string, "O0")) { outOptLevel = OptLevel::O0; }
+	else if(!strcmp(string, "O1"))
+	{
+		outOptLevel = OptLevel::O1;
+	}
+	else if(!strcmp(string, "O2"))
+	{
+		outOptLevel = OptLevel::O2;
+	}
+	else if(!strcmp(string, "O3"))
+	{
+		outOptLevel = OptLevel::O3;
+	}
+	else if(!strcmp(string, "Os"))
+	{
+		outOptLevel = OptLevel::Os;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char* LLVMJIT::getOptLevelName(OptLevel optLevel)
+{
+	switch(optLevel)
+	{
+	case OptLevel::O0: return "O0";
+	case OptLevel::O1: return "O1";
+	case OptLevel::O2: return "O2";
+	case OptLevel::O3: return "O3";
+	case OptLevel::Os: return "Os";
+	default: WAVM_UNREACHABLE();
+	}
+}
 
+static void runFunctionPassPipeline(llvm::Module& llvmModule)
+{
 	llvm::legacy::FunctionPassManager fpm(&llvmModule);
 	fpm.add(llvm::createPromoteMemoryToRegisterPass());
 	fpm.add(llvm::createInstructionCombiningPass());
@@ -101,6 +144,53 @@ static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
 	fpm.doInitialization();
 	for(auto functionIt = llvmModule.begin(); functionIt != llvmModule.end(); ++functionIt)
 	{ fpm.run(*functionIt); }
+}
+
+static void runStandardPassPipeline(llvm::Module& llvmModule,
+									llvm::TargetMachine* targetMachine,
+									unsigned optLevel,
+									unsigned sizeLevel)
+{
+	// Use LLVM's standard pass pipelines, which end with module passes such as the inliner and
+	// global dead code elimination.
+	llvm::PassManagerBuilder passManagerBuilder;
+	passManagerBuilder.OptLevel = optLevel;
+	passManagerBuilder.SizeLevel = sizeLevel;
+	passManagerBuilder.Inliner = llvm::createFunctionInliningPass(optLevel, sizeLevel, false);
+	passManagerBuilder.LoopVectorize = sizeLevel == 0;
+	passManagerBuilder.SLPVectorize = sizeLevel == 0;
+	targetMachine->adjustPassManager(passManagerBuilder);
+
+	llvm::legacy::FunctionPassManager fpm(&llvmModule);
+	llvm::legacy::PassManager mpm;
+	fpm.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+	mpm.add(llvm::createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+	passManagerBuilder.populateFunctionPassManager(fpm);
+	passManagerBuilder.populateModulePassManager(mpm);
+
+	fpm.doInitialization();
+	for(auto functionIt = llvmModule.begin(); functionIt != llvmModule.end(); ++functionIt)
+	{ fpm.run(*functionIt); }
+	fpm.doFinalization();
+
+	mpm.run(llvmModule);
+}
+
+static void optimizeLLVMModule(llvm::Module& llvmModule,
+							   llvm::TargetMachine* targetMachine,
+							   OptLevel optLevel,
+							   bool shouldLogMetrics)
+{
+	Timing::Timer optimizationTimer;
+	switch(optLevel)
+	{
+	case OptLevel::O0: return;
+	case OptLevel::O1: runFunctionPassPipeline(llvmModule); break;
+	case OptLevel::O2: runStandardPassPipeline(llvmModule, targetMachine, 2, 0); break;
+	case OptLevel::O3: runStandardPassPipeline(llvmModule, targetMachine, 3, 0); break;
+	case OptLevel::Os: runStandardPassPipeline(llvmModule, targetMachine, 2, 1); break;
+	default: WAVM_UNREACHABLE();
+	}
 
 	if(shouldLogMetrics)
 	{
@@ -109,10 +199,42 @@ static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
 	}
 }
 
+static void setCodeGenOptLevel(llvm::TargetMachine* targetMachine, OptLevel optLevel)
+{
+	switch(optLevel)
+	{
+	case OptLevel::O0:
+		// Disable the code generator's optimizations, and use the fast instruction selector.
+		targetMachine->setOptLevel(llvm::CodeGenOpt::None);
+		targetMachine->setFastISel(true);
+		break;
+	case OptLevel::O1:
+	case OptLevel::O2:
+	case OptLevel::Os:
+		targetMachine->setOptLevel(llvm::CodeGenOpt::Default);
+		targetMachine->setFastISel(false);
+		break;
+	case OptLevel::O3:
+		targetMachine->setOptLevel(llvm::CodeGenOpt::Aggressive);
+		targetMachine->setFastISel(false);
+		break;
+	default: WAVM_UNREACHABLE();
+	}
+}
+
+// The baseline tier of a tiered compile and the stubs of a lazy compile are compiled without
+// optimization; options.optLevel is used to recompile the functions that are called often, or to
+// compile the functions when they are first called.
+static OptLevel getInitialOptLevel(const CompileOptions& options)
+{
+	return options.tiered || options.lazy ? OptLevel::O0 : options.optLevel;
+}
+
 std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 										   llvm::Module&& llvmModule,
 										   bool shouldLogMetrics,
-										   llvm::TargetMachine* targetMachine)
+										   llvm::TargetMachine* targetMachine,
+										   OptLevel optLevel)
 {
 	// Verify the module.
 	if(WAVM_DEBUG || WAVM_ENABLE_RELEASE_ASSERTS)
@@ -127,7 +249,8 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 	}
 
 	// Optimize the module;
-	optimizeLLVMModule(llvmModule, shouldLogMetrics);
+	optimizeLLVMModule(llvmModule, targetMachine, optLevel, shouldLogMetrics);
+	setCodeGenOptLevel(targetMachine, optLevel);
 
 	// Generate machine code for the module.
 	Timing::Timer machineCodeTimer;
@@ -182,28 +305,222 @@ static std::unique_ptr<llvm::TargetMachine> getAndValidateTargetMachine(
 			targetSpec.cpu.c_str());
 
 	default: WAVM_UNREACHABLE();
-	};
+	}
 
 	return targetMachine;
 }
 
-std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule, const TargetSpec& targetSpec)
+// The minimum number of bytes of WebAssembly code to put in each shard when automatically choosing
+// the number of shards for a module.
+static constexpr Uptr minCodeBytesPerShard = 64 * 1024;
+
+static Uptr getNumShards(const IR::Module& irModule,
+						 llvm::TargetMachine* targetMachine,
+						 const CompileOptions& options)
+{
+	// The Windows SEH tables are fixed up relative to a single object's image, so don't split
+	// modules compiled for Windows.
+	if(targetMachine->getTargetTriple().getOS() == llvm::Triple::Win32) { return 1; }
+
+	Uptr numShards = options.numShards;
+	if(!numShards)
+	{
+		Uptr numCodeBytes = 0;
+		for(const FunctionDef& functionDef : irModule.functions.defs)
+		{ numCodeBytes += functionDef.code.size(); }
+		numShards
+			= std::min(Platform::getNumberOfHardwareThreads(), numCodeBytes / minCodeBytesPerShard);
+	}
+
+	return std::max(Uptr(1), std::min(numShards, Uptr(irModule.functions.defs.size())));
+}
+
+// Assigns each function definition to a shard, using the size of the function's code as an
+// estimate of the time it will take to compile. Each function is assigned, largest first, to the
+// shard with the least code so far.
+static std::vector<std::vector<Uptr>> partitionFunctionDefs(const IR::Module& irModule,
+															 Uptr numShards)
+{
+	std::vector<Uptr> sortedFunctionDefIndices;
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
+	{ sortedFunctionDefIndices.push_back(functionDefIndex); }
+	std::stable_sort(sortedFunctionDefIndices.begin(),
+					 sortedFunctionDefIndices.end(),
+					 [&irModule](Uptr left, Uptr right) {
+						 return irModule.functions.defs[left].code.size()
+								> irModule.functions.defs[right].code.size();
+					 });
+
+	std::vector<std::vector<Uptr>> shardFunctionDefIndices(numShards);
+	std::vector<Uptr> shardNumCodeBytes(numShards, 0);
+	for(Uptr functionDefIndex : sortedFunctionDefIndices)
+	{
+		Uptr smallestShardIndex = 0;
+		for(Uptr shardIndex = 1; shardIndex < numShards; ++shardIndex)
+		{
+			if(shardNumCodeBytes[shardIndex] < shardNumCodeBytes[smallestShardIndex])
+			{ smallestShardIndex = shardIndex; }
+		}
+		shardFunctionDefIndices[smallestShardIndex].push_back(functionDefIndex);
+		shardNumCodeBytes[smallestShardIndex]
+			+= irModule.functions.defs[functionDefIndex].code.size() + 1;
+	}
+
+	// Emit each shard's functions in the order they occur in the module.
+	for(std::vector<Uptr>& functionDefIndices : shardFunctionDefIndices)
+	{ std::sort(functionDefIndices.begin(), functionDefIndices.end()); }
+
+	return shardFunctionDefIndices;
+}
+
+struct ShardedCompileState
+{
+	const IR::Module& irModule;
+	const TargetSpec& targetSpec;
+	const CompileOptions& options;
+
+	std::vector<std::vector<Uptr>> shardFunctionDefIndices;
+	std::vector<std::vector<U8>> shardObjects;
+	std::vector<Timing::Timer> shardTimers;
+
+	std::atomic<Uptr> nextShardIndex{0};
+
+	ShardedCompileState(const IR::Module& inIRModule,
+						const TargetSpec& inTargetSpec,
+						const CompileOptions& inOptions,
+						std::vector<std::vector<Uptr>>&& inShardFunctionDefIndices)
+	: irModule(inIRModule)
+	, targetSpec(inTargetSpec)
+	, options(inOptions)
+	, shardFunctionDefIndices(std::move(inShardFunctionDefIndices))
+	, shardObjects(shardFunctionDefIndices.size())
+	, shardTimers(shardFunctionDefIndices.size())
+	{
+	}
+};
+
+static I64 compileShardsThreadEntry(void* stateVoid)
+{
+	ShardedCompileState& state = *(ShardedCompileState*)stateVoid;
+	while(true)
+	{
+		const Uptr shardIndex = state.nextShardIndex++;
+		if(shardIndex >= state.shardFunctionDefIndices.size()) { break; }
+
+		// Each shard gets its own LLVM context and target machine, since neither may be used by
+		// multiple threads at once.
+		state.shardTimers[shardIndex] = Timing::Timer();
+		std::unique_ptr<llvm::TargetMachine> targetMachine = getTargetMachine(state.targetSpec);
+		WAVM_ERROR_UNLESS(targetMachine);
+
+		LLVMContext llvmContext;
+		llvm::Module llvmModule("", llvmContext);
+		emitModule(state.irModule,
+				   llvmContext,
+				   llvmModule,
+				   targetMachine.get(),
+				   &state.shardFunctionDefIndices[shardIndex],
+				   state.options);
+		state.shardObjects[shardIndex] = compileLLVMModule(llvmContext,
+														   std::move(llvmModule),
+														   false,
+														   targetMachine.get(),
+														   getInitialOptLevel(state.options));
+		state.shardTimers[shardIndex].stop();
+	}
+	return 0;
+}
+
+// Bundles the objects compiled for each shard into a single image: the sharded object magic
+// number, the number of objects, the size of each object, and then the objects, each aligned to
+// 16 bytes so they can be loaded in place.
+static std::vector<U8> bundleShardObjects(std::vector<std::vector<U8>>& shardObjects)
+{
+	Serialization::ArrayOutputStream stream;
+	U64 magic = shardedObjectMagic;
+	U64 numObjects = U64(shardObjects.size());
+	Serialization::serialize(stream, magic);
+	Serialization::serialize(stream, numObjects);
+	for(const std::vector<U8>& object : shardObjects)
+	{
+		U64 numObjectBytes = U64(object.size());
+		Serialization::serialize(stream, numObjectBytes);
+	}
+
+	Uptr numBytes = (2 + shardObjects.size()) * sizeof(U64);
+	for(const std::vector<U8>& object : shardObjects)
+	{
+		const Uptr numPaddingBytes = ((numBytes + 15) & ~Uptr(15)) - numBytes;
+		memset(stream.advance(numPaddingBytes), 0, numPaddingBytes);
+		Serialization::serializeBytes(stream, object.data(), object.size());
+		numBytes += numPaddingBytes + object.size();
+	}
+
+	return stream.getBytes();
+}
+
+std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule,
+									   const TargetSpec& targetSpec,
+									   const CompileOptions& options)
 {
 	std::unique_ptr<llvm::TargetMachine> targetMachine
 		= getAndValidateTargetMachine(irModule.featureSpec, targetSpec);
 
-	// Emit LLVM IR for the module.
-	LLVMContext llvmContext;
-	llvm::Module llvmModule("", llvmContext);
-	emitModule(irModule, llvmContext, llvmModule, targetMachine.get());
+	const Uptr numShards = getNumShards(irModule, targetMachine.get(), options);
+	if(numShards == 1)
+	{
+		// Emit LLVM IR for the module.
+		LLVMContext llvmContext;
+		llvm::Module llvmModule("", llvmContext);
+		emitModule(irModule, llvmContext, llvmModule, targetMachine.get(), nullptr, options);
+
+		// Compile the LLVM IR to object code.
+		return compileLLVMModule(llvmContext,
+								 std::move(llvmModule),
+								 true,
+								 targetMachine.get(),
+								 getInitialOptLevel(options));
+	}
+
+	// Split the module's function definitions into shards, and compile them on a pool of threads.
+	Timing::Timer compileTimer;
+	ShardedCompileState state(
+		irModule, targetSpec, options, partitionFunctionDefs(irModule, numShards));
+
+	const Uptr numThreads = std::min(numShards, Platform::getNumberOfHardwareThreads());
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{
+		threads.push_back(
+			Platform::createThread(8 * 1024 * 1024, compileShardsThreadEntry, &state));
+	}
+	compileShardsThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	for(Uptr shardIndex = 0; shardIndex < numShards; ++shardIndex)
+	{
+		const std::string description = "Compiled shard " + std::to_string(shardIndex);
+		Timing::logRatePerSecond(description.c_str(),
+								 state.shardTimers[shardIndex],
+								 (F64)state.shardFunctionDefIndices[shardIndex].size(),
+								 "functions");
+	}
 
-	// Compile the LLVM IR to object code.
-	return compileLLVMModule(llvmContext, std::move(llvmModule), true, targetMachine.get());
+	std::vector<U8> objectBytes = bundleShardObjects(state.shardObjects);
+	Log::printf(Log::metrics,
+				"Compiled %" WAVM_PRIuPTR " functions in %" WAVM_PRIuPTR " shards on %" WAVM_PRIuPTR
+				" threads in %.2fms\n",
+				Uptr(irModule.functions.defs.size()),
+				numShards,
+				numThreads,
+				compileTimer.getMilliseconds());
+	return objectBytes;
 }
 
 std::string LLVMJIT::emitLLVMIR(const IR::Module& irModule,
 								const TargetSpec& targetSpec,
-								bool optimize)
+								OptLevel optLevel)
 {
 	std::unique_ptr<llvm::TargetMachine> targetMachine
 		= getAndValidateTargetMachine(irModule.featureSpec, targetSpec);
@@ -214,7 +531,7 @@ std::string LLVMJIT::emitLLVMIR(const IR::Module& irModule,
 	emitModule(irModule, llvmContext, llvmModule, targetMachine.get());
 
 	// Optimize the LLVM IR.
-	if(optimize) { optimizeLLVMModule(llvmModule, true); }
+	optimizeLLVMModule(llvmModule, targetMachine.get(), optLevel, true);
 
 	// Print the LLVM IR.
 	return printModule(llvmModule);
@@ -170,6 +170,17 @@ TargetSpec LLVMJIT::getHostTargetSpec()
 	return result;
 }
 
+// The version of the object code format and runtime ABI emitted by this compiler. This must be
+// incremented whenever a change to the compiler or runtime changes the code it emits, or the
+// layout of any structure that object code depends on, so that cached object code from an older
+// compiler is not loaded.
+#define WAVM_OBJECT_CODE_VERSION "1"
+
+std::string LLVMJIT::getCompilerVersion()
+{
+	return "WAVM object code v" WAVM_OBJECT_CODE_VERSION ", LLVM " LLVM_VERSION_STRING;
+}
+
 std::unique_ptr<llvm::TargetMachine> LLVMJIT::getTargetMachine(const TargetSpec& targetSpec)
 {
 	globalInitLLVMOnce();
@@ -4,9 +4,11 @@
 #include "WAVM/IR/Operators.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Mutex.h"
 #include "WAVM/RuntimeABI/RuntimeABI.h"
 
 #include <cctype>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -268,27 +270,63 @@ namespace WAVM { namespace LLVMJIT {
 		}
 	}
 
-	inline llvm::Constant* getMemoryIdFromOffset(LLVMContext& llvmContext,
-												 llvm::Constant* memoryOffset)
+	// The code for a module's function definitions is shared by all instances of the module. The
+	// values that differ between instances are loaded from the instance's binding table, whose
+	// address is passed to the shared code in a nest parameter preceding the wasm calling
+	// convention's context parameter.
+	inline llvm::FunctionType* getSharedFunctionType(LLVMContext& llvmContext,
+													 IR::FunctionType functionType)
 	{
-		return llvm::ConstantExpr::getExactUDiv(
-			llvm::ConstantExpr::getSub(
-				memoryOffset,
-				emitLiteral(llvmContext,
-							Uptr(offsetof(Runtime::CompartmentRuntimeData, memoryBases)))),
-			emitLiteral(llvmContext, Uptr(sizeof(Uptr))));
+		llvm::FunctionType* wasmFunctionType
+			= asLLVMType(llvmContext, functionType, IR::CallingConvention::wasm);
+		llvm::SmallVector<llvm::Type*, 8> llvmParamTypes;
+		llvmParamTypes.push_back(llvmContext.iptrType->getPointerTo());
+		llvmParamTypes.append(wasmFunctionType->param_begin(), wasmFunctionType->param_end());
+		return llvm::FunctionType::get(wasmFunctionType->getReturnType(), llvmParamTypes, false);
 	}
 
-	inline llvm::Constant* getTableIdFromOffset(LLVMContext& llvmContext,
-												llvm::Constant* tableOffset)
+	// The layout of a module instance's binding table: an array of pointer-sized values that
+	// contains, in order:
+	//   The ID of the module instance.
+	//   A Runtime::Function* for each of the module's functions, imports first.
+	//   The ID of each of the module's tables.
+	//   The ID of each of the module's memories.
+	//   For each of the module's globals, either the offset of its value in
+	//   ContextRuntimeData::mutableGlobals if it's mutable, or a pointer to its immutable value.
+	//   The ID of each of the module's exception types.
+	struct BindingTableLayout
 	{
-		return llvm::ConstantExpr::getExactUDiv(
-			llvm::ConstantExpr::getSub(
-				tableOffset,
-				emitLiteral(llvmContext,
-							Uptr(offsetof(Runtime::CompartmentRuntimeData, tableBases)))),
-			emitLiteral(llvmContext, Uptr(sizeof(Uptr))));
-	}
+		static constexpr Uptr moduleInstanceIdSlot = 0;
+		Uptr functionsBaseSlot;
+		Uptr tablesBaseSlot;
+		Uptr memoriesBaseSlot;
+		Uptr globalsBaseSlot;
+		Uptr exceptionTypesBaseSlot;
+		Uptr numSlots;
+
+		BindingTableLayout(Uptr numFunctions,
+						   Uptr numTables,
+						   Uptr numMemories,
+						   Uptr numGlobals,
+						   Uptr numExceptionTypes)
+		: functionsBaseSlot(moduleInstanceIdSlot + 1)
+		, tablesBaseSlot(functionsBaseSlot + numFunctions)
+		, memoriesBaseSlot(tablesBaseSlot + numTables)
+		, globalsBaseSlot(memoriesBaseSlot + numMemories)
+		, exceptionTypesBaseSlot(globalsBaseSlot + numGlobals)
+		, numSlots(exceptionTypesBaseSlot + numExceptionTypes)
+		{
+		}
+
+		BindingTableLayout(const IR::Module& irModule)
+		: BindingTableLayout(irModule.functions.size(),
+							 irModule.tables.size(),
+							 irModule.memories.size(),
+							 irModule.globals.size(),
+							 irModule.exceptionTypes.size())
+		{
+		}
+	};
 
 	inline void setRuntimeFunctionPrefix(LLVMContext& llvmContext,
 										 llvm::Function* function,
@@ -366,36 +404,130 @@ namespace WAVM { namespace LLVMJIT {
 #endif
 	}
 
-	// Emits LLVM IR for a module.
+	// Emits LLVM IR for a module. If functionDefIndices is non-null, only the listed function
+	// definitions are emitted, and the others are declared as external symbols that are resolved
+	// when the module's objects are loaded together. If options.tiered is set, each function is
+	// emitted with a prologue that counts its calls and forwards them to the function's optimized
+	// code once it has been compiled.
 	void emitModule(const IR::Module& irModule,
 					LLVMContext& llvmContext,
 					llvm::Module& outLLVMModule,
-					llvm::TargetMachine* targetMachine);
+					llvm::TargetMachine* targetMachine,
+					const std::vector<Uptr>* functionDefIndices = nullptr,
+					const CompileOptions& options = CompileOptions());
+
+	// A range of the profile counters of a function definition compiled with
+	// CompileOptions::instrumentProfile that counts how often each successor of one operator is
+	// taken.
+	struct ProfileCounterSite
+	{
+		Uptr opIndex;
+		Uptr firstCounterIndex;
+		Uptr numCounters;
+	};
+
+	// Returns the sites of the profile counters in a function definition's instrumented code. The
+	// first counter counts the function's calls, and is followed by the counters for each if, br_if
+	// and br_table operator in the function, in order, including those in unreachable code.
+	std::vector<ProfileCounterSite> getProfileCounterSites(const IR::FunctionDef& functionDef,
+														  Uptr& outNumCounters);
+
+	// A symbol for a range of JIT code in the perf map file written when enablePerfMap is called.
+	struct PerfMapEntry
+	{
+		Uptr address;
+		Uptr numBytes;
+		std::string name;
+	};
+
+	// Appends symbols for newly loaded code to the perf map file, if it is enabled.
+	bool isPerfMapEnabled();
+	void addPerfMapEntries(const std::vector<PerfMapEntry>& entries);
+
+	// Object code for a module that was compiled in multiple shards starts with this magic number,
+	// followed by the number of objects, and then the size and bytes of each object. A module
+	// compiled in a single shard is just a plain object file.
+	static constexpr U64 shardedObjectMagic = 0x7364726168736d77; // "wmshards"
 
 	// Used to override LLVM's default behavior of looking up unresolved symbols in DLL exports.
 	llvm::JITEvaluatedSymbol resolveJITImport(llvm::StringRef name);
 
 	struct ModuleMemoryManager;
+	struct TierUpState;
 
-	// Encapsulates a loaded module.
+	// Encapsulates a loaded module, or an instance of a loaded module.
 	struct Module
 	{
-		std::map<Uptr, Runtime::Function*> addressToFunctionMap;
+		// The module's functions, sorted by the address of the end of their code. It isn't changed
+		// after the module is loaded, so it can be searched without a lock.
+		struct FunctionCodeRange
+		{
+			Uptr codeEndAddress;
+			Runtime::Function* function;
+		};
+		std::vector<FunctionCodeRange> functionCodeRanges;
 		HashMap<std::string, Runtime::Function*> nameToFunctionMap;
 
+		// If the module was compiled by the baseline tier, the state used to recompile its
+		// functions with optimization.
+		std::shared_ptr<TierUpState> tierUpState;
+
+		// If the module was compiled with CompileOptions::instrumentProfile, the counters of each
+		// function definition, by the name of their symbol in the object code.
+		struct ProfileCounters
+		{
+			U64* counters;
+			Uptr numCounters;
+		};
+		HashMap<std::string, ProfileCounters> nameToProfileCountersMap;
+
+		// Loads object code.
 		Module(const std::vector<U8>& inObjectBytes,
 			   const HashMap<std::string, Uptr>& importedSymbolMap,
 			   bool shouldLogMetrics);
+
+		// Creates an instance of a loaded module that binds its shared code to the values in
+		// inBindingTable. A stub is created for each of the loaded module's function definitions
+		// that passes the address of the binding table to the shared code, and the address of the
+		// stub's Runtime::Function is stored in the binding table, starting at
+		// firstFunctionDefSlot.
+		Module(const std::shared_ptr<Module>& inLoadedModule,
+			   std::vector<Uptr>&& inBindingTable,
+			   Uptr firstFunctionDefSlot,
+			   const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas);
+
+		// Creates stubs for the function definitions of a module instance that isn't compiled. The
+		// stub for each function definition passes the address of its own Runtime::Function to the
+		// code of the corresponding element of targetFunctions.
+		Module(Uptr moduleInstanceId,
+			   const std::vector<const Runtime::Function*>& targetFunctions,
+			   const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas);
+
 		~Module();
 
 	private:
 		ModuleMemoryManager* memoryManager;
 
+		// If this is an instance of a loaded module, the loaded module, the binding table, and the
+		// pages that contain the instance's function stubs.
+		std::shared_ptr<Module> loadedModule;
+		std::vector<Uptr> bindingTable;
+		U8* stubPages = nullptr;
+		Uptr numStubPages = 0;
+
+		void createStubs(Uptr moduleInstanceId,
+						 const std::vector<const Runtime::Function*>& targetFunctions,
+						 const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas);
+
+		// The keys used to register each of the module's objects with the GDB registration
+		// listener.
+		std::vector<U64> gdbObjectKeys;
+
 		// Have to keep copies of these around because until LLVM 8, GDB registration listener uses
 		// their pointers as keys for deregistration.
 #if LLVM_VERSION_MAJOR < 8
 		std::vector<U8> objectBytes;
-		std::unique_ptr<llvm::object::ObjectFile> object;
+		std::vector<std::unique_ptr<llvm::object::ObjectFile>> objects;
 #endif
 	};
 
@@ -407,7 +539,62 @@ namespace WAVM { namespace LLVMJIT {
 	extern std::vector<U8> compileLLVMModule(LLVMContext& llvmContext,
 											 llvm::Module&& llvmModule,
 											 bool shouldLogMetrics,
-											 llvm::TargetMachine* targetMachine);
+											 llvm::TargetMachine* targetMachine,
+											 OptLevel optLevel = OptLevel::O1);
+
+	// The state used to recompile the functions of a module compiled by the baseline tier, or to
+	// compile the functions of a module compiled with lazy stubs.
+	struct TierUpState
+	{
+		Platform::Mutex mutex;
+
+		// Serializes lazy compilation, so a function that is called on several threads before it
+		// is compiled is only compiled once.
+		Platform::Mutex lazyCompileMutex;
+
+		// The module the state belongs to, or null if the module has been unloaded.
+		Module* module;
+
+		const std::shared_ptr<const IR::Module> irModule;
+		const HashMap<std::string, Uptr> importedSymbolMap;
+
+		// The optimization level to recompile the module's functions at, and whether they are
+		// recompiled with CompileOptions::interruptible, meterFuel, and boundsCheckMemories.
+		const OptLevel optLevel;
+		const bool isInterruptible;
+		const bool meterFuel;
+		const bool boundsCheckMemories;
+
+		// The modules containing the optimized or lazily compiled code for the module's functions.
+		std::vector<std::unique_ptr<Module>> optimizedModules;
+
+		TierUpState(Module* inModule,
+					std::shared_ptr<const IR::Module>&& inIRModule,
+					const HashMap<std::string, Uptr>& inImportedSymbolMap,
+					OptLevel inOptLevel,
+					bool inIsInterruptible,
+					bool inMeterFuel,
+					bool inBoundsCheckMemories)
+		: module(inModule)
+		, irModule(std::move(inIRModule))
+		, importedSymbolMap(inImportedSymbolMap)
+		, optLevel(inOptLevel)
+		, isInterruptible(inIsInterruptible)
+		, meterFuel(inMeterFuel)
+		, boundsCheckMemories(inBoundsCheckMemories)
+		{
+		}
+	};
+
+	// Called when a module compiled by the baseline tier is unloaded to discard its pending
+	// recompilation requests and free its optimized code.
+	void detachTierUpState(TierUpState& tierUpState);
+
+	// Returns a thunk with the same signature as the shared code for a function definition of the
+	// given type, that passes the Runtime::Function in its nest parameter and the function's
+	// arguments to interpreterEntry. The thunks are cached, so each type is only compiled once.
+	Runtime::Function* getInterpreterThunk(IR::FunctionType functionType,
+										   Runtime::InvokeThunkPointer interpreterEntry);
 
 	extern void processSEHTables(U8* imageBase,
 								 const llvm::LoadedObjectInfo& loadedObject,
@@ -1,6 +1,8 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -13,6 +15,7 @@
 #include "WAVM/IR/Types.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/ConcurrentIntervalMap.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Hash.h"
 #include "WAVM/Inline/HashMap.h"
@@ -65,61 +68,72 @@ using namespace WAVM::LLVMJIT;
 static Platform::Mutex gdbRegistrationListenerMutex;
 static llvm::JITEventListener* gdbRegistrationListener = nullptr;
 
-// A map from address to loaded JIT symbols.
-static Platform::Mutex addressToModuleMapMutex;
-static std::map<Uptr, LLVMJIT::Module*> addressToModuleMap;
+// Whether the images of objects loaded by ModuleMemoryManager are backed by huge pages.
+static std::atomic<bool> useHugePagesForCode{false};
 
-// Allocates memory for the LLVM object loader.
+// A map from the address ranges of loaded JIT code to the modules that contain them.
+static ConcurrentIntervalMap<LLVMJIT::Module*> codeAddressToModuleMap;
+
+// The function that is called with each address range of JIT code before it is unloaded.
+static std::atomic<CodeUnloadCallback> codeUnloadCallback{nullptr};
+
+static void notifyCodeUnload(Uptr beginAddress, Uptr endAddress)
+{
+	CodeUnloadCallback callback = codeUnloadCallback.load(std::memory_order_acquire);
+	if(callback) { (*callback)(beginAddress, endAddress); }
+}
+
+static void sortFunctionCodeRanges(std::vector<LLVMJIT::Module::FunctionCodeRange>& ranges)
+{
+	std::sort(ranges.begin(),
+			  ranges.end(),
+			  [](const LLVMJIT::Module::FunctionCodeRange& left,
+				 const LLVMJIT::Module::FunctionCodeRange& right) {
+				  return left.codeEndAddress < right.codeEndAddress;
+			  });
+}
+
+// Allocates memory for the LLVM object loader. Each object loaded by the memory manager is
+// allocated its own image of contiguous code, read-only, and read-write pages.
 struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 {
-	ModuleMemoryManager()
-	: imageBaseAddress(nullptr)
-	, isFinalized(false)
-	, codeSection({nullptr, 0, 0})
-	, readOnlySection({nullptr, 0, 0})
-	, readWriteSection({nullptr, 0, 0})
-	, hasRegisteredEHFrames(false)
-	{
-	}
+	ModuleMemoryManager() : isFinalized(false) {}
 	virtual ~ModuleMemoryManager() override
 	{
 		// Deregister the exception handling frame info.
 		deregisterEHFrames();
 
-		if(!KEEP_UNLOADED_MODULE_ADDRESSES_RESERVED)
-		{ Platform::freeVirtualPages(imageBaseAddress, numAllocatedImagePages); }
-		else
+		for(const Image& image : images)
 		{
-			// Decommit the image pages, but leave them reserved to catch any references to them
-			// that might erroneously remain.
-			Platform::decommitVirtualPages(imageBaseAddress, numAllocatedImagePages);
+			if(!KEEP_UNLOADED_MODULE_ADDRESSES_RESERVED)
+			{
+				Platform::freeAlignedVirtualPages(
+					image.unalignedBaseAddress, image.numPages, image.alignmentLog2);
+			}
+			else
+			{
+				// Decommit the image pages, but leave them reserved to catch any references to
+				// them that might erroneously remain.
+				Platform::decommitVirtualPages(image.baseAddress, image.numPages);
+			}
 		}
 	}
 
 	void registerEHFrames(U8* addr, U64 loadAddr, uintptr_t numBytes) override
 	{
-		if(!USE_WINDOWS_SEH)
-		{
-			Platform::registerEHFrames(imageBaseAddress, addr, numBytes);
-			hasRegisteredEHFrames = true;
-			ehFramesAddr = addr;
-			ehFramesNumBytes = numBytes;
-		}
+		if(!USE_WINDOWS_SEH) { registerFixedSEHFrames(addr, numBytes); }
 	}
 	void registerFixedSEHFrames(U8* addr, Uptr numBytes)
 	{
-		Platform::registerEHFrames(imageBaseAddress, addr, numBytes);
-		hasRegisteredEHFrames = true;
-		ehFramesAddr = addr;
-		ehFramesNumBytes = numBytes;
+		WAVM_ASSERT(images.size());
+		Platform::registerEHFrames(images.back().baseAddress, addr, numBytes);
+		ehFrames.push_back({images.back().baseAddress, addr, numBytes});
 	}
 	void deregisterEHFrames() override
 	{
-		if(hasRegisteredEHFrames)
-		{
-			hasRegisteredEHFrames = false;
-			Platform::deregisterEHFrames(imageBaseAddress, ehFramesAddr, ehFramesNumBytes);
-		}
+		for(const EHFrames& frames : ehFrames)
+		{ Platform::deregisterEHFrames(frames.imageBaseAddress, frames.addr, frames.numBytes); }
+		ehFrames.clear();
 	}
 
 	virtual bool needsToReserveAllocationSpace() override { return true; }
@@ -130,6 +144,8 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 										uintptr_t numReadWriteBytes,
 										U32 readWriteAlignment) override
 	{
+		WAVM_ASSERT(!isFinalized);
+
 		if(USE_WINDOWS_SEH)
 		{
 			// Pad the code section to allow for the SEH trampoline.
@@ -137,34 +153,56 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 		}
 
 		// Calculate the number of pages to be used by each section.
-		codeSection.numPages = shrAndRoundUp(numCodeBytes, Platform::getBytesPerPageLog2());
-		readOnlySection.numPages = shrAndRoundUp(numReadOnlyBytes, Platform::getBytesPerPageLog2());
-		readWriteSection.numPages
+		Image image;
+		image.baseAddress = nullptr;
+		image.unalignedBaseAddress = nullptr;
+		image.alignmentLog2 = Platform::getBytesPerPageLog2();
+		image.codeSection = {nullptr, 0, 0};
+		image.readOnlySection = {nullptr, 0, 0};
+		image.readWriteSection = {nullptr, 0, 0};
+		image.codeSection.numPages = shrAndRoundUp(numCodeBytes, Platform::getBytesPerPageLog2());
+		image.readOnlySection.numPages
+			= shrAndRoundUp(numReadOnlyBytes, Platform::getBytesPerPageLog2());
+		image.readWriteSection.numPages
 			= shrAndRoundUp(numReadWriteBytes, Platform::getBytesPerPageLog2());
-		numAllocatedImagePages
-			= codeSection.numPages + readOnlySection.numPages + readWriteSection.numPages;
-		if(numAllocatedImagePages)
+		image.numPages = image.codeSection.numPages + image.readOnlySection.numPages
+						 + image.readWriteSection.numPages;
+		if(image.numPages)
 		{
+			// If huge pages are enabled for code, and the image is at least as large as a huge
+			// page, align the image to a huge page so it can be backed by huge pages.
+			const Uptr hugePageBytesLog2 = Platform::getBytesPerHugePageLog2();
+			const Uptr pagesPerHugePageLog2 = hugePageBytesLog2 - Platform::getBytesPerPageLog2();
+			const bool useHugePages = hugePageBytesLog2
+									  && useHugePagesForCode.load(std::memory_order_relaxed)
+									  && image.numPages >= Uptr(1) << pagesPerHugePageLog2;
+			if(useHugePages) { image.alignmentLog2 = hugePageBytesLog2; }
+
 			// Reserve enough contiguous pages for all sections.
-			imageBaseAddress = Platform::allocateVirtualPages(numAllocatedImagePages);
-			if(!imageBaseAddress
-			   || !Platform::commitVirtualPages(imageBaseAddress, numAllocatedImagePages))
+			image.baseAddress = Platform::allocateAlignedVirtualPages(
+				image.numPages, image.alignmentLog2, image.unalignedBaseAddress);
+			if(!image.baseAddress
+			   || !Platform::commitVirtualPages(image.baseAddress, image.numPages))
 			{ Errors::fatal("memory allocation for JIT code failed"); }
-			codeSection.baseAddress = imageBaseAddress;
-			readOnlySection.baseAddress
-				= codeSection.baseAddress
-				  + (codeSection.numPages << Platform::getBytesPerPageLog2());
-			readWriteSection.baseAddress
-				= readOnlySection.baseAddress
-				  + (readOnlySection.numPages << Platform::getBytesPerPageLog2());
+			if(useHugePages)
+			{ Platform::adviseHugeVirtualPages(image.baseAddress, image.numPages, true); }
+			image.codeSection.baseAddress = image.baseAddress;
+			image.readOnlySection.baseAddress
+				= image.codeSection.baseAddress
+				  + (image.codeSection.numPages << Platform::getBytesPerPageLog2());
+			image.readWriteSection.baseAddress
+				= image.readOnlySection.baseAddress
+				  + (image.readOnlySection.numPages << Platform::getBytesPerPageLog2());
 		}
+		images.push_back(image);
 	}
 	virtual U8* allocateCodeSection(uintptr_t numBytes,
 									U32 alignment,
 									U32 sectionID,
 									llvm::StringRef sectionName) override
 	{
-		return allocateBytes((Uptr)numBytes, alignment, codeSection);
+		WAVM_ASSERT(images.size());
+		return allocateBytes((Uptr)numBytes, alignment, images.back().codeSection);
 	}
 	virtual U8* allocateDataSection(uintptr_t numBytes,
 									U32 alignment,
@@ -172,8 +210,11 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 									llvm::StringRef SectionName,
 									bool isReadOnly) override
 	{
-		return allocateBytes(
-			(Uptr)numBytes, alignment, isReadOnly ? readOnlySection : readWriteSection);
+		WAVM_ASSERT(images.size());
+		return allocateBytes((Uptr)numBytes,
+							 alignment,
+							 isReadOnly ? images.back().readOnlySection
+										: images.back().readWriteSection);
 	}
 	virtual bool finalizeMemory(std::string* ErrMsg = nullptr) override
 	{
@@ -187,22 +228,27 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 		WAVM_ASSERT(!isFinalized);
 		isFinalized = true;
 		const Platform::MemoryAccess codeAccess = Platform::MemoryAccess::execute;
-		if(codeSection.numPages)
-		{
-			WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(
-				codeSection.baseAddress, codeSection.numPages, codeAccess));
-		}
-		if(readOnlySection.numPages)
+		for(const Image& image : images)
 		{
-			WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(readOnlySection.baseAddress,
-															 readOnlySection.numPages,
-															 Platform::MemoryAccess::readOnly));
-		}
-		if(readWriteSection.numPages)
-		{
-			WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(readWriteSection.baseAddress,
-															 readWriteSection.numPages,
-															 Platform::MemoryAccess::readWrite));
+			if(image.codeSection.numPages)
+			{
+				WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(
+					image.codeSection.baseAddress, image.codeSection.numPages, codeAccess));
+			}
+			if(image.readOnlySection.numPages)
+			{
+				WAVM_ERROR_UNLESS(
+					Platform::setVirtualPageAccess(image.readOnlySection.baseAddress,
+												   image.readOnlySection.numPages,
+												   Platform::MemoryAccess::readOnly));
+			}
+			if(image.readWriteSection.numPages)
+			{
+				WAVM_ERROR_UNLESS(
+					Platform::setVirtualPageAccess(image.readWriteSection.baseAddress,
+												   image.readWriteSection.numPages,
+												   Platform::MemoryAccess::readWrite));
+			}
 		}
 
 		// Invalidate the instruction cache.
@@ -210,15 +256,19 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 	}
 	virtual void invalidateInstructionCache()
 	{
-		// Invalidate the instruction cache for the whole image.
-		llvm::sys::Memory::InvalidateInstructionCache(
-			imageBaseAddress, numAllocatedImagePages << Platform::getBytesPerPageLog2());
+		// Invalidate the instruction cache for all the images.
+		for(const Image& image : images)
+		{
+			llvm::sys::Memory::InvalidateInstructionCache(
+				image.baseAddress, image.numPages << Platform::getBytesPerPageLog2());
+		}
 	}
 
-	U8* getImageBaseAddress() const { return imageBaseAddress; }
-	Uptr getNumImageBytes() const
+	Uptr getNumImages() const { return images.size(); }
+	U8* getImageBaseAddress(Uptr imageIndex) const { return images[imageIndex].baseAddress; }
+	Uptr getNumImageBytes(Uptr imageIndex) const
 	{
-		return numAllocatedImagePages << Platform::getBytesPerPageLog2();
+		return images[imageIndex].numPages << Platform::getBytesPerPageLog2();
 	}
 
 private:
@@ -229,17 +279,32 @@ private:
 		Uptr numCommittedBytes;
 	};
 
-	U8* imageBaseAddress;
-	Uptr numAllocatedImagePages;
-	bool isFinalized;
+	struct Image
+	{
+		U8* baseAddress;
+		Uptr numPages;
 
-	Section codeSection;
-	Section readOnlySection;
-	Section readWriteSection;
+		// The address returned by Platform::allocateAlignedVirtualPages, and the alignment the
+		// image was allocated with.
+		U8* unalignedBaseAddress;
+		Uptr alignmentLog2;
 
-	bool hasRegisteredEHFrames;
-	const U8* ehFramesAddr;
-	Uptr ehFramesNumBytes;
+		Section codeSection;
+		Section readOnlySection;
+		Section readWriteSection;
+	};
+
+	struct EHFrames
+	{
+		const U8* imageBaseAddress;
+		const U8* addr;
+		Uptr numBytes;
+	};
+
+	std::vector<Image> images;
+	bool isFinalized;
+
+	std::vector<EHFrames> ehFrames;
 
 	U8* allocateBytes(Uptr numBytes, Uptr alignment, Section& section)
 	{
@@ -306,6 +371,43 @@ static void disassembleFunction(U8* bytes, Uptr numBytes)
 	LLVMDisasmDispose(disasmRef);
 }
 
+// Splits object code into the objects it contains: either a single object file, or the objects for
+// each shard of a module that was compiled in multiple shards.
+static std::vector<llvm::StringRef> getObjects(const std::vector<U8>& objectBytes)
+{
+	U64 magic = 0;
+	if(objectBytes.size() >= sizeof(U64)) { memcpy(&magic, objectBytes.data(), sizeof(U64)); }
+	if(magic != shardedObjectMagic)
+	{
+		return {llvm::StringRef((const char*)objectBytes.data(), objectBytes.size())};
+	}
+
+	U64 numObjects = 0;
+	WAVM_ERROR_UNLESS(objectBytes.size() >= 2 * sizeof(U64));
+	memcpy(&numObjects, objectBytes.data() + sizeof(U64), sizeof(U64));
+	WAVM_ERROR_UNLESS(numObjects <= (objectBytes.size() - 2 * sizeof(U64)) / sizeof(U64));
+
+	std::vector<llvm::StringRef> objects;
+	Uptr offset = Uptr(2 + numObjects) * sizeof(U64);
+	for(Uptr objectIndex = 0; objectIndex < numObjects; ++objectIndex)
+	{
+		U64 numObjectBytes = 0;
+		memcpy(&numObjectBytes,
+			   objectBytes.data() + (2 + objectIndex) * sizeof(U64),
+			   sizeof(U64));
+
+		offset = (offset + 15) & ~Uptr(15);
+		WAVM_ERROR_UNLESS(offset <= objectBytes.size()
+						  && numObjectBytes <= objectBytes.size() - offset);
+		objects.push_back(
+			llvm::StringRef((const char*)objectBytes.data() + offset, Uptr(numObjectBytes)));
+		offset += Uptr(numObjectBytes);
+	}
+	return objects;
+}
+
+static std::atomic<U64> nextGDBObjectKey{1};
+
 Module::Module(const std::vector<U8>& objectBytes,
 			   const HashMap<std::string, Uptr>& importedSymbolMap,
 			   bool shouldLogMetrics)
@@ -317,11 +419,15 @@ Module::Module(const std::vector<U8>& objectBytes,
 	Timing::Timer loadObjectTimer;
 
 #if LLVM_VERSION_MAJOR >= 8
-	std::unique_ptr<llvm::object::ObjectFile> object;
+	std::vector<std::unique_ptr<llvm::object::ObjectFile>> objects;
 #endif
 
-	object = cantFail(llvm::object::ObjectFile::createObjectFile(llvm::MemoryBufferRef(
-		llvm::StringRef((const char*)objectBytes.data(), objectBytes.size()), "memory")));
+	for(llvm::StringRef objectBuffer : getObjects(objectBytes))
+	{
+		objects.push_back(cantFail(llvm::object::ObjectFile::createObjectFile(
+			llvm::MemoryBufferRef(objectBuffer, "memory"))));
+	}
+	WAVM_ASSERT(objects.size());
 
 	// Create the LLVM object loader.
 	struct SymbolResolver : llvm::JITSymbolResolver
@@ -405,7 +511,10 @@ Module::Module(const std::vector<U8>& objectBytes,
 	U8* xdataCopy = nullptr;
 	if(USE_WINDOWS_SEH)
 	{
-		for(auto section : object->sections())
+		// Modules compiled for Windows are never split into multiple objects, since the SEH
+		// tables are fixed up relative to a single object's image.
+		WAVM_ERROR_UNLESS(objects.size() == 1);
+		for(auto section : objects[0]->sections())
 		{
 			llvm::StringRef sectionName;
 			if(!section.getName(sectionName))
@@ -439,8 +548,11 @@ Module::Module(const std::vector<U8>& objectBytes,
 		}
 	}
 
-	// Use the LLVM object loader to load the object.
-	std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo> loadedObject = loader.loadObject(*object);
+	// Use the LLVM object loader to load the objects. Finalizing the loader after all the objects
+	// are loaded resolves references between them.
+	std::vector<std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo>> loadedObjects;
+	for(const std::unique_ptr<llvm::object::ObjectFile>& object : objects)
+	{ loadedObjects.push_back(loader.loadObject(*object)); }
 	loader.finalizeWithMemoryManagerLocking();
 	if(loader.hasError())
 	{ Errors::fatalf("RuntimeDyld failed: %s", loader.getErrorString().data()); }
@@ -460,8 +572,8 @@ Module::Module(const std::vector<U8>& objectBytes,
 		memset(trampolineBytes + 2, 0, 4);
 		memcpy(trampolineBytes + 6, &sehHandlerAddress, sizeof(U64));
 
-		processSEHTables(memoryManager->getImageBaseAddress(),
-						 *loadedObject,
+		processSEHTables(memoryManager->getImageBaseAddress(0),
+						 *loadedObjects[0],
 						 pdataSection,
 						 pdataCopy,
 						 pdataNumBytes,
@@ -470,7 +582,7 @@ Module::Module(const std::vector<U8>& objectBytes,
 						 reinterpret_cast<Uptr>(trampolineBytes));
 
 		memoryManager->registerFixedSEHFrames(
-			reinterpret_cast<U8*>(Uptr(loadedObject->getSectionLoadAddress(pdataSection))),
+			reinterpret_cast<U8*>(Uptr(loadedObjects[0]->getSectionLoadAddress(pdataSection))),
 			pdataNumBytes);
 	}
 
@@ -490,88 +602,135 @@ Module::Module(const std::vector<U8>& objectBytes,
 	// final non-writable memory permissions.
 	memoryManager->reallyFinalizeMemory();
 
-	// Notify GDB of the new object.
+	const bool shouldAddPerfMapEntries = isPerfMapEnabled();
+	std::vector<PerfMapEntry> perfMapEntries;
+	for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
 	{
-		Lock<Platform::Mutex> gdbRegistrationListenerLock(gdbRegistrationListenerMutex);
-		if(!gdbRegistrationListener)
-		{ gdbRegistrationListener = llvm::JITEventListener::createGDBRegistrationListener(); }
+		const llvm::object::ObjectFile& object = *objects[objectIndex];
+		const llvm::RuntimeDyld::LoadedObjectInfo& loadedObject = *loadedObjects[objectIndex];
+
+		// Notify GDB of the new object.
+		{
+			Lock<Platform::Mutex> gdbRegistrationListenerLock(gdbRegistrationListenerMutex);
+			if(!gdbRegistrationListener)
+			{ gdbRegistrationListener = llvm::JITEventListener::createGDBRegistrationListener(); }
+			gdbObjectKeys.push_back(nextGDBObjectKey++);
 #if LLVM_VERSION_MAJOR >= 8
-		gdbRegistrationListener->notifyObjectLoaded(
-			reinterpret_cast<Uptr>(this), *object, *loadedObject);
+			gdbRegistrationListener->notifyObjectLoaded(
+				gdbObjectKeys.back(), object, loadedObject);
 #else
-		gdbRegistrationListener->NotifyObjectEmitted(*object, *loadedObject);
+			gdbRegistrationListener->NotifyObjectEmitted(object, loadedObject);
 #endif
-	}
-
-	// Create a DWARF context to interpret the debug information in this compilation unit.
-	auto dwarfContext = llvm::DWARFContext::create(*object, &*loadedObject);
-
-	// Iterate over the functions in the loaded object.
-	for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
-		llvm::object::computeSymbolSizes(*object))
-	{
-		llvm::object::SymbolRef symbol = symbolSizePair.first;
-
-		// Only process global symbols, which excludes SEH funclets.
-		if(!(symbol.getFlags() & llvm::object::SymbolRef::SF_Global)) { continue; }
+		}
 
-		// Get the type, name, and address of the symbol. Need to be careful not to get the
-		// Expected<T> for each value unless it will be checked for success before continuing.
-		llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
-		if(!type || *type != llvm::object::SymbolRef::ST_Function) { continue; }
-		llvm::Expected<llvm::StringRef> name = symbol.getName();
-		if(!name) { continue; }
-		llvm::Expected<U64> address = symbol.getAddress();
-		if(!address) { continue; }
+		// Create a DWARF context to interpret the debug information in this compilation unit.
+		auto dwarfContext = llvm::DWARFContext::create(object, &loadedObject);
 
-		// Compute the address the function was loaded at.
-		WAVM_ASSERT(*address <= UINTPTR_MAX);
-		Uptr loadedAddress = Uptr(*address);
-		if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
-		{ loadedAddress += (Uptr)loadedObject->getSectionLoadAddress(*symbolSection.get()); }
+		// Iterate over the functions in the loaded object.
+		for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
+			llvm::object::computeSymbolSizes(object))
+		{
+			llvm::object::SymbolRef symbol = symbolSizePair.first;
+
+			// Only process global symbols defined by this object, which excludes SEH funclets and
+			// references to functions defined by the module's other objects.
+			const U32 symbolFlags = symbol.getFlags();
+			if(!(symbolFlags & llvm::object::SymbolRef::SF_Global)
+			   || (symbolFlags & llvm::object::SymbolRef::SF_Undefined))
+			{ continue; }
+
+			// Get the type, name, and address of the symbol. Need to be careful not to get the
+			// Expected<T> for each value unless it will be checked for success before continuing.
+			llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+			if(!type
+			   || (*type != llvm::object::SymbolRef::ST_Function
+				   && *type != llvm::object::SymbolRef::ST_Data))
+			{ continue; }
+			llvm::Expected<llvm::StringRef> name = symbol.getName();
+			if(!name) { continue; }
+			llvm::Expected<U64> address = symbol.getAddress();
+			if(!address) { continue; }
+
+			// Compute the address the function was loaded at.
+			WAVM_ASSERT(*address <= UINTPTR_MAX);
+			Uptr loadedAddress = Uptr(*address);
+			if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
+			{ loadedAddress += (Uptr)loadedObject.getSectionLoadAddress(*symbolSection.get()); }
+
+			// The only data symbols that are used are the profile counters of instrumented code.
+			if(*type == llvm::object::SymbolRef::ST_Data)
+			{
+				if(name->startswith(mangleSymbol("functionDefProfileCounters")))
+				{
+					nameToProfileCountersMap.addOrFail(
+						name->str(),
+						ProfileCounters{reinterpret_cast<U64*>(loadedAddress),
+										Uptr(symbolSizePair.second / sizeof(U64))});
+				}
+				continue;
+			}
 
-		// Get the DWARF line info for this symbol, which maps machine code addresses to
-		// WebAssembly op indices.
+			// Get the DWARF line info for this symbol, which maps machine code addresses to
+			// WebAssembly op indices.
 #if LLVM_VERSION_MAJOR >= 9
-		llvm::Expected<llvm::object::section_iterator> section = symbol.getSection();
-		if(!section) { continue; }
-		llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(
-			llvm::object::SectionedAddress{loadedAddress, section.get()->getIndex()},
-			symbolSizePair.second);
+			llvm::Expected<llvm::object::section_iterator> section = symbol.getSection();
+			if(!section) { continue; }
+			llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(
+				llvm::object::SectionedAddress{loadedAddress, section.get()->getIndex()},
+				symbolSizePair.second);
 #else
-		llvm::DILineInfoTable lineInfoTable
-			= dwarfContext->getLineInfoForAddressRange(loadedAddress, symbolSizePair.second);
+			llvm::DILineInfoTable lineInfoTable
+				= dwarfContext->getLineInfoForAddressRange(loadedAddress, symbolSizePair.second);
 #endif
-		std::map<U32, U32> offsetToOpIndexMap;
-		for(auto lineInfo : lineInfoTable)
-		{ offsetToOpIndexMap.emplace(U32(lineInfo.first - loadedAddress), lineInfo.second.Line); }
-
-		if(PRINT_DISASSEMBLY && shouldLogMetrics)
-		{
-			Log::printf(Log::output, "Disassembly for function %s\n", name.get().data());
-			disassembleFunction(reinterpret_cast<U8*>(loadedAddress), Uptr(symbolSizePair.second));
-		}
+			std::map<U32, U32> offsetToOpIndexMap;
+			for(auto lineInfo : lineInfoTable)
+			{
+				offsetToOpIndexMap.emplace(U32(lineInfo.first - loadedAddress),
+										   lineInfo.second.Line);
+			}
 
-		// Add the function to the module's name and address to function maps.
-		WAVM_ASSERT(symbolSizePair.second <= UINTPTR_MAX);
-		Runtime::Function* function
-			= (Runtime::Function*)(loadedAddress - offsetof(Runtime::Function, code));
-		nameToFunctionMap.addOrFail(*name, function);
-		addressToFunctionMap.emplace(Uptr(loadedAddress + symbolSizePair.second), function);
+			if(PRINT_DISASSEMBLY && shouldLogMetrics)
+			{
+				Log::printf(Log::output, "Disassembly for function %s\n", name.get().data());
+				disassembleFunction(reinterpret_cast<U8*>(loadedAddress),
+									Uptr(symbolSizePair.second));
+			}
 
-		// Initialize the function mutable data.
-		WAVM_ASSERT(function->mutableData);
-		function->mutableData->jitModule = this;
-		function->mutableData->function = function;
-		function->mutableData->numCodeBytes = Uptr(symbolSizePair.second);
-		function->mutableData->offsetToOpIndexMap = std::move(std::move(offsetToOpIndexMap));
+			// Add the function to the module's name and address to function maps.
+			WAVM_ASSERT(symbolSizePair.second <= UINTPTR_MAX);
+			Runtime::Function* function
+				= (Runtime::Function*)(loadedAddress - offsetof(Runtime::Function, code));
+			nameToFunctionMap.addOrFail(*name, function);
+			functionCodeRanges.push_back({Uptr(loadedAddress + symbolSizePair.second), function});
+
+			// Initialize the function mutable data.
+			WAVM_ASSERT(function->mutableData);
+			function->mutableData->jitModule = this;
+			function->mutableData->function = function;
+			function->mutableData->numCodeBytes = Uptr(symbolSizePair.second);
+			function->mutableData->offsetToOpIndexMap = std::move(std::move(offsetToOpIndexMap));
+
+			if(shouldAddPerfMapEntries)
+			{
+				perfMapEntries.push_back(
+					{loadedAddress, Uptr(symbolSizePair.second), function->mutableData->debugName});
+			}
+		}
 	}
+	addPerfMapEntries(perfMapEntries);
+	sortFunctionCodeRanges(functionCodeRanges);
 
-	const Uptr moduleEndAddress = reinterpret_cast<Uptr>(memoryManager->getImageBaseAddress()
-														 + memoryManager->getNumImageBytes());
+	// Add the module's images to the global address to module map.
+	for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
 	{
-		Lock<Platform::Mutex> addressToModuleMapLock(addressToModuleMapMutex);
-		addressToModuleMap.emplace(moduleEndAddress, this);
+		if(memoryManager->getNumImageBytes(imageIndex))
+		{
+			const Uptr imageBaseAddress
+				= reinterpret_cast<Uptr>(memoryManager->getImageBaseAddress(imageIndex));
+			const Uptr imageEndAddress
+				= imageBaseAddress + memoryManager->getNumImageBytes(imageIndex);
+			codeAddressToModuleMap.addOrFail(imageBaseAddress, imageEndAddress, this);
+		}
 	}
 
 	if(shouldLogMetrics)
@@ -581,25 +740,185 @@ Module::Module(const std::vector<U8>& objectBytes,
 	}
 }
 
+// The machine code for a stub that calls a function definition's shared code with the address of
+// a module instance's binding table:
+//   mov r10, <binding table address>
+//   mov r11, <shared code address>
+//   jmp r11
+// The shared code takes the binding table in its nest parameter, which is passed in r10. r11 is
+// used for the jump because the wasm calling convention doesn't use it to pass arguments.
+static constexpr U8 stubCodeTemplate[]
+	= {0x49, 0xBA, 0, 0, 0, 0, 0, 0, 0, 0, 0x49, 0xBB, 0, 0, 0, 0, 0, 0, 0, 0, 0x41, 0xFF, 0xE3};
+static constexpr Uptr stubBindingTableOffset = 2;
+static constexpr Uptr stubSharedCodeOffset = 12;
+static constexpr Uptr numStubBytes = 64;
+static_assert(offsetof(Runtime::Function, code) + sizeof(stubCodeTemplate) <= numStubBytes,
+			  "Function stub doesn't fit in numStubBytes");
+
+Module::Module(const std::shared_ptr<Module>& inLoadedModule,
+			   std::vector<Uptr>&& inBindingTable,
+			   Uptr firstFunctionDefSlot,
+			   const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas)
+: memoryManager(nullptr), loadedModule(inLoadedModule), bindingTable(std::move(inBindingTable))
+{
+	const Uptr numFunctionDefs = functionDefMutableDatas.size();
+	WAVM_ASSERT(firstFunctionDefSlot + numFunctionDefs <= bindingTable.size());
+
+	std::vector<const Runtime::Function*> targetFunctions;
+	for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionDefs; ++functionDefIndex)
+	{
+		Runtime::Function** sharedFunction = loadedModule->nameToFunctionMap.get(
+			mangleSymbol(getExternalName("functionDef", functionDefIndex)));
+		WAVM_ERROR_UNLESS(sharedFunction);
+		targetFunctions.push_back(*sharedFunction);
+	}
+
+	createStubs(bindingTable[BindingTableLayout::moduleInstanceIdSlot],
+				targetFunctions,
+				functionDefMutableDatas);
+
+	// Bind the function definitions' slots in the binding table to their stubs.
+	for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionDefs; ++functionDefIndex)
+	{
+		bindingTable[firstFunctionDefSlot + functionDefIndex]
+			= reinterpret_cast<Uptr>(functionDefMutableDatas[functionDefIndex]->function);
+	}
+}
+
+Module::Module(Uptr moduleInstanceId,
+			   const std::vector<const Runtime::Function*>& targetFunctions,
+			   const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas)
+: memoryManager(nullptr)
+{
+	createStubs(moduleInstanceId, targetFunctions, functionDefMutableDatas);
+}
+
+void Module::createStubs(Uptr moduleInstanceId,
+						 const std::vector<const Runtime::Function*>& targetFunctions,
+						 const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas)
+{
+	const Uptr numFunctionDefs = functionDefMutableDatas.size();
+	WAVM_ASSERT(targetFunctions.size() == numFunctionDefs);
+	if(!numFunctionDefs) { return; }
+
+	// Allocate executable pages for the stubs.
+	numStubPages = (numFunctionDefs * numStubBytes + Platform::getBytesPerPage() - 1)
+				   >> Platform::getBytesPerPageLog2();
+	stubPages = Platform::allocateVirtualPages(numStubPages);
+	if(!stubPages || !Platform::commitVirtualPages(stubPages, numStubPages))
+	{ Errors::fatal("memory allocation for function stubs failed"); }
+
+	const bool shouldAddPerfMapEntries = isPerfMapEnabled();
+	std::vector<PerfMapEntry> perfMapEntries;
+	for(Uptr functionDefIndex = 0; functionDefIndex < numFunctionDefs; ++functionDefIndex)
+	{
+		const Runtime::Function* targetFunction = targetFunctions[functionDefIndex];
+
+		// Create the stub's Runtime::Function, followed by its code.
+		U8* stubBytes = stubPages + functionDefIndex * numStubBytes;
+		memset(stubBytes, 0xcc, numStubBytes);
+		Runtime::FunctionMutableData* functionMutableData
+			= functionDefMutableDatas[functionDefIndex];
+		Runtime::Function* function = new(stubBytes)
+			Runtime::Function(functionMutableData, moduleInstanceId, targetFunction->encodedType);
+
+		// If this is an instance of a loaded module, the stub passes the address of the binding
+		// table to the shared code. Otherwise, it passes the address of its own Runtime::Function.
+		U8* stubCode = stubBytes + offsetof(Runtime::Function, code);
+		const Uptr nestValue = bindingTable.size() ? reinterpret_cast<Uptr>(bindingTable.data())
+												   : reinterpret_cast<Uptr>(function);
+		const Uptr targetCodeAddress = reinterpret_cast<Uptr>(targetFunction->code);
+		memcpy(stubCode, stubCodeTemplate, sizeof(stubCodeTemplate));
+		memcpy(stubCode + stubBindingTableOffset, &nestValue, sizeof(Uptr));
+		memcpy(stubCode + stubSharedCodeOffset, &targetCodeAddress, sizeof(Uptr));
+
+		nameToFunctionMap.addOrFail(mangleSymbol(getExternalName("functionDef", functionDefIndex)),
+									function);
+		functionCodeRanges.push_back({Uptr(stubCode + sizeof(stubCodeTemplate)), function});
+
+		// Initialize the function mutable data. The stub doesn't have any line info, but the
+		// shared code's line info is available through the loaded module's Runtime::Function.
+		WAVM_ASSERT(functionMutableData);
+		functionMutableData->jitModule = this;
+		functionMutableData->function = function;
+		functionMutableData->numCodeBytes = sizeof(stubCodeTemplate);
+
+		if(shouldAddPerfMapEntries)
+		{
+			perfMapEntries.push_back({reinterpret_cast<Uptr>(stubCode),
+									  sizeof(stubCodeTemplate),
+									  "stub!" + functionMutableData->debugName});
+		}
+	}
+	addPerfMapEntries(perfMapEntries);
+
+	// Make the stubs executable.
+	if(!Platform::setVirtualPageAccess(stubPages, numStubPages, Platform::MemoryAccess::execute))
+	{ Errors::fatal("failed to make function stubs executable"); }
+
+	// Add the stubs to the global address to module map. The stubs are allocated in order, so
+	// functionCodeRanges is already sorted.
+	codeAddressToModuleMap.addOrFail(
+		reinterpret_cast<Uptr>(stubPages),
+		reinterpret_cast<Uptr>(stubPages + (numStubPages << Platform::getBytesPerPageLog2())),
+		this);
+}
+
 Module::~Module()
 {
-	// Notify GDB that the object is being unloaded.
+	// If this is an instance of a loaded module, free its stubs and their FunctionMutableData
+	// objects. The loaded module is freed when its last instance is.
+	if(!memoryManager)
+	{
+		if(stubPages)
+		{
+			// Let the stubs be looked up by the unload callback before they are removed.
+			const Uptr stubBaseAddress = reinterpret_cast<Uptr>(stubPages);
+			notifyCodeUnload(stubBaseAddress,
+							 stubBaseAddress + (numStubPages << Platform::getBytesPerPageLog2()));
+			codeAddressToModuleMap.removeOrFail(reinterpret_cast<Uptr>(stubPages));
+		}
+
+		for(const FunctionCodeRange& range : functionCodeRanges)
+		{ delete range.function->mutableData; }
+
+		if(stubPages) { Platform::freeVirtualPages(stubPages, numStubPages); }
+		return;
+	}
+
+	// Stop the background compiler from installing optimized code in the module's functions, and
+	// free the optimized code that was already compiled.
+	if(tierUpState) { detachTierUpState(*tierUpState); }
+
+	// Notify GDB that the objects are being unloaded.
 	{
 		Lock<Platform::Mutex> gdbRegistrationListenerLock(gdbRegistrationListenerMutex);
 #if LLVM_VERSION_MAJOR >= 8
-		gdbRegistrationListener->notifyFreeingObject(reinterpret_cast<Uptr>(this));
+		for(U64 gdbObjectKey : gdbObjectKeys)
+		{ gdbRegistrationListener->notifyFreeingObject(gdbObjectKey); }
 #else
-		gdbRegistrationListener->NotifyFreeingObject(*object);
+		for(const std::unique_ptr<llvm::object::ObjectFile>& object : objects)
+		{ gdbRegistrationListener->NotifyFreeingObject(*object); }
 #endif
 	}
 
-	// Remove the module from the global address to module map.
-	Lock<Platform::Mutex> addressToModuleMapLock(addressToModuleMapMutex);
-	addressToModuleMap.erase(addressToModuleMap.find(reinterpret_cast<Uptr>(
-		memoryManager->getImageBaseAddress() + memoryManager->getNumImageBytes())));
+	// Remove the module's images from the global address to module map, after letting them be
+	// looked up by the unload callback.
+	for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+	{
+		if(memoryManager->getNumImageBytes(imageIndex))
+		{
+			const Uptr imageBaseAddress
+				= reinterpret_cast<Uptr>(memoryManager->getImageBaseAddress(imageIndex));
+			notifyCodeUnload(imageBaseAddress,
+							 imageBaseAddress + memoryManager->getNumImageBytes(imageIndex));
+			codeAddressToModuleMap.removeOrFail(imageBaseAddress);
+		}
+	}
 
 	// Free the FunctionMutableData objects.
-	for(const auto& pair : addressToFunctionMap) { delete pair.second->mutableData; }
+	for(const FunctionCodeRange& range : functionCodeRanges)
+	{ delete range.function->mutableData; }
 
 	// Delete the memory manager.
 	delete memoryManager;
@@ -609,14 +928,13 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 	const std::vector<U8>& objectFileBytes,
 	HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
 	std::vector<IR::FunctionType>&& types,
-	std::vector<FunctionBinding>&& functionImports,
-	std::vector<TableBinding>&& tables,
-	std::vector<MemoryBinding>&& memories,
-	std::vector<GlobalBinding>&& globals,
-	std::vector<ExceptionTypeBinding>&& exceptionTypes,
-	ModuleInstanceBinding moduleInstance,
 	Uptr tableReferenceBias,
-	const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas)
+	const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas,
+	std::shared_ptr<const IR::Module> tierUpIRModule,
+	OptLevel tierUpOptLevel,
+	bool tierUpInterruptible,
+	bool tierUpMeterFuel,
+	bool tierUpBoundsCheckMemories)
 {
 	// Bind undefined symbols in the compiled object to values.
 	HashMap<std::string, Uptr> importedSymbolMap;
@@ -637,60 +955,7 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 									types[typeIndex].getEncoding().impl);
 	}
 
-	// Bind imported function symbols.
-	for(Uptr importIndex = 0; importIndex < functionImports.size(); ++importIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("functionImport", importIndex),
-									reinterpret_cast<Uptr>(functionImports[importIndex].code));
-	}
-
-	// Bind the table symbols. The compiled module uses the symbol's value as an offset into
-	// CompartmentRuntimeData to the table's entry in CompartmentRuntimeData::tableBases.
-	for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("tableOffset", tableIndex),
-									offsetof(Runtime::CompartmentRuntimeData, tableBases)
-										+ sizeof(void*) * tables[tableIndex].id);
-	}
-
-	// Bind the memory symbols. The compiled module uses the symbol's value as an offset into
-	// CompartmentRuntimeData to the memory's entry in CompartmentRuntimeData::memoryBases.
-	for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("memoryOffset", memoryIndex),
-									offsetof(Runtime::CompartmentRuntimeData, memoryBases)
-										+ sizeof(void*) * memories[memoryIndex].id);
-	}
-
-	// Bind the globals symbols.
-	for(Uptr globalIndex = 0; globalIndex < globals.size(); ++globalIndex)
-	{
-		const GlobalBinding& globalSpec = globals[globalIndex];
-		Uptr value;
-		if(globalSpec.type.isMutable)
-		{
-			// If the global is mutable, bind the symbol to the offset into
-			// ContextRuntimeData::globalData where it is stored.
-			value = offsetof(Runtime::ContextRuntimeData, mutableGlobals)
-					+ globalSpec.mutableGlobalIndex * sizeof(IR::UntaggedValue);
-		}
-		else
-		{
-			// Otherwise, bind the symbol to a pointer to the global's immutable value.
-			value = reinterpret_cast<Uptr>(globalSpec.immutableValuePointer);
-		}
-		importedSymbolMap.addOrFail(getExternalName("global", globalIndex), value);
-	}
-
-	// Bind exception type symbols to point to the exception type instance.
-	for(Uptr exceptionTypeIndex = 0; exceptionTypeIndex < exceptionTypes.size();
-		++exceptionTypeIndex)
-	{
-		importedSymbolMap.addOrFail(getExternalName("biasedExceptionTypeId", exceptionTypeIndex),
-									exceptionTypes[exceptionTypeIndex].id + 1);
-	}
-
-	// Allocate FunctionMutableData objects for each function def, and bind them to the symbols
+	// Bind the FunctionMutableData objects for the shared code of each function def to the symbols
 	// imported by the compiled module.
 	for(Uptr functionDefIndex = 0; functionDefIndex < functionDefMutableDatas.size();
 		++functionDefIndex)
@@ -699,11 +964,11 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 			= functionDefMutableDatas[functionDefIndex];
 		importedSymbolMap.addOrFail(getExternalName("functionDefMutableDatas", functionDefIndex),
 									reinterpret_cast<Uptr>(functionMutableData));
-	}
 
-	// Bind the moduleInstance symbol to point to the ModuleInstance.
-	WAVM_ASSERT(moduleInstance.id != UINTPTR_MAX);
-	importedSymbolMap.addOrFail("biasedModuleInstanceId", moduleInstance.id + 1);
+		// Bind the symbol used by code compiled by the baseline tier to count its calls.
+		importedSymbolMap.addOrFail(getExternalName("functionDefTierUpState", functionDefIndex),
+									reinterpret_cast<Uptr>(&functionMutableData->tierUpState));
+	}
 
 	// Bind the tableReferenceBias symbol to the tableReferenceBias.
 	importedSymbolMap.addOrFail("tableReferenceBias", tableReferenceBias);
@@ -727,24 +992,147 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 #endif
 
 	// Load the module.
-	return std::make_shared<Module>(objectFileBytes, importedSymbolMap, true);
+	std::shared_ptr<Module> jitModule
+		= std::make_shared<Module>(objectFileBytes, importedSymbolMap, true);
+
+	// If the module was compiled by the baseline tier, keep the IR and symbol bindings that are
+	// needed to recompile its functions with optimization.
+	if(tierUpIRModule)
+	{
+		jitModule->tierUpState = std::make_shared<TierUpState>(jitModule.get(),
+															   std::move(tierUpIRModule),
+															   importedSymbolMap,
+															   tierUpOptLevel,
+															   tierUpInterruptible,
+															   tierUpMeterFuel,
+															   tierUpBoundsCheckMemories);
+	}
+
+	return jitModule;
 }
 
-Runtime::Function* LLVMJIT::getFunctionByAddress(Uptr address)
+std::shared_ptr<LLVMJIT::Module> LLVMJIT::instantiateModule(
+	const std::shared_ptr<Module>& loadedModule,
+	std::vector<FunctionBinding>&& functionImports,
+	std::vector<TableBinding>&& tables,
+	std::vector<MemoryBinding>&& memories,
+	std::vector<GlobalBinding>&& globals,
+	std::vector<ExceptionTypeBinding>&& exceptionTypes,
+	ModuleInstanceBinding moduleInstance,
+	const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas)
 {
-	Module* jitModule;
+	const BindingTableLayout layout(functionImports.size() + functionDefMutableDatas.size(),
+									tables.size(),
+									memories.size(),
+									globals.size(),
+									exceptionTypes.size());
+	std::vector<Uptr> bindingTable(layout.numSlots, 0);
+
+	WAVM_ASSERT(moduleInstance.id != UINTPTR_MAX);
+	bindingTable[BindingTableLayout::moduleInstanceIdSlot] = moduleInstance.id;
+
+	// Bind the imported functions to their Runtime::Function. The slots for the module's function
+	// definitions are bound to the instance's stubs when they are created.
+	for(Uptr importIndex = 0; importIndex < functionImports.size(); ++importIndex)
+	{
+		WAVM_ASSERT(functionImports[importIndex].callingConvention == IR::CallingConvention::wasm);
+		bindingTable[layout.functionsBaseSlot + importIndex]
+			= reinterpret_cast<Uptr>(functionImports[importIndex].code)
+			  - offsetof(Runtime::Function, code);
+	}
+
+	// Bind the tables and memories to their IDs. The compiled code uses the ID to compute the
+	// offset of the table's entry in CompartmentRuntimeData::tableBases, or the memory's entry in
+	// CompartmentRuntimeData::memoryBases.
+	for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
+	{ bindingTable[layout.tablesBaseSlot + tableIndex] = tables[tableIndex].id; }
+	for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
+	{ bindingTable[layout.memoriesBaseSlot + memoryIndex] = memories[memoryIndex].id; }
+
+	// Bind the globals.
+	for(Uptr globalIndex = 0; globalIndex < globals.size(); ++globalIndex)
+	{
+		const GlobalBinding& globalSpec = globals[globalIndex];
+		Uptr value;
+		if(globalSpec.type.isMutable)
+		{
+			// If the global is mutable, bind it to the offset into ContextRuntimeData::globalData
+			// where it is stored.
+			value = offsetof(Runtime::ContextRuntimeData, mutableGlobals)
+					+ globalSpec.mutableGlobalIndex * sizeof(IR::UntaggedValue);
+		}
+		else
+		{
+			// Otherwise, bind it to a pointer to the global's immutable value.
+			value = reinterpret_cast<Uptr>(globalSpec.immutableValuePointer);
+		}
+		bindingTable[layout.globalsBaseSlot + globalIndex] = value;
+	}
+
+	// Bind the exception types to their IDs.
+	for(Uptr exceptionTypeIndex = 0; exceptionTypeIndex < exceptionTypes.size();
+		++exceptionTypeIndex)
 	{
-		Lock<Platform::Mutex> addressToModuleMapLock(addressToModuleMapMutex);
-		auto moduleIt = addressToModuleMap.upper_bound(address);
-		if(moduleIt == addressToModuleMap.end()) { return nullptr; }
-		jitModule = moduleIt->second;
+		bindingTable[layout.exceptionTypesBaseSlot + exceptionTypeIndex]
+			= exceptionTypes[exceptionTypeIndex].id;
 	}
 
-	auto functionIt = jitModule->addressToFunctionMap.upper_bound(address);
-	if(functionIt == jitModule->addressToFunctionMap.end()) { return nullptr; }
-	Runtime::Function* function = functionIt->second;
-	const Uptr codeAddress = reinterpret_cast<Uptr>(function->code);
-	return address >= codeAddress && address < codeAddress + function->mutableData->numCodeBytes
-			   ? function
-			   : nullptr;
+	return std::make_shared<Module>(loadedModule,
+									std::move(bindingTable),
+									layout.functionsBaseSlot + functionImports.size(),
+									functionDefMutableDatas);
+}
+
+std::shared_ptr<LLVMJIT::Module> LLVMJIT::instantiateInterpretedModule(
+	Runtime::InvokeThunkPointer interpreterEntry,
+	const std::vector<IR::FunctionType>& functionDefTypes,
+	ModuleInstanceBinding moduleInstance,
+	const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas)
+{
+	WAVM_ASSERT(functionDefTypes.size() == functionDefMutableDatas.size());
+	WAVM_ASSERT(moduleInstance.id != UINTPTR_MAX);
+
+	std::vector<const Runtime::Function*> targetFunctions;
+	for(IR::FunctionType functionType : functionDefTypes)
+	{ targetFunctions.push_back(getInterpreterThunk(functionType, interpreterEntry)); }
+
+	return std::make_shared<Module>(moduleInstance.id, targetFunctions, functionDefMutableDatas);
+}
+
+Runtime::Function* LLVMJIT::getFunctionByAddress(Uptr address)
+{
+	// Search the module's functions while the module's code range is protected from being removed
+	// from the map: ~Module removes the module's code ranges before freeing it, and waits for any
+	// lookup that found them to finish.
+	Runtime::Function* result = nullptr;
+	codeAddressToModuleMap.visit(address, [address, &result](Module* jitModule, Uptr) {
+		// Find the first function whose code ends after the address.
+		const std::vector<Module::FunctionCodeRange>& functionCodeRanges
+			= jitModule->functionCodeRanges;
+		auto functionIt = std::upper_bound(
+			functionCodeRanges.begin(),
+			functionCodeRanges.end(),
+			address,
+			[](Uptr searchAddress, const Module::FunctionCodeRange& range) {
+				return searchAddress < range.codeEndAddress;
+			});
+		if(functionIt == functionCodeRanges.end()) { return; }
+		Runtime::Function* function = functionIt->function;
+		const Uptr codeAddress = reinterpret_cast<Uptr>(function->code);
+		if(address >= codeAddress && address < codeAddress + function->mutableData->numCodeBytes)
+		{ result = function; }
+	});
+	return result;
+}
+
+void LLVMJIT::setCodeUnloadCallback(CodeUnloadCallback callback)
+{
+	codeUnloadCallback.store(callback, std::memory_order_release);
+}
+
+bool LLVMJIT::enableHugePagesForCode()
+{
+	if(!Platform::getBytesPerHugePageLog2()) { return false; }
+	useHugePagesForCode.store(true, std::memory_order_relaxed);
+	return true;
 }
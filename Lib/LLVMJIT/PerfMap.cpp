@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "LLVMJITPrivate.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Mutex.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using namespace WAVM;
+using namespace WAVM::LLVMJIT;
+
+// The perf map file is opened by enablePerfMap, and is never closed: perf reads it after the
+// process has exited.
+static Platform::Mutex perfMapMutex;
+static FILE* perfMapFile = nullptr;
+
+bool LLVMJIT::enablePerfMap()
+{
+#if defined(__linux__)
+	Lock<Platform::Mutex> perfMapLock(perfMapMutex);
+	if(perfMapFile) { return true; }
+
+	const std::string perfMapPath = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+	perfMapFile = fopen(perfMapPath.c_str(), "a");
+	return perfMapFile != nullptr;
+#else
+	return false;
+#endif
+}
+
+bool LLVMJIT::isPerfMapEnabled()
+{
+	Lock<Platform::Mutex> perfMapLock(perfMapMutex);
+	return perfMapFile != nullptr;
+}
+
+void LLVMJIT::addPerfMapEntries(const std::vector<PerfMapEntry>& entries)
+{
+	Lock<Platform::Mutex> perfMapLock(perfMapMutex);
+	if(!perfMapFile || !entries.size()) { return; }
+
+	// Each line gives the start address and size of a symbol in hexadecimal, followed by its name.
+	for(const PerfMapEntry& entry : entries)
+	{
+		fprintf(perfMapFile,
+				"%" WAVM_PRIxPTR " %" WAVM_PRIxPTR " %s\n",
+				entry.address,
+				entry.numBytes,
+				entry.name.c_str());
+	}
+
+	// Flush the file so perf can symbolize the code while the process is running.
+	fflush(perfMapFile);
+}
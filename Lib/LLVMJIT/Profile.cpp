@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LLVMJITPrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::LLVMJIT;
+
+// The first line of a serialized profile.
+static const char* profileHeader = "wavm-profile 1";
+
+// Assigns profile counters to the branch operators in a function's code.
+struct ProfileCounterSiteVisitor
+{
+	typedef void Result;
+
+	const FunctionDef& functionDef;
+	std::vector<ProfileCounterSite> sites;
+	Uptr opIndex = 0;
+
+	// The first counter counts the function's calls.
+	Uptr numCounters = 1;
+
+	ProfileCounterSiteVisitor(const FunctionDef& inFunctionDef) : functionDef(inFunctionDef) {}
+
+#define VISIT_OP(opcode, name, nameString, Imm, ...)                                               \
+	void name(Imm imm) { visit(Opcode::name, imm); }
+	WAVM_ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+
+	void unknown(Opcode) { WAVM_UNREACHABLE(); }
+
+private:
+	// if and br_if count the times their condition is false and true.
+	template<typename Imm> void visit(Opcode opcode, const Imm&)
+	{
+		if(opcode == Opcode::if_ || opcode == Opcode::br_if) { addSite(2); }
+		++opIndex;
+	}
+
+	// br_table counts the times each target is taken, followed by the default target.
+	void visit(Opcode, const BranchTableImm& imm)
+	{
+		WAVM_ASSERT(imm.branchTableIndex < functionDef.branchTables.size());
+		addSite(functionDef.branchTables[imm.branchTableIndex].size() + 1);
+		++opIndex;
+	}
+
+	void addSite(Uptr numSiteCounters)
+	{
+		sites.push_back({opIndex, numCounters, numSiteCounters});
+		numCounters += numSiteCounters;
+	}
+};
+
+std::vector<ProfileCounterSite> LLVMJIT::getProfileCounterSites(const FunctionDef& functionDef,
+															   Uptr& outNumCounters)
+{
+	ProfileCounterSiteVisitor visitor(functionDef);
+	OperatorDecoderStream decoder(functionDef.code);
+	while(decoder) { decoder.decodeOp(visitor); }
+
+	outNumCounters = visitor.numCounters;
+	return std::move(visitor.sites);
+}
+
+std::string LLVMJIT::serializeProfile(const ModuleProfile& profile)
+{
+	std::string result = profileHeader;
+	result += '\n';
+	for(Uptr functionDefIndex = 0; functionDefIndex < profile.functionDefs.size();
+		++functionDefIndex)
+	{
+		const FunctionProfile& functionProfile = profile.functionDefs[functionDefIndex];
+		result += "function " + std::to_string(functionDefIndex) + ' '
+				  + std::to_string(functionProfile.entryCount) + '\n';
+		for(const auto& branchCountsPair : functionProfile.branchCounts)
+		{
+			result += "branch " + std::to_string(branchCountsPair.first);
+			for(U64 count : branchCountsPair.second) { result += ' ' + std::to_string(count); }
+			result += '\n';
+		}
+	}
+	return result;
+}
+
+// Parses a decimal number followed by whitespace or the end of the line.
+static bool parseNumber(const char*& nextChar, U64& outNumber)
+{
+	while(*nextChar == ' ' || *nextChar == '\t') { ++nextChar; }
+	if(*nextChar < '0' || *nextChar > '9') { return false; }
+
+	char* numberEnd = nullptr;
+	outNumber = strtoull(nextChar, &numberEnd, 10);
+	nextChar = numberEnd;
+	return *nextChar == ' ' || *nextChar == '\t' || *nextChar == '\n' || *nextChar == 0;
+}
+
+static bool parseKeyword(const char*& nextChar, const char* keyword)
+{
+	const Uptr numKeywordChars = strlen(keyword);
+	if(strncmp(nextChar, keyword, numKeywordChars)) { return false; }
+	nextChar += numKeywordChars;
+	return true;
+}
+
+bool LLVMJIT::parseProfile(const std::string& string, ModuleProfile& outProfile)
+{
+	outProfile.functionDefs.clear();
+
+	const char* nextChar = string.c_str();
+	if(!parseKeyword(nextChar, profileHeader) || *nextChar++ != '\n') { return false; }
+
+	FunctionProfile* functionProfile = nullptr;
+	while(*nextChar)
+	{
+		if(parseKeyword(nextChar, "function "))
+		{
+			U64 functionDefIndex = 0;
+			U64 entryCount = 0;
+			if(!parseNumber(nextChar, functionDefIndex) || !parseNumber(nextChar, entryCount)
+			   || functionDefIndex > UINT32_MAX)
+			{ return false; }
+
+			if(functionDefIndex >= outProfile.functionDefs.size())
+			{ outProfile.functionDefs.resize(Uptr(functionDefIndex) + 1); }
+			functionProfile = &outProfile.functionDefs[Uptr(functionDefIndex)];
+			functionProfile->entryCount = entryCount;
+		}
+		else if(parseKeyword(nextChar, "branch "))
+		{
+			U64 opIndex = 0;
+			if(!functionProfile || !parseNumber(nextChar, opIndex) || opIndex > UINT32_MAX)
+			{ return false; }
+
+			std::vector<U64>& counts = functionProfile->branchCounts[Uptr(opIndex)];
+			counts.clear();
+			while(*nextChar && *nextChar != '\n')
+			{
+				U64 count = 0;
+				if(!parseNumber(nextChar, count)) { return false; }
+				counts.push_back(count);
+			};
+		}
+		else
+		{
+			return false;
+		}
+
+		if(*nextChar == '\n') { ++nextChar; }
+		else if(*nextChar)
+		{
+			return false;
+		}
+	};
+
+	return true;
+}
+
+bool LLVMJIT::getModuleProfile(const std::shared_ptr<Module>& loadedModule,
+							   const IR::Module& irModule,
+							   ModuleProfile& outProfile)
+{
+	outProfile.functionDefs.clear();
+	outProfile.functionDefs.resize(irModule.functions.defs.size());
+
+	bool isInstrumented = false;
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
+	{
+		const Module::ProfileCounters* profileCounters
+			= loadedModule->nameToProfileCountersMap.get(
+				mangleSymbol(getExternalName("functionDefProfileCounters", functionDefIndex)));
+		if(!profileCounters) { continue; }
+		isInstrumented = true;
+
+		// The counters are incremented without synchronization, so the counts may be slightly
+		// inconsistent if the module is running on other threads.
+		Uptr numCounters = 0;
+		std::vector<ProfileCounterSite> sites
+			= getProfileCounterSites(irModule.functions.defs[functionDefIndex], numCounters);
+		WAVM_ERROR_UNLESS(numCounters == profileCounters->numCounters);
+
+		FunctionProfile& functionProfile = outProfile.functionDefs[functionDefIndex];
+		functionProfile.entryCount = profileCounters->counters[0];
+		for(const ProfileCounterSite& site : sites)
+		{
+			functionProfile.branchCounts[site.opIndex] = std::vector<U64>(
+				profileCounters->counters + site.firstCounterIndex,
+				profileCounters->counters + site.firstCounterIndex + site.numCounters);
+		}
+	}
+
+	return isInstrumented;
+}
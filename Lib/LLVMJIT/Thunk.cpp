@@ -48,10 +48,18 @@ using namespace WAVM::Runtime;
 static Platform::Mutex invokeThunkMutex;
 static HashMap<FunctionType, Runtime::Function*> invokeThunkTypeToFunctionMap;
 
+// A map from function types to JIT symbols for cached invoke batch thunks (C++ -> WASM)
+static Platform::Mutex invokeBatchThunkMutex;
+static HashMap<FunctionType, Runtime::Function*> invokeBatchThunkTypeToFunctionMap;
+
 // A map from function types to JIT symbols for cached native thunks (WASM -> C++)
 static Platform::Mutex intrinsicThunkMutex;
 static HashMap<void*, Runtime::Function*> intrinsicFunctionToThunkFunctionMap;
 
+// A map from function types to JIT symbols for cached interpreter thunks (WASM -> interpreter)
+static Platform::Mutex interpreterThunkMutex;
+static HashMap<FunctionType, Runtime::Function*> interpreterThunkTypeToFunctionMap;
+
 InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
 {
 	Lock<Platform::Mutex> invokeThunkLock(invokeThunkMutex);
@@ -159,6 +167,135 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
 	return reinterpret_cast<InvokeThunkPointer>(const_cast<U8*>(invokeThunkFunction->code));
 }
 
+InvokeBatchThunkPointer LLVMJIT::getInvokeBatchThunk(FunctionType functionType)
+{
+	Lock<Platform::Mutex> invokeBatchThunkLock(invokeBatchThunkMutex);
+
+	// Reuse cached invoke batch thunks for the same function type.
+	Runtime::Function*& invokeBatchThunkFunction
+		= invokeBatchThunkTypeToFunctionMap.getOrAdd(functionType, nullptr);
+	if(invokeBatchThunkFunction)
+	{
+		return reinterpret_cast<InvokeBatchThunkPointer>(
+			const_cast<U8*>(invokeBatchThunkFunction->code));
+	}
+
+	// Create a FunctionMutableData object for the thunk.
+	FunctionMutableData* functionMutableData
+		= new FunctionMutableData("thnk!C to WASM batch thunk!" + asString(functionType));
+
+	// Create a LLVM module and a LLVM function for the thunk.
+	LLVMContext llvmContext;
+	llvm::Module llvmModule("", llvmContext);
+	std::unique_ptr<llvm::TargetMachine> targetMachine = getTargetMachine(getHostTargetSpec());
+	llvmModule.setDataLayout(targetMachine->createDataLayout());
+	auto llvmFunctionType = llvm::FunctionType::get(llvmContext.i8PtrType,
+													{llvmContext.i8PtrType,
+													 llvmContext.i8PtrType,
+													 llvmContext.i8PtrType,
+													 llvmContext.iptrType,
+													 llvmContext.i8PtrType,
+													 llvmContext.iptrType->getPointerTo()},
+													false);
+	auto function = llvm::Function::Create(
+		llvmFunctionType, llvm::Function::ExternalLinkage, "thunk", &llvmModule);
+	setRuntimeFunctionPrefix(llvmContext,
+							 function,
+							 emitLiteralPointer(functionMutableData, llvmContext.iptrType),
+							 emitLiteral(llvmContext, Uptr(UINTPTR_MAX)),
+							 emitLiteral(llvmContext, functionType.getEncoding().impl));
+	setFunctionAttributes(targetMachine.get(), function);
+
+	llvm::Value* calleeFunction = &*(function->args().begin() + 0);
+	llvm::Value* contextPointer = &*(function->args().begin() + 1);
+	llvm::Value* argRows = &*(function->args().begin() + 2);
+	llvm::Value* numRows = &*(function->args().begin() + 3);
+	llvm::Value* resultRows = &*(function->args().begin() + 4);
+	llvm::Value* rowIndexPointer = &*(function->args().begin() + 5);
+
+	EmitContext emitContext(llvmContext, nullptr);
+	llvm::IRBuilder<>& irBuilder = emitContext.irBuilder;
+	auto entryBlock = llvm::BasicBlock::Create(llvmContext, "entry", function);
+	auto loopBlock = llvm::BasicBlock::Create(llvmContext, "loop", function);
+	auto exitBlock = llvm::BasicBlock::Create(llvmContext, "exit", function);
+	irBuilder.SetInsertPoint(entryBlock);
+
+	emitContext.initContextVariables(contextPointer);
+
+	llvm::Value* functionCode = irBuilder.CreatePointerCast(
+		irBuilder.CreateInBoundsGEP(
+			calleeFunction, {emitLiteral(llvmContext, Uptr(offsetof(Runtime::Function, code)))}),
+		asLLVMType(llvmContext, functionType, IR::CallingConvention::wasm)->getPointerTo());
+
+	irBuilder.CreateCondBr(irBuilder.CreateICmpEQ(numRows, emitLiteral(llvmContext, Uptr(0))),
+						   exitBlock,
+						   loopBlock);
+
+	// Store the index of each row before calling the function with it, so the caller knows which
+	// row threw an exception.
+	irBuilder.SetInsertPoint(loopBlock);
+	llvm::PHINode* rowIndex = irBuilder.CreatePHI(llvmContext.iptrType, 2);
+	rowIndex->addIncoming(emitLiteral(llvmContext, Uptr(0)), entryBlock);
+	irBuilder.CreateStore(rowIndex, rowIndexPointer);
+
+	// Load the row's arguments from an array of UntaggedValues.
+	const Uptr numParams = functionType.params().size();
+	llvm::Value* argRow = irBuilder.CreateInBoundsGEP(
+		argRows,
+		{irBuilder.CreateMul(rowIndex,
+							 emitLiteral(llvmContext, Uptr(numParams * sizeof(UntaggedValue))))});
+	std::vector<llvm::Value*> arguments;
+	for(Uptr paramIndex = 0; paramIndex < numParams; ++paramIndex)
+	{
+		const ValueType paramType = functionType.params()[paramIndex];
+		arguments.push_back(emitContext.loadFromUntypedPointer(
+			irBuilder.CreateInBoundsGEP(
+				argRow, {emitLiteral(llvmContext, Uptr(paramIndex * sizeof(UntaggedValue)))}),
+			asLLVMType(llvmContext, paramType),
+			getTypeByteWidth(paramType)));
+	}
+
+	// Call the function.
+	ValueVector results = emitContext.emitCallOrInvoke(
+		functionCode, arguments, functionType, IR::CallingConvention::wasm);
+
+	// Write the row's results to an array of UntaggedValues.
+	WAVM_ASSERT(results.size() == functionType.results().size());
+	llvm::Value* resultRow = irBuilder.CreateInBoundsGEP(
+		resultRows,
+		{irBuilder.CreateMul(
+			rowIndex, emitLiteral(llvmContext, Uptr(results.size() * sizeof(UntaggedValue))))});
+	for(Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+	{
+		emitContext.storeToUntypedPointer(
+			results[resultIndex],
+			irBuilder.CreateInBoundsGEP(
+				resultRow, {emitLiteral(llvmContext, Uptr(resultIndex * sizeof(UntaggedValue)))}),
+			getTypeByteWidth(functionType.results()[resultIndex]));
+	}
+
+	// Loop until the function has been called with every row.
+	llvm::Value* nextRowIndex = irBuilder.CreateAdd(rowIndex, emitLiteral(llvmContext, Uptr(1)));
+	rowIndex->addIncoming(nextRowIndex, irBuilder.GetInsertBlock());
+	irBuilder.CreateCondBr(irBuilder.CreateICmpULT(nextRowIndex, numRows), loopBlock, exitBlock);
+
+	irBuilder.SetInsertPoint(exitBlock);
+	irBuilder.CreateStore(numRows, rowIndexPointer);
+	irBuilder.CreateRet(irBuilder.CreateLoad(emitContext.contextPointerVariable));
+
+	// Compile the LLVM IR to object code.
+	std::vector<U8> objectBytes
+		= compileLLVMModule(llvmContext, std::move(llvmModule), false, targetMachine.get());
+
+	// Load the object code.
+	auto jitModule = new LLVMJIT::Module(objectBytes, {}, false);
+	Platform::expectLeakedObject(jitModule);
+
+	invokeBatchThunkFunction = jitModule->nameToFunctionMap[mangleSymbol("thunk")];
+	return reinterpret_cast<InvokeBatchThunkPointer>(
+		const_cast<U8*>(invokeBatchThunkFunction->code));
+}
+
 Runtime::Function* LLVMJIT::getIntrinsicThunk(void* nativeFunction,
 											  FunctionType functionType,
 											  CallingConvention callingConvention,
@@ -226,3 +363,111 @@ Runtime::Function* LLVMJIT::getIntrinsicThunk(void* nativeFunction,
 	intrinsicThunkFunction = jitModule->nameToFunctionMap[mangleSymbol("thunk")];
 	return intrinsicThunkFunction;
 }
+
+Runtime::Function* LLVMJIT::getInterpreterThunk(FunctionType functionType,
+												InvokeThunkPointer interpreterEntry)
+{
+	Lock<Platform::Mutex> interpreterThunkLock(interpreterThunkMutex);
+
+	// Reuse cached interpreter thunks for the same function type.
+	Runtime::Function*& interpreterThunkFunction
+		= interpreterThunkTypeToFunctionMap.getOrAdd(functionType, nullptr);
+	if(interpreterThunkFunction) { return interpreterThunkFunction; }
+
+	// Create a FunctionMutableData object for the thunk.
+	FunctionMutableData* functionMutableData
+		= new FunctionMutableData("thnk!WASM to interpreter thunk!" + asString(functionType));
+
+	// Create a LLVM module containing a single function with the same signature as the shared code
+	// for a function definition: the interpreted function's stub passes its Runtime::Function in
+	// the nest parameter.
+	LLVMContext llvmContext;
+	llvm::Module llvmModule("", llvmContext);
+	std::unique_ptr<llvm::TargetMachine> targetMachine = getTargetMachine(getHostTargetSpec());
+	llvmModule.setDataLayout(targetMachine->createDataLayout());
+	auto function = llvm::Function::Create(getSharedFunctionType(llvmContext, functionType),
+										   llvm::Function::ExternalLinkage,
+										   "thunk",
+										   &llvmModule);
+	function->setCallingConv(asLLVMCallingConv(CallingConvention::wasm));
+	function->addParamAttr(0, llvm::Attribute::Nest);
+	setRuntimeFunctionPrefix(llvmContext,
+							 function,
+							 emitLiteralPointer(functionMutableData, llvmContext.iptrType),
+							 emitLiteral(llvmContext, Uptr(UINTPTR_MAX)),
+							 emitLiteral(llvmContext, functionType.getEncoding().impl));
+	setFunctionAttributes(targetMachine.get(), function);
+
+	llvm::Value* calleeFunction = &*(function->args().begin() + 0);
+	llvm::Value* contextPointer = &*(function->args().begin() + 1);
+
+	EmitContext emitContext(llvmContext, nullptr);
+	emitContext.irBuilder.SetInsertPoint(llvm::BasicBlock::Create(llvmContext, "entry", function));
+
+	emitContext.initContextVariables(contextPointer);
+
+	// Store the function's arguments in the context, with the same layout that invoke thunks load
+	// them from.
+	Uptr argDataOffset = 0;
+	for(Uptr paramIndex = 0; paramIndex < functionType.params().size(); ++paramIndex)
+	{
+		const ValueType parameterType = functionType.params()[paramIndex];
+
+		// Naturally align each argument.
+		const U32 numArgBytes = getTypeByteWidth(parameterType);
+		argDataOffset = (argDataOffset + numArgBytes - 1) & -numArgBytes;
+		WAVM_ASSERT(argDataOffset < maxThunkArgAndReturnBytes);
+
+		const Uptr argOffset = argDataOffset + offsetof(ContextRuntimeData, thunkArgAndReturnData);
+		emitContext.irBuilder.CreateStore(
+			&*(function->args().begin() + 2 + paramIndex),
+			emitContext.irBuilder.CreatePointerCast(
+				emitContext.irBuilder.CreateInBoundsGEP(contextPointer,
+														{emitLiteral(llvmContext, argOffset)}),
+				asLLVMType(llvmContext, parameterType)->getPointerTo()));
+
+		argDataOffset += numArgBytes;
+	}
+
+	// Call the interpreter, which has the same signature as an invoke thunk.
+	auto llvmEntryType = llvm::FunctionType::get(
+		llvmContext.i8PtrType, {llvmContext.i8PtrType, llvmContext.i8PtrType}, false);
+	llvm::Value* newContextPointer = emitContext.irBuilder.CreateCall(
+		emitLiteralPointer(reinterpret_cast<void*>(interpreterEntry),
+						   llvmEntryType->getPointerTo()),
+		{emitContext.irBuilder.CreatePointerCast(calleeFunction, llvmContext.i8PtrType),
+		 contextPointer});
+	emitContext.irBuilder.CreateStore(newContextPointer, emitContext.contextPointerVariable);
+
+	// Load the results that the interpreter wrote to the returned context.
+	ValueVector results;
+	Uptr resultOffset = 0;
+	for(ValueType resultType : functionType.results())
+	{
+		const U8 resultNumBytes = getTypeByteWidth(resultType);
+
+		resultOffset = (resultOffset + resultNumBytes - 1) & -I8(resultNumBytes);
+		WAVM_ASSERT(resultOffset < maxThunkArgAndReturnBytes);
+
+		results.push_back(emitContext.loadFromUntypedPointer(
+			emitContext.irBuilder.CreateInBoundsGEP(newContextPointer,
+													{emitLiteral(llvmContext, resultOffset)}),
+			asLLVMType(llvmContext, resultType),
+			resultNumBytes));
+
+		resultOffset += resultNumBytes;
+	}
+
+	emitContext.emitReturn(functionType.results(), results);
+
+	// Compile the LLVM IR to object code.
+	std::vector<U8> objectBytes
+		= compileLLVMModule(llvmContext, std::move(llvmModule), false, targetMachine.get());
+
+	// Load the object code.
+	auto jitModule = new LLVMJIT::Module(objectBytes, {}, false);
+	Platform::expectLeakedObject(jitModule);
+
+	interpreterThunkFunction = jitModule->nameToFunctionMap[mangleSymbol("thunk")];
+	return interpreterThunkFunction;
+}
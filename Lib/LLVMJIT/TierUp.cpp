@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LLVMJITPrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
+
+PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+
+using namespace WAVM;
+using namespace WAVM::LLVMJIT;
+
+struct TierUpRequest
+{
+	std::shared_ptr<TierUpState> state;
+	Uptr functionDefIndex;
+};
+
+// The queue of functions waiting to be recompiled with optimization. A single background thread
+// is started to process the queue when a request is added to it, and exits when it is empty.
+static Platform::Mutex tierUpQueueMutex;
+static std::vector<TierUpRequest> tierUpQueue;
+static bool isTierUpThreadRunning = false;
+
+static Runtime::Function* getBaselineFunction(TierUpState& state, Uptr functionDefIndex)
+{
+	Runtime::Function** function = state.module->nameToFunctionMap.get(
+		mangleSymbol(getExternalName("functionDef", functionDefIndex)));
+	WAVM_ERROR_UNLESS(function);
+	return *function;
+}
+
+static void tierUpFunctions(TierUpState& state,
+							std::vector<Uptr>& functionDefIndices,
+							const char* timerDescription)
+{
+	Timing::Timer tierUpTimer;
+
+	// Skip functions that were already recompiled, or whose module was unloaded while they were
+	// waiting in the queue.
+	{
+		Lock<Platform::Mutex> stateLock(state.mutex);
+		if(!state.module) { return; }
+
+		std::sort(functionDefIndices.begin(), functionDefIndices.end());
+		functionDefIndices.erase(std::unique(functionDefIndices.begin(), functionDefIndices.end()),
+								 functionDefIndices.end());
+		functionDefIndices.erase(
+			std::remove_if(functionDefIndices.begin(),
+						   functionDefIndices.end(),
+						   [&state](Uptr functionDefIndex) {
+							   Runtime::Function* function
+								   = getBaselineFunction(state, functionDefIndex);
+							   return function->mutableData->tierUpState.optimizedCode.load(
+										  std::memory_order_acquire)
+									  != nullptr;
+						   }),
+			functionDefIndices.end());
+		if(!functionDefIndices.size()) { return; }
+	}
+
+	// Compile the functions with optimization. The IR module is immutable, so this doesn't need to
+	// hold the state's mutex.
+	std::unique_ptr<llvm::TargetMachine> targetMachine = getTargetMachine(getHostTargetSpec());
+	WAVM_ERROR_UNLESS(targetMachine);
+	std::vector<U8> objectBytes;
+	{
+		LLVMContext llvmContext;
+		llvm::Module llvmModule("", llvmContext);
+		CompileOptions options;
+		options.interruptible = state.isInterruptible;
+		options.meterFuel = state.meterFuel;
+		options.boundsCheckMemories = state.boundsCheckMemories;
+		emitModule(*state.irModule,
+				   llvmContext,
+				   llvmModule,
+				   targetMachine.get(),
+				   &functionDefIndices,
+				   options);
+		objectBytes = compileLLVMModule(
+			llvmContext, std::move(llvmModule), false, targetMachine.get(), state.optLevel);
+	}
+
+	Lock<Platform::Mutex> stateLock(state.mutex);
+	if(!state.module) { return; }
+
+	// Load the optimized code with the same bindings as the baseline code, except that references
+	// to the module's other functions are bound to their baseline code, and each optimized
+	// function gets its own FunctionMutableData.
+	HashMap<std::string, Uptr> importedSymbolMap = state.importedSymbolMap;
+	for(Uptr functionDefIndex = 0; functionDefIndex < state.irModule->functions.defs.size();
+		++functionDefIndex)
+	{
+		Runtime::Function* baselineFunction = getBaselineFunction(state, functionDefIndex);
+		if(std::binary_search(
+			   functionDefIndices.begin(), functionDefIndices.end(), functionDefIndex))
+		{
+			importedSymbolMap.set(getExternalName("functionDefMutableDatas", functionDefIndex),
+								  reinterpret_cast<Uptr>(new Runtime::FunctionMutableData(
+									  std::string(baselineFunction->mutableData->debugName))));
+		}
+		else
+		{
+			importedSymbolMap.set(getExternalName("functionDef", functionDefIndex),
+								  reinterpret_cast<Uptr>(baselineFunction->code));
+		}
+	}
+	std::unique_ptr<Module> optimizedModule(new Module(objectBytes, importedSymbolMap, false));
+
+	// Forward calls to the baseline functions to the optimized code.
+	for(Uptr functionDefIndex : functionDefIndices)
+	{
+		Runtime::Function** optimizedFunction = optimizedModule->nameToFunctionMap.get(
+			mangleSymbol(getExternalName("functionDef", functionDefIndex)));
+		WAVM_ERROR_UNLESS(optimizedFunction);
+		getBaselineFunction(state, functionDefIndex)
+			->mutableData->tierUpState.optimizedCode.store((*optimizedFunction)->code,
+														   std::memory_order_release);
+	}
+	state.optimizedModules.push_back(std::move(optimizedModule));
+
+	Timing::logRatePerSecond(
+		timerDescription, tierUpTimer, (F64)functionDefIndices.size(), "functions");
+}
+
+static I64 tierUpThreadEntry(void*)
+{
+	while(true)
+	{
+		// Take all the queued requests for the same module as the oldest request, so they can be
+		// compiled together.
+		std::shared_ptr<TierUpState> state;
+		std::vector<Uptr> functionDefIndices;
+		{
+			Lock<Platform::Mutex> tierUpQueueLock(tierUpQueueMutex);
+			if(!tierUpQueue.size())
+			{
+				isTierUpThreadRunning = false;
+				return 0;
+			}
+
+			state = tierUpQueue[0].state;
+			std::vector<TierUpRequest> remainingRequests;
+			for(TierUpRequest& request : tierUpQueue)
+			{
+				if(request.state == state)
+				{ functionDefIndices.push_back(request.functionDefIndex); }
+				else
+				{
+					remainingRequests.push_back(std::move(request));
+				}
+			}
+			tierUpQueue = std::move(remainingRequests);
+		}
+
+		tierUpFunctions(*state, functionDefIndices, "Recompiled functions with optimization");
+	}
+}
+
+void LLVMJIT::requestTierUp(const Runtime::Function* function, Uptr functionDefIndex)
+{
+	// Ignore requests from baseline code that was loaded without the IR needed to recompile it.
+	Module* jitModule = function->mutableData->jitModule;
+	WAVM_ASSERT(jitModule);
+	if(!jitModule->tierUpState) { return; }
+
+	Lock<Platform::Mutex> tierUpQueueLock(tierUpQueueMutex);
+	tierUpQueue.push_back({jitModule->tierUpState, functionDefIndex});
+	if(!isTierUpThreadRunning)
+	{
+		isTierUpThreadRunning = true;
+		Platform::detachThread(
+			Platform::createThread(8 * 1024 * 1024, tierUpThreadEntry, nullptr));
+	}
+}
+
+// Adds the indices of the function definitions called directly by a function to a list.
+struct DirectCalleeVisitor
+{
+	typedef void Result;
+
+	const IR::Module& irModule;
+	std::vector<Uptr>& functionDefIndices;
+
+	DirectCalleeVisitor(const IR::Module& inIRModule, std::vector<Uptr>& inFunctionDefIndices)
+	: irModule(inIRModule), functionDefIndices(inFunctionDefIndices)
+	{
+	}
+
+#define VISIT_OP(opcode, name, nameString, Imm, ...)                                               \
+	void name(IR::Imm imm) { visit(IR::Opcode::name, imm); }
+	WAVM_ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+
+private:
+	template<typename Imm> void visit(IR::Opcode, const Imm&) {}
+	void visit(IR::Opcode opcode, const IR::FunctionImm& imm)
+	{
+		if(opcode == IR::Opcode::call && imm.functionIndex >= irModule.functions.imports.size())
+		{ functionDefIndices.push_back(imm.functionIndex - irModule.functions.imports.size()); }
+	}
+};
+
+void LLVMJIT::compileLazyFunction(const Runtime::Function* function,
+								  Uptr functionDefIndex,
+								  bool shouldCompileDirectCallees)
+{
+	Module* jitModule = function->mutableData->jitModule;
+	WAVM_ASSERT(jitModule);
+	if(!jitModule->tierUpState)
+	{ Errors::fatal("lazily compiled code was loaded without the IR needed to compile it"); }
+	TierUpState& state = *jitModule->tierUpState;
+
+	std::vector<Uptr> functionDefIndices{functionDefIndex};
+	if(shouldCompileDirectCallees)
+	{
+		const IR::FunctionDef& functionDef = state.irModule->functions.defs[functionDefIndex];
+		DirectCalleeVisitor visitor(*state.irModule, functionDefIndices);
+		IR::OperatorDecoderStream decoder(functionDef.code);
+		while(decoder) { decoder.decodeOp(visitor); }
+	}
+
+	// Hold the lazy compilation lock while compiling, so if another thread is already compiling
+	// the function, this thread waits for it to finish, and then skips compiling it again.
+	Lock<Platform::Mutex> lazyCompileLock(state.lazyCompileMutex);
+	tierUpFunctions(state, functionDefIndices, "Lazily compiled functions");
+}
+
+void LLVMJIT::detachTierUpState(TierUpState& state)
+{
+	// Remove the module's queued requests.
+	{
+		Lock<Platform::Mutex> tierUpQueueLock(tierUpQueueMutex);
+		tierUpQueue.erase(std::remove_if(tierUpQueue.begin(),
+										 tierUpQueue.end(),
+										 [&state](const TierUpRequest& request) {
+											 return request.state.get() == &state;
+										 }),
+						  tierUpQueue.end());
+	}
+
+	// Detach the state from the module, so a recompilation that is already in progress won't
+	// install its code, and free the optimized code.
+	std::vector<std::unique_ptr<Module>> optimizedModules;
+	{
+		Lock<Platform::Mutex> stateLock(state.mutex);
+		state.module = nullptr;
+		optimizedModules = std::move(state.optimizedModules);
+	}
+}
@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -584,6 +585,7 @@ struct POSIXFS : HostFS
 	virtual Result openDir(const std::string& path, DirEntStream*& outStream) override;
 
 	virtual Result unlinkFile(const std::string& path) override;
+	virtual Result renameFile(const std::string& oldPath, const std::string& newPath) override;
 	virtual Result removeDir(const std::string& path) override;
 	virtual Result createDir(const std::string& path) override;
 
@@ -686,6 +688,11 @@ Result POSIXFS::unlinkFile(const std::string& path)
 	return !unlink(path.c_str()) ? VFS::Result::success : asVFSResult(errno);
 }
 
+Result POSIXFS::renameFile(const std::string& oldPath, const std::string& newPath)
+{
+	return !rename(oldPath.c_str(), newPath.c_str()) ? Result::success : asVFSResult(errno);
+}
+
 Result POSIXFS::removeDir(const std::string& path)
 {
 	return !unlinkat(AT_FDCWD, path.c_str(), AT_REMOVEDIR) ? Result::success : asVFSResult(errno);
@@ -693,7 +700,7 @@ Result POSIXFS::removeDir(const std::string& path)
 
 Result POSIXFS::createDir(const std::string& path)
 {
-	return !mkdir(path.c_str(), 0666) ? Result::success : asVFSResult(errno);
+	return !mkdir(path.c_str(), 0777) ? Result::success : asVFSResult(errno);
 }
 
 std::string Platform::getCurrentWorkingDirectory()
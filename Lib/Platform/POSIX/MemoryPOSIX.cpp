@@ -1,8 +1,11 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include "POSIXPrivate.h"
 #include "WAVM/Inline/Assert.h"
@@ -32,6 +35,61 @@ Uptr Platform::getBytesPerPageLog2()
 	return preferredVirtualPageSizeLog2;
 }
 
+static Uptr internalGetHugePageSizeLog2()
+{
+#ifdef __linux__
+	// Transparent huge pages are backed by pages of the size Linux reports in sysfs. If the file
+	// doesn't exist, the kernel doesn't support transparent huge pages.
+	FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+	if(!file) { return 0; }
+	unsigned long long hugePageSize = 0;
+	const bool readSize = fscanf(file, "%llu", &hugePageSize) == 1;
+	fclose(file);
+
+	if(!readSize || hugePageSize <= getBytesPerPage() || (hugePageSize & (hugePageSize - 1)))
+	{ return 0; }
+	return Uptr(floorLogTwo(U64(hugePageSize)));
+#else
+	return 0;
+#endif
+}
+Uptr Platform::getBytesPerHugePageLog2()
+{
+	static Uptr hugePageSizeLog2 = internalGetHugePageSizeLog2();
+	return hugePageSizeLog2;
+}
+
+static bool internalCanUseHugePagesForSharedMemory()
+{
+#ifdef __linux__
+	if(!getBytesPerHugePageLog2()) { return false; }
+
+	// Shared memory objects are memfds, which are backed by shmem. Linux only backs shmem with
+	// transparent huge pages if shmem_enabled allows it, and the default is never. The file lists
+	// the possible settings, with the current one in brackets.
+	FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+	if(!file) { return false; }
+	char settings[256];
+	const bool readSettings = fgets(settings, sizeof(settings), file) != nullptr;
+	fclose(file);
+	if(!readSettings) { return false; }
+
+	for(const char* setting : {"[always]", "[within_size]", "[advise]", "[force]"})
+	{
+		if(strstr(settings, setting)) { return true; }
+	}
+	return false;
+#else
+	return false;
+#endif
+}
+
+bool Platform::canUseHugePagesForSharedMemory()
+{
+	static bool canUseHugePages = internalCanUseHugePagesForSharedMemory();
+	return canUseHugePages;
+}
+
 static U32 memoryAccessAsPOSIXFlag(MemoryAccess access)
 {
 	switch(access)
@@ -143,6 +201,28 @@ bool Platform::setVirtualPageAccess(U8* baseVirtualAddress, Uptr numPages, Memor
 	return result == 0;
 }
 
+bool Platform::adviseHugeVirtualPages(U8* baseVirtualAddress, Uptr numPages, bool useHugePages)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+#ifdef __linux__
+	if(!getBytesPerHugePageLog2()) { return false; }
+	const Uptr numBytes = numPages << getBytesPerPageLog2();
+	if(madvise(baseVirtualAddress, numBytes, useHugePages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE))
+	{
+		fprintf(stderr,
+				"madvise(0x%" WAVM_PRIxPTR ", %" WAVM_PRIuPTR ", %s) failed: %s\n",
+				reinterpret_cast<Uptr>(baseVirtualAddress),
+				numBytes,
+				useHugePages ? "MADV_HUGEPAGE" : "MADV_NOHUGEPAGE",
+				strerror(errno));
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
 void Platform::decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
@@ -158,6 +238,175 @@ void Platform::decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 	}
 }
 
+void Platform::resetVirtualPages(U8* baseVirtualAddress, Uptr numPages)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+	auto numBytes = numPages << getBytesPerPageLog2();
+#ifdef __linux__
+	// On Linux, MADV_DONTNEED frees the pages of a private mapping. When they are next accessed,
+	// anonymous pages are zero-filled, and pages mapped from a file are read from the file.
+	if(madvise(baseVirtualAddress, numBytes, MADV_DONTNEED))
+	{
+		Errors::fatalf("madvise(0x%" WAVM_PRIxPTR ", %" WAVM_PRIuPTR ", MADV_DONTNEED) failed: %s",
+					   reinterpret_cast<Uptr>(baseVirtualAddress),
+					   numBytes,
+					   strerror(errno));
+	}
+#else
+	// Other systems don't guarantee that MADV_DONTNEED zeroes the pages, so replace them with a new
+	// anonymous mapping.
+	if(mmap(baseVirtualAddress,
+			numBytes,
+			PROT_READ | PROT_WRITE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0)
+	   == MAP_FAILED)
+	{
+		Errors::fatalf(
+			"mmap(0x%" WAVM_PRIxPTR ", %" WAVM_PRIuPTR
+			", PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) failed: %s",
+			reinterpret_cast<Uptr>(baseVirtualAddress),
+			numBytes,
+			strerror(errno));
+	}
+#endif
+}
+
+bool Platform::getWrittenVirtualPages(U8* baseVirtualAddress,
+									  Uptr numPages,
+									  std::vector<bool>& outIsPageWritten)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+#ifdef __linux__
+	// /proc/self/pagemap has a 64-bit entry for each virtual page. A private page that has been
+	// written is either present and anonymous, or swapped out. A private page that hasn't been
+	// written is either not present, or present and mapped from a file (including a memfd).
+	const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if(fd < 0) { return false; }
+
+	static constexpr U64 presentBit = U64(1) << 63;
+	static constexpr U64 swappedBit = U64(1) << 62;
+	static constexpr U64 filePageBit = U64(1) << 61;
+	static constexpr Uptr maxEntriesPerRead = 512;
+	U64 entries[maxEntriesPerRead];
+
+	outIsPageWritten.assign(numPages, false);
+	const Uptr firstPageIndex = reinterpret_cast<Uptr>(baseVirtualAddress) >> getBytesPerPageLog2();
+	for(Uptr pageIndex = 0; pageIndex < numPages;)
+	{
+		const Uptr numEntries = std::min(numPages - pageIndex, maxEntriesPerRead);
+		const Uptr numBytes = numEntries * sizeof(U64);
+		if(pread(fd, entries, numBytes, off_t((firstPageIndex + pageIndex) * sizeof(U64)))
+		   != ssize_t(numBytes))
+		{
+			close(fd);
+			return false;
+		}
+
+		for(Uptr entryIndex = 0; entryIndex < numEntries; ++entryIndex)
+		{
+			const U64 entry = entries[entryIndex];
+			outIsPageWritten[pageIndex + entryIndex]
+				= (entry & swappedBit) || ((entry & presentBit) && !(entry & filePageBit));
+		}
+		pageIndex += numEntries;
+	}
+
+	close(fd);
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef __linux__
+struct Platform::SharedMemory
+{
+	int fd;
+};
+#endif
+
+SharedMemory* Platform::createSharedMemory()
+{
+#ifdef __linux__
+	// Linux memory file descriptors can be mapped like any other file, but aren't backed by a file
+	// system.
+	const int fd = memfd_create("wavm-shared-memory", MFD_CLOEXEC);
+	if(fd < 0) { return nullptr; }
+	return new SharedMemory{fd};
+#else
+	return nullptr;
+#endif
+}
+
+SharedMemory* Platform::openSharedMemoryFile(const std::string& path)
+{
+#ifdef __linux__
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) { return nullptr; }
+	return new SharedMemory{fd};
+#else
+	return nullptr;
+#endif
+}
+
+void Platform::destroySharedMemory(SharedMemory* sharedMemory)
+{
+#ifdef __linux__
+	if(close(sharedMemory->fd)) { Errors::fatalf("close failed: %s", strerror(errno)); }
+	delete sharedMemory;
+#else
+	WAVM_UNREACHABLE();
+#endif
+}
+
+bool Platform::resizeSharedMemory(SharedMemory* sharedMemory, Uptr numPages)
+{
+#ifdef __linux__
+	return !ftruncate(sharedMemory->fd, off_t(numPages << getBytesPerPageLog2()));
+#else
+	WAVM_UNREACHABLE();
+#endif
+}
+
+bool Platform::mapSharedMemoryPages(SharedMemory* sharedMemory,
+									Uptr firstPageIndex,
+									U8* baseVirtualAddress,
+									Uptr numPages,
+									MemoryAccess access,
+									bool copyOnWrite)
+{
+#ifdef __linux__
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+	const Uptr numBytes = numPages << getBytesPerPageLog2();
+	if(mmap(baseVirtualAddress,
+			numBytes,
+			memoryAccessAsPOSIXFlag(access),
+			MAP_FIXED | (copyOnWrite ? MAP_PRIVATE : MAP_SHARED),
+			sharedMemory->fd,
+			off_t(firstPageIndex << getBytesPerPageLog2()))
+	   == MAP_FAILED)
+	{
+		fprintf(stderr,
+				"mmap(0x%" WAVM_PRIxPTR ", %" WAVM_PRIuPTR ", %u, %s, %d, %" WAVM_PRIuPTR
+				") failed: %s\n",
+				reinterpret_cast<Uptr>(baseVirtualAddress),
+				numBytes,
+				memoryAccessAsPOSIXFlag(access),
+				copyOnWrite ? "MAP_FIXED | MAP_PRIVATE" : "MAP_FIXED | MAP_SHARED",
+				sharedMemory->fd,
+				firstPageIndex << getBytesPerPageLog2(),
+				strerror(errno));
+		dumpErrorCallStack(0);
+		return false;
+	}
+	return true;
+#else
+	WAVM_UNREACHABLE();
+#endif
+}
+
 void Platform::freeVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
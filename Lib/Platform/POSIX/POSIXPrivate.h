@@ -102,6 +102,12 @@ namespace WAVM { namespace Platform {
 	};
 
 	extern thread_local SigAltStack sigAltStack;
+
+	// The bounds of the current thread's non-signal stack, or null if sigAltStack hasn't been
+	// initialized on the thread. Unlike SigAltStack::getNonSignalStack, these may be read from any
+	// signal handler.
+	extern thread_local U8* signalSafeStackMinAddr;
+	extern thread_local U8* signalSafeStackMaxAddr;
 	extern thread_local SignalContext* innermostSignalContext;
 
 	void dumpErrorCallStack(Uptr numOmittedFramesFromTop);
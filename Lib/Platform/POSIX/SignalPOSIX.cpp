@@ -1,4 +1,8 @@
+#include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ucontext.h>
 #include <unistd.h>
 #include <atomic>
 
@@ -6,6 +10,7 @@
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Platform/Diagnostics.h"
+#include "WAVM/Platform/Thread.h"
 
 using namespace WAVM;
 using namespace WAVM::Platform;
@@ -119,6 +124,134 @@ bool Platform::catchSignals(void (*thunk)(void*),
 #endif
 }
 
+enum
+{
+	maxCPUTimeSampleFrames = 64
+};
+
+static std::atomic<void (*)(const Uptr*, Uptr)> cpuTimeSampleHandler{nullptr};
+static std::atomic<Uptr> numRunningCPUTimeSignalHandlers{0};
+
+// Finds the instruction pointers of the call stack interrupted by a signal by following the chain
+// of frame pointers that starts in the signal's ucontext. This can't use libunwind, since it takes
+// locks and calls dl_iterate_phdr, so it may deadlock if the signal interrupted a thread that was
+// already in libunwind (for example, registering the unwind info for JIT code). Instead, it only
+// reads frames that are in the interrupted thread's stack: each frame must be above the
+// interrupted stack pointer and the previous frame, and below the top of the stack. It only
+// supports x86-64, and doesn't capture any frames on other architectures.
+static Uptr captureInterruptedCallStackFrames(const void* signalContext,
+											   Uptr* outFrameIPs,
+											   Uptr maxFrames)
+{
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+	const ucontext_t* context = (const ucontext_t*)signalContext;
+#ifdef __linux__
+	const Uptr ip = Uptr(context->uc_mcontext.gregs[REG_RIP]);
+	const Uptr stackPointer = Uptr(context->uc_mcontext.gregs[REG_RSP]);
+	Uptr framePointer = Uptr(context->uc_mcontext.gregs[REG_RBP]);
+#else
+	const Uptr ip = Uptr(context->uc_mcontext->__ss.__rip);
+	const Uptr stackPointer = Uptr(context->uc_mcontext->__ss.__rsp);
+	Uptr framePointer = Uptr(context->uc_mcontext->__ss.__rbp);
+#endif
+
+	Uptr numFrames = 0;
+	if(numFrames < maxFrames) { outFrameIPs[numFrames++] = ip; }
+
+	// If the thread's stack bounds aren't known, only the interrupted instruction is sampled.
+	const Uptr stackMaxAddr = reinterpret_cast<Uptr>(signalSafeStackMaxAddr);
+	Uptr minFrameAddr = reinterpret_cast<Uptr>(signalSafeStackMinAddr);
+	if(!stackMaxAddr) { return numFrames; }
+	if(minFrameAddr < stackPointer) { minFrameAddr = stackPointer; }
+
+	// Each frame starts with the caller's frame pointer, followed by the return address.
+	while(numFrames < maxFrames && !(framePointer & (sizeof(Uptr) - 1))
+		  && framePointer >= minFrameAddr && framePointer + 2 * sizeof(Uptr) <= stackMaxAddr)
+	{
+		const Uptr* frame = reinterpret_cast<const Uptr*>(framePointer);
+		const Uptr returnAddress = frame[1];
+		if(!returnAddress) { break; }
+
+		// Subtract 1 from the return address so it's inside the call instruction.
+		outFrameIPs[numFrames++] = returnAddress - 1;
+
+		minFrameAddr = framePointer + 2 * sizeof(Uptr);
+		framePointer = frame[0];
+	}
+
+	return numFrames;
+#else
+	return 0;
+#endif
+}
+
+static void cpuTimeSignalHandler(int signalNumber, siginfo_t* signalInfo, void* signalContext)
+{
+	// Preserve errno for the code that was interrupted by the signal.
+	const int savedErrno = errno;
+
+	// Count the running handlers before loading the sample handler, so stopCPUTimeSampling can
+	// wait for any handler that loaded the sample handler before it was cleared.
+	numRunningCPUTimeSignalHandlers.fetch_add(1, std::memory_order_seq_cst);
+	void (*sampleHandler)(const Uptr*, Uptr) = cpuTimeSampleHandler.load(std::memory_order_seq_cst);
+	if(sampleHandler)
+	{
+		Uptr frameIPs[maxCPUTimeSampleFrames];
+		const Uptr numFrames
+			= captureInterruptedCallStackFrames(signalContext, frameIPs, maxCPUTimeSampleFrames);
+		sampleHandler(frameIPs, numFrames);
+	}
+	numRunningCPUTimeSignalHandlers.fetch_sub(1, std::memory_order_release);
+
+	errno = savedErrno;
+}
+
+bool Platform::startCPUTimeSampling(U64 intervalMicroseconds,
+									void (*sampleHandler)(const Uptr* frameIPs, Uptr numFrames))
+{
+#ifdef __WAVIX__
+	return false;
+#else
+	WAVM_ASSERT(intervalMicroseconds);
+	cpuTimeSampleHandler.store(sampleHandler, std::memory_order_seq_cst);
+
+	// The SIGPROF handler stays installed after sampling stops, so a signal that is already
+	// pending doesn't terminate the process.
+	struct sigaction signalAction;
+	sigemptyset(&signalAction.sa_mask);
+	signalAction.sa_sigaction = cpuTimeSignalHandler;
+	signalAction.sa_flags = SA_SIGINFO | SA_RESTART;
+
+	// ITIMER_PROF counts the CPU time used by all the process's threads, and the kernel delivers
+	// SIGPROF to a thread that is running when it expires.
+	struct itimerval timer;
+	timer.it_interval.tv_sec = time_t(intervalMicroseconds / 1000000);
+	timer.it_interval.tv_usec = suseconds_t(intervalMicroseconds % 1000000);
+	timer.it_value = timer.it_interval;
+	if(sigaction(SIGPROF, &signalAction, nullptr) || setitimer(ITIMER_PROF, &timer, nullptr))
+	{
+		stopCPUTimeSampling();
+		return false;
+	}
+	return true;
+#endif
+}
+
+void Platform::stopCPUTimeSampling()
+{
+#ifndef __WAVIX__
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+
+	// A signal may still be delivered after the timer is stopped, so clear the sample handler, and
+	// wait for the signal handlers that may have loaded it before it was cleared to return.
+	cpuTimeSampleHandler.store(nullptr, std::memory_order_seq_cst);
+	while(numRunningCPUTimeSignalHandlers.load(std::memory_order_acquire))
+	{ yieldToAnotherThread(); }
+}
+
 static void visitFDEs(const U8* ehFrames, Uptr numBytes, void (*visitFDE)(const void*))
 {
 	// The LLVM project libunwind implementation that WAVM uses expects __register_frame and
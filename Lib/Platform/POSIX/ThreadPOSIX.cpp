@@ -16,6 +16,11 @@
 #include <sanitizer/asan_interface.h>
 #endif
 
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#endif
+
 #include "POSIXPrivate.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
@@ -107,6 +112,8 @@ void SigAltStack::deinit()
 			}
 		}
 		base = nullptr;
+		signalSafeStackMinAddr = nullptr;
+		signalSafeStackMaxAddr = nullptr;
 	}
 }
 
@@ -208,6 +215,9 @@ void SigAltStack::init()
 		sigAltStackInfo.ss_sp = base;
 		sigAltStackInfo.ss_flags = 0;
 		WAVM_ERROR_UNLESS(!sigaltstack(&sigAltStackInfo, nullptr));
+
+		signalSafeStackMinAddr = stackMinAddr;
+		signalSafeStackMaxAddr = stackMaxAddr;
 	}
 }
 
@@ -223,6 +233,8 @@ void SigAltStack::getNonSignalStack(U8*& outMinGuardAddr, U8*& outMinAddr, U8*&
 }
 
 thread_local SigAltStack Platform::sigAltStack;
+thread_local U8* Platform::signalSafeStackMinAddr = nullptr;
+thread_local U8* Platform::signalSafeStackMaxAddr = nullptr;
 
 struct ThreadEntryContext
 {
@@ -430,3 +442,41 @@ WAVM_NO_ASAN Thread* Platform::forkCurrentThread()
 Uptr Platform::getNumberOfHardwareThreads() { return std::thread::hardware_concurrency(); }
 
 void Platform::yieldToAnotherThread() { WAVM_ERROR_UNLESS(sched_yield() == 0); }
+
+#ifdef __linux__
+static bool registerPrivateExpeditedMembarrier()
+{
+	return !syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0);
+}
+#endif
+
+void Platform::flushProcessWriteBuffers()
+{
+#ifdef __linux__
+	// Linux 4.14 and later can execute a memory barrier on the process's running threads directly.
+	static const bool isMembarrierRegistered = registerPrivateExpeditedMembarrier();
+	if(isMembarrierRegistered
+	   && !syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0))
+	{ return; }
+#endif
+
+	// Otherwise, change the protection of a page that was just written: the kernel interrupts each
+	// processor that may have the page's mapping cached to invalidate it, which executes a memory
+	// barrier on any thread of the process that is running.
+	static Platform::Mutex helperPageMutex;
+	static U8* helperPage = nullptr;
+	Lock<Platform::Mutex> helperPageLock(helperPageMutex);
+	if(!helperPage)
+	{
+		helperPage = (U8*)mmap(nullptr,
+							   getBytesPerPage(),
+							   PROT_NONE,
+							   MAP_PRIVATE | MAP_ANONYMOUS,
+							   -1,
+							   0);
+		WAVM_ERROR_UNLESS(helperPage != MAP_FAILED);
+	}
+	WAVM_ERROR_UNLESS(!mprotect(helperPage, getBytesPerPage(), PROT_READ | PROT_WRITE));
+	++*(volatile U8*)helperPage;
+	WAVM_ERROR_UNLESS(!mprotect(helperPage, getBytesPerPage(), PROT_NONE));
+}
@@ -672,6 +672,7 @@ struct WindowsFS : HostFS
 	virtual Result openDir(const std::string& path, DirEntStream*& outStream) override;
 
 	virtual Result unlinkFile(const std::string& path) override;
+	virtual Result renameFile(const std::string& oldPath, const std::string& newPath) override;
 	virtual Result removeDir(const std::string& path) override;
 	virtual Result createDir(const std::string& path) override;
 
@@ -820,6 +821,19 @@ Result WindowsFS::unlinkFile(const std::string& path)
 	return DeleteFileW(windowsPath.c_str()) ? Result::success : asVFSResult(GetLastError());
 }
 
+Result WindowsFS::renameFile(const std::string& oldPath, const std::string& newPath)
+{
+	// Convert the paths from UTF-8 VFS paths (with /) to UTF-16 Windows paths (with \).
+	std::wstring oldWindowsPath;
+	std::wstring newWindowsPath;
+	if(!getWindowsPath(oldPath, oldWindowsPath) || !getWindowsPath(newPath, newWindowsPath))
+	{ return Result::invalidNameCharacter; }
+
+	return MoveFileExW(oldWindowsPath.c_str(), newWindowsPath.c_str(), MOVEFILE_REPLACE_EXISTING)
+			   ? Result::success
+			   : asVFSResult(GetLastError());
+}
+
 Result WindowsFS::removeDir(const std::string& path)
 {
 	// Convert the path from a UTF-8 VFS path (with /) to a UTF-16 Windows path (with \).
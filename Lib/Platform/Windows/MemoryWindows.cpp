@@ -27,6 +27,14 @@ Uptr Platform::getBytesPerPageLog2()
 	return preferredVirtualPageSizeLog2;
 }
 
+Uptr Platform::getBytesPerHugePageLog2()
+{
+	// Windows large pages must be committed when they are reserved, and require the process to
+	// have SeLockMemoryPrivilege, so they can't back memory that is reserved and committed
+	// separately.
+	return 0;
+}
+
 static U32 memoryAccessAsWin32Flag(MemoryAccess access)
 {
 	switch(access)
@@ -126,6 +134,22 @@ bool Platform::setVirtualPageAccess(U8* baseVirtualAddress, Uptr numPages, Memor
 		   != 0;
 }
 
+bool Platform::canUseHugePagesForSharedMemory() { return false; }
+
+bool Platform::getWrittenVirtualPages(U8* baseVirtualAddress,
+									  Uptr numPages,
+									  std::vector<bool>& outIsPageWritten)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+	return false;
+}
+
+bool Platform::adviseHugeVirtualPages(U8* baseVirtualAddress, Uptr numPages, bool useHugePages)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+	return false;
+}
+
 void Platform::decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
@@ -133,6 +157,35 @@ void Platform::decommitVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 	if(baseVirtualAddress && !result) { Errors::fatal("VirtualFree(MEM_DECOMMIT) failed"); }
 }
 
+void Platform::resetVirtualPages(U8* baseVirtualAddress, Uptr numPages)
+{
+	// Decommit the pages and commit them again, which zeroes them.
+	decommitVirtualPages(baseVirtualAddress, numPages);
+	if(!commitVirtualPages(baseVirtualAddress, numPages, MemoryAccess::readWrite))
+	{ Errors::fatal("VirtualAlloc(MEM_COMMIT) failed"); }
+}
+
+SharedMemory* Platform::createSharedMemory() { return nullptr; }
+
+SharedMemory* Platform::openSharedMemoryFile(const std::string& path) { return nullptr; }
+
+void Platform::destroySharedMemory(SharedMemory* sharedMemory) { WAVM_UNREACHABLE(); }
+
+bool Platform::resizeSharedMemory(SharedMemory* sharedMemory, Uptr numPages)
+{
+	WAVM_UNREACHABLE();
+}
+
+bool Platform::mapSharedMemoryPages(SharedMemory* sharedMemory,
+									Uptr firstPageIndex,
+									U8* baseVirtualAddress,
+									Uptr numPages,
+									MemoryAccess access,
+									bool copyOnWrite)
+{
+	WAVM_UNREACHABLE();
+}
+
 void Platform::freeVirtualPages(U8* baseVirtualAddress, Uptr numPages)
 {
 	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
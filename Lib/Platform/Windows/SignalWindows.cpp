@@ -112,3 +112,11 @@ bool Platform::catchSignals(void (*thunk)(void*),
 		return true;
 	}
 }
+
+bool Platform::startCPUTimeSampling(U64 intervalMicroseconds,
+									 void (*sampleHandler)(const Uptr* frameIPs, Uptr numFrames))
+{
+	return false;
+}
+
+void Platform::stopCPUTimeSampling() {}
@@ -315,3 +315,5 @@ Uptr Platform::getNumberOfHardwareThreads()
 }
 
 void Platform::yieldToAnotherThread() { SwitchToThread(); }
+
+void Platform::flushProcessWriteBuffers() { FlushProcessWriteBuffers(); }
@@ -25,7 +25,6 @@ Runtime::Compartment::Compartment()
 , globals(0, UINTPTR_MAX - 1)
 , exceptionTypes(0, UINTPTR_MAX - 1)
 , moduleInstances(0, UINTPTR_MAX - 1)
-, contexts(0, maxContexts - 1)
 {
 	runtimeData = (CompartmentRuntimeData*)Platform::allocateAlignedVirtualPages(
 		wavmCompartmentReservedBytes >> Platform::getBytesPerPageLog2(),
@@ -60,12 +59,26 @@ Runtime::Compartment::~Compartment()
 
 Compartment* Runtime::createCompartment() { return new Compartment; }
 
+void Runtime::setCompartmentMaxMemoryReservation(Compartment* compartment, Uptr maxReservedBytes)
+{
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	compartment->maxMemoryReservationBytes = maxReservedBytes;
+}
+
+void Runtime::setCompartmentHugePages(Compartment* compartment, bool useHugePages)
+{
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	compartment->useHugePagesForMemories = useHugePages;
+}
+
 Compartment* Runtime::cloneCompartment(const Compartment* compartment)
 {
 	Timing::Timer timer;
 
 	Compartment* newCompartment = new Compartment;
 	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	newCompartment->maxMemoryReservationBytes = compartment->maxMemoryReservationBytes;
+	newCompartment->useHugePagesForMemories = compartment->useHugePagesForMemories;
 
 	// Clone tables.
 	for(Table* table : compartment->tables)
@@ -86,6 +99,9 @@ Compartment* Runtime::cloneCompartment(const Compartment* compartment)
 	memcpy(newCompartment->initialContextMutableGlobals,
 		   compartment->initialContextMutableGlobals,
 		   sizeof(newCompartment->initialContextMutableGlobals));
+	newCompartment->numInitialContextMutableGlobals.store(
+		compartment->numInitialContextMutableGlobals.load(std::memory_order_relaxed),
+		std::memory_order_relaxed);
 	for(Global* global : compartment->globals)
 	{
 		Global* newGlobal = cloneGlobal(global, newCompartment);
@@ -5,6 +5,7 @@
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
@@ -14,31 +15,140 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
+static Uptr getNumContextSlotPages()
+{
+	return (Uptr(maxContexts) * sizeof(std::atomic<Uptr>) + Platform::getBytesPerPage() - 1)
+		   >> Platform::getBytesPerPageLog2();
+}
+
+Runtime::ContextMap::ContextMap()
+{
+	// Commit the slots up front: their pages aren't backed by physical memory until a context is
+	// added to them, and it lets a slot be read as soon as its ID is allocated.
+	const Uptr numSlotPages = getNumContextSlotPages();
+	U8* slotPages = Platform::allocateVirtualPages(numSlotPages);
+	if(!slotPages || !Platform::commitVirtualPages(slotPages, numSlotPages))
+	{ Errors::fatal("memory allocation for context slots failed"); }
+	slots = (std::atomic<Uptr>*)slotPages;
+}
+
+Runtime::ContextMap::~ContextMap()
+{
+	Platform::freeVirtualPages((U8*)slots, getNumContextSlotPages());
+}
+
+Uptr Runtime::ContextMap::allocateId(bool& outIsNewId)
+{
+	// Try to pop an ID from the free list.
+	Uptr id = UINTPTR_MAX;
+	U64 head = freeListHead.load(std::memory_order_acquire);
+	while(head & 0xffffffff)
+	{
+		// The slot may be reused by another thread that pops the same ID before this thread
+		// does, but then the head's change count will have changed, and the exchange will fail.
+		const Uptr headId = Uptr(head & 0xffffffff) - 1;
+		const Uptr nextIdPlusOne = slots[headId].load(std::memory_order_relaxed) >> 1;
+		const U64 newHead = (((head >> 32) + 1) << 32) | U64(nextIdPlusOne);
+		if(freeListHead.compare_exchange_weak(head, newHead, std::memory_order_acquire))
+		{
+			id = headId;
+			break;
+		}
+	}
+
+	// If the free list was empty, allocate a new ID.
+	outIsNewId = id == UINTPTR_MAX;
+	if(outIsNewId)
+	{
+		id = numAllocatedIds.fetch_add(1, std::memory_order_acq_rel);
+		if(id >= Uptr(maxContexts)) { return UINTPTR_MAX; }
+	}
+
+	// Clear the slot's link to the next free ID, so it isn't mistaken for a context.
+	slots[id].store(0, std::memory_order_relaxed);
+	return id;
+}
+
+void Runtime::ContextMap::set(Uptr id, Context* context)
+{
+	WAVM_ASSERT(id < getNumAllocatedIds());
+	WAVM_ASSERT(context && !(reinterpret_cast<Uptr>(context) & 1));
+	WAVM_ASSERT(!slots[id].load(std::memory_order_relaxed));
+	slots[id].store(reinterpret_cast<Uptr>(context), std::memory_order_release);
+	numContexts.fetch_add(1, std::memory_order_release);
+}
+
+void Runtime::ContextMap::removeOrFail(Uptr id)
+{
+	WAVM_ERROR_UNLESS(get(id));
+	numContexts.fetch_sub(1, std::memory_order_release);
+
+	// Push the ID on the free list.
+	U64 head = freeListHead.load(std::memory_order_relaxed);
+	U64 newHead;
+	do
+	{
+		slots[id].store(Uptr(((head & 0xffffffff) << 1) | 1), std::memory_order_relaxed);
+		newHead = (((head >> 32) + 1) << 32) | U64(id + 1);
+	} while(!freeListHead.compare_exchange_weak(head, newHead, std::memory_order_release));
+}
+
+// Copies the initial values of the mutable globals that may be used in a compartment to a context.
+static void copyInitialMutableGlobals(const Compartment* compartment, Context* context)
+{
+	const U32 numMutableGlobals
+		= compartment->numInitialContextMutableGlobals.load(std::memory_order_acquire);
+	memcpy(context->runtimeData->mutableGlobals,
+		   compartment->initialContextMutableGlobals,
+		   numMutableGlobals * sizeof(IR::UntaggedValue));
+}
+
 Context* Runtime::createContext(Compartment* compartment)
 {
 	WAVM_ASSERT(compartment);
 	Context* context = new Context(compartment);
-	{
-		Lock<Platform::Mutex> lock(compartment->mutex);
 
-		// Allocate an ID for the context in the compartment.
-		context->id = compartment->contexts.add(UINTPTR_MAX, context);
-		if(context->id == UINTPTR_MAX)
-		{
-			delete context;
-			return nullptr;
-		}
-		context->runtimeData = &compartment->runtimeData->contexts[context->id];
+	// Allocate an ID for the context in the compartment.
+	bool isNewId = false;
+	context->id = compartment->contexts.allocateId(isNewId);
+	if(context->id == UINTPTR_MAX)
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		delete context;
+		return nullptr;
+	}
+	context->runtimeData = &compartment->runtimeData->contexts[context->id];
 
-		// Commit the page(s) for the context's runtime data.
+	// Commit the page(s) for the context's runtime data the first time its ID is used. The pages of
+	// reused IDs are still committed.
+	if(isNewId)
+	{
 		WAVM_ERROR_UNLESS(Platform::commitVirtualPages(
 			(U8*)context->runtimeData,
 			sizeof(ContextRuntimeData) >> Platform::getBytesPerPageLog2()));
+	}
+
+	// Clear any interrupt request or fuel left by a previous context with the same ID.
+	context->runtimeData->interruptRequested.store(0, std::memory_order_relaxed);
+	context->runtimeData->fuel = 0;
 
-		// Initialize the context's global data.
-		memcpy(context->runtimeData->mutableGlobals,
-			   compartment->initialContextMutableGlobals,
-			   maxGlobalBytes);
+	// Initialize the context's global data, and add the context to the compartment, without locking
+	// the compartment's mutex. createGlobal and initializeGlobal change an initial value, increment
+	// the version of the initial values, and then write the value to every context in the
+	// compartment. If the version doesn't change between copying the initial values and checking
+	// it after the context was added, a concurrent change was either copied, or will be written to
+	// the context. Otherwise, copy the initial values again.
+	U64 version = compartment->initialContextMutableGlobalsVersion.load(std::memory_order_acquire);
+	copyInitialMutableGlobals(compartment, context);
+	compartment->contexts.set(context->id, context);
+	while(true)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const U64 newVersion
+			= compartment->initialContextMutableGlobalsVersion.load(std::memory_order_acquire);
+		if(newVersion == version) { break; }
+		version = newVersion;
+		copyInitialMutableGlobals(compartment, context);
 	}
 
 	return context;
@@ -47,7 +157,7 @@ Context* Runtime::createContext(Compartment* compartment)
 Runtime::Context::~Context()
 {
 	WAVM_ASSERT_MUTEX_IS_LOCKED_BY_CURRENT_THREAD(compartment->mutex);
-	compartment->contexts.removeOrFail(id);
+	if(id != UINTPTR_MAX) { compartment->contexts.removeOrFail(id); }
 }
 
 Context* Runtime::cloneContext(const Context* context, Compartment* newCompartment)
@@ -57,5 +167,52 @@ Context* Runtime::cloneContext(const Context* context, Compartment* newCompartme
 	memcpy(clonedContext->runtimeData->mutableGlobals,
 		   context->runtimeData->mutableGlobals,
 		   maxGlobalBytes);
+	clonedContext->runtimeData->fuel = context->runtimeData->fuel;
+	clonedContext->outOfFuelCallback = context->outOfFuelCallback;
 	return clonedContext;
 }
+
+void Runtime::interruptContext(Context* context)
+{
+	context->runtimeData->interruptRequested.store(1, std::memory_order_relaxed);
+}
+
+void Runtime::throwInterruptedException(ContextRuntimeData* contextRuntimeData)
+{
+	contextRuntimeData->interruptRequested.store(0, std::memory_order_relaxed);
+	throwException(ExceptionTypes::interrupted);
+}
+
+void Runtime::setContextFuel(Context* context, U64 fuel)
+{
+	context->runtimeData->fuel = fuel > U64(INT64_MAX) ? INT64_MAX : I64(fuel);
+}
+
+void Runtime::addContextFuel(Context* context, U64 additionalFuel)
+{
+	// Saturate the fuel at INT64_MAX. The fuel may be negative, so compute the headroom with
+	// unsigned arithmetic.
+	const I64 fuel = context->runtimeData->fuel;
+	const U64 maxAdditionalFuel = U64(INT64_MAX) - U64(fuel);
+	context->runtimeData->fuel
+		= additionalFuel > maxAdditionalFuel ? INT64_MAX : I64(U64(fuel) + additionalFuel);
+}
+
+U64 Runtime::getContextFuel(const Context* context)
+{
+	const I64 fuel = context->runtimeData->fuel;
+	return fuel < 0 ? 0 : U64(fuel);
+}
+
+void Runtime::setContextOutOfFuelCallback(Context* context,
+										  std::function<void(Context*)>&& callback)
+{
+	context->outOfFuelCallback = std::move(callback);
+}
+
+void Runtime::handleOutOfFuel(ContextRuntimeData* contextRuntimeData)
+{
+	Context* context = getContextFromRuntimeData(contextRuntimeData);
+	if(context->outOfFuelCallback) { context->outOfFuelCallback(context); }
+	if(contextRuntimeData->fuel < 0) { throwException(ExceptionTypes::outOfFuel); }
+}
@@ -17,6 +17,25 @@ using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::Runtime;
 
+// Sets a mutable global's value for all current and future contexts in a compartment. The
+// compartment's mutex must be locked, but createContext doesn't lock it: it copies the initial
+// values, adds the context to the compartment, and then copies them again if their version changed.
+static void setMutableGlobalForAllContexts(Compartment* compartment,
+										   U32 mutableGlobalIndex,
+										   IR::UntaggedValue value)
+{
+	WAVM_ASSERT_MUTEX_IS_LOCKED_BY_CURRENT_THREAD(compartment->mutex);
+	compartment->initialContextMutableGlobals[mutableGlobalIndex] = value;
+
+	// Either createContext sees the new version after adding a context, or the context is visited
+	// here. The fence orders the increment before reading the compartment's contexts, to pair with
+	// the fence in createContext between adding the context and reading the version.
+	compartment->initialContextMutableGlobalsVersion.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for(Context* context : compartment->contexts)
+	{ context->runtimeData->mutableGlobals[mutableGlobalIndex] = value; }
+}
+
 Global* Runtime::createGlobal(Compartment* compartment,
 							  GlobalType type,
 							  ResourceQuotaRefParam resourceQuota)
@@ -24,14 +43,19 @@ Global* Runtime::createGlobal(Compartment* compartment,
 	U32 mutableGlobalIndex = UINT32_MAX;
 	if(type.isMutable)
 	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
 		mutableGlobalIndex = compartment->globalDataAllocationMask.getSmallestNonMember();
 		if(mutableGlobalIndex == maxMutableGlobals) { return nullptr; }
 		compartment->globalDataAllocationMask.add(mutableGlobalIndex);
+		if(mutableGlobalIndex >= compartment->numInitialContextMutableGlobals.load(
+			   std::memory_order_relaxed))
+		{
+			compartment->numInitialContextMutableGlobals.store(mutableGlobalIndex + 1,
+															   std::memory_order_relaxed);
+		}
 
 		// Zero-initialize the global's mutable value for all current and future contexts.
-		compartment->initialContextMutableGlobals[mutableGlobalIndex] = IR::UntaggedValue();
-		for(Context* context : compartment->contexts)
-		{ context->runtimeData->mutableGlobals[mutableGlobalIndex] = IR::UntaggedValue(); }
+		setMutableGlobalForAllContexts(compartment, mutableGlobalIndex, IR::UntaggedValue());
 	}
 
 	// Create the global and add it to the compartment's list of globals.
@@ -63,9 +87,8 @@ void Runtime::initializeGlobal(Global* global, Value value)
 	if(global->type.isMutable)
 	{
 		// Initialize the global's mutable value for all current and future contexts.
-		compartment->initialContextMutableGlobals[global->mutableGlobalIndex] = value;
-		for(Context* context : compartment->contexts)
-		{ context->runtimeData->mutableGlobals[global->mutableGlobalIndex] = value; }
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		setMutableGlobalForAllContexts(compartment, global->mutableGlobalIndex, value);
 	}
 }
 
@@ -0,0 +1,212 @@
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+// A copy of a module instance and context in its own compartment.
+struct PooledInstance
+{
+	GCPointer<Compartment> compartment;
+	GCPointer<ModuleInstance> moduleInstance;
+	GCPointer<Context> context;
+	bool isAcquired = false;
+};
+
+struct Runtime::InstancePool
+{
+	// The copy that the pool's instances are reset to. No code is run in it.
+	PooledInstance snapshot;
+	HashMap<Uptr, std::vector<MemoryPageRange>> memoryIdToModifiedPageRangesMap;
+
+	Platform::Mutex mutex;
+	std::vector<std::unique_ptr<PooledInstance>> instances;
+	std::vector<PooledInstance*> freeInstances;
+	HashMap<const ModuleInstance*, PooledInstance*> moduleInstanceToPooledInstanceMap;
+};
+
+static std::unique_ptr<PooledInstance> clonePooledInstance(ModuleInstance* moduleInstance,
+														   const Context* context)
+{
+	std::unique_ptr<PooledInstance> instance(new PooledInstance);
+	instance->compartment = cloneCompartment(moduleInstance->compartment);
+	instance->moduleInstance = remapToClonedCompartment(moduleInstance, instance->compartment);
+	instance->context = cloneContext(context, instance->compartment);
+	return instance;
+}
+
+static void addPooledInstance(InstancePool* pool, std::unique_ptr<PooledInstance>&& instance)
+{
+	pool->moduleInstanceToPooledInstanceMap.addOrFail(instance->moduleInstance, instance.get());
+	pool->freeInstances.push_back(instance.get());
+	pool->instances.push_back(std::move(instance));
+}
+
+// Resets a pooled instance to the state of the pool's snapshot.
+static void resetPooledInstance(InstancePool* pool, PooledInstance& instance)
+{
+	Compartment* compartment = instance.compartment;
+	Compartment* snapshotCompartment = pool->snapshot.compartment;
+
+	// Pair the snapshot's objects with the objects that have the same IDs in the instance's
+	// compartment. No code is running in the instance, so the objects can be reset after the
+	// compartments are unlocked.
+	std::vector<std::pair<Memory*, Memory*>> memoryPairs;
+	std::vector<std::pair<Table*, Table*>> tablePairs;
+	std::vector<std::pair<ModuleInstance*, ModuleInstance*>> moduleInstancePairs;
+	{
+		Lock<Platform::Mutex> snapshotCompartmentLock(snapshotCompartment->mutex);
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		for(Memory* snapshotMemory : snapshotCompartment->memories)
+		{
+			if(compartment->memories.contains(snapshotMemory->id))
+			{ memoryPairs.push_back({compartment->memories[snapshotMemory->id], snapshotMemory}); }
+		}
+		for(Table* snapshotTable : snapshotCompartment->tables)
+		{
+			if(compartment->tables.contains(snapshotTable->id))
+			{ tablePairs.push_back({compartment->tables[snapshotTable->id], snapshotTable}); }
+		}
+		for(ModuleInstance* snapshotModuleInstance : snapshotCompartment->moduleInstances)
+		{
+			if(compartment->moduleInstances.contains(snapshotModuleInstance->id))
+			{
+				moduleInstancePairs.push_back(
+					{compartment->moduleInstances[snapshotModuleInstance->id],
+					 snapshotModuleInstance});
+			}
+		}
+	}
+
+	for(const auto& memoryPair : memoryPairs)
+	{
+		const std::vector<MemoryPageRange>* modifiedPageRanges
+			= pool->memoryIdToModifiedPageRangesMap.get(memoryPair.second->id);
+		WAVM_ASSERT(modifiedPageRanges);
+		resetMemory(memoryPair.first, memoryPair.second, *modifiedPageRanges);
+	}
+	for(const auto& tablePair : tablePairs) { resetTable(tablePair.first, tablePair.second); }
+
+	// Restore the passive data and elem segments that were dropped.
+	for(const auto& moduleInstancePair : moduleInstancePairs)
+	{
+		ModuleInstance* moduleInstance = moduleInstancePair.first;
+		const ModuleInstance* snapshotModuleInstance = moduleInstancePair.second;
+		{
+			Lock<Platform::Mutex> dataSegmentsLock(moduleInstance->dataSegmentsMutex);
+			moduleInstance->dataSegments = snapshotModuleInstance->dataSegments;
+		}
+		{
+			Lock<Platform::Mutex> elemSegmentsLock(moduleInstance->elemSegmentsMutex);
+			moduleInstance->elemSegments = snapshotModuleInstance->elemSegments;
+		}
+	}
+
+	// Restore the context's mutable globals and fuel, and clear any interrupt request.
+	ContextRuntimeData* contextRuntimeData = instance.context->runtimeData;
+	const ContextRuntimeData* snapshotContextRuntimeData = pool->snapshot.context->runtimeData;
+	memcpy(contextRuntimeData->mutableGlobals,
+		   snapshotContextRuntimeData->mutableGlobals,
+		   maxGlobalBytes);
+	contextRuntimeData->fuel = snapshotContextRuntimeData->fuel;
+	contextRuntimeData->interruptRequested.store(0, std::memory_order_relaxed);
+}
+
+InstancePool* Runtime::createInstancePool(ModuleInstance* moduleInstance,
+										  const Context* context,
+										  Uptr numInstances)
+{
+	WAVM_ERROR_UNLESS(moduleInstance->compartment == context->compartment);
+	Timing::Timer timer;
+
+	InstancePool* pool = new InstancePool;
+	pool->snapshot = std::move(*clonePooledInstance(moduleInstance, context));
+
+	// Find the pages of the snapshot's memories that differ from the images they share with the
+	// instances' memories, which are the only pages that need to be copied to reset an instance.
+	std::vector<Memory*> snapshotMemories;
+	{
+		Lock<Platform::Mutex> snapshotCompartmentLock(pool->snapshot.compartment->mutex);
+		for(Memory* memory : pool->snapshot.compartment->memories)
+		{ snapshotMemories.push_back(memory); }
+	}
+	for(Memory* memory : snapshotMemories)
+	{
+		pool->memoryIdToModifiedPageRangesMap.addOrFail(memory->id,
+														getModifiedMemoryPageRanges(memory));
+	}
+
+	// Clone the pool's instances from the snapshot.
+	for(Uptr instanceIndex = 0; instanceIndex < numInstances; ++instanceIndex)
+	{
+		addPooledInstance(
+			pool, clonePooledInstance(pool->snapshot.moduleInstance, pool->snapshot.context));
+	}
+
+	Timing::logTimer("Created instance pool", timer);
+	return pool;
+}
+
+void Runtime::destroyInstancePool(InstancePool* pool)
+{
+	WAVM_ERROR_UNLESS(pool->freeInstances.size() == pool->instances.size());
+
+	pool->instances.push_back(std::unique_ptr<PooledInstance>(
+		new PooledInstance(std::move(pool->snapshot))));
+	for(std::unique_ptr<PooledInstance>& instance : pool->instances)
+	{
+		instance->moduleInstance = nullptr;
+		instance->context = nullptr;
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(instance->compartment)));
+	}
+
+	delete pool;
+}
+
+ModuleInstance* Runtime::acquirePooledInstance(InstancePool* pool, Context*& outContext)
+{
+	Lock<Platform::Mutex> poolLock(pool->mutex);
+	if(!pool->freeInstances.size())
+	{
+		addPooledInstance(
+			pool, clonePooledInstance(pool->snapshot.moduleInstance, pool->snapshot.context));
+	}
+
+	PooledInstance* instance = pool->freeInstances.back();
+	pool->freeInstances.pop_back();
+	instance->isAcquired = true;
+
+	outContext = instance->context;
+	return instance->moduleInstance;
+}
+
+void Runtime::releasePooledInstance(InstancePool* pool, ModuleInstance* moduleInstance)
+{
+	PooledInstance* instance;
+	{
+		Lock<Platform::Mutex> poolLock(pool->mutex);
+		PooledInstance** instancePointer
+			= pool->moduleInstanceToPooledInstanceMap.get(moduleInstance);
+		WAVM_ERROR_UNLESS(instancePointer && (*instancePointer)->isAcquired);
+		instance = *instancePointer;
+	}
+
+	// The instance isn't in the free list, so it can be reset without holding the pool's lock.
+	resetPooledInstance(pool, *instance);
+
+	Lock<Platform::Mutex> poolLock(pool->mutex);
+	instance->isAcquired = false;
+	pool->freeInstances.push_back(instance);
+}
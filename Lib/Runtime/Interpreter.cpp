@@ -0,0 +1,1649 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/IR.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Intrinsic.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+namespace WAVM { namespace Runtime {
+	// A function definition translated to the interpreter's code: a flat array of instructions
+	// that operate on a stack of untyped 64-bit slots. Block structure is resolved when the code
+	// is translated, so branches jump directly to the index of their target instruction.
+	struct InterpretedCode
+	{
+		enum class Op : U16
+		{
+		// The non-control, non-parametric operators are interpreted as-is.
+#define VISIT_OP(opcode, name, ...) name = opcode,
+			WAVM_ENUM_NONCONTROL_NONPARAMETRIC_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+
+			// The parametric operators, and control flow with resolved branch targets.
+			unreachable = 0xff00,
+			jump,
+			jump_if,
+			jump_unless,
+			branch,
+			branch_if,
+			branch_table,
+			return_,
+			call,
+			call_indirect,
+			drop,
+			select,
+			local_get,
+			local_set,
+			local_tee,
+			global_get,
+			global_get_mutable,
+			global_get_reference,
+			global_set,
+			table_get,
+			table_set,
+			table_grow,
+			table_fill,
+		};
+
+		// The immediates of each Op:
+		//   Loads and stores: a is the offset.
+		//   Constants: a is the low 32 bits of the value, and b is the high 32 bits.
+		//   jump*: a is the index of the target instruction.
+		//   branch*: a is the index of the target instruction, b is the number of values to move
+		//     to the target, and c is the stack height to move them to.
+		//   branch_table: a is the number of branch targets. It is followed by a+1 jump or branch
+		//     instructions, the last of which is the default target.
+		//   call: a is the function index, b is the number of parameters, and c is the number of
+		//     results.
+		//   call_indirect: a is the type index, and b is the table index.
+		//   Other operators take the operator's indices in a and b, in the order of the
+		//   corresponding IR immediate's fields.
+		struct Instruction
+		{
+			Op op;
+			U32 a;
+			U32 b;
+			U32 c;
+		};
+
+		FunctionType type;
+		std::vector<Instruction> instructions;
+		Uptr numLocals;
+		Uptr maxStackHeight;
+	};
+
+	struct InterpretedModule
+	{
+		std::vector<FunctionType> types;
+		std::vector<InterpretedCode> functionDefs;
+	};
+
+	struct InterpretedFunction
+	{
+		const InterpretedInstance* instance;
+		const InterpretedCode* code;
+	};
+
+	struct InterpretedInstance
+	{
+		std::shared_ptr<const InterpretedModule> module;
+		Uptr moduleInstanceId;
+
+		// The instance's functions, imports first, and the IDs of its tables and memories.
+		std::vector<Function*> functions;
+		std::vector<Uptr> tableIds;
+		std::vector<Uptr> memoryIds;
+
+		// For each of the instance's globals: the index of its value in
+		// ContextRuntimeData::mutableGlobals if it's mutable, the global's ID if it's an
+		// immutable reference, or a copy of its value otherwise. The instance is shared by the
+		// clones of its ModuleInstance, so it can't point to the Global objects of any one
+		// compartment: immutable references are looked up in the calling context's compartment,
+		// since they are remapped when the compartment is cloned.
+		struct GlobalBinding
+		{
+			union
+			{
+				U64 immutableValue;
+				Uptr mutableGlobalIndex;
+				Uptr immutableReferenceGlobalId;
+			};
+		};
+		std::vector<GlobalBinding> globals;
+
+		std::vector<InterpretedFunction> functionDefs;
+	};
+}}
+
+typedef InterpretedCode::Op Op;
+typedef InterpretedCode::Instruction Instruction;
+
+// A value on the interpreter's operand stack, or a local variable.
+union Slot
+{
+	I32 i32;
+	U32 u32;
+	I64 i64;
+	U64 u64;
+	F32 f32;
+	F64 f64;
+	Object* object;
+	Function* function;
+};
+static_assert(sizeof(Slot) == sizeof(U64), "Slot is expected to be 64 bits");
+
+// The features of the operators that the interpreter supports.
+static const FeatureSpec& getInterpreterFeatureSpec()
+{
+	static FeatureSpec featureSpec = [] {
+		FeatureSpec result(true);
+		result.simd = false;
+		result.atomics = false;
+		result.exceptionHandling = false;
+		return result;
+	}();
+	return featureSpec;
+}
+
+// Returns the number of bytes needed to pass values of the given types in
+// ContextRuntimeData::thunkArgAndReturnData.
+static Uptr getThunkDataNumBytes(TypeTuple types)
+{
+	Uptr numBytes = 0;
+	for(ValueType type : types)
+	{
+		const Uptr numTypeBytes = getTypeByteWidth(type);
+		numBytes = (numBytes + numTypeBytes - 1) & -numTypeBytes;
+		numBytes += numTypeBytes;
+	}
+	return numBytes;
+}
+
+// Translates a function definition's operators to the interpreter's code in a single pass. The
+// height of the operand stack is known at each operator, so branches can be resolved to the
+// stack height their arguments must be moved to as well as the index of their target.
+struct FunctionTranslator
+{
+	typedef void Result;
+
+	bool isSupported = true;
+
+	FunctionTranslator(const IR::Module& inIRModule,
+					   const FunctionDef& inFunctionDef,
+					   InterpretedCode& inCode)
+	: irModule(inIRModule), functionDef(inFunctionDef), code(inCode)
+	{
+		code.type = irModule.types[functionDef.type.index];
+		code.numLocals = code.type.params().size() + functionDef.nonParameterLocalTypes.size();
+		code.maxStackHeight = 0;
+	}
+
+	void translate()
+	{
+		pushControlStack(ControlContext::Type::function, FunctionType(code.type.results(), {}));
+
+		OperatorDecoderStream decoder(functionDef.code);
+		UnreachableOpVisitor unreachableOpVisitor(*this);
+		while(decoder && controlStack.size() && isSupported)
+		{
+			if(controlStack.back().isReachable) { decoder.decodeOp(*this); }
+			else
+			{
+				decoder.decodeOp(unreachableOpVisitor);
+			}
+		}
+	}
+
+	// The non-control, non-parametric operators are translated to an instruction with the same
+	// opcode, if the interpreter supports the operator's feature.
+#define VISIT_OP(opcode, name, nameString, Imm, signature, requiredFeature)                        \
+	void name(Imm imm)                                                                             \
+	{                                                                                              \
+		if(!getInterpreterFeatureSpec().requiredFeature)                                           \
+		{                                                                                          \
+			isSupported = false;                                                                   \
+			return;                                                                                \
+		}                                                                                          \
+		if(Op::name != Op::nop) { emit(Op::name, imm); }                                           \
+		const FunctionType& opSignature = getNonParametricOpSigs().name;                           \
+		popAndPush(opSignature.params().size(), opSignature.results().size());                     \
+	}
+	WAVM_ENUM_NONCONTROL_NONPARAMETRIC_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+
+	void unknown(Opcode) { WAVM_UNREACHABLE(); }
+
+	// Control structures.
+	void block(ControlStructureImm imm)
+	{
+		pushControlStack(ControlContext::Type::block, resolveBlockType(irModule, imm.type));
+	}
+	void loop(ControlStructureImm imm)
+	{
+		pushControlStack(ControlContext::Type::loop, resolveBlockType(irModule, imm.type));
+	}
+	void if_(ControlStructureImm imm)
+	{
+		// Pop the condition, and jump to the else clause or end if it's zero.
+		popAndPush(1, 0);
+		const U32 elseFixupIndex = emit(Op::jump_unless);
+		pushControlStack(ControlContext::Type::ifThen, resolveBlockType(irModule, imm.type));
+		controlStack.back().elseFixupIndex = elseFixupIndex;
+	}
+	void else_(NoImm)
+	{
+		ControlContext& currentContext = controlStack.back();
+		WAVM_ASSERT(currentContext.type == ControlContext::Type::ifThen);
+
+		// Jump from the end of the then clause to the end of the if.
+		if(currentContext.isReachable)
+		{ currentContext.endFixupIndices.push_back(emit(Op::jump)); }
+
+		// Start the else clause with the if's parameters on the stack.
+		code.instructions[currentContext.elseFixupIndex].a = U32(code.instructions.size());
+		setStackHeight(currentContext.outerStackHeight
+					   + currentContext.blockType.params().size());
+		currentContext.type = ControlContext::Type::ifElse;
+		currentContext.isReachable = true;
+	}
+	void end(NoImm)
+	{
+		ControlContext& currentContext = controlStack.back();
+
+		// If this is the end of an if without an else clause, the if's parameters are passed
+		// through to its results.
+		const U32 endIndex = U32(code.instructions.size());
+		if(currentContext.type == ControlContext::Type::ifThen)
+		{ code.instructions[currentContext.elseFixupIndex].a = endIndex; }
+
+		// Resolve the branches to the end of the control structure.
+		for(U32 fixupIndex : currentContext.endFixupIndices)
+		{ code.instructions[fixupIndex].a = endIndex; }
+
+		setStackHeight(currentContext.outerStackHeight
+					   + currentContext.blockType.results().size());
+
+		const bool isFunctionEnd = currentContext.type == ControlContext::Type::function;
+		controlStack.pop_back();
+		if(isFunctionEnd) { emit(Op::return_); }
+	}
+	void try_(ControlStructureImm) { isSupported = false; }
+	void catch_(ExceptionTypeImm) { isSupported = false; }
+	void catch_all(NoImm) { isSupported = false; }
+
+	// Branches.
+	void unreachable(NoImm)
+	{
+		emit(Op::unreachable);
+		enterUnreachable();
+	}
+	void br(BranchImm imm)
+	{
+		emitBranch(Op::jump, Op::branch, imm.targetDepth);
+		enterUnreachable();
+	}
+	void br_if(BranchImm imm)
+	{
+		popAndPush(1, 0);
+		emitBranch(Op::jump_if, Op::branch_if, imm.targetDepth);
+	}
+	void br_table(BranchTableImm imm)
+	{
+		popAndPush(1, 0);
+		const std::vector<Uptr>& targetDepths = functionDef.branchTables[imm.branchTableIndex];
+		emit(Op::branch_table, U32(targetDepths.size()));
+		for(Uptr targetDepth : targetDepths) { emitBranch(Op::jump, Op::branch, targetDepth); }
+		emitBranch(Op::jump, Op::branch, imm.defaultTargetDepth);
+		enterUnreachable();
+	}
+	void return_(NoImm)
+	{
+		emit(Op::return_);
+		enterUnreachable();
+	}
+
+	// Calls.
+	void call(FunctionImm imm)
+	{
+		const FunctionType calleeType
+			= irModule.types[irModule.functions.getType(imm.functionIndex).index];
+		emit(Op::call,
+			 U32(imm.functionIndex),
+			 U32(calleeType.params().size()),
+			 U32(calleeType.results().size()));
+		popAndPush(calleeType.params().size(), calleeType.results().size());
+	}
+	void call_indirect(CallIndirectImm imm)
+	{
+		const FunctionType calleeType = irModule.types[imm.type.index];
+		emit(Op::call_indirect, U32(imm.type.index), U32(imm.tableIndex));
+		popAndPush(1 + calleeType.params().size(), calleeType.results().size());
+	}
+
+	// Stack manipulation.
+	void drop(NoImm)
+	{
+		emit(Op::drop);
+		popAndPush(1, 0);
+	}
+	void select(SelectImm)
+	{
+		emit(Op::select);
+		popAndPush(3, 1);
+	}
+
+	// Variables.
+	void local_get(GetOrSetVariableImm<false> imm)
+	{
+		emit(Op::local_get, U32(imm.variableIndex));
+		popAndPush(0, 1);
+	}
+	void local_set(GetOrSetVariableImm<false> imm)
+	{
+		emit(Op::local_set, U32(imm.variableIndex));
+		popAndPush(1, 0);
+	}
+	void local_tee(GetOrSetVariableImm<false> imm)
+	{
+		emit(Op::local_tee, U32(imm.variableIndex));
+	}
+	void global_get(GetOrSetVariableImm<true> imm)
+	{
+		const GlobalType globalType = irModule.globals.getType(imm.variableIndex);
+		Op op = Op::global_get;
+		if(globalType.isMutable) { op = Op::global_get_mutable; }
+		else if(isReferenceType(globalType.valueType))
+		{
+			op = Op::global_get_reference;
+		}
+		emit(op, U32(imm.variableIndex));
+		popAndPush(0, 1);
+	}
+	void global_set(GetOrSetVariableImm<true> imm)
+	{
+		emit(Op::global_set, U32(imm.variableIndex));
+		popAndPush(1, 0);
+	}
+
+	// Table access.
+	void table_get(TableImm imm)
+	{
+		emit(Op::table_get, U32(imm.tableIndex));
+		popAndPush(1, 1);
+	}
+	void table_set(TableImm imm)
+	{
+		emit(Op::table_set, U32(imm.tableIndex));
+		popAndPush(2, 0);
+	}
+	void table_grow(TableImm imm)
+	{
+		emit(Op::table_grow, U32(imm.tableIndex));
+		popAndPush(2, 1);
+	}
+	void table_fill(TableImm imm)
+	{
+		emit(Op::table_fill, U32(imm.tableIndex));
+		popAndPush(3, 0);
+	}
+
+	// Exceptions.
+	void throw_(ExceptionTypeImm) { isSupported = false; }
+	void rethrow(RethrowImm) { isSupported = false; }
+
+private:
+	struct ControlContext
+	{
+		enum class Type : U8
+		{
+			function,
+			block,
+			ifThen,
+			ifElse,
+			loop
+		};
+
+		Type type;
+		FunctionType blockType;
+		Uptr outerStackHeight;
+		U32 loopStartIndex;
+		U32 elseFixupIndex;
+		std::vector<U32> endFixupIndices;
+		bool isReachable;
+	};
+
+	// A do-nothing visitor used to decode past unreachable operators, passing through the else or
+	// end operator that ends the unreachable code.
+	struct UnreachableOpVisitor
+	{
+		typedef void Result;
+
+		UnreachableOpVisitor(FunctionTranslator& inTranslator)
+		: translator(inTranslator), unreachableControlDepth(0)
+		{
+		}
+#define VISIT_OP(opcode, name, nameString, Imm, ...)                                               \
+	void name(Imm imm) {}
+		WAVM_ENUM_NONCONTROL_OPERATORS(VISIT_OP)
+		VISIT_OP(_, unknown, "unknown", Opcode)
+#undef VISIT_OP
+
+		void block(ControlStructureImm) { ++unreachableControlDepth; }
+		void loop(ControlStructureImm) { ++unreachableControlDepth; }
+		void if_(ControlStructureImm) { ++unreachableControlDepth; }
+		void try_(ControlStructureImm) { ++unreachableControlDepth; }
+
+		void else_(NoImm imm)
+		{
+			if(!unreachableControlDepth) { translator.else_(imm); }
+		}
+		void end(NoImm imm)
+		{
+			if(!unreachableControlDepth) { translator.end(imm); }
+			else
+			{
+				--unreachableControlDepth;
+			}
+		}
+		void catch_(ExceptionTypeImm imm) { translator.catch_(imm); }
+		void catch_all(NoImm imm) { translator.catch_all(imm); }
+
+	private:
+		FunctionTranslator& translator;
+		Uptr unreachableControlDepth;
+	};
+
+	const IR::Module& irModule;
+	const FunctionDef& functionDef;
+	InterpretedCode& code;
+
+	std::vector<ControlContext> controlStack;
+	Uptr stackHeight = 0;
+
+	void setStackHeight(Uptr newStackHeight)
+	{
+		stackHeight = newStackHeight;
+		if(stackHeight > code.maxStackHeight) { code.maxStackHeight = stackHeight; }
+	}
+
+	void popAndPush(Uptr numPopped, Uptr numPushed)
+	{
+		WAVM_ASSERT(stackHeight >= numPopped);
+		setStackHeight(stackHeight - numPopped + numPushed);
+	}
+
+	void pushControlStack(ControlContext::Type type, FunctionType blockType)
+	{
+		WAVM_ASSERT(stackHeight >= blockType.params().size());
+		ControlContext context;
+		context.type = type;
+		context.blockType = blockType;
+		context.outerStackHeight = stackHeight - blockType.params().size();
+		context.loopStartIndex = U32(code.instructions.size());
+		context.elseFixupIndex = UINT32_MAX;
+		context.isReachable = true;
+		controlStack.push_back(std::move(context));
+	}
+
+	void enterUnreachable() { controlStack.back().isReachable = false; }
+
+	U32 emit(Op op, U32 a = 0, U32 b = 0, U32 c = 0)
+	{
+		const U32 instructionIndex = U32(code.instructions.size());
+		code.instructions.push_back({op, a, b, c});
+		return instructionIndex;
+	}
+
+	// Emits the instructions for operators with an immediate.
+	void emit(Op op, NoImm) { emit(op); }
+	void emit(Op op, MemoryImm imm) { emit(op, U32(imm.memoryIndex)); }
+	void emit(Op op, MemoryCopyImm imm)
+	{
+		emit(op, U32(imm.sourceMemoryIndex), U32(imm.destMemoryIndex));
+	}
+	void emit(Op op, TableImm imm) { emit(op, U32(imm.tableIndex)); }
+	void emit(Op op, TableCopyImm imm)
+	{
+		emit(op, U32(imm.sourceTableIndex), U32(imm.destTableIndex));
+	}
+	void emit(Op op, FunctionImm imm) { emit(op, U32(imm.functionIndex)); }
+	void emit(Op op, DataSegmentAndMemImm imm)
+	{
+		emit(op, U32(imm.dataSegmentIndex), U32(imm.memoryIndex));
+	}
+	void emit(Op op, DataSegmentImm imm) { emit(op, U32(imm.dataSegmentIndex)); }
+	void emit(Op op, ElemSegmentAndTableImm imm)
+	{
+		emit(op, U32(imm.elemSegmentIndex), U32(imm.tableIndex));
+	}
+	void emit(Op op, ElemSegmentImm imm) { emit(op, U32(imm.elemSegmentIndex)); }
+	template<Uptr naturalAlignmentLog2>
+	void emit(Op op, LoadOrStoreImm<naturalAlignmentLog2> imm)
+	{
+		emit(op, imm.offset);
+	}
+	template<typename Value> void emit(Op op, LiteralImm<Value> imm)
+	{
+		static_assert(sizeof(Value) <= sizeof(U64), "unexpected literal size");
+		U64 bits = 0;
+		memcpy(&bits, &imm.value, sizeof(Value));
+		emit(op, U32(bits), U32(bits >> 32));
+	}
+
+	// The immediates of operators for features the interpreter doesn't support.
+	void emit(Op op, LiteralImm<V128>) { WAVM_UNREACHABLE(); }
+	template<Uptr numLanes> void emit(Op op, LaneIndexImm<numLanes>) { WAVM_UNREACHABLE(); }
+	template<Uptr numLanes> void emit(Op op, ShuffleImm<numLanes>) { WAVM_UNREACHABLE(); }
+	template<Uptr naturalAlignmentLog2>
+	void emit(Op op, AtomicLoadOrStoreImm<naturalAlignmentLog2>)
+	{
+		WAVM_UNREACHABLE();
+	}
+
+	// Emits a jump to the target of a branch if the branch's arguments are already at the
+	// target's stack height, or otherwise a branch that moves them there.
+	void emitBranch(Op jumpOp, Op branchOp, Uptr targetDepth)
+	{
+		WAVM_ASSERT(targetDepth < controlStack.size());
+		ControlContext& targetContext = controlStack[controlStack.size() - targetDepth - 1];
+		const bool isLoop = targetContext.type == ControlContext::Type::loop;
+		const Uptr arity = isLoop ? targetContext.blockType.params().size()
+								  : targetContext.blockType.results().size();
+		WAVM_ASSERT(stackHeight >= targetContext.outerStackHeight + arity);
+
+		const U32 instructionIndex
+			= stackHeight == targetContext.outerStackHeight + arity
+				  ? emit(jumpOp)
+				  : emit(branchOp, 0, U32(arity), U32(targetContext.outerStackHeight));
+
+		// Branches to a loop go to its start, and branches to other control structures go to
+		// their end, which is resolved when the end is translated.
+		if(isLoop) { code.instructions[instructionIndex].a = targetContext.loopStartIndex; }
+		else
+		{
+			targetContext.endFixupIndices.push_back(instructionIndex);
+		}
+	}
+};
+
+std::shared_ptr<const InterpretedModule> Runtime::translateModuleForInterpreter(
+	const IR::Module& irModule)
+{
+	Timing::Timer translateTimer;
+
+	// The interpreter passes values to and from compiled code in
+	// ContextRuntimeData::thunkArgAndReturnData, so it doesn't support functions whose parameters
+	// or results don't fit there. It also doesn't support v128 values.
+	for(FunctionType type : irModule.types)
+	{
+		if(getThunkDataNumBytes(type.params()) > maxThunkArgAndReturnBytes
+		   || getThunkDataNumBytes(type.results()) > maxThunkArgAndReturnBytes)
+		{ return nullptr; }
+		for(ValueType valueType : type.params())
+		{
+			if(valueType == ValueType::v128) { return nullptr; }
+		}
+		for(ValueType valueType : type.results())
+		{
+			if(valueType == ValueType::v128) { return nullptr; }
+		}
+	}
+	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
+	{
+		if(irModule.globals.getType(globalIndex).valueType == ValueType::v128) { return nullptr; }
+	}
+
+	auto interpretedModule = std::make_shared<InterpretedModule>();
+	interpretedModule->types = irModule.types;
+	interpretedModule->functionDefs.resize(irModule.functions.defs.size());
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
+	{
+		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
+		for(ValueType localType : functionDef.nonParameterLocalTypes)
+		{
+			if(localType == ValueType::v128) { return nullptr; }
+		}
+
+		FunctionTranslator translator(
+			irModule, functionDef, interpretedModule->functionDefs[functionDefIndex]);
+		translator.translate();
+		if(!translator.isSupported) { return nullptr; }
+	}
+
+	Timing::logRatePerSecond("Translated module for the interpreter",
+							 translateTimer,
+							 (F64)irModule.functions.defs.size(),
+							 "functions");
+	return interpretedModule;
+}
+
+//
+// Helper functions for the interpreter's instructions.
+//
+
+static U64 countSetBits(U64 value)
+{
+	value = value - ((value >> 1) & 0x5555555555555555ull);
+	value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+	value = (value + (value >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (value * 0x0101010101010101ull) >> 56;
+}
+
+static U32 countSetBits(U32 value) { return U32(countSetBits(U64(value))); }
+
+template<typename UInt> static UInt rotateLeft(UInt value, UInt count)
+{
+	const UInt mask = sizeof(UInt) * 8 - 1;
+	count &= mask;
+	return (value << count) | (value >> ((UInt(0) - count) & mask));
+}
+
+template<typename UInt> static UInt rotateRight(UInt value, UInt count)
+{
+	const UInt mask = sizeof(UInt) * 8 - 1;
+	count &= mask;
+	return (value >> count) | (value << ((UInt(0) - count) & mask));
+}
+
+template<typename Int> static Int divideSigned(Int left, Int right)
+{
+	if(right == 0 || (left == std::numeric_limits<Int>::min() && right == -1))
+	{ throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
+	return left / right;
+}
+
+template<typename Int> static Int remainderSigned(Int left, Int right)
+{
+	if(right == 0) { throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
+	return right == -1 ? 0 : left % right;
+}
+
+template<typename UInt> static UInt divideUnsigned(UInt left, UInt right)
+{
+	if(right == 0) { throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
+	return left / right;
+}
+
+template<typename UInt> static UInt remainderUnsigned(UInt left, UInt right)
+{
+	if(right == 0) { throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
+	return left % right;
+}
+
+// min and max return a NaN operand as-is, and order -0 before +0, like the compiled code.
+template<typename Float, typename Bits> static Float floatMin(Float left, Float right)
+{
+	if(left != left) { return left; }
+	else if(right != right)
+	{
+		return right;
+	}
+	else if(left < right)
+	{
+		return left;
+	}
+	else if(left > right)
+	{
+		return right;
+	}
+
+	Bits leftBits;
+	Bits rightBits;
+	memcpy(&leftBits, &left, sizeof(Float));
+	memcpy(&rightBits, &right, sizeof(Float));
+	const Bits resultBits = leftBits | rightBits;
+	Float result;
+	memcpy(&result, &resultBits, sizeof(Float));
+	return result;
+}
+
+template<typename Float, typename Bits> static Float floatMax(Float left, Float right)
+{
+	if(left != left) { return left; }
+	else if(right != right)
+	{
+		return right;
+	}
+	else if(left < right)
+	{
+		return right;
+	}
+	else if(left > right)
+	{
+		return left;
+	}
+
+	Bits leftBits;
+	Bits rightBits;
+	memcpy(&leftBits, &left, sizeof(Float));
+	memcpy(&rightBits, &right, sizeof(Float));
+	const Bits resultBits = leftBits & rightBits;
+	Float result;
+	memcpy(&result, &resultBits, sizeof(Float));
+	return result;
+}
+
+// minBounds and maxBounds are the widest floats that can't be truncated to an integer in range,
+// the same bounds used by the compiled code.
+template<typename Int, typename Float>
+static Int truncFloatToInt(Float value, Float minBounds, Float maxBounds)
+{
+	if(value != value) { throwException(ExceptionTypes::invalidFloatOperation); }
+	if(value >= maxBounds || value <= minBounds)
+	{ throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
+	return Int(value);
+}
+
+template<typename Int, typename Float>
+static Int truncFloatToIntSat(Float value,
+							  Float minFloatBounds,
+							  Float maxFloatBounds,
+							  Int minIntBounds,
+							  Int maxIntBounds)
+{
+	if(value != value) { return 0; }
+	else if(value >= maxFloatBounds)
+	{
+		return maxIntBounds;
+	}
+	else if(value <= minFloatBounds)
+	{
+		return minIntBounds;
+	}
+	return Int(value);
+}
+
+// Copies values between the interpreter's slots and the naturally aligned layout used by
+// ContextRuntimeData::thunkArgAndReturnData.
+static void copyToThunkData(TypeTuple types, const Slot* values, U8* thunkData)
+{
+	Uptr offset = 0;
+	for(Uptr valueIndex = 0; valueIndex < types.size(); ++valueIndex)
+	{
+		const Uptr numValueBytes = getTypeByteWidth(types[valueIndex]);
+		offset = (offset + numValueBytes - 1) & -numValueBytes;
+		WAVM_ASSERT(offset + numValueBytes <= maxThunkArgAndReturnBytes);
+		memcpy(thunkData + offset, &values[valueIndex], numValueBytes);
+		offset += numValueBytes;
+	}
+}
+
+static void copyFromThunkData(TypeTuple types, const U8* thunkData, Slot* values)
+{
+	Uptr offset = 0;
+	for(Uptr valueIndex = 0; valueIndex < types.size(); ++valueIndex)
+	{
+		const Uptr numValueBytes = getTypeByteWidth(types[valueIndex]);
+		offset = (offset + numValueBytes - 1) & -numValueBytes;
+		WAVM_ASSERT(offset + numValueBytes <= maxThunkArgAndReturnBytes);
+		values[valueIndex].u64 = 0;
+		memcpy(&values[valueIndex], thunkData + offset, numValueBytes);
+		offset += numValueBytes;
+	}
+}
+
+static ContextRuntimeData* interpret(const InterpretedFunction& function,
+									 ContextRuntimeData* contextRuntimeData,
+									 Slot* argsAndResults);
+
+// Calls a function with arguments in argsAndResults, and writes its results there. Interpreted
+// functions are called directly, and other functions are called through an invoke thunk.
+static ContextRuntimeData* callFunction(const Function* callee,
+										ContextRuntimeData* contextRuntimeData,
+										Slot* argsAndResults)
+{
+	if(const InterpretedFunction* interpretedCallee = callee->mutableData->interpretedFunction)
+	{ return interpret(*interpretedCallee, contextRuntimeData, argsAndResults); }
+
+	const FunctionType calleeType{callee->encodedType};
+
+	// Get the invoke thunk for the callee's type, and cache it in the function's
+	// FunctionMutableData like invokeFunctionUnchecked does.
+	InvokeThunkPointer invokeThunk
+		= callee->mutableData->invokeThunk.load(std::memory_order_acquire);
+	while(!invokeThunk)
+	{
+		InvokeThunkPointer newInvokeThunk = LLVMJIT::getInvokeThunk(calleeType);
+		callee->mutableData->invokeThunk.compare_exchange_strong(
+			invokeThunk, newInvokeThunk, std::memory_order_acq_rel);
+	};
+
+	copyToThunkData(calleeType.params(), argsAndResults, contextRuntimeData->thunkArgAndReturnData);
+	contextRuntimeData = (*invokeThunk)(callee, contextRuntimeData);
+	copyFromThunkData(
+		calleeType.results(), contextRuntimeData->thunkArgAndReturnData, argsAndResults);
+	return contextRuntimeData;
+}
+
+// The entry point for calls to interpreted functions from compiled code or invokeFunction: it has
+// the same signature as an invoke thunk.
+static ContextRuntimeData* invokeInterpretedFunction(const Function* function,
+													 ContextRuntimeData* contextRuntimeData)
+{
+	const InterpretedFunction* interpretedFunction = function->mutableData->interpretedFunction;
+	WAVM_ASSERT(interpretedFunction);
+
+	const FunctionType type = interpretedFunction->code->type;
+	Slot* argsAndResults = (Slot*)alloca(
+		std::max(type.params().size(), type.results().size()) * sizeof(Slot) + 1);
+	copyFromThunkData(type.params(), contextRuntimeData->thunkArgAndReturnData, argsAndResults);
+	contextRuntimeData = interpret(*interpretedFunction, contextRuntimeData, argsAndResults);
+	copyToThunkData(type.results(), argsAndResults, contextRuntimeData->thunkArgAndReturnData);
+	return contextRuntimeData;
+}
+
+// Calls the function in a table element, after checking that it has the expected type.
+static ContextRuntimeData* callIndirect(const InterpretedInstance& instance,
+										ContextRuntimeData* contextRuntimeData,
+										Uptr typeIndex,
+										Uptr tableIndex,
+										U32 elementIndex,
+										Slot* argsAndResults)
+{
+	// Read the table element without locking the compartment, like the compiled code does. An
+	// index past the end of the table reads an out-of-bounds sentinel element, or faults in the
+	// table's guard pages.
+	const Uptr tableId = instance.tableIds[tableIndex];
+	const Table::Element* elements = reinterpret_cast<const Table::Element*>(
+		getCompartmentRuntimeData(contextRuntimeData)->tableBases[tableId]);
+	const Uptr biasedValue = elements[elementIndex].biasedValue.load(std::memory_order_acquire);
+	Function* callee = reinterpret_cast<Function*>(
+		biasedValue + reinterpret_cast<Uptr>(getOutOfBoundsElement()));
+
+	// The out-of-bounds and uninitialized sentinel elements never match the expected type.
+	const FunctionType::Encoding expectedEncoding
+		= instance.module->types[typeIndex].getEncoding();
+	if(callee->encodedType.impl != expectedEncoding.impl)
+	{
+		throwCallIndirectFailure(getTableFromRuntimeData(contextRuntimeData, tableId),
+								 elementIndex,
+								 callee,
+								 expectedEncoding.impl);
+	}
+
+	return callFunction(callee, contextRuntimeData, argsAndResults);
+}
+
+static void memoryInit(const InterpretedInstance& instance,
+					   ContextRuntimeData* contextRuntimeData,
+					   Uptr dataSegmentIndex,
+					   Uptr memoryIndex,
+					   U32 destAddress,
+					   U32 sourceOffset,
+					   U32 numBytes)
+{
+	ModuleInstance* moduleInstance
+		= getModuleInstanceFromRuntimeData(contextRuntimeData, instance.moduleInstanceId);
+	Memory* memory = getMemoryFromRuntimeData(contextRuntimeData, instance.memoryIds[memoryIndex]);
+
+	Lock<Platform::Mutex> dataSegmentsLock(moduleInstance->dataSegmentsMutex);
+	if(!moduleInstance->dataSegments[dataSegmentIndex])
+	{ throwException(ExceptionTypes::invalidArgument); }
+
+	// Make a copy of the shared_ptr to the data and unlock the data segments mutex.
+	std::shared_ptr<std::vector<U8>> dataVector = moduleInstance->dataSegments[dataSegmentIndex];
+	dataSegmentsLock.unlock();
+
+	initDataSegment(moduleInstance,
+					dataSegmentIndex,
+					dataVector.get(),
+					memory,
+					destAddress,
+					sourceOffset,
+					numBytes);
+}
+
+static void dataDrop(const InterpretedInstance& instance,
+					 ContextRuntimeData* contextRuntimeData,
+					 Uptr dataSegmentIndex)
+{
+	ModuleInstance* moduleInstance
+		= getModuleInstanceFromRuntimeData(contextRuntimeData, instance.moduleInstanceId);
+	Lock<Platform::Mutex> dataSegmentsLock(moduleInstance->dataSegmentsMutex);
+	if(!moduleInstance->dataSegments[dataSegmentIndex])
+	{ throwException(ExceptionTypes::invalidArgument); }
+	moduleInstance->dataSegments[dataSegmentIndex].reset();
+}
+
+static void memoryCopy(const InterpretedInstance& instance,
+					   ContextRuntimeData* contextRuntimeData,
+					   Uptr sourceMemoryIndex,
+					   Uptr destMemoryIndex,
+					   U32 destAddress,
+					   U32 sourceAddress,
+					   U32 numBytes)
+{
+	Memory* sourceMemory
+		= getMemoryFromRuntimeData(contextRuntimeData, instance.memoryIds[sourceMemoryIndex]);
+	Memory* destMemory
+		= getMemoryFromRuntimeData(contextRuntimeData, instance.memoryIds[destMemoryIndex]);
+
+	U8* destPointer = getReservedMemoryOffsetRange(destMemory, destAddress, numBytes);
+	U8* sourcePointer = getReservedMemoryOffsetRange(sourceMemory, sourceAddress, numBytes);
+	unwindSignalsAsExceptions([=] { bytewiseMemMove(destPointer, sourcePointer, numBytes); });
+}
+
+static void memoryFill(const InterpretedInstance& instance,
+					   ContextRuntimeData* contextRuntimeData,
+					   Uptr memoryIndex,
+					   U32 destAddress,
+					   U32 value,
+					   U32 numBytes)
+{
+	Memory* memory = getMemoryFromRuntimeData(contextRuntimeData, instance.memoryIds[memoryIndex]);
+	U8* destPointer = getReservedMemoryOffsetRange(memory, destAddress, numBytes);
+	unwindSignalsAsExceptions([=] { bytewiseMemSet(destPointer, U8(value), numBytes); });
+}
+
+static void tableInit(const InterpretedInstance& instance,
+					  ContextRuntimeData* contextRuntimeData,
+					  Uptr elemSegmentIndex,
+					  Uptr tableIndex,
+					  U32 destIndex,
+					  U32 sourceIndex,
+					  U32 numElems)
+{
+	ModuleInstance* moduleInstance
+		= getModuleInstanceFromRuntimeData(contextRuntimeData, instance.moduleInstanceId);
+	Table* table = getTableFromRuntimeData(contextRuntimeData, instance.tableIds[tableIndex]);
+
+	Lock<Platform::Mutex> elemSegmentsLock(moduleInstance->elemSegmentsMutex);
+	if(!moduleInstance->elemSegments[elemSegmentIndex])
+	{ throwException(ExceptionTypes::invalidArgument); }
+
+	// Make a copy of the shared_ptr to the elems and unlock the elem segments mutex.
+	std::shared_ptr<std::vector<IR::Elem>> elemVector
+		= moduleInstance->elemSegments[elemSegmentIndex];
+	elemSegmentsLock.unlock();
+
+	initElemSegment(moduleInstance,
+					elemSegmentIndex,
+					elemVector.get(),
+					table,
+					destIndex,
+					sourceIndex,
+					numElems);
+}
+
+static void elemDrop(const InterpretedInstance& instance,
+					 ContextRuntimeData* contextRuntimeData,
+					 Uptr elemSegmentIndex)
+{
+	ModuleInstance* moduleInstance
+		= getModuleInstanceFromRuntimeData(contextRuntimeData, instance.moduleInstanceId);
+	Lock<Platform::Mutex> elemSegmentsLock(moduleInstance->elemSegmentsMutex);
+	if(!moduleInstance->elemSegments[elemSegmentIndex])
+	{ throwException(ExceptionTypes::invalidArgument); }
+	moduleInstance->elemSegments[elemSegmentIndex].reset();
+}
+
+static void tableCopy(const InterpretedInstance& instance,
+					  ContextRuntimeData* contextRuntimeData,
+					  Uptr sourceTableIndex,
+					  Uptr destTableIndex,
+					  U32 destOffset,
+					  U32 sourceOffset,
+					  U32 numElements)
+{
+	Table* sourceTable
+		= getTableFromRuntimeData(contextRuntimeData, instance.tableIds[sourceTableIndex]);
+	Table* destTable
+		= getTableFromRuntimeData(contextRuntimeData, instance.tableIds[destTableIndex]);
+
+	// When copying to higher indices, copy the elements in descending order to ensure that source
+	// elements may only be overwritten after they have been copied.
+	for(Uptr index = 0; index < numElements; ++index)
+	{
+		const Uptr elementIndex = sourceOffset < destOffset ? numElements - index - 1 : index;
+		setTableElement(destTable,
+						U64(destOffset) + U64(elementIndex),
+						getTableElement(sourceTable, U64(sourceOffset) + U64(elementIndex)));
+	}
+}
+
+static void tableFill(const InterpretedInstance& instance,
+					  ContextRuntimeData* contextRuntimeData,
+					  Uptr tableIndex,
+					  U32 destOffset,
+					  Object* value,
+					  U32 numElements)
+{
+	Table* table = getTableFromRuntimeData(contextRuntimeData, instance.tableIds[tableIndex]);
+	for(Uptr index = 0; index < numElements; ++index)
+	{ setTableElement(table, U64(destOffset) + U64(index), value); }
+}
+
+// Traps if Runtime::interruptContext has been called for the context.
+static void checkInterrupt(ContextRuntimeData* contextRuntimeData)
+{
+	if(WAVM_UNLIKELY(contextRuntimeData->interruptRequested.load(std::memory_order_relaxed)))
+	{ throwInterruptedException(contextRuntimeData); }
+}
+
+// Executes an interpreted function with the arguments in argsAndResults, and writes its results
+// there. The function's locals and operand stack are allocated on the native stack, and this
+// function doesn't hold any objects with destructors, so it's safe for a signal caught by
+// Platform::catchSignals to unwind through it, the same as compiled code.
+static ContextRuntimeData* interpret(const InterpretedFunction& function,
+									 ContextRuntimeData* contextRuntimeData,
+									 Slot* argsAndResults)
+{
+	const InterpretedInstance& instance = *function.instance;
+	const InterpretedCode& code = *function.code;
+	const Uptr numParams = code.type.params().size();
+	const Uptr numResults = code.type.results().size();
+
+	// Allocate the locals followed by the operand stack, and initialize the locals.
+	Slot* locals = (Slot*)alloca((code.numLocals + code.maxStackHeight) * sizeof(Slot) + 1);
+	memcpy(locals, argsAndResults, numParams * sizeof(Slot));
+	memset(locals + numParams, 0, (code.numLocals - numParams) * sizeof(Slot));
+	Slot* stack = locals + code.numLocals;
+	Slot* sp = stack;
+
+	// The memory's base address never changes, so the default memory's base is loaded once.
+	U8* memoryBase = nullptr;
+	if(instance.memoryIds.size())
+	{
+		memoryBase = (U8*)getCompartmentRuntimeData(contextRuntimeData)
+						 ->memoryBases[instance.memoryIds[0]];
+	}
+
+	// Check whether the context has been interrupted on entry to the function and on backward
+	// branches, which is where compiled code checks it when it's compiled with
+	// CompileOptions::interruptible.
+	checkInterrupt(contextRuntimeData);
+
+	const Instruction* instructions = code.instructions.data();
+	const Instruction* ip = instructions;
+	while(true)
+	{
+		const Instruction& instruction = *ip++;
+		switch(instruction.op)
+		{
+#define UNARY_OP(name, operandField, resultField, expression)                                      \
+	case Op::name: {                                                                               \
+		const auto operand = sp[-1].operandField;                                                  \
+		sp[-1].resultField = (expression);                                                         \
+		break;                                                                                     \
+	}
+
+#define BINARY_OP(name, operandField, resultField, expression)                                     \
+	case Op::name: {                                                                               \
+		const auto left = sp[-2].operandField;                                                     \
+		const auto right = sp[-1].operandField;                                                    \
+		--sp;                                                                                      \
+		sp[-1].resultField = (expression);                                                         \
+		break;                                                                                     \
+	}
+
+		// Loads and stores access the memory without bounds checks, relying on the memory's
+		// reserved address space and guard pages to fault on out-of-bounds accesses, like the
+		// compiled code does.
+#define LOAD_OP(name, resultField, MemoryType)                                                     \
+	case Op::name: {                                                                               \
+		MemoryType value;                                                                          \
+		memcpy(&value, memoryBase + U64(sp[-1].u32) + instruction.a, sizeof(MemoryType));          \
+		sp[-1].resultField = value;                                                                \
+		break;                                                                                     \
+	}
+
+#define STORE_OP(name, valueField, MemoryType)                                                     \
+	case Op::name: {                                                                               \
+		const MemoryType value = MemoryType(sp[-1].valueField);                                    \
+		memcpy(memoryBase + U64(sp[-2].u32) + instruction.a, &value, sizeof(MemoryType));          \
+		sp -= 2;                                                                                   \
+		break;                                                                                     \
+	}
+
+		// Control flow
+		case Op::unreachable: throwException(ExceptionTypes::reachedUnreachable);
+		case Op::jump:
+			if(instructions + instruction.a < ip) { checkInterrupt(contextRuntimeData); }
+			ip = instructions + instruction.a;
+			break;
+		case Op::jump_if:
+			if((--sp)->u32) { ip = instructions + instruction.a; }
+			break;
+		case Op::jump_unless:
+			if(!(--sp)->u32) { ip = instructions + instruction.a; }
+			break;
+		case Op::branch_if:
+			if(!(--sp)->u32) { break; }
+			// fallthrough
+		case Op::branch: {
+			// Move the branch arguments to the target's stack height.
+			Slot* targetSp = stack + instruction.c;
+			for(U32 argIndex = 0; argIndex < instruction.b; ++argIndex)
+			{ targetSp[argIndex] = sp[argIndex - instruction.b]; }
+			sp = targetSp + instruction.b;
+			if(instructions + instruction.a < ip) { checkInterrupt(contextRuntimeData); }
+			ip = instructions + instruction.a;
+			break;
+		}
+		case Op::branch_table: {
+			// Select one of the branches following this instruction.
+			const U32 index = (--sp)->u32;
+			ip += index < instruction.a ? index : instruction.a;
+			break;
+		}
+		case Op::return_:
+			memcpy(argsAndResults, sp - numResults, numResults * sizeof(Slot));
+			return contextRuntimeData;
+
+		// Calls
+		case Op::call: {
+			Slot* calleeArgsAndResults = sp - instruction.b;
+			contextRuntimeData = callFunction(
+				instance.functions[instruction.a], contextRuntimeData, calleeArgsAndResults);
+			sp = calleeArgsAndResults + instruction.c;
+			break;
+		}
+		case Op::call_indirect: {
+			const FunctionType calleeType = instance.module->types[instruction.a];
+			const U32 elementIndex = (--sp)->u32;
+			Slot* calleeArgsAndResults = sp - calleeType.params().size();
+			contextRuntimeData = callIndirect(instance,
+											  contextRuntimeData,
+											  instruction.a,
+											  instruction.b,
+											  elementIndex,
+											  calleeArgsAndResults);
+			sp = calleeArgsAndResults + calleeType.results().size();
+			break;
+		}
+
+		// Stack manipulation
+		case Op::drop: --sp; break;
+		case Op::select: {
+			const U32 condition = sp[-1].u32;
+			sp -= 2;
+			if(!condition) { sp[-1] = sp[0]; }
+			break;
+		}
+
+		// Variables
+		case Op::local_get: *sp++ = locals[instruction.a]; break;
+		case Op::local_set: locals[instruction.a] = *--sp; break;
+		case Op::local_tee: locals[instruction.a] = sp[-1]; break;
+		case Op::global_get: (sp++)->u64 = instance.globals[instruction.a].immutableValue; break;
+		case Op::global_get_mutable:
+			(sp++)->u64 = contextRuntimeData
+							  ->mutableGlobals[instance.globals[instruction.a].mutableGlobalIndex]
+							  .u64;
+			break;
+		case Op::global_get_reference:
+			(sp++)->object
+				= getGlobalFromRuntimeData(contextRuntimeData,
+										   instance.globals[instruction.a].immutableReferenceGlobalId)
+					  ->initialValue.object;
+			break;
+		case Op::global_set:
+			contextRuntimeData->mutableGlobals[instance.globals[instruction.a].mutableGlobalIndex]
+				.u64
+				= (--sp)->u64;
+			break;
+
+		// Memory
+		LOAD_OP(i32_load, i32, I32)
+		LOAD_OP(i64_load, i64, I64)
+		LOAD_OP(f32_load, f32, F32)
+		LOAD_OP(f64_load, f64, F64)
+		LOAD_OP(i32_load8_s, i32, I8)
+		LOAD_OP(i32_load8_u, u32, U8)
+		LOAD_OP(i32_load16_s, i32, I16)
+		LOAD_OP(i32_load16_u, u32, U16)
+		LOAD_OP(i64_load8_s, i64, I8)
+		LOAD_OP(i64_load8_u, u64, U8)
+		LOAD_OP(i64_load16_s, i64, I16)
+		LOAD_OP(i64_load16_u, u64, U16)
+		LOAD_OP(i64_load32_s, i64, I32)
+		LOAD_OP(i64_load32_u, u64, U32)
+		STORE_OP(i32_store, i32, I32)
+		STORE_OP(i64_store, i64, I64)
+		STORE_OP(f32_store, f32, F32)
+		STORE_OP(f64_store, f64, F64)
+		STORE_OP(i32_store8, u32, U8)
+		STORE_OP(i32_store16, u32, U16)
+		STORE_OP(i64_store8, u64, U8)
+		STORE_OP(i64_store16, u64, U16)
+		STORE_OP(i64_store32, u64, U32)
+
+		case Op::memory_size: {
+			Memory* memory = getMemoryFromRuntimeData(contextRuntimeData,
+													  instance.memoryIds[instruction.a]);
+			(sp++)->u32 = U32(getMemoryNumPages(memory));
+			break;
+		}
+		case Op::memory_grow: {
+			Memory* memory = getMemoryFromRuntimeData(contextRuntimeData,
+													  instance.memoryIds[instruction.a]);
+			Uptr oldNumPages = 0;
+			sp[-1].i32 = growMemory(memory, sp[-1].u32, &oldNumPages) ? I32(oldNumPages) : -1;
+			break;
+		}
+
+		// Literals
+		case Op::i32_const:
+		case Op::f32_const: (sp++)->u32 = instruction.a; break;
+		case Op::i64_const:
+		case Op::f64_const: (sp++)->u64 = U64(instruction.a) | (U64(instruction.b) << 32); break;
+
+		// Comparisons
+		UNARY_OP(i32_eqz, u32, i32, operand == 0)
+		BINARY_OP(i32_eq, u32, i32, left == right)
+		BINARY_OP(i32_ne, u32, i32, left != right)
+		BINARY_OP(i32_lt_s, i32, i32, left < right)
+		BINARY_OP(i32_lt_u, u32, i32, left < right)
+		BINARY_OP(i32_gt_s, i32, i32, left > right)
+		BINARY_OP(i32_gt_u, u32, i32, left > right)
+		BINARY_OP(i32_le_s, i32, i32, left <= right)
+		BINARY_OP(i32_le_u, u32, i32, left <= right)
+		BINARY_OP(i32_ge_s, i32, i32, left >= right)
+		BINARY_OP(i32_ge_u, u32, i32, left >= right)
+		UNARY_OP(i64_eqz, u64, i32, operand == 0)
+		BINARY_OP(i64_eq, u64, i32, left == right)
+		BINARY_OP(i64_ne, u64, i32, left != right)
+		BINARY_OP(i64_lt_s, i64, i32, left < right)
+		BINARY_OP(i64_lt_u, u64, i32, left < right)
+		BINARY_OP(i64_gt_s, i64, i32, left > right)
+		BINARY_OP(i64_gt_u, u64, i32, left > right)
+		BINARY_OP(i64_le_s, i64, i32, left <= right)
+		BINARY_OP(i64_le_u, u64, i32, left <= right)
+		BINARY_OP(i64_ge_s, i64, i32, left >= right)
+		BINARY_OP(i64_ge_u, u64, i32, left >= right)
+		BINARY_OP(f32_eq, f32, i32, left == right)
+		BINARY_OP(f32_ne, f32, i32, left != right)
+		BINARY_OP(f32_lt, f32, i32, left < right)
+		BINARY_OP(f32_gt, f32, i32, left > right)
+		BINARY_OP(f32_le, f32, i32, left <= right)
+		BINARY_OP(f32_ge, f32, i32, left >= right)
+		BINARY_OP(f64_eq, f64, i32, left == right)
+		BINARY_OP(f64_ne, f64, i32, left != right)
+		BINARY_OP(f64_lt, f64, i32, left < right)
+		BINARY_OP(f64_gt, f64, i32, left > right)
+		BINARY_OP(f64_le, f64, i32, left <= right)
+		BINARY_OP(f64_ge, f64, i32, left >= right)
+
+		// i32 arithmetic
+		UNARY_OP(i32_clz, u32, u32, countLeadingZeroes(operand))
+		UNARY_OP(i32_ctz, u32, u32, countTrailingZeroes(operand))
+		UNARY_OP(i32_popcnt, u32, u32, countSetBits(operand))
+		BINARY_OP(i32_add, u32, u32, left + right)
+		BINARY_OP(i32_sub, u32, u32, left - right)
+		BINARY_OP(i32_mul, u32, u32, left * right)
+		BINARY_OP(i32_div_s, i32, i32, divideSigned(left, right))
+		BINARY_OP(i32_div_u, u32, u32, divideUnsigned(left, right))
+		BINARY_OP(i32_rem_s, i32, i32, remainderSigned(left, right))
+		BINARY_OP(i32_rem_u, u32, u32, remainderUnsigned(left, right))
+		BINARY_OP(i32_and_, u32, u32, left & right)
+		BINARY_OP(i32_or_, u32, u32, left | right)
+		BINARY_OP(i32_xor_, u32, u32, left ^ right)
+		BINARY_OP(i32_shl, u32, u32, left << (right & 31))
+		BINARY_OP(i32_shr_s, i32, i32, left >> (right & 31))
+		BINARY_OP(i32_shr_u, u32, u32, left >> (right & 31))
+		BINARY_OP(i32_rotl, u32, u32, rotateLeft(left, right))
+		BINARY_OP(i32_rotr, u32, u32, rotateRight(left, right))
+
+		// i64 arithmetic
+		UNARY_OP(i64_clz, u64, u64, countLeadingZeroes(operand))
+		UNARY_OP(i64_ctz, u64, u64, countTrailingZeroes(operand))
+		UNARY_OP(i64_popcnt, u64, u64, countSetBits(operand))
+		BINARY_OP(i64_add, u64, u64, left + right)
+		BINARY_OP(i64_sub, u64, u64, left - right)
+		BINARY_OP(i64_mul, u64, u64, left * right)
+		BINARY_OP(i64_div_s, i64, i64, divideSigned(left, right))
+		BINARY_OP(i64_div_u, u64, u64, divideUnsigned(left, right))
+		BINARY_OP(i64_rem_s, i64, i64, remainderSigned(left, right))
+		BINARY_OP(i64_rem_u, u64, u64, remainderUnsigned(left, right))
+		BINARY_OP(i64_and_, u64, u64, left & right)
+		BINARY_OP(i64_or_, u64, u64, left | right)
+		BINARY_OP(i64_xor_, u64, u64, left ^ right)
+		BINARY_OP(i64_shl, u64, u64, left << (right & 63))
+		BINARY_OP(i64_shr_s, i64, i64, left >> (right & 63))
+		BINARY_OP(i64_shr_u, u64, u64, left >> (right & 63))
+		BINARY_OP(i64_rotl, u64, u64, rotateLeft(left, right))
+		BINARY_OP(i64_rotr, u64, u64, rotateRight(left, right))
+
+		// f32 arithmetic
+		UNARY_OP(f32_abs, f32, f32, std::fabs(operand))
+		UNARY_OP(f32_neg, f32, f32, -operand)
+		UNARY_OP(f32_ceil, f32, f32, std::ceil(operand))
+		UNARY_OP(f32_floor, f32, f32, std::floor(operand))
+		UNARY_OP(f32_trunc, f32, f32, std::trunc(operand))
+		UNARY_OP(f32_nearest, f32, f32, std::nearbyint(operand))
+		UNARY_OP(f32_sqrt, f32, f32, std::sqrt(operand))
+		BINARY_OP(f32_add, f32, f32, left + right)
+		BINARY_OP(f32_sub, f32, f32, left - right)
+		BINARY_OP(f32_mul, f32, f32, left * right)
+		BINARY_OP(f32_div, f32, f32, left / right)
+		BINARY_OP(f32_min, f32, f32, (floatMin<F32, U32>(left, right)))
+		BINARY_OP(f32_max, f32, f32, (floatMax<F32, U32>(left, right)))
+		BINARY_OP(f32_copysign, f32, f32, std::copysign(left, right))
+
+		// f64 arithmetic
+		UNARY_OP(f64_abs, f64, f64, std::fabs(operand))
+		UNARY_OP(f64_neg, f64, f64, -operand)
+		UNARY_OP(f64_ceil, f64, f64, std::ceil(operand))
+		UNARY_OP(f64_floor, f64, f64, std::floor(operand))
+		UNARY_OP(f64_trunc, f64, f64, std::trunc(operand))
+		UNARY_OP(f64_nearest, f64, f64, std::nearbyint(operand))
+		UNARY_OP(f64_sqrt, f64, f64, std::sqrt(operand))
+		BINARY_OP(f64_add, f64, f64, left + right)
+		BINARY_OP(f64_sub, f64, f64, left - right)
+		BINARY_OP(f64_mul, f64, f64, left * right)
+		BINARY_OP(f64_div, f64, f64, left / right)
+		BINARY_OP(f64_min, f64, f64, (floatMin<F64, U64>(left, right)))
+		BINARY_OP(f64_max, f64, f64, (floatMax<F64, U64>(left, right)))
+		BINARY_OP(f64_copysign, f64, f64, std::copysign(left, right))
+
+		// Conversions
+		UNARY_OP(i32_wrap_i64, u64, u32, U32(operand))
+		UNARY_OP(i32_trunc_f32_s,
+				 f32,
+				 i32,
+				 (truncFloatToInt<I32, F32>(operand, -2147483904.0f, 2147483648.0f)))
+		UNARY_OP(i32_trunc_f32_u,
+				 f32,
+				 u32,
+				 (truncFloatToInt<U32, F32>(operand, -1.0f, 4294967296.0f)))
+		UNARY_OP(i32_trunc_f64_s,
+				 f64,
+				 i32,
+				 (truncFloatToInt<I32, F64>(operand, -2147483649.0, 2147483648.0)))
+		UNARY_OP(i32_trunc_f64_u,
+				 f64,
+				 u32,
+				 (truncFloatToInt<U32, F64>(operand, -1.0, 4294967296.0)))
+		UNARY_OP(i64_extend_i32_s, i32, i64, I64(operand))
+		UNARY_OP(i64_extend_i32_u, u32, u64, U64(operand))
+		UNARY_OP(
+			i64_trunc_f32_s,
+			f32,
+			i64,
+			(truncFloatToInt<I64, F32>(operand, -9223373136366403584.0f, 9223372036854775808.0f)))
+		UNARY_OP(i64_trunc_f32_u,
+				 f32,
+				 u64,
+				 (truncFloatToInt<U64, F32>(operand, -1.0f, 18446744073709551616.0f)))
+		UNARY_OP(
+			i64_trunc_f64_s,
+			f64,
+			i64,
+			(truncFloatToInt<I64, F64>(operand, -9223372036854777856.0, 9223372036854775808.0)))
+		UNARY_OP(i64_trunc_f64_u,
+				 f64,
+				 u64,
+				 (truncFloatToInt<U64, F64>(operand, -1.0, 18446744073709551616.0)))
+		UNARY_OP(f32_convert_i32_s, i32, f32, F32(operand))
+		UNARY_OP(f32_convert_i32_u, u32, f32, F32(operand))
+		UNARY_OP(f32_convert_i64_s, i64, f32, F32(operand))
+		UNARY_OP(f32_convert_i64_u, u64, f32, F32(operand))
+		UNARY_OP(f32_demote_f64, f64, f32, F32(operand))
+		UNARY_OP(f64_convert_i32_s, i32, f64, F64(operand))
+		UNARY_OP(f64_convert_i32_u, u32, f64, F64(operand))
+		UNARY_OP(f64_convert_i64_s, i64, f64, F64(operand))
+		UNARY_OP(f64_convert_i64_u, u64, f64, F64(operand))
+		UNARY_OP(f64_promote_f32, f32, f64, F64(operand))
+
+		// The slots are untyped, so reinterpreting a value doesn't need to change it.
+		case Op::i32_reinterpret_f32:
+		case Op::i64_reinterpret_f64:
+		case Op::f32_reinterpret_i32:
+		case Op::f64_reinterpret_i64: break;
+
+		// 8- and 16-bit sign extension operators
+		UNARY_OP(i32_extend8_s, i32, i32, I32(I8(operand)))
+		UNARY_OP(i32_extend16_s, i32, i32, I32(I16(operand)))
+		UNARY_OP(i64_extend8_s, i64, i64, I64(I8(operand)))
+		UNARY_OP(i64_extend16_s, i64, i64, I64(I16(operand)))
+		UNARY_OP(i64_extend32_s, i64, i64, I64(I32(operand)))
+
+		// Reference type operators
+		case Op::ref_null: (sp++)->object = nullptr; break;
+		UNARY_OP(ref_is_null, object, i32, operand == nullptr)
+		case Op::ref_func: (sp++)->function = instance.functions[instruction.a]; break;
+
+		// Saturating float->int truncation operators
+		UNARY_OP(i32_trunc_sat_f32_s,
+				 f32,
+				 i32,
+				 truncFloatToIntSat(operand, F32(INT32_MIN), F32(INT32_MAX), INT32_MIN, INT32_MAX))
+		UNARY_OP(i32_trunc_sat_f64_s,
+				 f64,
+				 i32,
+				 truncFloatToIntSat(operand, F64(INT32_MIN), F64(INT32_MAX), INT32_MIN, INT32_MAX))
+		UNARY_OP(i32_trunc_sat_f32_u,
+				 f32,
+				 u32,
+				 truncFloatToIntSat(operand, 0.0f, F32(UINT32_MAX), U32(0), UINT32_MAX))
+		UNARY_OP(i32_trunc_sat_f64_u,
+				 f64,
+				 u32,
+				 truncFloatToIntSat(operand, 0.0, F64(UINT32_MAX), U32(0), UINT32_MAX))
+		UNARY_OP(i64_trunc_sat_f32_s,
+				 f32,
+				 i64,
+				 truncFloatToIntSat(operand, F32(INT64_MIN), F32(INT64_MAX), INT64_MIN, INT64_MAX))
+		UNARY_OP(i64_trunc_sat_f64_s,
+				 f64,
+				 i64,
+				 truncFloatToIntSat(operand, F64(INT64_MIN), F64(INT64_MAX), INT64_MIN, INT64_MAX))
+		UNARY_OP(i64_trunc_sat_f32_u,
+				 f32,
+				 u64,
+				 truncFloatToIntSat(operand, 0.0f, F32(UINT64_MAX), U64(0), UINT64_MAX))
+		UNARY_OP(i64_trunc_sat_f64_u,
+				 f64,
+				 u64,
+				 truncFloatToIntSat(operand, 0.0, F64(UINT64_MAX), U64(0), UINT64_MAX))
+
+		// Bulk memory/table operators
+		case Op::memory_init:
+			memoryInit(instance,
+					   contextRuntimeData,
+					   instruction.a,
+					   instruction.b,
+					   sp[-3].u32,
+					   sp[-2].u32,
+					   sp[-1].u32);
+			sp -= 3;
+			break;
+		case Op::data_drop: dataDrop(instance, contextRuntimeData, instruction.a); break;
+		case Op::memory_copy:
+			memoryCopy(instance,
+					   contextRuntimeData,
+					   instruction.a,
+					   instruction.b,
+					   sp[-3].u32,
+					   sp[-2].u32,
+					   sp[-1].u32);
+			sp -= 3;
+			break;
+		case Op::memory_fill:
+			memoryFill(
+				instance, contextRuntimeData, instruction.a, sp[-3].u32, sp[-2].u32, sp[-1].u32);
+			sp -= 3;
+			break;
+		case Op::table_init:
+			tableInit(instance,
+					  contextRuntimeData,
+					  instruction.a,
+					  instruction.b,
+					  sp[-3].u32,
+					  sp[-2].u32,
+					  sp[-1].u32);
+			sp -= 3;
+			break;
+		case Op::elem_drop: elemDrop(instance, contextRuntimeData, instruction.a); break;
+		case Op::table_copy:
+			tableCopy(instance,
+					  contextRuntimeData,
+					  instruction.a,
+					  instruction.b,
+					  sp[-3].u32,
+					  sp[-2].u32,
+					  sp[-1].u32);
+			sp -= 3;
+			break;
+		case Op::table_size: {
+			Table* table = getTableFromRuntimeData(contextRuntimeData,
+												   instance.tableIds[instruction.a]);
+			(sp++)->u32 = U32(getTableNumElements(table));
+			break;
+		}
+
+		// Table access
+		case Op::table_get: {
+			Table* table = getTableFromRuntimeData(contextRuntimeData,
+												   instance.tableIds[instruction.a]);
+			sp[-1].object = getTableElement(table, sp[-1].u32);
+			break;
+		}
+		case Op::table_set: {
+			Table* table = getTableFromRuntimeData(contextRuntimeData,
+												   instance.tableIds[instruction.a]);
+			setTableElement(table, sp[-2].u32, sp[-1].object);
+			sp -= 2;
+			break;
+		}
+		case Op::table_grow: {
+			Table* table = getTableFromRuntimeData(contextRuntimeData,
+												   instance.tableIds[instruction.a]);
+			Object* initialValue = sp[-2].object;
+			Uptr oldNumElements = 0;
+			const bool succeeded
+				= growTable(table,
+							sp[-1].u32,
+							&oldNumElements,
+							initialValue ? initialValue : getUninitializedElement());
+			--sp;
+			sp[-1].i32 = succeeded ? I32(oldNumElements) : -1;
+			break;
+		}
+		case Op::table_fill:
+			tableFill(
+				instance, contextRuntimeData, instruction.a, sp[-3].u32, sp[-2].object, sp[-1].u32);
+			sp -= 3;
+			break;
+
+#undef UNARY_OP
+#undef BINARY_OP
+#undef LOAD_OP
+#undef STORE_OP
+
+		// The translator doesn't emit nops, or operators for features the interpreter doesn't
+		// support.
+#define UNSUPPORTED_mvp(name)
+#define UNSUPPORTED_bulkMemoryOperations(name)
+#define UNSUPPORTED_extendedSignExtension(name)
+#define UNSUPPORTED_nonTrappingFloatToInt(name)
+#define UNSUPPORTED_referenceTypes(name)
+#define UNSUPPORTED_simd(name) case Op::name:
+#define UNSUPPORTED_atomics(name) case Op::name:
+#define VISIT_OP(opcode, name, nameString, Imm, signature, requiredFeature)                        \
+	UNSUPPORTED_##requiredFeature(name)
+			WAVM_ENUM_NONCONTROL_NONPARAMETRIC_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+#undef UNSUPPORTED_mvp
+#undef UNSUPPORTED_bulkMemoryOperations
+#undef UNSUPPORTED_extendedSignExtension
+#undef UNSUPPORTED_nonTrappingFloatToInt
+#undef UNSUPPORTED_referenceTypes
+#undef UNSUPPORTED_simd
+#undef UNSUPPORTED_atomics
+		case Op::nop:
+		default: WAVM_UNREACHABLE();
+		};
+	}
+}
+
+std::shared_ptr<LLVMJIT::Module> Runtime::instantiateInterpretedModule(
+	const std::shared_ptr<const InterpretedModule>& interpretedModule,
+	const std::vector<Function*>& functionImports,
+	const std::vector<Table*>& tables,
+	const std::vector<Memory*>& memories,
+	const std::vector<Global*>& globals,
+	Uptr moduleInstanceId,
+	const std::vector<FunctionMutableData*>& functionDefMutableDatas,
+	std::shared_ptr<InterpretedInstance>& outInterpretedInstance)
+{
+	WAVM_ASSERT(functionDefMutableDatas.size() == interpretedModule->functionDefs.size());
+
+	auto interpretedInstance = std::make_shared<InterpretedInstance>();
+	interpretedInstance->module = interpretedModule;
+	interpretedInstance->moduleInstanceId = moduleInstanceId;
+	interpretedInstance->functions = functionImports;
+	for(Table* table : tables) { interpretedInstance->tableIds.push_back(table->id); }
+	for(Memory* memory : memories) { interpretedInstance->memoryIds.push_back(memory->id); }
+	for(Global* global : globals)
+	{
+		InterpretedInstance::GlobalBinding globalBinding;
+		if(global->type.isMutable)
+		{ globalBinding.mutableGlobalIndex = global->mutableGlobalIndex; }
+		else if(isReferenceType(global->type.valueType))
+		{
+			globalBinding.immutableReferenceGlobalId = global->id;
+		}
+		else
+		{
+			// The interpreter doesn't support V128, so the value fits in 64 bits. Globals without
+			// a (ref.func ...) initializer are initialized before the module is instantiated.
+			WAVM_ASSERT(global->type.valueType != ValueType::v128);
+			globalBinding.immutableValue = global->initialValue.u64;
+		}
+		interpretedInstance->globals.push_back(globalBinding);
+	}
+
+	// Bind each function definition's FunctionMutableData to its interpreted code. The interpreter
+	// entry point has the same signature as an invoke thunk, so it's also used to invoke the
+	// functions without compiling an invoke thunk.
+	std::vector<FunctionType> functionDefTypes;
+	interpretedInstance->functionDefs.resize(functionDefMutableDatas.size());
+	for(Uptr functionDefIndex = 0; functionDefIndex < functionDefMutableDatas.size();
+		++functionDefIndex)
+	{
+		const InterpretedCode& code = interpretedModule->functionDefs[functionDefIndex];
+		InterpretedFunction& interpretedFunction
+			= interpretedInstance->functionDefs[functionDefIndex];
+		interpretedFunction.instance = interpretedInstance.get();
+		interpretedFunction.code = &code;
+
+		FunctionMutableData* functionMutableData = functionDefMutableDatas[functionDefIndex];
+		functionMutableData->interpretedFunction = &interpretedFunction;
+		functionMutableData->invokeThunk.store(invokeInterpretedFunction,
+											   std::memory_order_release);
+		functionDefTypes.push_back(code.type);
+	}
+
+	// Create the Runtime::Function objects that compiled code calls the interpreted functions
+	// through.
+	std::shared_ptr<LLVMJIT::Module> jitModule = LLVMJIT::instantiateInterpretedModule(
+		invokeInterpretedFunction, functionDefTypes, {moduleInstanceId}, functionDefMutableDatas);
+	for(FunctionMutableData* functionMutableData : functionDefMutableDatas)
+	{ interpretedInstance->functions.push_back(functionMutableData->function); }
+
+	outInterpretedInstance = std::move(interpretedInstance);
+	return jitModule;
+}
@@ -126,3 +126,37 @@ ValueTuple Runtime::invokeFunctionChecked(Context* context,
 	}
 	return results;
 }
+
+Uptr Runtime::invokeFunctionBatch(Context* context,
+								  const Function* function,
+								  const UntaggedValue* argRows,
+								  Uptr numRows,
+								  UntaggedValue* resultRows,
+								  Exception** outException)
+{
+	WAVM_ERROR_UNLESS(isInCompartment(asObject(function), context->compartment));
+
+	// The batch thunk is only looked up once per batch, so it isn't cached in the function's
+	// FunctionMutableData like the invoke thunk.
+	InvokeBatchThunkPointer invokeBatchThunk
+		= LLVMJIT::getInvokeBatchThunk(FunctionType(function->encodedType));
+	ContextRuntimeData* contextRuntimeData
+		= &context->compartment->runtimeData->contexts[context->id];
+
+	// The thunk writes the index of each row before invoking the function with it, so if a row
+	// throws an exception, rowIndex will be the index of that row.
+	Uptr rowIndex = 0;
+	catchRuntimeExceptions(
+		[&] {
+			(*invokeBatchThunk)(
+				function, contextRuntimeData, argRows, numRows, resultRows, &rowIndex);
+		},
+		[&](Exception* exception) {
+			if(outException) { *outException = exception; }
+			else
+			{
+				destroyException(exception);
+			}
+		});
+	return rowIndex;
+}
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <vector>
@@ -10,12 +11,16 @@
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/ConcurrentIntervalMap.h"
+#include "WAVM/Inline/Errors.h"
 #include "WAVM/Inline/Lock.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/RuntimeABI/RuntimeABI.h"
+#include "WAVM/VFS/VFS.h"
 
 using namespace WAVM;
 using namespace WAVM::Runtime;
@@ -24,44 +29,156 @@ namespace WAVM { namespace Runtime {
 	WAVM_DEFINE_INTRINSIC_MODULE(wavmIntrinsicsMemory)
 }}
 
-// Global lists of memories; used to query whether an address is reserved by one of them.
-static Platform::Mutex memoriesMutex;
-static std::vector<Memory*> memories;
+// A map from the address space reserved by each memory to the memory; used to find the memory
+// that owns the address of an access violation.
+static ConcurrentIntervalMap<Memory*> memoryReservations;
 
 enum
 {
 	numGuardPages = 1
 };
 
+// The address space reserved for a memory that is accessed without bounds checks. Any 32-bit
+// address plus a 32-bit offset is within it.
+static constexpr Uptr fullMemoryReservationBytes = Uptr(8ull * 1024 * 1024 * 1024);
+
 static Uptr getPlatformPagesPerWebAssemblyPageLog2()
 {
 	WAVM_ERROR_UNLESS(Platform::getBytesPerPageLog2() <= IR::numBytesPerPageLog2);
 	return IR::numBytesPerPageLog2 - Platform::getBytesPerPageLog2();
 }
 
+// Sets the number of pages in a memory, and the number of bytes that bounds checked code checks
+// the addresses it accesses in the memory against.
+static void setMemoryNumPages(Memory* memory, Uptr numPages)
+{
+	memory->numPages.store(numPages, std::memory_order_release);
+	if(memory->id != UINTPTR_MAX)
+	{
+		memory->compartment->runtimeData->memoryNumBytes[memory->id].store(
+			numPages * IR::numBytesPerPage, std::memory_order_release);
+	}
+}
+
+// Asks the platform to back pages of a memory with huge pages if the memory uses them. This must
+// be repeated after the pages are remapped, which resets the setting.
+static void adviseMemoryHugePages(Memory* memory, Uptr firstPageIndex, Uptr numPages)
+{
+	if(memory->useHugePages && numPages)
+	{
+		Platform::adviseHugeVirtualPages(
+			memory->baseAddress + firstPageIndex * IR::numBytesPerPage,
+			numPages << getPlatformPagesPerWebAssemblyPageLog2(),
+			true);
+	}
+}
+
+// Commits pages of a memory, mapping them from its shared memory object if it has one.
+static bool commitMemoryPages(Memory* memory, Uptr firstPageIndex, Uptr numPages)
+{
+	const Uptr platformPagesPerWebAssemblyPageLog2 = getPlatformPagesPerWebAssemblyPageLog2();
+	U8* baseAddress = memory->baseAddress + firstPageIndex * IR::numBytesPerPage;
+	if(!memory->sharedMemory)
+	{
+		if(!Platform::commitVirtualPages(baseAddress,
+										 numPages << platformPagesPerWebAssemblyPageLog2))
+		{ return false; }
+	}
+	else
+	{
+		const Uptr firstPlatformPageIndex = firstPageIndex << platformPagesPerWebAssemblyPageLog2;
+		const Uptr numPlatformPages = numPages << platformPagesPerWebAssemblyPageLog2;
+		if(!Platform::resizeSharedMemory(memory->sharedMemory,
+										 firstPlatformPageIndex + numPlatformPages)
+		   || !Platform::mapSharedMemoryPages(memory->sharedMemory,
+											  firstPlatformPageIndex,
+											  baseAddress,
+											  numPlatformPages,
+											  Platform::MemoryAccess::readWrite,
+											  false))
+		{ return false; }
+	}
+
+	adviseMemoryHugePages(memory, firstPageIndex, numPages);
+	return true;
+}
+
 static Memory* createMemoryImpl(Compartment* compartment,
 								IR::MemoryType type,
 								Uptr numPages,
 								std::string&& debugName,
-								ResourceQuotaRefParam resourceQuota)
+								ResourceQuotaRefParam resourceQuota,
+								Uptr numReservedBytes,
+								bool useHugePages,
+								const std::shared_ptr<MemoryImage>& image = nullptr)
 {
+	if(numPages > numReservedBytes >> IR::numBytesPerPageLog2) { return nullptr; }
+
 	Memory* memory = new Memory(compartment, type, std::move(debugName), resourceQuota);
 
-	// On a 64-bit runtime, allocate 8GB of address space for the memory.
-	// This allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset
-	// will always be within the reserved address-space.
+	// Reserve the memory's address space, followed by guard pages. If the memory uses huge pages,
+	// align it to a huge page so its first pages can be backed by one.
 	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
-	const Uptr memoryMaxBytes = Uptr(8ull * 1024 * 1024 * 1024);
-	const Uptr memoryMaxPages = memoryMaxBytes >> pageBytesLog2;
-
-	memory->baseAddress = Platform::allocateVirtualPages(memoryMaxPages + numGuardPages);
-	memory->numReservedBytes = memoryMaxBytes;
+	memory->useHugePages = useHugePages && Platform::getBytesPerHugePageLog2();
+	memory->reservationAlignmentLog2
+		= memory->useHugePages ? Platform::getBytesPerHugePageLog2() : pageBytesLog2;
+	memory->baseAddress
+		= Platform::allocateAlignedVirtualPages((numReservedBytes >> pageBytesLog2) + numGuardPages,
+												memory->reservationAlignmentLog2,
+												memory->unalignedBaseAddress);
+	memory->numReservedBytes = numReservedBytes;
+	memory->requiresBoundsChecks = numReservedBytes < fullMemoryReservationBytes;
 	if(!memory->baseAddress)
 	{
 		delete memory;
 		return nullptr;
 	}
 
+	// Add the memory's address space to the global map.
+	memoryReservations.addOrFail(reinterpret_cast<Uptr>(memory->baseAddress),
+								 reinterpret_cast<Uptr>(memory->baseAddress) + numReservedBytes,
+								 memory);
+
+	if(image)
+	{
+		// Map the image's pages copy-on-write, so the memory shares them until it writes to them.
+		const Uptr numImagePages = std::min(numPages, image->numPages);
+		memory->image = image;
+		if(numImagePages)
+		{
+			if(memory->resourceQuota
+			   && !memory->resourceQuota->memoryPages.allocate(numImagePages))
+			{
+				delete memory;
+				return nullptr;
+			}
+			setMemoryNumPages(memory, numImagePages);
+
+			if(!Platform::mapSharedMemoryPages(
+				   image->sharedMemory,
+				   image->firstSharedMemoryPageIndex,
+				   memory->baseAddress,
+				   numImagePages << getPlatformPagesPerWebAssemblyPageLog2(),
+				   Platform::MemoryAccess::readWrite,
+				   true))
+			{
+				delete memory;
+				return nullptr;
+			}
+			adviseMemoryHugePages(memory, 0, numImagePages);
+		}
+		numPages -= numImagePages;
+	}
+	else
+	{
+		// Map the memory's pages from a shared memory object if the platform supports it, so they
+		// can be shared copy-on-write with the memory's clones. If the memory uses huge pages, but
+		// the platform can't back shared memory with them, use anonymous pages, which are copied to
+		// the memory's clones instead.
+		if(!memory->useHugePages || Platform::canUseHugePagesForSharedMemory())
+		{ memory->sharedMemory = Platform::createSharedMemory(); }
+	}
+
 	// Grow the memory to the type's minimum size.
 	if(!growMemory(memory, numPages))
 	{
@@ -69,12 +186,6 @@ static Memory* createMemoryImpl(Compartment* compartment,
 		return nullptr;
 	}
 
-	// Add the memory to the global array.
-	{
-		Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-		memories.push_back(memory);
-	}
-
 	return memory;
 }
 
@@ -82,10 +193,47 @@ Memory* Runtime::createMemory(Compartment* compartment,
 							  IR::MemoryType type,
 							  std::string&& debugName,
 							  ResourceQuotaRefParam resourceQuota)
+{
+	return createMemory(compartment, type, std::move(debugName), resourceQuota, true);
+}
+
+Memory* Runtime::createMemory(Compartment* compartment,
+							  IR::MemoryType type,
+							  std::string&& debugName,
+							  ResourceQuotaRefParam resourceQuota,
+							  bool isBoundsChecked)
 {
 	WAVM_ASSERT(type.size.min <= UINTPTR_MAX);
-	Memory* memory = createMemoryImpl(
-		compartment, type, Uptr(type.size.min), std::move(debugName), resourceQuota);
+
+	// On a 64-bit runtime, allocate 8GB of address space for the memory. This allows eliding
+	// bounds checks on memory accesses, since a 32-bit index + 32-bit offset will always be within
+	// the reserved address-space. If the code that accesses the memory checks bounds, and the
+	// compartment limits the address space its memories reserve, only reserve enough address
+	// space for the memory's maximum size.
+	Uptr numReservedBytes = fullMemoryReservationBytes;
+
+	// Memories use huge pages if their compartment did when they were created.
+	bool useHugePages = false;
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		useHugePages = compartment->useHugePagesForMemories;
+		if(isBoundsChecked && compartment->maxMemoryReservationBytes)
+		{
+			const U64 maxReservedPages
+				= compartment->maxMemoryReservationBytes >> IR::numBytesPerPageLog2;
+			const U64 maxPages
+				= std::min(std::min(type.size.max, U64(IR::maxMemoryPages)), maxReservedPages);
+			numReservedBytes = Uptr(maxPages) << IR::numBytesPerPageLog2;
+		}
+	}
+
+	Memory* memory = createMemoryImpl(compartment,
+									  type,
+									  Uptr(type.size.min),
+									  std::move(debugName),
+									  resourceQuota,
+									  numReservedBytes,
+									  useHugePages);
 	if(!memory) { return nullptr; }
 
 	// Add the memory to the compartment's memories IndexMap.
@@ -99,22 +247,176 @@ Memory* Runtime::createMemory(Compartment* compartment,
 			return nullptr;
 		}
 		compartment->runtimeData->memoryBases[memory->id] = memory->baseAddress;
+		compartment->runtimeData->memoryNumBytes[memory->id].store(
+			memory->numPages.load(std::memory_order_acquire) * IR::numBytesPerPage,
+			std::memory_order_release);
 	}
 
 	return memory;
 }
 
+// Creates an image from numPages WebAssembly pages of a shared memory object, starting at a page
+// index of the shared memory object. If successful, the image takes ownership of the shared
+// memory object. Returns nullptr if the image couldn't be mapped.
+static std::shared_ptr<MemoryImage> createMemoryImage(Platform::SharedMemory* sharedMemory,
+													  Uptr firstSharedMemoryPageIndex,
+													  Uptr numPages)
+{
+	const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+	U8* imageBaseAddress = Platform::allocateVirtualPages(numPlatformPages);
+	if(!imageBaseAddress) { return nullptr; }
+	if(!Platform::mapSharedMemoryPages(sharedMemory,
+									   firstSharedMemoryPageIndex,
+									   imageBaseAddress,
+									   numPlatformPages,
+									   Platform::MemoryAccess::readOnly,
+									   false))
+	{
+		Platform::freeVirtualPages(imageBaseAddress, numPlatformPages);
+		return nullptr;
+	}
+
+	std::shared_ptr<MemoryImage> image = std::make_shared<MemoryImage>();
+	image->sharedMemory = sharedMemory;
+	image->firstSharedMemoryPageIndex = firstSharedMemoryPageIndex;
+	image->numPages = numPages;
+	image->baseAddress = imageBaseAddress;
+	return image;
+}
+
+// Maps the first numPages of a memory copy-on-write from its image. Remapping the memory's pages
+// can only fail if the process runs out of memory mappings, in which case the memory's pages may
+// have been unmapped.
+static void mapMemoryImage(Memory* memory, Uptr numPages)
+{
+	WAVM_ASSERT(numPages <= memory->image->numPages);
+	if(!Platform::mapSharedMemoryPages(memory->image->sharedMemory,
+									   memory->image->firstSharedMemoryPageIndex,
+									   memory->baseAddress,
+									   numPages << getPlatformPagesPerWebAssemblyPageLog2(),
+									   Platform::MemoryAccess::readWrite,
+									   true))
+	{ Errors::fatal("Failed to map memory pages copy-on-write"); }
+	adviseMemoryHugePages(memory, 0, numPages);
+}
+
+// Turns a memory's shared memory object into an image, and maps the memory's pages from the image
+// copy-on-write. This doesn't copy the memory's contents, since they are already in the shared
+// memory object. Returns false if the image couldn't be created, in which case the memory still
+// uses its shared memory object.
+static bool convertSharedMemoryToImage(Memory* memory, Uptr numPages)
+{
+	WAVM_ASSERT_MUTEX_IS_LOCKED_BY_CURRENT_THREAD(memory->resizingMutex);
+	WAVM_ASSERT(memory->sharedMemory && !memory->image);
+
+	std::shared_ptr<MemoryImage> image = createMemoryImage(memory->sharedMemory, 0, numPages);
+	if(!image) { return false; }
+
+	memory->sharedMemory = nullptr;
+	memory->image = std::move(image);
+	mapMemoryImage(memory, numPages);
+	return true;
+}
+
+Runtime::MemoryImage::~MemoryImage()
+{
+	if(baseAddress)
+	{
+		Platform::freeVirtualPages(baseAddress,
+								   numPages << getPlatformPagesPerWebAssemblyPageLog2());
+	}
+	if(sharedMemory) { Platform::destroySharedMemory(sharedMemory); }
+}
+
+// Finds the ranges of platform pages in the first numPages of a memory that differ from an image,
+// or that contain non-zero bytes if they are after the end of the image.
+static std::vector<MemoryPageRange> getModifiedMemoryPageRangesImpl(Memory* memory,
+																	Uptr numPages,
+																	const MemoryImage* image)
+{
+	WAVM_ASSERT_MUTEX_IS_LOCKED_BY_CURRENT_THREAD(memory->resizingMutex);
+	const Uptr platformPagesPerWebAssemblyPageLog2 = getPlatformPagesPerWebAssemblyPageLog2();
+	const Uptr numPlatformPages = numPages << platformPagesPerWebAssemblyPageLog2;
+	const Uptr numImagePages = image ? std::min(numPages, image->numPages) : 0;
+	const Uptr numImagePlatformPages = numImagePages << platformPagesPerWebAssemblyPageLog2;
+	const Uptr numBytesPerPage = Platform::getBytesPerPage();
+	const Uptr numWordsPerPage = numBytesPerPage / sizeof(U64);
+
+	// If the memory's pages are mapped copy-on-write from the image they are compared to, and are
+	// anonymous after its end, the pages that haven't been written since they were mapped are
+	// unmodified, so ask the platform which pages were written and only compare those.
+	std::vector<bool> isPageWritten;
+	const bool onlyCompareWrittenPages
+		= !memory->sharedMemory && image == memory->image.get()
+		  && Platform::getWrittenVirtualPages(memory->baseAddress, numPlatformPages, isPageWritten);
+
+	std::vector<MemoryPageRange> ranges;
+	for(Uptr pageIndex = 0; pageIndex < numPlatformPages; ++pageIndex)
+	{
+		if(onlyCompareWrittenPages && !isPageWritten[pageIndex]) { continue; }
+
+		const U8* page = memory->baseAddress + pageIndex * numBytesPerPage;
+		bool isModified = false;
+		if(pageIndex < numImagePlatformPages)
+		{
+			const U8* imagePage = image->baseAddress + pageIndex * numBytesPerPage;
+			isModified = memcmp(page, imagePage, numBytesPerPage) != 0;
+		}
+		else
+		{
+			const U64* words = (const U64*)page;
+			for(Uptr wordIndex = 0; wordIndex < numWordsPerPage && !isModified; ++wordIndex)
+			{ isModified = words[wordIndex] != 0; }
+		}
+		if(!isModified) { continue; }
+
+		// Extend the last range if this page follows it, or start a new range.
+		if(ranges.size()
+		   && ranges.back().firstPageIndex + ranges.back().numPages == pageIndex)
+		{ ++ranges.back().numPages; }
+		else
+		{
+			ranges.push_back({pageIndex, 1});
+		}
+	}
+	return ranges;
+}
+
 Memory* Runtime::cloneMemory(Memory* memory, Compartment* newCompartment)
 {
 	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
 	const Uptr numPages = memory->numPages.load(std::memory_order_acquire);
+
+	// If the memory's pages are mapped from a shared memory object, turn it into an image that the
+	// memory and the new memory both map copy-on-write.
+	const bool createdImage
+		= memory->sharedMemory && numPages && convertSharedMemoryToImage(memory, numPages);
+
 	std::string debugName = memory->debugName;
-	Memory* newMemory = createMemoryImpl(
-		newCompartment, memory->type, numPages, std::move(debugName), memory->resourceQuota);
+	Memory* newMemory = createMemoryImpl(newCompartment,
+										 memory->type,
+										 numPages,
+										 std::move(debugName),
+										 memory->resourceQuota,
+										 memory->numReservedBytes,
+										 memory->useHugePages,
+										 memory->image);
 	if(!newMemory) { return nullptr; }
 
-	// Copy the memory contents to the new memory.
-	memcpy(newMemory->baseAddress, memory->baseAddress, numPages * IR::numBytesPerPage);
+	// Copy the pages of the memory that differ from the image the memories share. If they don't
+	// share an image, this copies the memory's non-zero pages. If the image was just created from
+	// all of the memory's pages, none of them differ from it.
+	if(!createdImage)
+	{
+		const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+		for(const MemoryPageRange& range :
+			getModifiedMemoryPageRangesImpl(memory, numPages, memory->image.get()))
+		{
+			memcpy(newMemory->baseAddress + (range.firstPageIndex << pageBytesLog2),
+				   memory->baseAddress + (range.firstPageIndex << pageBytesLog2),
+				   range.numPages << pageBytesLog2);
+		}
+	}
 
 	resizingLock.unlock();
 
@@ -126,11 +428,172 @@ Memory* Runtime::cloneMemory(Memory* memory, Compartment* newCompartment)
 		newMemory->id = memory->id;
 		newCompartment->memories.insertOrFail(newMemory->id, newMemory);
 		newCompartment->runtimeData->memoryBases[newMemory->id] = newMemory->baseAddress;
+		newCompartment->runtimeData->memoryNumBytes[newMemory->id].store(
+			numPages * IR::numBytesPerPage, std::memory_order_release);
 	}
 
 	return newMemory;
 }
 
+std::vector<MemoryPageRange> Runtime::getModifiedMemoryPageRanges(Memory* memory)
+{
+	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+	return getModifiedMemoryPageRangesImpl(
+		memory, memory->numPages.load(std::memory_order_acquire), memory->image.get());
+}
+
+std::vector<MemoryPageRange> Runtime::getNonZeroMemoryPageRanges(Memory* memory)
+{
+	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+	return getModifiedMemoryPageRangesImpl(
+		memory, memory->numPages.load(std::memory_order_acquire), nullptr);
+}
+
+bool Runtime::restoreMemory(Memory* memory,
+							Uptr numPages,
+							const std::string& filePath,
+							U64 fileOffset,
+							const std::vector<MemoryPageRange>& nonZeroPageRanges)
+{
+	const Uptr platformPagesPerWebAssemblyPageLog2 = getPlatformPagesPerWebAssemblyPageLog2();
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	WAVM_ERROR_UNLESS(!(fileOffset & (IR::numBytesPerPage - 1)));
+
+	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+	const Uptr oldNumPages = memory->numPages.load(std::memory_order_acquire);
+	if(numPages > memory->type.size.max || numPages > IR::maxMemoryPages
+	   || numPages > memory->numReservedBytes >> IR::numBytesPerPageLog2)
+	{ return false; }
+
+	// Resize the memory, discarding the pages after the new end of the memory.
+	if(numPages > oldNumPages)
+	{
+		if(memory->resourceQuota
+		   && !memory->resourceQuota->memoryPages.allocate(numPages - oldNumPages))
+		{ return false; }
+		if(!commitMemoryPages(memory, oldNumPages, numPages - oldNumPages))
+		{
+			if(memory->resourceQuota)
+			{ memory->resourceQuota->memoryPages.free(numPages - oldNumPages); }
+			return false;
+		}
+	}
+	else if(numPages < oldNumPages)
+	{
+		Platform::decommitVirtualPages(
+			memory->baseAddress + numPages * IR::numBytesPerPage,
+			(oldNumPages - numPages) << platformPagesPerWebAssemblyPageLog2);
+		if(memory->sharedMemory)
+		{
+			WAVM_ERROR_UNLESS(Platform::resizeSharedMemory(
+				memory->sharedMemory, numPages << platformPagesPerWebAssemblyPageLog2));
+		}
+		if(memory->resourceQuota)
+		{ memory->resourceQuota->memoryPages.free(oldNumPages - numPages); }
+	}
+	setMemoryNumPages(memory, numPages);
+	if(!numPages) { return true; }
+
+	// Try to map the file as the memory's image, which doesn't read the file until the memory's
+	// pages are accessed.
+	Platform::SharedMemory* fileSharedMemory = Platform::openSharedMemoryFile(filePath);
+	if(fileSharedMemory)
+	{
+		std::shared_ptr<MemoryImage> image
+			= createMemoryImage(fileSharedMemory, Uptr(fileOffset >> pageBytesLog2), numPages);
+		if(image)
+		{
+			if(memory->sharedMemory)
+			{
+				Platform::destroySharedMemory(memory->sharedMemory);
+				memory->sharedMemory = nullptr;
+			}
+			memory->image = std::move(image);
+			mapMemoryImage(memory, numPages);
+			return true;
+		}
+		Platform::destroySharedMemory(fileSharedMemory);
+	}
+
+	// Otherwise, zero the memory and read the file's non-zero pages into it. This overwrites all of
+	// the pages the memory mapped from its image, so it no longer has one.
+	memset(memory->baseAddress, 0, numPages * IR::numBytesPerPage);
+	memory->image = nullptr;
+	VFS::VFD* vfd = nullptr;
+	if(Platform::getHostFS().open(
+		   filePath, VFS::FileAccessMode::readOnly, VFS::FileCreateMode::openExisting, vfd)
+	   != VFS::Result::success)
+	{ return false; }
+	bool succeeded = true;
+	for(const MemoryPageRange& range : nonZeroPageRanges)
+	{
+		WAVM_ERROR_UNLESS(range.firstPageIndex + range.numPages
+						  <= numPages << platformPagesPerWebAssemblyPageLog2);
+		U64 offset = fileOffset + (U64(range.firstPageIndex) << pageBytesLog2);
+		const Uptr numBytes = range.numPages << pageBytesLog2;
+		Uptr numBytesRead = 0;
+		if(vfd->read(memory->baseAddress + (range.firstPageIndex << pageBytesLog2),
+					 numBytes,
+					 &numBytesRead,
+					 &offset)
+			   != VFS::Result::success
+		   || numBytesRead != numBytes)
+		{
+			succeeded = false;
+			break;
+		}
+	}
+	WAVM_ERROR_UNLESS(vfd->close() == VFS::Result::success);
+	return succeeded;
+}
+
+void Runtime::resetMemory(Memory* memory,
+						  Memory* sourceMemory,
+						  const std::vector<MemoryPageRange>& sourceModifiedPageRanges)
+{
+	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+	const Uptr numPages = memory->numPages.load(std::memory_order_acquire);
+	const Uptr sourceNumPages = sourceMemory->numPages.load(std::memory_order_acquire);
+	WAVM_ERROR_UNLESS(numPages >= sourceNumPages);
+	WAVM_ERROR_UNLESS(memory->image == sourceMemory->image);
+
+	// Decommit the pages the memory has grown by since it was cloned, and free their quota.
+	if(numPages > sourceNumPages)
+	{
+		Platform::decommitVirtualPages(
+			memory->baseAddress + sourceNumPages * IR::numBytesPerPage,
+			(numPages - sourceNumPages) << getPlatformPagesPerWebAssemblyPageLog2());
+		if(memory->resourceQuota)
+		{ memory->resourceQuota->memoryPages.free(numPages - sourceNumPages); }
+		setMemoryNumPages(memory, sourceNumPages);
+	}
+
+	// Discard the contents of the remaining pages, which only costs time for the pages that have
+	// been touched, and copy the source's modified pages. Truncating a shared memory object
+	// discards its pages, and growing it again fills them with zeroes.
+	if(memory->sharedMemory)
+	{
+		WAVM_ERROR_UNLESS(Platform::resizeSharedMemory(memory->sharedMemory, 0)
+						  && Platform::resizeSharedMemory(
+							  memory->sharedMemory,
+							  sourceNumPages << getPlatformPagesPerWebAssemblyPageLog2()));
+	}
+	else if(sourceNumPages)
+	{
+		Platform::resetVirtualPages(memory->baseAddress,
+									sourceNumPages << getPlatformPagesPerWebAssemblyPageLog2());
+	}
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	for(const MemoryPageRange& range : sourceModifiedPageRanges)
+	{
+		WAVM_ASSERT(((range.firstPageIndex + range.numPages) << pageBytesLog2)
+					<= sourceNumPages * IR::numBytesPerPage);
+		memcpy(memory->baseAddress + (range.firstPageIndex << pageBytesLog2),
+			   sourceMemory->baseAddress + (range.firstPageIndex << pageBytesLog2),
+			   range.numPages << pageBytesLog2);
+	}
+}
+
 Runtime::Memory::~Memory()
 {
 	if(id != UINTPTR_MAX)
@@ -142,50 +605,34 @@ Runtime::Memory::~Memory()
 
 		WAVM_ASSERT(compartment->runtimeData->memoryBases[id] == baseAddress);
 		compartment->runtimeData->memoryBases[id] = nullptr;
+		compartment->runtimeData->memoryNumBytes[id].store(0, std::memory_order_release);
 	}
 
-	// Remove the memory from the global array.
-	{
-		Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-		for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
-		{
-			if(memories[memoryIndex] == this)
-			{
-				memories.erase(memories.begin() + memoryIndex);
-				break;
-			}
-		}
-	}
+	// Remove the memory's address space from the global map.
+	if(baseAddress) { memoryReservations.removeOrFail(reinterpret_cast<Uptr>(baseAddress)); }
 
 	// Free the virtual address space.
 	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
-	if(numReservedBytes > 0)
+	if(baseAddress)
 	{
-		Platform::freeVirtualPages(baseAddress,
-								   (numReservedBytes >> pageBytesLog2) + numGuardPages);
+		Platform::freeAlignedVirtualPages(unalignedBaseAddress,
+										  (numReservedBytes >> pageBytesLog2) + numGuardPages,
+										  reservationAlignmentLog2);
 	}
 
+	if(sharedMemory) { Platform::destroySharedMemory(sharedMemory); }
+
 	// Free the allocated quota.
 	if(resourceQuota) { resourceQuota->memoryPages.free(numPages); }
 }
 
 bool Runtime::isAddressOwnedByMemory(U8* address, Memory*& outMemory, Uptr& outMemoryAddress)
 {
-	// Iterate over all memories and check if the address is within the reserved address space for
-	// each.
-	Lock<Platform::Mutex> memoriesLock(memoriesMutex);
-	for(auto memory : memories)
-	{
-		U8* startAddress = memory->baseAddress;
-		U8* endAddress = memory->baseAddress + memory->numReservedBytes;
-		if(address >= startAddress && address < endAddress)
-		{
-			outMemory = memory;
-			outMemoryAddress = address - startAddress;
-			return true;
-		}
-	}
-	return false;
+	Uptr baseAddress = 0;
+	if(!memoryReservations.get(reinterpret_cast<Uptr>(address), outMemory, baseAddress))
+	{ return false; }
+	outMemoryAddress = reinterpret_cast<Uptr>(address) - baseAddress;
+	return true;
 }
 
 Uptr Runtime::getMemoryNumPages(const Memory* memory)
@@ -194,6 +641,33 @@ Uptr Runtime::getMemoryNumPages(const Memory* memory)
 }
 IR::MemoryType Runtime::getMemoryType(const Memory* memory) { return memory->type; }
 
+bool Runtime::getMemoryRequiresBoundsChecks(const Memory* memory)
+{
+	return memory->requiresBoundsChecks;
+}
+
+bool Runtime::setMemoryHugePages(Memory* memory, bool useHugePages)
+{
+	if(!Platform::getBytesPerHugePageLog2()) { return false; }
+
+	// Advise the memory's whole reservation, so pages that are committed by growing the memory
+	// later use the new setting.
+	Lock<Platform::Mutex> resizingLock(memory->resizingMutex);
+
+	// The pages of a memory that are mapped from a shared memory object or an image can only be
+	// backed by huge pages if the platform supports huge pages for shared memory.
+	if(useHugePages && (memory->sharedMemory || memory->image)
+	   && !Platform::canUseHugePagesForSharedMemory())
+	{ return false; }
+	if(!Platform::adviseHugeVirtualPages(
+		   memory->baseAddress,
+		   memory->numReservedBytes >> Platform::getBytesPerPageLog2(),
+		   useHugePages))
+	{ return false; }
+	memory->useHugePages = useHugePages;
+	return true;
+}
+
 bool Runtime::growMemory(Memory* memory, Uptr numPagesToGrow, Uptr* outOldNumPages)
 {
 	Uptr oldNumPages;
@@ -212,22 +686,21 @@ bool Runtime::growMemory(Memory* memory, Uptr numPagesToGrow, Uptr* outOldNumPag
 		if(numPagesToGrow > memory->type.size.max
 		   || oldNumPages > memory->type.size.max - numPagesToGrow
 		   || numPagesToGrow > IR::maxMemoryPages
-		   || oldNumPages > IR::maxMemoryPages - numPagesToGrow)
+		   || oldNumPages > IR::maxMemoryPages - numPagesToGrow
+		   || oldNumPages + numPagesToGrow > memory->numReservedBytes >> IR::numBytesPerPageLog2)
 		{
 			if(memory->resourceQuota) { memory->resourceQuota->memoryPages.free(numPagesToGrow); }
 			return false;
 		}
 
 		// Try to commit the new pages, and return -1 if the commit fails.
-		if(!Platform::commitVirtualPages(
-			   memory->baseAddress + oldNumPages * IR::numBytesPerPage,
-			   numPagesToGrow << getPlatformPagesPerWebAssemblyPageLog2()))
+		if(!commitMemoryPages(memory, oldNumPages, numPagesToGrow))
 		{
 			if(memory->resourceQuota) { memory->resourceQuota->memoryPages.free(numPagesToGrow); }
 			return false;
 		}
 
-		memory->numPages.store(oldNumPages + numPagesToGrow, std::memory_order_release);
+		setMemoryNumPages(memory, oldNumPages + numPagesToGrow);
 	}
 
 	if(outOldNumPages) { *outOldNumPages = oldNumPages; }
@@ -338,6 +811,17 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsMemory,
 	return I32(oldNumPages);
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsMemory,
+							   "outOfBoundsMemoryAccessTrap",
+							   void,
+							   outOfBoundsMemoryAccessTrap,
+							   U64 address,
+							   Uptr memoryId)
+{
+	Memory* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
+	throwException(ExceptionTypes::outOfBoundsMemoryAccess, {asObject(memory), address});
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsMemory, "memory.size", U32, memory_size, I64 memoryId)
 {
 	Memory* memory = getMemoryFromRuntimeData(contextRuntimeData, memoryId);
@@ -54,8 +54,45 @@ static Value evaluateInitializer(const std::vector<Global*>& moduleGlobals,
 
 ModuleRef Runtime::compileModule(const IR::Module& irModule)
 {
-	std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec());
-	return std::make_shared<Module>(IR::Module(irModule), std::move(objectCode));
+	return compileModule(irModule, LLVMJIT::CompileOptions());
+}
+
+ModuleRef Runtime::compileModule(const IR::Module& irModule,
+								 const LLVMJIT::CompileOptions& options)
+{
+	const LLVMJIT::TargetSpec targetSpec = LLVMJIT::getHostTargetSpec();
+
+	// If the object cache is enabled, try to load the module's object code from it before
+	// compiling it.
+	ObjectCacheKey objectCacheKey;
+	const bool useObjectCache = getObjectCacheKey(irModule, targetSpec, options, objectCacheKey);
+
+	std::vector<U8> objectCode;
+	if(!useObjectCache || !loadCachedObjectCode(objectCacheKey, objectCode))
+	{
+		objectCode = LLVMJIT::compileModule(irModule, targetSpec, options);
+		if(useObjectCache) { saveCachedObjectCode(objectCacheKey, objectCode); }
+	}
+
+	return std::make_shared<Module>(IR::Module(irModule),
+									std::move(objectCode),
+									options.tiered && !options.lazy,
+									options.optLevel,
+									options.lazy,
+									options.interruptible,
+									options.meterFuel,
+									options.boundsCheckMemories);
+}
+
+ModuleRef Runtime::createInterpretedModule(const IR::Module& irModule)
+{
+	std::shared_ptr<const InterpretedModule> interpretedModule
+		= translateModuleForInterpreter(irModule);
+	if(!interpretedModule) { return nullptr; }
+
+	auto module = std::make_shared<Module>(IR::Module(irModule), std::vector<U8>());
+	module->interpretedModule = std::move(interpretedModule);
+	return module;
 }
 
 std::vector<U8> Runtime::getObjectCode(ModuleConstRefParam module) { return module->objectCode; }
@@ -68,6 +105,13 @@ ModuleRef Runtime::loadPrecompiledModule(const IR::Module& irModule,
 
 const IR::Module& Runtime::getModuleIR(ModuleConstRefParam module) { return module->ir; }
 
+bool Runtime::getModuleProfile(ModuleConstRefParam module, LLVMJIT::ModuleProfile& outProfile)
+{
+	Lock<Platform::Mutex> jitModuleLock(module->jitModuleMutex);
+	if(!module->jitModule) { return false; }
+	return LLVMJIT::getModuleProfile(module->jitModule, module->ir, outProfile);
+}
+
 ModuleInstance::~ModuleInstance()
 {
 	if(id != UINTPTR_MAX)
@@ -126,6 +170,18 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 			Memory* memory = asMemory(importObject);
 			WAVM_ERROR_UNLESS(
 				isSubtype(memory->type, module->ir.memories.getType(kindIndex.index)));
+
+			// A memory that doesn't reserve enough address space to be accessed without bounds
+			// checks may only be imported by a module that checks the bounds of its accesses.
+			if(memory->requiresBoundsChecks && !module->boundsCheckMemories)
+			{
+				{
+					Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+					compartment->moduleInstances.removeOrFail(id);
+				}
+				throwException(ExceptionTypes::importRequiresBoundsChecks);
+			}
+
 			memories.push_back(memory);
 			break;
 		}
@@ -183,7 +239,8 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 		auto memory = createMemory(compartment,
 								   module->ir.memories.defs[memoryDefIndex].type,
 								   std::move(debugName),
-								   resourceQuota);
+								   resourceQuota,
+								   module->boundsCheckMemories);
 		if(!memory)
 		{
 			Lock<Platform::Mutex> compartmentLock(compartment->mutex);
@@ -223,85 +280,129 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 			createExceptionType(compartment, exceptionTypeDef.type, std::move(debugName)));
 	}
 
-	// Set up the values to bind to the symbols in the LLVMJIT object code.
-	HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap;
-	for(const HashMapPair<std::string, Intrinsics::Function*>& intrinsicFunctionPair :
-		Intrinsics::getUninstantiatedFunctions({WAVM_INTRINSIC_MODULE_REF(wavmIntrinsics),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsAtomics),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsException),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsMemory),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsTable)}))
-	{
-		LLVMJIT::FunctionBinding functionBinding{
-			intrinsicFunctionPair.value->getCallingConvention(),
-			intrinsicFunctionPair.value->getNativeFunction()};
-		wavmIntrinsicsExportMap.add(intrinsicFunctionPair.key, functionBinding);
-	}
+	// Create a FunctionMutableData for each function definition.
+	auto createFunctionDefMutableDatas = [&module, &disassemblyNames, &moduleDebugName]() {
+		std::vector<FunctionMutableData*> functionDefMutableDatas;
+		for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
+			++functionDefIndex)
+		{
+			std::string debugName
+				= disassemblyNames.functions[module->ir.functions.imports.size() + functionDefIndex]
+					  .name;
+			if(!debugName.size())
+			{ debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
+			debugName = "wasm!" + moduleDebugName + '!' + debugName;
+
+			functionDefMutableDatas.push_back(new FunctionMutableData(std::move(debugName)));
+		}
+		return functionDefMutableDatas;
+	};
 
-	std::vector<LLVMJIT::FunctionBinding> jitFunctionImports;
-	for(Uptr importIndex = 0; importIndex < module->ir.functions.imports.size(); ++importIndex)
+	std::vector<FunctionMutableData*> functionDefMutableDatas = createFunctionDefMutableDatas();
+	std::shared_ptr<LLVMJIT::Module> jitModule;
+	std::shared_ptr<InterpretedInstance> interpretedInstance;
+	if(module->interpretedModule)
 	{
-		jitFunctionImports.push_back(
-			{CallingConvention::wasm, const_cast<U8*>(functions[importIndex]->code)});
+		// Bind the interpreted code to this module instance's imports and definitions.
+		jitModule = instantiateInterpretedModule(module->interpretedModule,
+												 functions,
+												 tables,
+												 memories,
+												 globals,
+												 id,
+												 functionDefMutableDatas,
+												 interpretedInstance);
 	}
-
-	std::vector<LLVMJIT::TableBinding> jitTables;
-	for(Table* table : tables) { jitTables.push_back({table->id}); }
-
-	std::vector<LLVMJIT::MemoryBinding> jitMemories;
-	for(Memory* memory : memories) { jitMemories.push_back({memory->id}); }
-
-	std::vector<LLVMJIT::GlobalBinding> jitGlobals;
-	for(Global* global : globals)
+	else
 	{
-		LLVMJIT::GlobalBinding globalSpec;
-		globalSpec.type = global->type;
-		if(global->type.isMutable) { globalSpec.mutableGlobalIndex = global->mutableGlobalIndex; }
-		else
+		// Load the compiled module's object code if this is the module's first instance. The loaded
+		// code is shared by all the module's instances, so its functions are named by the first
+		// instance.
+		std::shared_ptr<LLVMJIT::Module> loadedJITModule;
 		{
-			globalSpec.immutableValuePointer = &global->initialValue;
+			Lock<Platform::Mutex> jitModuleLock(module->jitModuleMutex);
+			if(!module->jitModule)
+			{
+				HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap;
+				for(const HashMapPair<std::string, Intrinsics::Function*>& intrinsicFunctionPair :
+					Intrinsics::getUninstantiatedFunctions(
+						{WAVM_INTRINSIC_MODULE_REF(wavmIntrinsics),
+						 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsAtomics),
+						 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsException),
+						 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsMemory),
+						 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsTable)}))
+				{
+					LLVMJIT::FunctionBinding functionBinding{
+						intrinsicFunctionPair.value->getCallingConvention(),
+						intrinsicFunctionPair.value->getNativeFunction()};
+					wavmIntrinsicsExportMap.add(intrinsicFunctionPair.key, functionBinding);
+				}
+
+				// The tier-up state keeps a copy of the IR rather than a reference to the module,
+				// since the module owns the loaded code.
+				std::vector<FunctionType> jitTypes = module->ir.types;
+				module->jitModule = LLVMJIT::loadModule(
+					module->objectCode,
+					std::move(wavmIntrinsicsExportMap),
+					std::move(jitTypes),
+					reinterpret_cast<Uptr>(getOutOfBoundsElement()),
+					createFunctionDefMutableDatas(),
+					module->isTiered || module->isLazy
+						? std::make_shared<const IR::Module>(module->ir)
+						: nullptr,
+					module->tierUpOptLevel,
+					module->isInterruptible,
+					module->meterFuel,
+					module->boundsCheckMemories);
+			}
+			loadedJITModule = module->jitModule;
 		}
-		jitGlobals.push_back(globalSpec);
-	}
 
-	std::vector<LLVMJIT::ExceptionTypeBinding> jitExceptionTypes;
-	for(ExceptionType* exceptionType : exceptionTypes)
-	{ jitExceptionTypes.push_back({exceptionType->id}); }
+		// Set up the values to bind to this instance's binding table.
+		std::vector<LLVMJIT::FunctionBinding> jitFunctionImports;
+		for(Uptr importIndex = 0; importIndex < module->ir.functions.imports.size(); ++importIndex)
+		{
+			jitFunctionImports.push_back(
+				{CallingConvention::wasm, const_cast<U8*>(functions[importIndex]->code)});
+		}
 
-	// Create a FunctionMutableData for each function definition.
-	std::vector<FunctionMutableData*> functionDefMutableDatas;
-	for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
-		++functionDefIndex)
-	{
-		std::string debugName
-			= disassemblyNames.functions[module->ir.functions.imports.size() + functionDefIndex]
-				  .name;
-		if(!debugName.size())
-		{ debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
-		debugName = "wasm!" + moduleDebugName + '!' + debugName;
+		std::vector<LLVMJIT::TableBinding> jitTables;
+		for(Table* table : tables) { jitTables.push_back({table->id}); }
+
+		std::vector<LLVMJIT::MemoryBinding> jitMemories;
+		for(Memory* memory : memories) { jitMemories.push_back({memory->id}); }
+
+		std::vector<LLVMJIT::GlobalBinding> jitGlobals;
+		for(Global* global : globals)
+		{
+			LLVMJIT::GlobalBinding globalSpec;
+			globalSpec.type = global->type;
+			if(global->type.isMutable)
+			{ globalSpec.mutableGlobalIndex = global->mutableGlobalIndex; }
+			else
+			{
+				globalSpec.immutableValuePointer = &global->initialValue;
+			}
+			jitGlobals.push_back(globalSpec);
+		}
 
-		functionDefMutableDatas.push_back(new FunctionMutableData(std::move(debugName)));
+		std::vector<LLVMJIT::ExceptionTypeBinding> jitExceptionTypes;
+		for(ExceptionType* exceptionType : exceptionTypes)
+		{ jitExceptionTypes.push_back({exceptionType->id}); }
+
+		// Bind the loaded code to this module instance's imports and definitions.
+		jitModule = LLVMJIT::instantiateModule(loadedJITModule,
+											   std::move(jitFunctionImports),
+											   std::move(jitTables),
+											   std::move(jitMemories),
+											   std::move(jitGlobals),
+											   std::move(jitExceptionTypes),
+											   {id},
+											   functionDefMutableDatas);
 	}
 
-	// Load the compiled module's object code with this module instance's imports.
-	std::vector<FunctionType> jitTypes = module->ir.types;
-	std::vector<Runtime::Function*> jitFunctionDefs;
-	jitFunctionDefs.resize(module->ir.functions.defs.size(), nullptr);
-	std::shared_ptr<LLVMJIT::Module> jitModule
-		= LLVMJIT::loadModule(module->objectCode,
-							  std::move(wavmIntrinsicsExportMap),
-							  std::move(jitTypes),
-							  std::move(jitFunctionImports),
-							  std::move(jitTables),
-							  std::move(jitMemories),
-							  std::move(jitGlobals),
-							  std::move(jitExceptionTypes),
-							  {id},
-							  reinterpret_cast<Uptr>(getOutOfBoundsElement()),
-							  functionDefMutableDatas);
-
-	// LLVMJIT::loadModule filled in the functionDefMutableDatas' function pointers with the
-	// compiled functions. Add those functions to the module.
+	// Instantiating the module filled in the functionDefMutableDatas' function pointers with the
+	// instance's functions. Add those functions to the module.
 	for(FunctionMutableData* functionMutableData : functionDefMutableDatas)
 	{ functions.push_back(functionMutableData->function); }
 
@@ -357,7 +458,8 @@ ModuleInstance* Runtime::instantiateModule(Compartment* compartment,
 														std::move(elemSegments),
 														std::move(jitModule),
 														std::move(moduleDebugName),
-														resourceQuota);
+														resourceQuota,
+														std::move(interpretedInstance));
 	{
 		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
 		compartment->moduleInstances[id] = moduleInstance;
@@ -472,6 +574,8 @@ ModuleInstance* Runtime::cloneModuleInstance(ModuleInstance* moduleInstance,
 
 	// Create the new ModuleInstance in the cloned compartment, but with the same ID as the old one.
 	std::shared_ptr<LLVMJIT::Module> jitModuleCopy = moduleInstance->jitModule;
+	std::shared_ptr<InterpretedInstance> interpretedInstanceCopy
+		= moduleInstance->interpretedInstance;
 	ModuleInstance* newModuleInstance = new ModuleInstance(newCompartment,
 														   moduleInstance->id,
 														   std::move(newExportMap),
@@ -486,7 +590,8 @@ ModuleInstance* Runtime::cloneModuleInstance(ModuleInstance* moduleInstance,
 														   std::move(newElemSegments),
 														   std::move(jitModuleCopy),
 														   std::string(moduleInstance->debugName),
-														   moduleInstance->resourceQuota);
+														   moduleInstance->resourceQuota,
+														   std::move(interpretedInstanceCopy));
 	{
 		Lock<Platform::Mutex> compartmentLock(newCompartment->mutex);
 		newCompartment->moduleInstances.insertOrFail(moduleInstance->id, newModuleInstance);
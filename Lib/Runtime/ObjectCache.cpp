@@ -0,0 +1,364 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/I128.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Time.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Clock.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Random.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/VFS/VFS.h"
+#include "WAVM/WASM/WASM.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Each cache entry is a file named by the hex encoding of its key, with this extension. Entries are
+// written to a temporary file with objectCacheTempFileExtension, and then renamed to the entry's
+// name, so readers never see a partially written entry.
+static const char objectCacheFileExtension[] = ".wavmobj";
+static const char objectCacheTempFileExtension[] = ".wavmobj-tmp";
+
+// The header at the start of each cache entry.
+struct ObjectCacheFileHeader
+{
+	U64 magic;
+	U64 keyHash[2];
+	U64 numObjectBytes;
+	U64 objectBytesHash;
+};
+static constexpr U64 objectCacheFileMagic = 0x6a626f6d7661772e; // ".wavmobj"
+
+static Platform::Mutex objectCacheConfigMutex;
+static std::string objectCacheDirectoryPath;
+static U64 objectCacheMaxBytes = 0;
+
+bool Runtime::enableObjectCache(const std::string& directoryPath, U64 maxBytes)
+{
+	VFS::FileSystem& hostFS = Platform::getHostFS();
+
+	// Create the cache directory if it doesn't already exist.
+	VFS::Result result = hostFS.createDir(directoryPath);
+	if(result != VFS::Result::success && result != VFS::Result::alreadyExists)
+	{
+		Log::printf(Log::error,
+					"Error creating object cache directory '%s': %s\n",
+					directoryPath.c_str(),
+					VFS::describeResult(result));
+		return false;
+	}
+
+	VFS::FileInfo fileInfo;
+	result = hostFS.getFileInfo(directoryPath, fileInfo);
+	if(result != VFS::Result::success || fileInfo.type != VFS::FileType::directory)
+	{
+		Log::printf(
+			Log::error, "Object cache path '%s' isn't a directory.\n", directoryPath.c_str());
+		return false;
+	}
+
+	Lock<Platform::Mutex> configLock(objectCacheConfigMutex);
+	objectCacheDirectoryPath = directoryPath;
+	objectCacheMaxBytes = maxBytes;
+	return true;
+}
+
+void Runtime::disableObjectCache()
+{
+	Lock<Platform::Mutex> configLock(objectCacheConfigMutex);
+	objectCacheDirectoryPath.clear();
+	objectCacheMaxBytes = 0;
+}
+
+static void serializeFeatureSpec(Serialization::OutputStream& stream,
+								 const FeatureSpec& featureSpec)
+{
+	// Serialize each field explicitly instead of hashing the struct's bytes, which include padding.
+	U8 flags[] = {featureSpec.mvp,
+				  featureSpec.importExportMutableGlobals,
+				  featureSpec.nonTrappingFloatToInt,
+				  featureSpec.extendedSignExtension,
+				  featureSpec.simd,
+				  featureSpec.atomics,
+				  featureSpec.exceptionHandling,
+				  featureSpec.multipleResultsAndBlockParams,
+				  featureSpec.bulkMemoryOperations,
+				  featureSpec.referenceTypes,
+				  featureSpec.extendedNamesSection,
+				  featureSpec.quotedNamesInTextFormat,
+				  featureSpec.sharedTables,
+				  featureSpec.requireSharedFlagForAtomicOperators,
+				  featureSpec.allowLegacyOperatorNames};
+	Serialization::serializeBytes(stream, flags, sizeof(flags));
+
+	U64 limits[] = {U64(featureSpec.maxLocals),
+					U64(featureSpec.maxLabelsPerFunction),
+					U64(featureSpec.maxDataSegments),
+					U64(featureSpec.maxSyntaxRecursion)};
+	Serialization::serializeBytes(stream, (const U8*)limits, sizeof(limits));
+}
+
+static std::string getObjectCacheFilePath(const ObjectCacheKey& key, const char* extension)
+{
+	char keyString[33];
+	snprintf(keyString, sizeof(keyString), "%016" PRIx64 "%016" PRIx64, key.hash[0], key.hash[1]);
+	return key.directoryPath + '/' + keyString + extension;
+}
+
+bool Runtime::getObjectCacheKey(const IR::Module& irModule,
+								const LLVMJIT::TargetSpec& targetSpec,
+								const LLVMJIT::CompileOptions& compileOptions,
+								ObjectCacheKey& outKey)
+{
+	{
+		Lock<Platform::Mutex> configLock(objectCacheConfigMutex);
+		if(objectCacheDirectoryPath.empty()) { return false; }
+		outKey.directoryPath = objectCacheDirectoryPath;
+		outKey.maxBytes = objectCacheMaxBytes;
+	}
+
+	// The key is a hash of the module's WebAssembly binary encoding, and everything else that
+	// affects the object code generated for it.
+	Serialization::ArrayOutputStream keyStream;
+	try
+	{
+		WASM::serialize(keyStream, irModule);
+	}
+	catch(Serialization::FatalSerializationException const& exception)
+	{
+		Log::printf(Log::debug,
+					"Not caching object code for module that couldn't be serialized: %s\n",
+					exception.message.c_str());
+		return false;
+	}
+
+	std::string triple = targetSpec.triple;
+	std::string cpu = targetSpec.cpu;
+	std::string compilerVersion = LLVMJIT::getCompilerVersion();
+	U8 optLevel = U8(compileOptions.optLevel);
+	U64 numShards = U64(compileOptions.numShards);
+	U8 tiered = compileOptions.tiered ? 1 : 0;
+	U32 tierUpCallThreshold = compileOptions.tierUpCallThreshold;
+	U8 lazy = compileOptions.lazy ? 1 : 0;
+	U8 lazyCompileDirectCallees = compileOptions.lazyCompileDirectCallees ? 1 : 0;
+	U8 instrumentProfile = compileOptions.instrumentProfile ? 1 : 0;
+	U8 interruptible = compileOptions.interruptible ? 1 : 0;
+	U8 meterFuel = compileOptions.meterFuel ? 1 : 0;
+	U8 boundsCheckMemories = compileOptions.boundsCheckMemories ? 1 : 0;
+	std::string profile
+		= compileOptions.profile ? LLVMJIT::serializeProfile(*compileOptions.profile) : "";
+	Serialization::serialize(keyStream, triple);
+	Serialization::serialize(keyStream, cpu);
+	Serialization::serialize(keyStream, compilerVersion);
+	serializeFeatureSpec(keyStream, irModule.featureSpec);
+	Serialization::serialize(keyStream, optLevel);
+	Serialization::serialize(keyStream, numShards);
+	Serialization::serialize(keyStream, tiered);
+	Serialization::serialize(keyStream, tierUpCallThreshold);
+	Serialization::serialize(keyStream, lazy);
+	Serialization::serialize(keyStream, lazyCompileDirectCallees);
+	Serialization::serialize(keyStream, instrumentProfile);
+	Serialization::serialize(keyStream, interruptible);
+	Serialization::serialize(keyStream, meterFuel);
+	Serialization::serialize(keyStream, boundsCheckMemories);
+	Serialization::serialize(keyStream, profile);
+
+	const std::vector<U8> keyBytes = keyStream.getBytes();
+	outKey.hash[0] = XXH64(keyBytes.data(), keyBytes.size(), 0);
+	outKey.hash[1] = XXH64(keyBytes.data(), keyBytes.size(), outKey.hash[0]);
+	return true;
+}
+
+static bool readObjectCacheFile(const ObjectCacheKey& key,
+								const std::string& filePath,
+								std::vector<U8>& outObjectCode)
+{
+	VFS::VFD* vfd = nullptr;
+	if(Platform::getHostFS().open(filePath,
+								  VFS::FileAccessMode::readOnly,
+								  VFS::FileCreateMode::openExisting,
+								  vfd)
+	   != VFS::Result::success)
+	{ return false; }
+
+	// Read and validate the header.
+	bool succeeded = false;
+	ObjectCacheFileHeader header;
+	Uptr numBytesRead = 0;
+	if(vfd->read(&header, sizeof(header), &numBytesRead) == VFS::Result::success
+	   && numBytesRead == sizeof(header) && header.magic == objectCacheFileMagic
+	   && header.keyHash[0] == key.hash[0] && header.keyHash[1] == key.hash[1]
+	   && header.numObjectBytes <= UINTPTR_MAX)
+	{
+		// Read the object code, and check that it wasn't truncated or corrupted.
+		outObjectCode.resize(Uptr(header.numObjectBytes));
+		succeeded
+			= vfd->read(outObjectCode.data(), outObjectCode.size(), &numBytesRead)
+				  == VFS::Result::success
+			  && numBytesRead == outObjectCode.size()
+			  && XXH64(outObjectCode.data(), outObjectCode.size(), 0) == header.objectBytesHash;
+	}
+
+	WAVM_ERROR_UNLESS(vfd->close() == VFS::Result::success);
+	return succeeded;
+}
+
+bool Runtime::loadCachedObjectCode(const ObjectCacheKey& key, std::vector<U8>& outObjectCode)
+{
+	Timing::Timer loadTimer;
+
+	const std::string filePath = getObjectCacheFilePath(key, objectCacheFileExtension);
+	if(!readObjectCacheFile(key, filePath, outObjectCode))
+	{
+		outObjectCode.clear();
+		return false;
+	}
+
+	// Update the entry's last write time, which is used to pick the least recently used entries
+	// to evict. The last access time isn't reliably updated by all file systems.
+	Platform::getHostFS().setFileTimes(
+		filePath, false, Time(), true, Platform::getClockTime(Platform::Clock::realtime));
+
+	Timing::logRatePerSecond("Loaded cached object code",
+							 loadTimer,
+							 (F64)outObjectCode.size() / 1024.0 / 1024.0,
+							 "MiB");
+	return true;
+}
+
+static bool stringEndsWith(const std::string& string, const char* suffix)
+{
+	const Uptr numSuffixChars = strlen(suffix);
+	return string.size() >= numSuffixChars
+		   && !string.compare(string.size() - numSuffixChars, numSuffixChars, suffix);
+}
+
+// Deletes the least recently used entries in the cache until it holds at most maxBytes.
+static void evictObjectCacheEntries(const std::string& directoryPath, U64 maxBytes)
+{
+	VFS::FileSystem& hostFS = Platform::getHostFS();
+
+	struct Entry
+	{
+		std::string path;
+		U64 numBytes;
+		I128 lastWriteTime;
+	};
+	std::vector<Entry> entries;
+	U64 totalBytes = 0;
+
+	VFS::DirEntStream* dirEntStream = nullptr;
+	if(hostFS.openDir(directoryPath, dirEntStream) != VFS::Result::success) { return; }
+	VFS::DirEnt dirEnt;
+	while(dirEntStream->getNext(dirEnt))
+	{
+		if(!stringEndsWith(dirEnt.name, objectCacheFileExtension)
+		   && !stringEndsWith(dirEnt.name, objectCacheTempFileExtension))
+		{ continue; }
+
+		std::string path = directoryPath + '/' + dirEnt.name;
+		VFS::FileInfo fileInfo;
+		if(hostFS.getFileInfo(path, fileInfo) != VFS::Result::success
+		   || fileInfo.type != VFS::FileType::file)
+		{ continue; }
+
+		totalBytes += fileInfo.numBytes;
+		entries.push_back({std::move(path), fileInfo.numBytes, fileInfo.lastWriteTime.ns});
+	}
+	dirEntStream->close();
+
+	if(totalBytes <= maxBytes) { return; }
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& left, const Entry& right) {
+		return left.lastWriteTime < right.lastWriteTime;
+	});
+	for(const Entry& entry : entries)
+	{
+		if(totalBytes <= maxBytes) { break; }
+
+		// Another process may have already deleted the entry, so ignore errors.
+		if(hostFS.unlinkFile(entry.path) == VFS::Result::success)
+		{
+			Log::printf(Log::debug, "Evicted object cache entry %s\n", entry.path.c_str());
+			totalBytes -= entry.numBytes;
+		}
+	}
+}
+
+void Runtime::saveCachedObjectCode(const ObjectCacheKey& key, const std::vector<U8>& objectCode)
+{
+	VFS::FileSystem& hostFS = Platform::getHostFS();
+
+	// Write the entry to a uniquely named temporary file.
+	U64 tempFileNonce = 0;
+	Platform::getCryptographicRNG((U8*)&tempFileNonce, sizeof(tempFileNonce));
+	char tempFileSuffix[40];
+	snprintf(tempFileSuffix,
+			 sizeof(tempFileSuffix),
+			 ".%016" PRIx64 "%s",
+			 tempFileNonce,
+			 objectCacheTempFileExtension);
+	const std::string tempFilePath = getObjectCacheFilePath(key, tempFileSuffix);
+
+	VFS::VFD* vfd = nullptr;
+	VFS::Result result = hostFS.open(
+		tempFilePath, VFS::FileAccessMode::writeOnly, VFS::FileCreateMode::createNew, vfd);
+	if(result != VFS::Result::success)
+	{
+		Log::printf(Log::debug,
+					"Error creating object cache entry '%s': %s\n",
+					tempFilePath.c_str(),
+					VFS::describeResult(result));
+		return;
+	}
+
+	ObjectCacheFileHeader header;
+	header.magic = objectCacheFileMagic;
+	header.keyHash[0] = key.hash[0];
+	header.keyHash[1] = key.hash[1];
+	header.numObjectBytes = U64(objectCode.size());
+	header.objectBytesHash = XXH64(objectCode.data(), objectCode.size(), 0);
+
+	VFS::IOWriteBuffer buffers[2] = {{&header, sizeof(header)},
+									 {objectCode.data(), objectCode.size()}};
+	Uptr numBytesWritten = 0;
+	result = vfd->writev(buffers, 2, &numBytesWritten);
+	if(result == VFS::Result::success && numBytesWritten != sizeof(header) + objectCode.size())
+	{ result = VFS::Result::outOfFreeSpace; }
+	const VFS::Result closeResult = vfd->close();
+	if(result == VFS::Result::success) { result = closeResult; }
+
+	// Atomically rename the temporary file to the entry's name.
+	if(result == VFS::Result::success)
+	{
+		result = hostFS.renameFile(tempFilePath,
+								   getObjectCacheFilePath(key, objectCacheFileExtension));
+	}
+	if(result != VFS::Result::success)
+	{
+		Log::printf(Log::debug,
+					"Error writing object cache entry '%s': %s\n",
+					tempFilePath.c_str(),
+					VFS::describeResult(result));
+		hostFS.unlinkFile(tempFilePath);
+		return;
+	}
+
+	evictObjectCacheEntries(key.directoryPath, key.maxBytes);
+}
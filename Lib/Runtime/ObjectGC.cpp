@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <algorithm>
 #include <atomic>
 #include <utility>
 #include <vector>
@@ -6,12 +7,12 @@
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
-#include "WAVM/Inline/Hash.h"
-#include "WAVM/Inline/HashSet.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Diagnostics.h"
 #include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Runtime.h"
 
 using namespace WAVM;
@@ -22,9 +23,181 @@ Runtime::GCObject::GCObject(ObjectKind inKind, Compartment* inCompartment)
 {
 }
 
+// Whether addGCRoot and removeGCRoot defer their changes to the root reference counters. This is
+// only read without any ordering, so changing it doesn't wait for threads that are in the middle
+// of changing a root reference counter.
+static std::atomic<bool> areRootReferenceCountsDeferred{true};
+
+// The number of garbage collections that are using the root reference counters. While it is
+// non-zero, root reference count changes are applied directly to the counters.
+static std::atomic<Uptr> numCollectionsUsingRootReferenceCounts{0};
+
+// The changes to root reference counters made by a thread that haven't been applied to the
+// counters yet. Applying them only when garbage is collected means that threads which add and
+// remove roots to the same object don't contend for the cache line that contains its counter.
+//
+// Only the owning thread changes the deferred counts, without taking a lock or executing a memory
+// barrier. A collection drains them with a handshake: the owner sets isChanging before it checks
+// whether any collection is using the counters, and the collector increments
+// numCollectionsUsingRootReferenceCounts and then makes every thread execute a memory barrier
+// before it checks isChanging. Either the owner sees the collection and changes the counter
+// directly, or the collector sees that the owner is changing its deferred counts and waits for it
+// to finish.
+struct DeferredRootReferenceCounts
+{
+	static constexpr Uptr maxCounters = 32;
+
+	struct CounterDelta
+	{
+		std::atomic<Uptr>* counter;
+		Iptr delta;
+	};
+
+	std::atomic<bool> isChanging{false};
+	Uptr numCounters = 0;
+	CounterDelta counterDeltas[maxCounters];
+
+	DeferredRootReferenceCounts();
+	~DeferredRootReferenceCounts();
+
+	void change(std::atomic<Uptr>& counter, Iptr delta)
+	{
+		if(!areRootReferenceCountsDeferred.load(std::memory_order_relaxed))
+		{
+			counter.fetch_add(Uptr(delta), std::memory_order_relaxed);
+			return;
+		}
+
+		// The acquire load synchronizes with the release decrement at the end of a collection, so
+		// if the owner sees that no collection is using the counters, the deferred counts the last
+		// collection drained aren't written until after it finished reading them.
+		isChanging.store(true, std::memory_order_relaxed);
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		if(numCollectionsUsingRootReferenceCounts.load(std::memory_order_acquire))
+		{ counter.fetch_add(Uptr(delta), std::memory_order_relaxed); }
+		else
+		{
+			changeDeferred(counter, delta);
+		}
+		isChanging.store(false, std::memory_order_release);
+	}
+
+	// Applies the deferred counts to the counters. Must only be called by the owning thread, or by a
+	// collector after the handshake.
+	void apply()
+	{
+		for(Uptr index = 0; index < numCounters; ++index)
+		{
+			counterDeltas[index].counter->fetch_add(Uptr(counterDeltas[index].delta),
+													std::memory_order_relaxed);
+		}
+		numCounters = 0;
+	}
+
+private:
+	void changeDeferred(std::atomic<Uptr>& counter, Iptr delta)
+	{
+		for(Uptr index = 0; index < numCounters; ++index)
+		{
+			if(counterDeltas[index].counter == &counter)
+			{
+				// Remove a counter whose net delta returns to zero.
+				counterDeltas[index].delta += delta;
+				if(!counterDeltas[index].delta) { counterDeltas[index] = counterDeltas[--numCounters]; }
+				return;
+			}
+		}
+
+		// If there isn't room for another counter, apply the deferred counts to make room. This
+		// doesn't need the registry lock: a collector that is draining this thread's counts waits
+		// for isChanging to be cleared, so it can't read the counters while they are being applied.
+		if(numCounters == maxCounters) { apply(); }
+		counterDeltas[numCounters++] = {&counter, delta};
+	}
+};
+
+// The deferred counts of every thread that has changed a root reference counter. This is never
+// freed, so threads that exit after the static destructors have run can still remove themselves.
+struct DeferredRootReferenceCountsRegistry
+{
+	Platform::Mutex mutex;
+	std::vector<DeferredRootReferenceCounts*> threadCounts;
+};
+
+static DeferredRootReferenceCountsRegistry& getDeferredRootReferenceCountsRegistry()
+{
+	static DeferredRootReferenceCountsRegistry* registry = [] {
+		DeferredRootReferenceCountsRegistry* newRegistry = new DeferredRootReferenceCountsRegistry;
+		Platform::expectLeakedObject(newRegistry);
+		return newRegistry;
+	}();
+	return *registry;
+}
+
+DeferredRootReferenceCounts::DeferredRootReferenceCounts()
+{
+	DeferredRootReferenceCountsRegistry& registry = getDeferredRootReferenceCountsRegistry();
+	Lock<Platform::Mutex> registryLock(registry.mutex);
+	registry.threadCounts.push_back(this);
+}
+
+DeferredRootReferenceCounts::~DeferredRootReferenceCounts()
+{
+	// Apply the thread's deferred counts before it exits. Holding the registry lock keeps
+	// collectors from draining the counts at the same time.
+	DeferredRootReferenceCountsRegistry& registry = getDeferredRootReferenceCountsRegistry();
+	Lock<Platform::Mutex> registryLock(registry.mutex);
+	apply();
+	for(Uptr index = 0; index < registry.threadCounts.size(); ++index)
+	{
+		if(registry.threadCounts[index] == this)
+		{
+			registry.threadCounts[index] = registry.threadCounts.back();
+			registry.threadCounts.pop_back();
+			break;
+		}
+	}
+}
+
+static thread_local DeferredRootReferenceCounts threadDeferredRootReferenceCounts;
+
+// Makes root reference count changes apply directly to the counters until
+// endUsingRootReferenceCounts is called, and applies every thread's deferred counts, so the
+// counters are accurate for a garbage collection.
+static void beginUsingRootReferenceCounts()
+{
+	numCollectionsUsingRootReferenceCounts.fetch_add(1, std::memory_order_seq_cst);
+	Platform::flushProcessWriteBuffers();
+
+	DeferredRootReferenceCountsRegistry& registry = getDeferredRootReferenceCountsRegistry();
+	Lock<Platform::Mutex> registryLock(registry.mutex);
+	for(DeferredRootReferenceCounts* counts : registry.threadCounts)
+	{
+		while(counts->isChanging.load(std::memory_order_acquire))
+		{ Platform::yieldToAnotherThread(); }
+		counts->apply();
+	}
+}
+
+static void endUsingRootReferenceCounts()
+{
+	numCollectionsUsingRootReferenceCounts.fetch_sub(1, std::memory_order_release);
+}
+
+void Runtime::setGCRootReferenceCountsDeferred(bool deferred)
+{
+	areRootReferenceCountsDeferred.store(deferred, std::memory_order_relaxed);
+}
+
 #define IMPLEMENT_GCOBJECT_REFCOUNTING(Type)                                                       \
-	void Runtime::addGCRoot(const Type* object) { ++object->numRootReferences; }                   \
-	void Runtime::removeGCRoot(const Type* object) { --object->numRootReferences; }
+	void Runtime::addGCRoot(const Type* object)                                                    \
+	{                                                                                              \
+		threadDeferredRootReferenceCounts.change(object->numRootReferences, 1);                    \
+	}                                                                                              \
+	void Runtime::removeGCRoot(const Type* object)                                                 \
+	{                                                                                              \
+		threadDeferredRootReferenceCounts.change(object->numRootReferences, -1);                   \
+	}
 
 IMPLEMENT_GCOBJECT_REFCOUNTING(Table)
 IMPLEMENT_GCOBJECT_REFCOUNTING(Memory)
@@ -38,13 +211,13 @@ IMPLEMENT_GCOBJECT_REFCOUNTING(Foreign)
 void Runtime::addGCRoot(const Function* function)
 {
 	WAVM_ASSERT(function->mutableData);
-	++function->mutableData->numRootReferences;
+	threadDeferredRootReferenceCounts.change(function->mutableData->numRootReferences, 1);
 }
 
 void Runtime::removeGCRoot(const Function* function)
 {
 	WAVM_ASSERT(function->mutableData);
-	--function->mutableData->numRootReferences;
+	threadDeferredRootReferenceCounts.change(function->mutableData->numRootReferences, -1);
 }
 
 void Runtime::addGCRoot(const Object* object)
@@ -53,7 +226,7 @@ void Runtime::addGCRoot(const Object* object)
 	else
 	{
 		const GCObject* gcObject = static_cast<const GCObject*>(object);
-		++gcObject->numRootReferences;
+		threadDeferredRootReferenceCounts.change(gcObject->numRootReferences, 1);
 	}
 }
 
@@ -62,18 +235,123 @@ void Runtime::removeGCRoot(const Object* object)
 	if(object->kind == ObjectKind::function) { removeGCRoot((const Function*)object); }
 	else
 	{
-		GCObject* gcObject = (GCObject*)object;
-		--gcObject->numRootReferences;
+		const GCObject* gcObject = static_cast<const GCObject*>(object);
+		threadDeferredRootReferenceCounts.change(gcObject->numRootReferences, -1);
 	}
 }
 
+// The number of objects that each thread marking a compartment's objects should have to scan. If a
+// compartment has fewer objects than this, they are marked on the collecting thread.
+static constexpr Uptr minObjectsPerMarkThread = 4096;
+
+// When a marking thread has more objects than this waiting to be scanned, it shares some of them
+// with idle marking threads.
+static constexpr Uptr maxUnsharedPendingScanObjects = 64;
+
+// The state shared by the threads that mark the objects reachable from a compartment's roots. An
+// object is marked by setting its gcMarkEpoch to the collection's epoch, so the marks don't need to
+// be cleared between collections.
 struct GCState
 {
-	Compartment* compartment;
-	HashSet<GCObject*> unreferencedObjects;
+	const Compartment* compartment;
+	const Uptr markEpoch;
+	const Uptr numThreads;
+
+	Platform::Mutex sharedPendingScanObjectsMutex;
+	std::vector<GCObject*> sharedPendingScanObjects;
+	std::atomic<Uptr> numIdleThreads{0};
+	std::atomic<Uptr> numScannedObjects{0};
+
+	GCState(const Compartment* inCompartment, Uptr inMarkEpoch, Uptr inNumThreads)
+	: compartment(inCompartment), markEpoch(inMarkEpoch), numThreads(inNumThreads)
+	{
+	}
+
+	// Marks an object, and returns true if it wasn't already marked.
+	bool mark(GCObject* object)
+	{
+		if(object->gcMarkEpoch.load(std::memory_order_relaxed) == markEpoch) { return false; }
+		return object->gcMarkEpoch.exchange(markEpoch, std::memory_order_relaxed) != markEpoch;
+	}
+
+	bool isMarked(const GCObject* object) const
+	{
+		return object->gcMarkEpoch.load(std::memory_order_relaxed) == markEpoch;
+	}
+};
+
+// Scans marked objects on one thread, marking the objects they reference.
+struct GCMarker
+{
+	GCMarker(GCState& inState) : state(inState) {}
+
+	void run()
+	{
+		Uptr numScannedObjects = 0;
+		while(takeSharedPendingScanObjects())
+		{
+			while(pendingScanObjects.size())
+			{
+				GCObject* object = pendingScanObjects.back();
+				pendingScanObjects.pop_back();
+				scanObject(object);
+				++numScannedObjects;
+
+				if(pendingScanObjects.size() > maxUnsharedPendingScanObjects
+				   && state.numIdleThreads.load(std::memory_order_relaxed))
+				{ sharePendingScanObjects(); }
+			}
+		}
+		state.numScannedObjects += numScannedObjects;
+	}
+
+private:
+	GCState& state;
 	std::vector<GCObject*> pendingScanObjects;
 
-	GCState(Compartment* inCompartment) : compartment(inCompartment) {}
+	// Moves the oldest half of this thread's pending objects to the shared list.
+	void sharePendingScanObjects()
+	{
+		const Uptr numSharedObjects = pendingScanObjects.size() / 2;
+		Lock<Platform::Mutex> sharedLock(state.sharedPendingScanObjectsMutex);
+		state.sharedPendingScanObjects.insert(state.sharedPendingScanObjects.end(),
+											  pendingScanObjects.begin(),
+											  pendingScanObjects.begin() + numSharedObjects);
+		pendingScanObjects.erase(pendingScanObjects.begin(),
+								 pendingScanObjects.begin() + numSharedObjects);
+	}
+
+	// Waits until there are shared objects to scan, and moves some of them to this thread's
+	// pending objects. Returns false if every thread is idle, and so there are no objects left to
+	// scan.
+	bool takeSharedPendingScanObjects()
+	{
+		state.numIdleThreads.fetch_add(1, std::memory_order_relaxed);
+		while(true)
+		{
+			{
+				Lock<Platform::Mutex> sharedLock(state.sharedPendingScanObjectsMutex);
+				std::vector<GCObject*>& sharedObjects = state.sharedPendingScanObjects;
+				if(sharedObjects.size())
+				{
+					const Uptr numTakenObjects
+						= (sharedObjects.size() + state.numThreads - 1) / state.numThreads;
+					pendingScanObjects.insert(pendingScanObjects.end(),
+											  sharedObjects.end() - numTakenObjects,
+											  sharedObjects.end());
+					sharedObjects.resize(sharedObjects.size() - numTakenObjects);
+					state.numIdleThreads.fetch_sub(1, std::memory_order_relaxed);
+					return true;
+				}
+
+				// Threads only share objects while they aren't idle, so if every thread is idle,
+				// there won't be any more objects to scan.
+				if(state.numIdleThreads.load(std::memory_order_relaxed) == state.numThreads)
+				{ return false; }
+			}
+			Platform::yieldToAnotherThread();
+		}
+	}
 
 	void visitReference(Object* object)
 	{
@@ -84,13 +362,14 @@ struct GCState
 				Function* function = asFunction(object);
 				if(function->moduleInstanceId != UINTPTR_MAX)
 				{
+					const Compartment* compartment = state.compartment;
 					WAVM_ASSERT(compartment->moduleInstances.contains(function->moduleInstanceId));
 					ModuleInstance* moduleInstance
 						= compartment->moduleInstances[function->moduleInstanceId];
 					visitReference(moduleInstance);
 				}
 			}
-			else if(unreferencedObjects.remove((GCObject*)object))
+			else if(object->kind != ObjectKind::foreign && state.mark((GCObject*)object))
 			{
 				pendingScanObjects.push_back((GCObject*)object);
 			}
@@ -102,17 +381,9 @@ struct GCState
 		for(auto reference : array) { visitReference(asObject(reference)); }
 	}
 
-	void initGCObject(GCObject* object, bool forceRoot = false)
-	{
-		if(forceRoot || object->numRootReferences > 0) { pendingScanObjects.push_back(object); }
-		else
-		{
-			unreferencedObjects.add(object);
-		}
-	}
-
 	void scanObject(GCObject* object)
 	{
+		const Compartment* compartment = state.compartment;
 		WAVM_ASSERT(!object->compartment || object->compartment == compartment);
 		visitReference(object->compartment);
 
@@ -174,15 +445,33 @@ struct GCState
 	}
 };
 
+static I64 markThreadEntry(void* stateVoid)
+{
+	GCMarker(*(GCState*)stateVoid).run();
+	return 0;
+}
+
 static bool collectGarbageImpl(Compartment* compartment)
 {
+	beginUsingRootReferenceCounts();
+
 	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
 	Timing::Timer timer;
 
-	GCState state(compartment);
+	const Uptr numObjects = 1 + compartment->moduleInstances.size() + compartment->memories.size()
+							+ compartment->tables.size() + compartment->exceptionTypes.size()
+							+ compartment->globals.size() + compartment->contexts.size();
+	const Uptr numThreads = std::max(
+		Uptr(1),
+		std::min(Platform::getNumberOfHardwareThreads(), numObjects / minObjectsPerMarkThread));
+	GCState state(compartment, ++compartment->gcEpoch, numThreads);
 
-	// Initialize the GC state from the compartment's various sets of objects.
-	state.initGCObject(compartment);
+	// Mark the roots from the compartment's various sets of objects.
+	auto addRoot = [&state](GCObject* object, bool forceRoot = false) {
+		if((forceRoot || object->numRootReferences > 0) && state.mark(object))
+		{ state.sharedPendingScanObjects.push_back(object); }
+	};
+	addRoot(compartment);
 	for(ModuleInstance* moduleInstance : compartment->moduleInstances)
 	{
 		if(moduleInstance)
@@ -198,50 +487,56 @@ static bool collectGarbageImpl(Compartment* compartment)
 				}
 			}
 
-			state.initGCObject(moduleInstance, hasRootFunction);
+			addRoot(moduleInstance, hasRootFunction);
 		}
 	}
-	for(Memory* memory : compartment->memories) { state.initGCObject(memory); }
-	for(Table* table : compartment->tables) { state.initGCObject(table); }
-	for(ExceptionType* exceptionType : compartment->exceptionTypes)
-	{ state.initGCObject(exceptionType); }
-	for(Global* global : compartment->globals) { state.initGCObject(global); }
-	for(Context* context : compartment->contexts) { state.initGCObject(context); }
-
-	// Scan the objects added to the referenced set so far: gather their child references and
-	// recurse.
-	const Uptr numInitialObjects
-		= state.pendingScanObjects.size() + state.unreferencedObjects.size();
-	const Uptr numRoots = state.pendingScanObjects.size();
-	while(state.pendingScanObjects.size())
-	{
-		GCObject* object = state.pendingScanObjects.back();
-		state.pendingScanObjects.pop_back();
-		state.scanObject(object);
-	};
+	for(Memory* memory : compartment->memories) { addRoot(memory); }
+	for(Table* table : compartment->tables) { addRoot(table); }
+	for(ExceptionType* exceptionType : compartment->exceptionTypes) { addRoot(exceptionType); }
+	for(Global* global : compartment->globals) { addRoot(global); }
+	for(Context* context : compartment->contexts) { addRoot(context); }
+	const Uptr numRoots = state.sharedPendingScanObjects.size();
 
-	// Delete each unreferenced object that isn't the compartment.
-	bool wasCompartmentUnreferenced = false;
-	for(GCObject* object : state.unreferencedObjects)
-	{
-		if(object == compartment) { wasCompartmentUnreferenced = true; }
-		else
-		{
-			delete object;
-		}
-	}
+	// Scan the marked objects: mark their child references and recurse.
+	Timing::Timer markTimer;
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{ threads.push_back(Platform::createThread(1024 * 1024, markThreadEntry, &state)); }
+	GCMarker(state).run();
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+	markTimer.stop();
+
+	// Gather the objects that weren't marked, and delete each of them that isn't the compartment.
+	std::vector<GCObject*> garbageObjects;
+	auto addGarbage = [&state, &garbageObjects](GCObject* object) {
+		if(object && !state.isMarked(object)) { garbageObjects.push_back(object); }
+	};
+	for(ModuleInstance* moduleInstance : compartment->moduleInstances)
+	{ addGarbage(moduleInstance); }
+	for(Memory* memory : compartment->memories) { addGarbage(memory); }
+	for(Table* table : compartment->tables) { addGarbage(table); }
+	for(ExceptionType* exceptionType : compartment->exceptionTypes) { addGarbage(exceptionType); }
+	for(Global* global : compartment->globals) { addGarbage(global); }
+	for(Context* context : compartment->contexts) { addGarbage(context); }
+	for(GCObject* object : garbageObjects) { delete object; }
 
 	// Delete the compartment last, if it wasn't referenced.
+	const bool wasCompartmentUnreferenced = !state.isMarked(compartment);
 	compartmentLock.unlock();
 	if(wasCompartmentUnreferenced) { delete compartment; }
+	endUsingRootReferenceCounts();
 
 	Log::printf(Log::metrics,
-				"Collected garbage in %.2fms: %" WAVM_PRIuPTR " roots, %" WAVM_PRIuPTR
-				" objects, %" WAVM_PRIuPTR " garbage\n",
+				"Collected garbage in %.2fms (%.2fms marking on %" WAVM_PRIuPTR
+				" threads): %" WAVM_PRIuPTR " roots, %" WAVM_PRIuPTR " objects, %" WAVM_PRIuPTR
+				" scanned, %" WAVM_PRIuPTR " garbage\n",
 				timer.getMilliseconds(),
+				markTimer.getMilliseconds(),
+				numThreads,
 				numRoots,
-				numInitialObjects,
-				Uptr(state.unreferencedObjects.size()));
+				numObjects,
+				Uptr(state.numScannedObjects.load()),
+				Uptr(garbageObjects.size() + (wasCompartmentUnreferenced ? 1 : 0)));
 
 	return wasCompartmentUnreferenced;
 }
@@ -0,0 +1,308 @@
+#include <string.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/IR.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Runs of fewer zero bytes than this are included in a data segment instead of splitting it, since
+// each segment has a few bytes of overhead.
+static constexpr Uptr minZeroBytesBetweenDataSegments = 16;
+
+// Adds active data segments to the module that initialize a memory with its current contents.
+static void addMemoryDataSegments(IR::Module& irModule, Uptr memoryIndex, Memory* memory)
+{
+	const U8* bytes = getMemoryBaseAddress(memory);
+	const Uptr numBytes = getMemoryNumPages(memory) * IR::numBytesPerPage;
+	Uptr offset = 0;
+	while(true)
+	{
+		// Skip to the next non-zero byte: the memory is zeroed when it is created.
+		while(offset < numBytes && !bytes[offset]) { ++offset; };
+		if(offset == numBytes) { break; }
+
+		// Extend the segment until it's followed by a long enough run of zero bytes.
+		const Uptr segmentBeginOffset = offset;
+		Uptr segmentEndOffset = offset;
+		while(offset < numBytes && offset - segmentEndOffset < minZeroBytesBetweenDataSegments)
+		{
+			if(bytes[offset]) { segmentEndOffset = offset + 1; }
+			++offset;
+		};
+
+		irModule.dataSegments.push_back(
+			{true,
+			 memoryIndex,
+			 InitializerExpression(I32(U32(segmentBeginOffset))),
+			 std::make_shared<std::vector<U8>>(bytes + segmentBeginOffset,
+											   bytes + segmentEndOffset)});
+	};
+}
+
+// Runs the initialization of an instance of a module that exports all its tables, memories, and
+// globals after the module's own exports, and rewrites the module's data segments and global
+// initializers to produce the resulting state.
+static bool preinitializeInstance(IR::Module& irModule,
+								  ModuleInstance* moduleInstance,
+								  Context* context,
+								  const char* initExportName,
+								  std::string& outError)
+{
+	const std::vector<Object*>& exports = getInstanceExports(moduleInstance);
+	const Uptr tableExportsBegin = irModule.exports.size();
+	const Uptr memoryExportsBegin = tableExportsBegin + irModule.tables.size();
+	const Uptr globalExportsBegin = memoryExportsBegin + irModule.memories.size();
+
+	// Save the state of the tables and mutable globals before the module's initialization runs,
+	// so it can tell which of them changed.
+	std::vector<std::vector<Object*>> initialTableElements;
+	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
+	{
+		const Table* table = asTable(exports[tableExportsBegin + tableIndex]);
+		std::vector<Object*> elements;
+		for(Uptr elementIndex = 0; elementIndex < getTableNumElements(table); ++elementIndex)
+		{ elements.push_back(getTableElement(table, elementIndex)); }
+		initialTableElements.push_back(std::move(elements));
+	}
+	std::vector<IR::Value> initialGlobalValues;
+	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
+	{
+		const Global* global = asGlobal(exports[globalExportsBegin + globalIndex]);
+		initialGlobalValues.push_back(getGlobalValue(context, global));
+	}
+
+	Function* initFunction = nullptr;
+	if(initExportName)
+	{
+		initFunction = asFunctionNullable(getInstanceExport(moduleInstance, initExportName));
+		if(!initFunction || getFunctionType(initFunction).params().size())
+		{
+			outError = "Module doesn't export a function named '" + std::string(initExportName)
+					   + "' without parameters.";
+			return false;
+		}
+	}
+
+	// Run the module's initialization.
+	bool succeeded = true;
+	catchRuntimeExceptions(
+		[&]() {
+			Function* startFunction = getStartFunction(moduleInstance);
+			if(startFunction) { invokeFunctionChecked(context, startFunction, {}); }
+			if(initFunction) { invokeFunctionChecked(context, initFunction, {}); }
+		},
+		[&](Exception* exception) {
+			outError = "Pre-initialization failed. Calls to imports trap during"
+					   " pre-initialization.\n"
+					   + describeException(exception);
+			destroyException(exception);
+			succeeded = false;
+		});
+	if(!succeeded) { return false; }
+
+	// Tables hold references to functions that can't be mapped back to indices in the module, so
+	// the initialization may not change them.
+	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
+	{
+		const Table* table = asTable(exports[tableExportsBegin + tableIndex]);
+		const std::vector<Object*>& initialElements = initialTableElements[tableIndex];
+		bool isTableUnchanged = getTableNumElements(table) == initialElements.size();
+		for(Uptr elementIndex = 0; isTableUnchanged && elementIndex < initialElements.size();
+			++elementIndex)
+		{
+			isTableUnchanged
+				= getTableElement(table, elementIndex) == initialElements[elementIndex];
+		}
+		if(!isTableUnchanged)
+		{
+			outError = "Pre-initialization changed table " + std::to_string(tableIndex)
+					   + ", which can't be written to the module.";
+			return false;
+		}
+	}
+
+	// Create initializers for the mutable globals that changed. They aren't written to the module
+	// until all the globals are checked, so the module isn't changed if one of them is rejected.
+	std::vector<InitializerExpression> globalInitializers;
+	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
+	{
+		const Global* global = asGlobal(exports[globalExportsBegin + globalIndex]);
+		const IR::Value value = getGlobalValue(context, global);
+		const IR::Value& initialValue = initialGlobalValues[globalIndex];
+		if(!memcmp(&value, &initialValue, sizeof(IR::UntaggedValue)))
+		{
+			globalInitializers.push_back(irModule.globals.defs[globalIndex].initializer);
+			continue;
+		}
+
+		InitializerExpression initializer;
+		switch(value.type)
+		{
+		case ValueType::i32: initializer = InitializerExpression(value.i32); break;
+		case ValueType::i64: initializer = InitializerExpression(value.i64); break;
+		case ValueType::f32: initializer = InitializerExpression(value.f32); break;
+		case ValueType::f64: initializer = InitializerExpression(value.f64); break;
+		case ValueType::v128: initializer = InitializerExpression(value.v128); break;
+		case ValueType::anyref:
+		case ValueType::funcref:
+			outError = "Pre-initialization changed reference global " + std::to_string(globalIndex)
+					   + ", which can't be written to the module.";
+			return false;
+
+		case ValueType::none:
+		case ValueType::any:
+		case ValueType::nullref:
+		default: WAVM_UNREACHABLE();
+		};
+		globalInitializers.push_back(initializer);
+	}
+	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
+	{ irModule.globals.defs[globalIndex].initializer = globalInitializers[globalIndex]; }
+
+	// Replace the module's data segments with segments that initialize each memory with its
+	// current contents.
+	irModule.dataSegments.clear();
+	for(Uptr memoryIndex = 0; memoryIndex < irModule.memories.size(); ++memoryIndex)
+	{
+		Memory* memory = asMemory(exports[memoryExportsBegin + memoryIndex]);
+		irModule.memories.defs[memoryIndex].type.size.min = getMemoryNumPages(memory);
+		addMemoryDataSegments(irModule, memoryIndex, memory);
+	}
+
+	return true;
+}
+
+bool Runtime::preinitializeModule(IR::Module& irModule,
+								  const char* initExportName,
+								  std::string& outError)
+{
+	// Only function imports can be stubbed out without changing the state the module initializes.
+	if(irModule.tables.imports.size() || irModule.memories.imports.size()
+	   || irModule.globals.imports.size())
+	{
+		outError = "Can't pre-initialize a module that imports tables, memories, or globals.";
+		return false;
+	}
+
+	// Which passive segments have been dropped is part of the instance's state, but isn't
+	// represented in the module.
+	for(const DataSegment& dataSegment : irModule.dataSegments)
+	{
+		if(!dataSegment.isActive)
+		{
+			outError = "Can't pre-initialize a module with passive data segments.";
+			return false;
+		}
+	}
+	for(const ElemSegment& elemSegment : irModule.elemSegments)
+	{
+		if(!elemSegment.isActive)
+		{
+			outError = "Can't pre-initialize a module with passive elem segments.";
+			return false;
+		}
+	}
+
+	for(const MemoryDef& memoryDef : irModule.memories.defs)
+	{
+		if(memoryDef.type.isShared)
+		{
+			outError = "Can't pre-initialize a module with shared memories.";
+			return false;
+		}
+	}
+
+	Timing::Timer timer;
+
+	// Export all the module's tables, memories, and globals from the instance that is initialized,
+	// so their state can be read after it runs.
+	IR::Module instanceIRModule = irModule;
+	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
+	{
+		instanceIRModule.exports.push_back(
+			{"wavm.preinit.table" + std::to_string(tableIndex), ExternKind::table, tableIndex});
+	}
+	for(Uptr memoryIndex = 0; memoryIndex < irModule.memories.size(); ++memoryIndex)
+	{
+		instanceIRModule.exports.push_back(
+			{"wavm.preinit.memory" + std::to_string(memoryIndex), ExternKind::memory, memoryIndex});
+	}
+	for(Uptr globalIndex = 0; globalIndex < irModule.globals.size(); ++globalIndex)
+	{
+		instanceIRModule.exports.push_back(
+			{"wavm.preinit.global" + std::to_string(globalIndex), ExternKind::global, globalIndex});
+	}
+
+	GCPointer<Compartment> compartment = createCompartment();
+	bool succeeded = false;
+	{
+		// Link the module's function imports to stubs that trap if they are called.
+		StubResolver stubResolver(compartment, StubResolver::FunctionBehavior::trap, false);
+		LinkResult linkResult = linkModule(instanceIRModule, stubResolver);
+		WAVM_ERROR_UNLESS(linkResult.success);
+
+		// Instantiating the module traps if its segments are out of bounds.
+		ModuleInstance* moduleInstance = nullptr;
+		catchRuntimeExceptions(
+			[&]() {
+				moduleInstance = instantiateModule(compartment,
+												   compileModule(instanceIRModule),
+												   std::move(linkResult.resolvedImports),
+												   "preinit");
+			},
+			[&](Exception* exception) {
+				outError = "Instantiating the module failed.\n" + describeException(exception);
+				destroyException(exception);
+			});
+		if(moduleInstance)
+		{
+			Context* context = createContext(compartment);
+			succeeded = preinitializeInstance(
+				irModule, moduleInstance, context, initExportName, outError);
+		}
+	}
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	if(!succeeded) { return false; }
+
+	// The start function and the init function have already run, so remove them from the module.
+	irModule.startFunctionIndex = UINTPTR_MAX;
+	if(initExportName)
+	{
+		for(auto exportIt = irModule.exports.begin(); exportIt != irModule.exports.end();
+			++exportIt)
+		{
+			if(exportIt->name == initExportName)
+			{
+				irModule.exports.erase(exportIt);
+				break;
+			}
+		}
+	}
+
+	// Drop the names of the original data segments from the name section.
+	Uptr nameSectionIndex = 0;
+	if(findUserSection(irModule, "name", nameSectionIndex))
+	{
+		DisassemblyNames names;
+		getDisassemblyNames(irModule, names);
+		names.dataSegments.assign(irModule.dataSegments.size(), "");
+		setDisassemblyNames(irModule, names);
+	}
+
+	Timing::logTimer("Pre-initialized module", timer);
+	return true;
+}
@@ -134,12 +134,13 @@ ExternType Runtime::getExternType(const Object* object)
 
 FunctionType Runtime::getFunctionType(const Function* function) { return function->encodedType; }
 
+const void* Runtime::getFunctionCode(const Function* function) { return function->code; }
+
 Context* Runtime::getContextFromRuntimeData(ContextRuntimeData* contextRuntimeData)
 {
 	const CompartmentRuntimeData* compartmentRuntimeData
 		= getCompartmentRuntimeData(contextRuntimeData);
 	const Uptr contextId = contextRuntimeData - compartmentRuntimeData->contexts;
-	Lock<Platform::Mutex> compartmentLock(compartmentRuntimeData->compartment->mutex);
 	return compartmentRuntimeData->compartment->contexts[contextId];
 }
 
@@ -180,6 +181,13 @@ Memory* Runtime::getMemoryFromRuntimeData(ContextRuntimeData* contextRuntimeData
 	return compartment->memories[memoryId];
 }
 
+Global* Runtime::getGlobalFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr globalId)
+{
+	Compartment* compartment = getCompartmentRuntimeData(contextRuntimeData)->compartment;
+	Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+	return compartment->globals[globalId];
+}
+
 Foreign* Runtime::createForeign(Compartment* compartment, void* userData, void (*finalizer)(void*))
 {
 	Foreign* foreign = new Foreign(compartment);
@@ -9,6 +9,7 @@
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -24,11 +25,18 @@ namespace WAVM { namespace Intrinsics {
 
 namespace WAVM { namespace Runtime {
 
+	struct InterpretedModule;
+	struct InterpretedInstance;
+
 	// A private base class for all runtime objects that are garbage collected.
 	struct GCObject : Object
 	{
 		Compartment* const compartment;
 		mutable std::atomic<Uptr> numRootReferences{0};
+
+		// The epoch of the most recent garbage collection that marked this object as reachable.
+		std::atomic<Uptr> gcMarkEpoch{0};
+
 		void* userData{nullptr};
 		void (*finalizeUserData)(void*);
 
@@ -75,7 +83,40 @@ namespace WAVM { namespace Runtime {
 	// at the end of the array will, when re-adding this Function's address, point to this Object.
 	extern Object* getOutOfBoundsElement();
 
+	// This is used as a sentinel value for table elements that haven't been initialized, or were
+	// set to null.
+	extern Object* getUninitializedElement();
+
+	// Throws the exception for a call_indirect whose table element isn't a function of the
+	// expected type.
+	[[noreturn]] void throwCallIndirectFailure(Table* table,
+											   Uptr index,
+											   Function* function,
+											   Uptr expectedTypeEncoding);
+
+	// Clears the context's interrupt request, and throws ExceptionTypes::interrupted.
+	[[noreturn]] void throwInterruptedException(ContextRuntimeData* contextRuntimeData);
+
+	// Calls the context's out-of-fuel callback, and throws ExceptionTypes::outOfFuel if the context
+	// still doesn't have enough fuel.
+	void handleOutOfFuel(ContextRuntimeData* contextRuntimeData);
+
 	// An instance of a WebAssembly Memory.
+	// The contents of a memory when it was first cloned or restored from a snapshot, which are
+	// shared copy-on-write by the memory and its clones. The contents of an image are never
+	// changed.
+	struct MemoryImage
+	{
+		Platform::SharedMemory* sharedMemory = nullptr;
+		Uptr firstSharedMemoryPageIndex = 0;
+		Uptr numPages = 0;
+
+		// A read-only mapping of the image, used to find the pages that differ from it.
+		U8* baseAddress = nullptr;
+
+		~MemoryImage();
+	};
+
 	struct Memory : GCObject
 	{
 		Uptr id = UINTPTR_MAX;
@@ -85,6 +126,24 @@ namespace WAVM { namespace Runtime {
 		U8* baseAddress = nullptr;
 		Uptr numReservedBytes = 0;
 
+		// The address returned by Platform::allocateAlignedVirtualPages when the memory's address
+		// space was reserved, and the alignment it was reserved with.
+		U8* unalignedBaseAddress = nullptr;
+		Uptr reservationAlignmentLog2 = 0;
+
+		// True if the memory's pages are backed by huge pages where the platform supports them.
+		bool useHugePages = false;
+
+		// True if the memory only reserves address space for its maximum size, so it may only be
+		// accessed by code that checks the addresses it accesses are within the memory.
+		bool requiresBoundsChecks = false;
+
+		// If the memory has a shared memory object, its pages are mapped from it. Otherwise, the
+		// pages before the end of the memory's image are mapped copy-on-write from the image, and
+		// the pages after it are private.
+		Platform::SharedMemory* sharedMemory = nullptr;
+		std::shared_ptr<MemoryImage> image;
+
 		mutable Platform::Mutex resizingMutex;
 		std::atomic<Uptr> numPages{0};
 
@@ -156,8 +215,47 @@ namespace WAVM { namespace Runtime {
 		IR::Module ir;
 		std::vector<U8> objectCode;
 
-		Module(IR::Module&& inIR, std::vector<U8>&& inObjectCode)
-		: ir(inIR), objectCode(std::move(inObjectCode))
+		// True if the object code was compiled by the baseline tier, and its functions should be
+		// recompiled at tierUpOptLevel when they are called frequently.
+		bool isTiered;
+		LLVMJIT::OptLevel tierUpOptLevel;
+
+		// True if the object code only contains stubs that compile each function at
+		// tierUpOptLevel the first time it is called.
+		bool isLazy;
+
+		// Whether the object code was compiled with CompileOptions::interruptible, meterFuel, and
+		// boundsCheckMemories, so the functions compiled by tier-up or lazy compilation must be
+		// too.
+		bool isInterruptible;
+		bool meterFuel;
+		bool boundsCheckMemories;
+
+		// The loaded object code, which is shared by all instances of the module. It is loaded
+		// when the module is first instantiated.
+		mutable Platform::Mutex jitModuleMutex;
+		mutable std::shared_ptr<LLVMJIT::Module> jitModule;
+
+		// If the module was created by createInterpretedModule, the code translated for the
+		// interpreter, which is shared by all instances of the module.
+		std::shared_ptr<const InterpretedModule> interpretedModule;
+
+		Module(IR::Module&& inIR,
+			   std::vector<U8>&& inObjectCode,
+			   bool inIsTiered = false,
+			   LLVMJIT::OptLevel inTierUpOptLevel = LLVMJIT::OptLevel::O1,
+			   bool inIsLazy = false,
+			   bool inIsInterruptible = false,
+			   bool inMeterFuel = false,
+			   bool inBoundsCheckMemories = false)
+		: ir(inIR)
+		, objectCode(std::move(inObjectCode))
+		, isTiered(inIsTiered)
+		, tierUpOptLevel(inTierUpOptLevel)
+		, isLazy(inIsLazy)
+		, isInterruptible(inIsInterruptible)
+		, meterFuel(inMeterFuel)
+		, boundsCheckMemories(inBoundsCheckMemories)
 		{
 		}
 	};
@@ -186,6 +284,7 @@ namespace WAVM { namespace Runtime {
 		ElemSegmentVector elemSegments;
 
 		const std::shared_ptr<LLVMJIT::Module> jitModule;
+		const std::shared_ptr<InterpretedInstance> interpretedInstance;
 
 		ResourceQuotaRef resourceQuota;
 
@@ -203,7 +302,8 @@ namespace WAVM { namespace Runtime {
 					   ElemSegmentVector&& inPassiveElemSegments,
 					   std::shared_ptr<LLVMJIT::Module>&& inJITModule,
 					   std::string&& inDebugName,
-					   ResourceQuotaRefParam inResourceQuota)
+					   ResourceQuotaRefParam inResourceQuota,
+					   std::shared_ptr<InterpretedInstance>&& inInterpretedInstance = nullptr)
 		: GCObject(ObjectKind::moduleInstance, inCompartment)
 		, id(inID)
 		, debugName(std::move(inDebugName))
@@ -218,6 +318,7 @@ namespace WAVM { namespace Runtime {
 		, dataSegments(std::move(inPassiveDataSegments))
 		, elemSegments(std::move(inPassiveElemSegments))
 		, jitModule(std::move(inJITModule))
+		, interpretedInstance(std::move(inInterpretedInstance))
 		, resourceQuota(inResourceQuota)
 		{
 		}
@@ -230,10 +331,103 @@ namespace WAVM { namespace Runtime {
 		Uptr id = UINTPTR_MAX;
 		struct ContextRuntimeData* runtimeData = nullptr;
 
+		// Called by code compiled with CompileOptions::meterFuel when the context's fuel runs out.
+		std::function<void(Context*)> outOfFuelCallback;
+
 		Context(Compartment* inCompartment) : GCObject(ObjectKind::context, inCompartment) {}
 		~Context();
 	};
 
+	// A map from IDs to the contexts in a compartment, which contexts are added to and removed from
+	// without a lock. The IDs of removed contexts are kept on a lock-free free list, and reused
+	// before allocating a new ID, so the runtime data pages of reused IDs are already committed.
+	// A slot that doesn't contain a context holds the next ID on the free list, shifted left by one
+	// and with the low bit set.
+	struct ContextMap
+	{
+		// Iterates over the contexts with the IDs that were allocated when the iteration began.
+		// IDs may be allocated concurrently, so the iterator stops at the end ID it was created
+		// with, instead of the end ID of the iterator it is compared to.
+		struct Iterator
+		{
+			Iterator(const ContextMap& inMap, Uptr inId, Uptr inEndId)
+			: map(inMap), id(inId), endId(inEndId)
+			{
+				skipEmptySlots();
+			}
+
+			Context* operator*() const { return map[id]; }
+			Iterator& operator++()
+			{
+				++id;
+				skipEmptySlots();
+				return *this;
+			}
+			bool operator!=(const Iterator& other) const
+			{
+				return id < endId && id < other.id;
+			}
+
+		private:
+			const ContextMap& map;
+			Uptr id;
+			Uptr endId;
+
+			void skipEmptySlots()
+			{
+				while(id < endId && !map.get(id)) { ++id; }
+			}
+		};
+
+		ContextMap();
+		~ContextMap();
+
+		// Allocates an ID for a context, or returns UINTPTR_MAX if all IDs are in use. outIsNewId
+		// is set to false if the ID was reused from a removed context. The context isn't in the
+		// map until it is passed to set with the ID, so it can be initialized first.
+		Uptr allocateId(bool& outIsNewId);
+		void set(Uptr id, Context* context);
+		void removeOrFail(Uptr id);
+
+		Context* get(Uptr id) const
+		{
+			if(id >= getNumAllocatedIds()) { return nullptr; }
+			const Uptr slot = slots[id].load(std::memory_order_acquire);
+			return slot & 1 ? nullptr : reinterpret_cast<Context*>(slot);
+		}
+		Context* operator[](Uptr id) const
+		{
+			Context* context = get(id);
+			WAVM_ASSERT(context);
+			return context;
+		}
+
+		Uptr size() const { return numContexts.load(std::memory_order_acquire); }
+
+		Iterator begin() const { return Iterator(*this, 0, getNumAllocatedIds()); }
+		Iterator end() const
+		{
+			const Uptr endId = getNumAllocatedIds();
+			return Iterator(*this, endId, endId);
+		}
+
+	private:
+		std::atomic<Uptr>* slots;
+		std::atomic<Uptr> numAllocatedIds{0};
+		std::atomic<Uptr> numContexts{0};
+
+		// The head of the free list: the ID at the head plus one (or zero if the list is empty) in
+		// the low 32 bits, and a count of the changes to the head in the high 32 bits, so a thread
+		// that pops an ID can tell if the list changed after it read the head.
+		std::atomic<U64> freeListHead{0};
+
+		Uptr getNumAllocatedIds() const
+		{
+			const Uptr numIds = numAllocatedIds.load(std::memory_order_acquire);
+			return numIds < Uptr(maxContexts) ? numIds : Uptr(maxContexts);
+		}
+	};
+
 	struct Compartment : GCObject
 	{
 		mutable Platform::Mutex mutex;
@@ -246,11 +440,31 @@ namespace WAVM { namespace Runtime {
 		IndexMap<Uptr, Global*> globals;
 		IndexMap<Uptr, ExceptionType*> exceptionTypes;
 		IndexMap<Uptr, ModuleInstance*> moduleInstances;
-		IndexMap<Uptr, Context*> contexts;
+		ContextMap contexts;
 
 		DenseStaticIntSet<U32, maxMutableGlobals> globalDataAllocationMask;
 		IR::UntaggedValue initialContextMutableGlobals[maxMutableGlobals];
 
+		// One more than the highest index a mutable global in the compartment has been given, so
+		// createContext only copies the initial values that may be used.
+		std::atomic<U32> numInitialContextMutableGlobals{0};
+
+		// Incremented after initialContextMutableGlobals changes, and before the change is written
+		// to the compartment's contexts, so createContext can tell if the initial values changed
+		// while it copied them without locking the mutex.
+		std::atomic<U64> initialContextMutableGlobalsVersion{0};
+
+		// The most address space each memory created in the compartment may reserve, or 0 if
+		// memories reserve enough address space to be accessed without bounds checks.
+		Uptr maxMemoryReservationBytes = 0;
+
+		// True if memories created in the compartment are backed by huge pages.
+		bool useHugePagesForMemories = false;
+
+		// The epoch of the compartment's most recent garbage collection, which is incremented by
+		// each collection instead of clearing the marks of the compartment's objects.
+		Uptr gcEpoch = 0;
+
 		Compartment();
 		~Compartment();
 	};
@@ -322,6 +536,15 @@ namespace WAVM { namespace Runtime {
 	bool isAddressOwnedByTable(U8* address, Table*& outTable, Uptr& outTableIndex);
 	bool isAddressOwnedByMemory(U8* address, Memory*& outMemory, Uptr& outMemoryAddress);
 
+	// Creates a memory like Runtime::createMemory. If isBoundsChecked is false, the memory will
+	// be accessed by code that doesn't check bounds, so it reserves enough address space for any
+	// address regardless of the compartment's memory reservation limit.
+	Memory* createMemory(Compartment* compartment,
+						 IR::MemoryType type,
+						 std::string&& debugName,
+						 ResourceQuotaRefParam resourceQuota,
+						 bool isBoundsChecked);
+
 	// Clones objects into a new compartment with the same ID.
 	Table* cloneTable(Table* memory, Compartment* newCompartment);
 	Memory* cloneMemory(Memory* memory, Compartment* newCompartment);
@@ -332,10 +555,65 @@ namespace WAVM { namespace Runtime {
 	// Clone a global with same ID and mutable data offset (if mutable) in a new compartment.
 	Global* cloneGlobal(Global* global, Compartment* newCompartment);
 
+	// A range of a memory's pages, in units of the platform's virtual page size.
+	struct MemoryPageRange
+	{
+		Uptr firstPageIndex;
+		Uptr numPages;
+	};
+
+	// Finds the ranges of platform pages in a memory that differ from its image, or that contain
+	// non-zero bytes if they are after the end of its image.
+	std::vector<MemoryPageRange> getModifiedMemoryPageRanges(Memory* memory);
+
+	// Finds the ranges of platform pages in a memory that contain non-zero bytes.
+	std::vector<MemoryPageRange> getNonZeroMemoryPageRanges(Memory* memory);
+
+	// Resizes a memory to numPages, and replaces its contents with the numPages WebAssembly pages
+	// that start at fileOffset in a file. The file must contain zeroes outside of
+	// nonZeroPageRanges, which are relative to fileOffset. The file is mapped copy-on-write as the
+	// memory's image if the platform supports it, and read otherwise. Returns false if the memory
+	// couldn't be resized, or the file couldn't be read.
+	bool restoreMemory(Memory* memory,
+					   Uptr numPages,
+					   const std::string& filePath,
+					   U64 fileOffset,
+					   const std::vector<MemoryPageRange>& nonZeroPageRanges);
+
+	// Resets a memory or table to the state of a source memory or table that is a clone of it, or
+	// that it is a clone of. It is shrunk to the size of the source, and its contents are replaced
+	// with the source's. For a memory, the memories must share the same image: only the source's
+	// sourceModifiedPageRanges are copied, and the other pages revert to the image's contents or
+	// are zeroed. Neither object may be accessed by other threads while it is reset.
+	void resetMemory(Memory* memory,
+					 Memory* sourceMemory,
+					 const std::vector<MemoryPageRange>& sourceModifiedPageRanges);
+	void resetTable(Table* table, Table* sourceTable);
+
+	// Identifies a module's compiled object code in the persistent object cache.
+	struct ObjectCacheKey
+	{
+		std::string directoryPath;
+		U64 maxBytes;
+		U64 hash[2];
+	};
+
+	// Computes the object cache key for compiling a module with the given target and options.
+	// Returns false if the object cache isn't enabled.
+	bool getObjectCacheKey(const IR::Module& irModule,
+						   const LLVMJIT::TargetSpec& targetSpec,
+						   const LLVMJIT::CompileOptions& compileOptions,
+						   ObjectCacheKey& outKey);
+
+	// Looks up and stores object code in the persistent object cache.
+	bool loadCachedObjectCode(const ObjectCacheKey& key, std::vector<U8>& outObjectCode);
+	void saveCachedObjectCode(const ObjectCacheKey& key, const std::vector<U8>& objectCode);
+
 	ModuleInstance* getModuleInstanceFromRuntimeData(ContextRuntimeData* contextRuntimeData,
 													 Uptr moduleInstanceId);
 	Table* getTableFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr tableId);
 	Memory* getMemoryFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr memoryId);
+	Global* getGlobalFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr globalId);
 
 	// Initialize a data segment (equivalent to executing a memory.init instruction).
 	void initDataSegment(ModuleInstance* moduleInstance,
@@ -354,6 +632,23 @@ namespace WAVM { namespace Runtime {
 						 Uptr destOffset,
 						 Uptr sourceOffset,
 						 Uptr numElems);
+
+	// Translates a module's function definitions for the interpreter. Returns null if the module
+	// uses a feature the interpreter doesn't support.
+	std::shared_ptr<const InterpretedModule> translateModuleForInterpreter(
+		const IR::Module& irModule);
+
+	// Binds an interpreted module's code to an instance's imports and objects, and creates the
+	// Runtime::Function objects for its function definitions.
+	std::shared_ptr<LLVMJIT::Module> instantiateInterpretedModule(
+		const std::shared_ptr<const InterpretedModule>& interpretedModule,
+		const std::vector<Function*>& functionImports,
+		const std::vector<Table*>& tables,
+		const std::vector<Memory*>& memories,
+		const std::vector<Global*>& globals,
+		Uptr moduleInstanceId,
+		const std::vector<FunctionMutableData*>& functionDefMutableDatas,
+		std::shared_ptr<InterpretedInstance>& outInterpretedInstance);
 }}
 
 namespace WAVM { namespace Intrinsics {
@@ -0,0 +1,281 @@
+#include <string.h>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "RuntimePrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Diagnostics.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Signal.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+
+static constexpr Uptr numSampleBuffers = 64;
+static constexpr Uptr numSampleBufferWords = 128 * 1024;
+
+// The samples taken on a single thread. Each sample is stored as the number of frames, followed
+// by the instruction pointer of each frame from innermost to outermost. Only the thread that owns
+// the buffer writes to it, so it doesn't need a lock: the writer publishes each sample by
+// incrementing numWords with release semantics.
+struct SampleBuffer
+{
+	std::atomic<Uptr> numWords{0};
+	Uptr words[numSampleBufferWords];
+};
+
+// The sample buffers are allocated by the first call to startSamplingProfiler, and never freed, so
+// a signal handler that is still running when the profiler is stopped can't write to freed memory.
+// Each thread claims a buffer the first time it is sampled after the profiler is started.
+static Platform::Mutex samplingProfilerMutex;
+static bool isSamplingProfilerRunning = false;
+static SampleBuffer* sampleBuffers = nullptr;
+static std::atomic<Uptr> numClaimedSampleBuffers{0};
+static std::atomic<Uptr> numDroppedSamples{0};
+static std::atomic<U64> samplingProfilerGeneration{0};
+
+static thread_local SampleBuffer* threadSampleBuffer = nullptr;
+static thread_local U64 threadSampleBufferGeneration = 0;
+
+// Called in a signal handler, so it must be async-signal-safe.
+static void takeSample(const Uptr* frameIPs, Uptr numFrames)
+{
+	const U64 generation = samplingProfilerGeneration.load(std::memory_order_acquire);
+	if(threadSampleBufferGeneration != generation)
+	{
+		threadSampleBufferGeneration = generation;
+		const Uptr bufferIndex = numClaimedSampleBuffers.fetch_add(1, std::memory_order_relaxed);
+		threadSampleBuffer = bufferIndex < numSampleBuffers ? &sampleBuffers[bufferIndex] : nullptr;
+	}
+
+	SampleBuffer* buffer = threadSampleBuffer;
+	if(!buffer)
+	{
+		numDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const Uptr numWords = buffer->numWords.load(std::memory_order_relaxed);
+	if(numWords + 1 + numFrames > numSampleBufferWords)
+	{
+		numDroppedSamples.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	buffer->words[numWords] = numFrames;
+	memcpy(&buffer->words[numWords + 1], frameIPs, numFrames * sizeof(Uptr));
+	buffer->numWords.store(numWords + 1 + numFrames, std::memory_order_release);
+}
+
+// A WebAssembly function and operator that a sampled instruction pointer is in.
+struct SampledFrame
+{
+	std::string functionName;
+	U32 opIndex;
+};
+
+// The frames of samples in code that was unloaded after it was sampled, which are symbolized
+// before the code is freed, by the address of the frame's word in its sample buffer.
+static HashMap<const Uptr*, SampledFrame> unloadedFrameMap;
+
+// Finds the WebAssembly function and operator that contain a sampled instruction pointer, or
+// returns false if it isn't in WebAssembly code. The code must not be unloaded during the call.
+static bool symbolizeSampledFrame(Uptr ip, SampledFrame& outFrame)
+{
+	Runtime::Function* function = LLVMJIT::getFunctionByAddress(ip);
+	if(!function) { return false; }
+
+	outFrame.functionName = function->mutableData->debugName;
+
+	// Find the highest entry in the offsetToOpIndexMap whose offset is <= the symbol-relative IP.
+	const std::map<U32, U32>& offsetToOpIndexMap = function->mutableData->offsetToOpIndexMap;
+	const U32 ipOffset = (U32)(ip - reinterpret_cast<Uptr>(function->code));
+	auto offsetMapIt = offsetToOpIndexMap.upper_bound(ipOffset);
+	outFrame.opIndex
+		= offsetMapIt == offsetToOpIndexMap.begin() ? 0 : std::prev(offsetMapIt)->second;
+	return true;
+}
+
+// Describes a sampled frame as a frame in a collapsed stack.
+static std::string describeSampledFrame(const SampledFrame& frame, bool includeOpIndex)
+{
+	std::string description = frame.functionName;
+	if(includeOpIndex)
+	{
+		description += '+';
+		description += std::to_string(frame.opIndex);
+	}
+
+	// Semicolons separate the frames of a collapsed stack, so they can't occur in frame names.
+	for(char& c : description)
+	{
+		if(c == ';') { c = ':'; }
+	}
+	return description;
+}
+
+// Called by LLVMJIT before the code in an address range is unloaded. Symbolizes the frames that
+// were sampled in the range while the code's functions can still be looked up, so they aren't
+// looked up after the code is freed, or attributed to other code that is loaded at the same
+// address. Code can't be sampled after it is unloaded, so only the samples that have already been
+// published need to be symbolized.
+static void symbolizeUnloadedCode(Uptr beginAddress, Uptr endAddress)
+{
+	Lock<Platform::Mutex> samplingProfilerLock(samplingProfilerMutex);
+
+	Uptr numClaimedBuffers = numClaimedSampleBuffers.load(std::memory_order_relaxed);
+	if(numClaimedBuffers > numSampleBuffers) { numClaimedBuffers = numSampleBuffers; }
+	for(Uptr bufferIndex = 0; bufferIndex < numClaimedBuffers; ++bufferIndex)
+	{
+		const SampleBuffer& buffer = sampleBuffers[bufferIndex];
+		const Uptr numWords = buffer.numWords.load(std::memory_order_acquire);
+		Uptr wordIndex = 0;
+		while(wordIndex < numWords)
+		{
+			const Uptr numFrames = buffer.words[wordIndex];
+			for(Uptr frameIndex = 0; frameIndex < numFrames; ++frameIndex)
+			{
+				const Uptr* frameWord = &buffer.words[wordIndex + 1 + frameIndex];
+				if(*frameWord >= beginAddress && *frameWord < endAddress)
+				{
+					SampledFrame frame;
+					if(symbolizeSampledFrame(*frameWord, frame))
+					{ unloadedFrameMap.set(frameWord, std::move(frame)); }
+				}
+			}
+			wordIndex += 1 + numFrames;
+		}
+	}
+}
+
+bool Runtime::startSamplingProfiler(U64 samplesPerSecond)
+{
+	Lock<Platform::Mutex> samplingProfilerLock(samplingProfilerMutex);
+	if(isSamplingProfilerRunning) { return false; }
+
+	if(!sampleBuffers)
+	{
+		sampleBuffers = new SampleBuffer[numSampleBuffers];
+		Platform::expectLeakedObject(sampleBuffers);
+		LLVMJIT::setCodeUnloadCallback(symbolizeUnloadedCode);
+	}
+
+	// Discard the samples from the last time the profiler ran, and make each thread claim a new
+	// buffer the next time it is sampled. stopSamplingProfiler waited for any signal handler that
+	// was writing to the buffers to return, so no thread is writing to them now.
+	for(Uptr bufferIndex = 0; bufferIndex < numSampleBuffers; ++bufferIndex)
+	{ sampleBuffers[bufferIndex].numWords.store(0, std::memory_order_relaxed); }
+	numClaimedSampleBuffers.store(0, std::memory_order_relaxed);
+	numDroppedSamples.store(0, std::memory_order_relaxed);
+	unloadedFrameMap.clear();
+	samplingProfilerGeneration.fetch_add(1, std::memory_order_release);
+
+	const U64 intervalMicroseconds = samplesPerSecond >= 1000000 ? 1 : 1000000 / samplesPerSecond;
+	if(!samplesPerSecond || !Platform::startCPUTimeSampling(intervalMicroseconds, takeSample))
+	{ return false; }
+
+	isSamplingProfilerRunning = true;
+	return true;
+}
+
+void Runtime::stopSamplingProfiler()
+{
+	Lock<Platform::Mutex> samplingProfilerLock(samplingProfilerMutex);
+	if(isSamplingProfilerRunning)
+	{
+		Platform::stopCPUTimeSampling();
+		isSamplingProfilerRunning = false;
+	}
+}
+
+std::string Runtime::getSampledCallStacks(bool includeOpIndices)
+{
+	Lock<Platform::Mutex> samplingProfilerLock(samplingProfilerMutex);
+	if(!sampleBuffers) { return std::string(); }
+
+	// Count the samples of each distinct call stack. The map is ordered so the output is
+	// deterministic.
+	HashMap<Uptr, std::string> ipToFrameMap;
+	std::map<std::string, U64> callStackToNumSamplesMap;
+	Uptr numHostSamples = 0;
+
+	Uptr numClaimedBuffers = numClaimedSampleBuffers.load(std::memory_order_relaxed);
+	if(numClaimedBuffers > numSampleBuffers) { numClaimedBuffers = numSampleBuffers; }
+	for(Uptr bufferIndex = 0; bufferIndex < numClaimedBuffers; ++bufferIndex)
+	{
+		const SampleBuffer& buffer = sampleBuffers[bufferIndex];
+		const Uptr numWords = buffer.numWords.load(std::memory_order_acquire);
+		Uptr wordIndex = 0;
+		while(wordIndex < numWords)
+		{
+			const Uptr numFrames = buffer.words[wordIndex];
+			const Uptr* frameIPs = &buffer.words[wordIndex + 1];
+			wordIndex += 1 + numFrames;
+
+			// Only include the frames in WebAssembly code, from outermost to innermost. The frames
+			// in code that has been unloaded were symbolized before it was unloaded, and the rest
+			// of the code can't be unloaded while the lock is held.
+			std::string callStack;
+			for(Uptr frameIndex = numFrames; frameIndex > 0; --frameIndex)
+			{
+				const Uptr* frameWord = &frameIPs[frameIndex - 1];
+				const Uptr ip = *frameWord;
+				std::string unloadedFrameDescription;
+				std::string* frame = nullptr;
+				if(const SampledFrame* unloadedFrame = unloadedFrameMap.get(frameWord))
+				{
+					unloadedFrameDescription
+						= describeSampledFrame(*unloadedFrame, includeOpIndices);
+					frame = &unloadedFrameDescription;
+				}
+				else if(!(frame = ipToFrameMap.get(ip)))
+				{
+					// Frames outside WebAssembly code are described by an empty string.
+					SampledFrame sampledFrame;
+					frame = &ipToFrameMap.set(
+						ip,
+						symbolizeSampledFrame(ip, sampledFrame)
+							? describeSampledFrame(sampledFrame, includeOpIndices)
+							: std::string());
+				}
+
+				if(frame->size())
+				{
+					if(callStack.size()) { callStack += ';'; }
+					callStack += *frame;
+				}
+			}
+
+			if(callStack.size()) { ++callStackToNumSamplesMap[callStack]; }
+			else
+			{
+				++numHostSamples;
+			}
+		}
+	}
+
+	Log::printf(Log::debug,
+				"Sampling profiler: %" WAVM_PRIuPTR
+				" samples outside WebAssembly code, %" WAVM_PRIuPTR " samples dropped.\n",
+				numHostSamples,
+				numDroppedSamples.load(std::memory_order_relaxed));
+
+	std::string result;
+	for(const auto& callStackNumSamplesPair : callStackToNumSamplesMap)
+	{
+		result += callStackNumSamplesPair.first;
+		result += ' ';
+		result += std::to_string(callStackNumSamplesPair.second);
+		result += '\n';
+	}
+	return result;
+}
@@ -0,0 +1,789 @@
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RuntimePrivate.h"
+#include "WAVM/IR/IR.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/HashMap.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Random.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
+#include "WAVM/VFS/VFS.h"
+
+using namespace WAVM;
+using namespace WAVM::Runtime;
+using namespace WAVM::Serialization;
+
+// A snapshot file starts with a header, followed by the serialized SnapshotMetadata. The contents
+// of each memory follow, starting at the header's dataOffset, and aligned to WebAssembly pages so
+// they can be mapped into memory. Zero pages of the memories aren't written to the file.
+struct SnapshotFileHeader
+{
+	U64 magic;
+	U64 version;
+	U64 numMetadataBytes;
+	U64 metadataHash;
+	U64 dataOffset;
+	U64 numDataBytes;
+};
+static constexpr U64 snapshotFileMagic = 0x70616e736d766177; // "wavmsnap"
+static constexpr U64 snapshotFileVersion = 2;
+
+struct SnapshotModuleInstance
+{
+	Uptr id;
+	std::string debugName;
+	std::vector<U8> isDataSegmentDropped;
+	std::vector<U8> isElemSegmentDropped;
+};
+
+// A range of bytes in a memory, which is page-aligned in the memory that was snapshotted.
+struct SnapshotMemoryRange
+{
+	U64 offset;
+	U64 numBytes;
+};
+
+struct SnapshotMemory
+{
+	Uptr id;
+	IR::MemoryType type;
+	Uptr numPages;
+	U64 dataOffset;
+	std::vector<SnapshotMemoryRange> nonZeroRanges;
+};
+
+// Identifies an object referenced by a table element or a global: a function is identified by the
+// ID of a module instance and its index in the module instance's functions, and other objects by
+// their kind and ID.
+struct SnapshotReference
+{
+	ObjectKind kind;
+	Uptr id;
+	Uptr functionIndex;
+};
+
+struct SnapshotTable
+{
+	Uptr id;
+	IR::TableType type;
+	std::vector<SnapshotReference> elements;
+};
+
+struct SnapshotGlobal
+{
+	Uptr id;
+	U32 mutableGlobalIndex;
+	U8 isMutableReference;
+};
+
+// The values of the mutable globals are written as bytes, except for the mutable reference
+// globals, which are written as references in the order of the metadata's globals, and are zero in
+// the bytes.
+struct SnapshotContext
+{
+	Uptr id;
+	std::vector<U8> mutableGlobals;
+	std::vector<SnapshotReference> mutableReferenceGlobals;
+};
+
+struct SnapshotMetadata
+{
+	std::vector<SnapshotModuleInstance> moduleInstances;
+	std::vector<SnapshotMemory> memories;
+	std::vector<SnapshotTable> tables;
+	std::vector<SnapshotGlobal> globals;
+	std::vector<SnapshotContext> contexts;
+	std::vector<U8> initialContextMutableGlobals;
+	std::vector<SnapshotReference> initialContextMutableReferenceGlobals;
+};
+
+template<typename Stream> static void serialize(Stream& stream, IR::SizeConstraints& size)
+{
+	serializeVarUInt64(stream, size.min);
+	serializeVarUInt64(stream, size.max);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotModuleInstance& instance)
+{
+	serializeVarUInt64(stream, instance.id);
+	serialize(stream, instance.debugName);
+	serialize(stream, instance.isDataSegmentDropped);
+	serialize(stream, instance.isElemSegmentDropped);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotMemoryRange& range)
+{
+	serializeVarUInt64(stream, range.offset);
+	serializeVarUInt64(stream, range.numBytes);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotMemory& memory)
+{
+	serializeVarUInt64(stream, memory.id);
+	U8 isShared = memory.type.isShared ? 1 : 0;
+	serializeVarUInt1(stream, isShared);
+	if(Stream::isInput) { memory.type.isShared = isShared != 0; }
+	serialize(stream, memory.type.size);
+	serializeVarUInt64(stream, memory.numPages);
+	serializeVarUInt64(stream, memory.dataOffset);
+	serialize(stream, memory.nonZeroRanges);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotReference& reference)
+{
+	serializeNativeValue(stream, reference.kind);
+	if(reference.kind != ObjectKind::invalid) { serializeVarUInt64(stream, reference.id); }
+	if(reference.kind == ObjectKind::function)
+	{ serializeVarUInt64(stream, reference.functionIndex); }
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotTable& table)
+{
+	serializeVarUInt64(stream, table.id);
+	serializeNativeValue(stream, table.type.elementType);
+	U8 isShared = table.type.isShared ? 1 : 0;
+	serializeVarUInt1(stream, isShared);
+	if(Stream::isInput) { table.type.isShared = isShared != 0; }
+	serialize(stream, table.type.size);
+	serialize(stream, table.elements);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotGlobal& global)
+{
+	serializeVarUInt64(stream, global.id);
+	serializeVarUInt32(stream, global.mutableGlobalIndex);
+	serializeVarUInt1(stream, global.isMutableReference);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotContext& context)
+{
+	serializeVarUInt64(stream, context.id);
+	serialize(stream, context.mutableGlobals);
+	serialize(stream, context.mutableReferenceGlobals);
+}
+
+template<typename Stream> static void serialize(Stream& stream, SnapshotMetadata& metadata)
+{
+	serialize(stream, metadata.moduleInstances);
+	serialize(stream, metadata.memories);
+	serialize(stream, metadata.tables);
+	serialize(stream, metadata.globals);
+	serialize(stream, metadata.contexts);
+	serialize(stream, metadata.initialContextMutableGlobals);
+	serialize(stream, metadata.initialContextMutableReferenceGlobals);
+}
+
+// Looks up an object in one of a compartment's IndexMaps, returning null if it isn't there.
+template<typename ObjectType>
+static ObjectType* getObjectByID(const IndexMap<Uptr, ObjectType*>& map, Uptr id)
+{
+	ObjectType* const* object = map.get(id);
+	return object ? *object : nullptr;
+}
+
+typedef HashMap<const Function*, std::pair<Uptr, Uptr>> FunctionToIdentityMap;
+
+// Identifies an object, returning false if it can't be identified.
+static bool identifyReference(const FunctionToIdentityMap& functionToIdentityMap,
+							  Object* object,
+							  SnapshotReference& outReference)
+{
+	outReference = {ObjectKind::invalid, 0, 0};
+	if(!object) { return true; }
+
+	outReference.kind = object->kind;
+	switch(object->kind)
+	{
+	case ObjectKind::function: {
+		const std::pair<Uptr, Uptr>* identity = functionToIdentityMap.get(asFunction(object));
+		if(!identity) { return false; }
+		outReference.id = identity->first;
+		outReference.functionIndex = identity->second;
+		return true;
+	}
+	case ObjectKind::table: outReference.id = asTable(object)->id; return true;
+	case ObjectKind::memory: outReference.id = asMemory(object)->id; return true;
+	case ObjectKind::global: outReference.id = asGlobal(object)->id; return true;
+	case ObjectKind::exceptionType: outReference.id = asExceptionType(object)->id; return true;
+	case ObjectKind::moduleInstance: outReference.id = asModuleInstance(object)->id; return true;
+
+	case ObjectKind::context:
+	case ObjectKind::compartment:
+	case ObjectKind::foreign:
+	case ObjectKind::invalid:
+	default: return false;
+	};
+}
+
+// Finds the object in a compartment that a reference identifies. Returns false if the reference
+// isn't null, and the compartment doesn't contain the object. The compartment's mutex must be
+// locked.
+static bool findReference(const Compartment* compartment,
+						  const SnapshotReference& reference,
+						  Object*& outObject)
+{
+	outObject = nullptr;
+	switch(reference.kind)
+	{
+	case ObjectKind::invalid: return true;
+	case ObjectKind::function: {
+		ModuleInstance* moduleInstance = getObjectByID(compartment->moduleInstances, reference.id);
+		if(moduleInstance && reference.functionIndex < moduleInstance->functions.size())
+		{ outObject = asObject(moduleInstance->functions[reference.functionIndex]); }
+		break;
+	}
+	case ObjectKind::table: outObject = getObjectByID(compartment->tables, reference.id); break;
+	case ObjectKind::memory: outObject = getObjectByID(compartment->memories, reference.id); break;
+	case ObjectKind::global: outObject = getObjectByID(compartment->globals, reference.id); break;
+	case ObjectKind::exceptionType:
+		outObject = getObjectByID(compartment->exceptionTypes, reference.id);
+		break;
+	case ObjectKind::moduleInstance:
+		outObject = getObjectByID(compartment->moduleInstances, reference.id);
+		break;
+
+	case ObjectKind::context:
+	case ObjectKind::compartment:
+	case ObjectKind::foreign:
+	default: break;
+	};
+	return outObject != nullptr;
+}
+
+static bool isMutableReferenceGlobal(const Global* global)
+{
+	return global->type.isMutable && isReferenceType(global->type.valueType);
+}
+
+static U64 alignToWebAssemblyPage(U64 offset)
+{
+	return (offset + IR::numBytesPerPage - 1) & ~U64(IR::numBytesPerPage - 1);
+}
+
+bool Runtime::snapshotCompartment(const Compartment* compartment, const std::string& path)
+{
+	Timing::Timer timer;
+
+	SnapshotMetadata metadata;
+	std::vector<Memory*> memories;
+	std::vector<Table*> tables;
+	FunctionToIdentityMap functionToIdentityMap;
+
+	// The values of the mutable reference globals: the initial values, followed by the values in
+	// each context.
+	std::vector<Global*> mutableReferenceGlobals;
+	std::vector<Object*> mutableReferenceGlobalValues;
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+
+		for(ModuleInstance* moduleInstance : compartment->moduleInstances)
+		{
+			SnapshotModuleInstance snapshotModuleInstance;
+			snapshotModuleInstance.id = moduleInstance->id;
+			snapshotModuleInstance.debugName = moduleInstance->debugName;
+			{
+				Lock<Platform::Mutex> dataSegmentsLock(moduleInstance->dataSegmentsMutex);
+				for(const auto& dataSegment : moduleInstance->dataSegments)
+				{ snapshotModuleInstance.isDataSegmentDropped.push_back(dataSegment ? 0 : 1); }
+			}
+			{
+				Lock<Platform::Mutex> elemSegmentsLock(moduleInstance->elemSegmentsMutex);
+				for(const auto& elemSegment : moduleInstance->elemSegments)
+				{ snapshotModuleInstance.isElemSegmentDropped.push_back(elemSegment ? 0 : 1); }
+			}
+			metadata.moduleInstances.push_back(std::move(snapshotModuleInstance));
+
+			// Identify each function by the first module instance that contains it.
+			for(Uptr functionIndex = 0; functionIndex < moduleInstance->functions.size();
+				++functionIndex)
+			{
+				functionToIdentityMap.add(moduleInstance->functions[functionIndex],
+										  std::make_pair(moduleInstance->id, functionIndex));
+			}
+		}
+
+		for(Memory* memory : compartment->memories) { memories.push_back(memory); }
+		for(Table* table : compartment->tables) { tables.push_back(table); }
+		for(Global* global : compartment->globals)
+		{
+			const bool isMutableReference = isMutableReferenceGlobal(global);
+			metadata.globals.push_back(
+				{global->id, global->mutableGlobalIndex, U8(isMutableReference ? 1 : 0)});
+			if(isMutableReference) { mutableReferenceGlobals.push_back(global); }
+		}
+
+		// Copy the values of the mutable globals, replacing the references with zeroes: they are
+		// pointers that are only valid in this process.
+		auto copyMutableGlobals = [&](const IR::UntaggedValue* mutableGlobals) {
+			const U8* mutableGlobalBytes = (const U8*)mutableGlobals;
+			std::vector<U8> bytes(mutableGlobalBytes, mutableGlobalBytes + maxGlobalBytes);
+			for(Global* global : mutableReferenceGlobals)
+			{
+				mutableReferenceGlobalValues.push_back(
+					mutableGlobals[global->mutableGlobalIndex].object);
+				memset(bytes.data() + global->mutableGlobalIndex * sizeof(IR::UntaggedValue),
+					   0,
+					   sizeof(IR::UntaggedValue));
+			}
+			return bytes;
+		};
+		metadata.initialContextMutableGlobals
+			= copyMutableGlobals(compartment->initialContextMutableGlobals);
+		for(Context* context : compartment->contexts)
+		{
+			metadata.contexts.push_back(
+				{context->id, copyMutableGlobals(context->runtimeData->mutableGlobals), {}});
+		}
+	}
+
+	// Find the non-zero pages of each memory, and assign each memory a range of the file.
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	U64 numDataBytes = 0;
+	for(Memory* memory : memories)
+	{
+		SnapshotMemory snapshotMemory;
+		snapshotMemory.id = memory->id;
+		snapshotMemory.type = memory->type;
+		snapshotMemory.numPages = getMemoryNumPages(memory);
+		snapshotMemory.dataOffset = numDataBytes;
+		for(const MemoryPageRange& range : getNonZeroMemoryPageRanges(memory))
+		{
+			snapshotMemory.nonZeroRanges.push_back(
+				{U64(range.firstPageIndex) << pageBytesLog2, U64(range.numPages) << pageBytesLog2});
+		}
+		numDataBytes += U64(snapshotMemory.numPages) * IR::numBytesPerPage;
+		metadata.memories.push_back(std::move(snapshotMemory));
+	}
+
+	// Identify the elements of each table.
+	for(Table* table : tables)
+	{
+		SnapshotTable snapshotTable;
+		snapshotTable.id = table->id;
+		snapshotTable.type = table->type;
+
+		const Uptr numElements = getTableNumElements(table);
+		for(Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex)
+		{
+			SnapshotReference element;
+			if(!identifyReference(
+				   functionToIdentityMap, getTableElement(table, elementIndex), element))
+			{
+				Log::printf(Log::error,
+							"Can't snapshot table element %" WAVM_PRIuPTR
+							" of %s: the object can't be identified.\n",
+							elementIndex,
+							table->debugName.c_str());
+				return false;
+			}
+			snapshotTable.elements.push_back(element);
+		}
+		metadata.tables.push_back(std::move(snapshotTable));
+	}
+
+	// Identify the values of the mutable reference globals.
+	for(Uptr valueIndex = 0; valueIndex < mutableReferenceGlobalValues.size(); ++valueIndex)
+	{
+		const Uptr contextIndex = valueIndex / mutableReferenceGlobals.size();
+		const Global* global = mutableReferenceGlobals[valueIndex % mutableReferenceGlobals.size()];
+
+		SnapshotReference reference;
+		if(!identifyReference(
+			   functionToIdentityMap, mutableReferenceGlobalValues[valueIndex], reference))
+		{
+			Log::printf(Log::error,
+						"Can't snapshot the value of global %" WAVM_PRIuPTR
+						": the object can't be identified.\n",
+						global->id);
+			return false;
+		}
+		if(contextIndex == 0)
+		{ metadata.initialContextMutableReferenceGlobals.push_back(reference); }
+		else
+		{
+			metadata.contexts[contextIndex - 1].mutableReferenceGlobals.push_back(reference);
+		}
+	}
+
+	ArrayOutputStream metadataStream;
+	serialize(metadataStream, metadata);
+	const std::vector<U8> metadataBytes = metadataStream.getBytes();
+
+	SnapshotFileHeader header;
+	header.magic = snapshotFileMagic;
+	header.version = snapshotFileVersion;
+	header.numMetadataBytes = metadataBytes.size();
+	header.metadataHash = XXH64(metadataBytes.data(), metadataBytes.size(), 0);
+	header.dataOffset = alignToWebAssemblyPage(sizeof(header) + metadataBytes.size());
+	header.numDataBytes = numDataBytes;
+
+	// Write the snapshot to a uniquely named temporary file, and then rename it, so memories that
+	// are mapped from a file that is replaced keep mapping the old file.
+	VFS::FileSystem& hostFS = Platform::getHostFS();
+	U64 tempFileNonce = 0;
+	Platform::getCryptographicRNG((U8*)&tempFileNonce, sizeof(tempFileNonce));
+	const std::string tempFilePath = path + ".tmp" + std::to_string(tempFileNonce);
+
+	VFS::VFD* vfd = nullptr;
+	VFS::Result result = hostFS.open(
+		tempFilePath, VFS::FileAccessMode::writeOnly, VFS::FileCreateMode::createNew, vfd);
+	if(result != VFS::Result::success)
+	{
+		Log::printf(Log::error,
+					"Error creating snapshot file '%s': %s\n",
+					tempFilePath.c_str(),
+					VFS::describeResult(result));
+		return false;
+	}
+
+	VFS::IOWriteBuffer buffers[2]
+		= {{&header, sizeof(header)}, {metadataBytes.data(), metadataBytes.size()}};
+	Uptr numBytesWritten = 0;
+	result = vfd->writev(buffers, 2, &numBytesWritten);
+	if(result == VFS::Result::success && numBytesWritten != sizeof(header) + metadataBytes.size())
+	{ result = VFS::Result::outOfFreeSpace; }
+
+	// Write the non-zero pages of each memory, leaving holes in the file for the zero pages.
+	for(Uptr memoryIndex = 0; memoryIndex < memories.size() && result == VFS::Result::success;
+		++memoryIndex)
+	{
+		const U8* memoryBase = memories[memoryIndex]->baseAddress;
+		const SnapshotMemory& snapshotMemory = metadata.memories[memoryIndex];
+		for(const SnapshotMemoryRange& range : snapshotMemory.nonZeroRanges)
+		{
+			U64 offset = header.dataOffset + snapshotMemory.dataOffset + range.offset;
+			result = vfd->write(
+				memoryBase + range.offset, Uptr(range.numBytes), &numBytesWritten, &offset);
+			if(result == VFS::Result::success && numBytesWritten != range.numBytes)
+			{ result = VFS::Result::outOfFreeSpace; }
+			if(result != VFS::Result::success) { break; }
+		}
+	}
+	if(result == VFS::Result::success)
+	{ result = vfd->setFileSize(header.dataOffset + header.numDataBytes); }
+	const VFS::Result closeResult = vfd->close();
+	if(result == VFS::Result::success) { result = closeResult; }
+
+	if(result == VFS::Result::success) { result = hostFS.renameFile(tempFilePath, path); }
+	if(result != VFS::Result::success)
+	{
+		Log::printf(Log::error,
+					"Error writing snapshot file '%s': %s\n",
+					path.c_str(),
+					VFS::describeResult(result));
+		hostFS.unlinkFile(tempFilePath);
+		return false;
+	}
+
+	Timing::logTimer("Snapshotted compartment", timer);
+	return true;
+}
+
+static bool readSnapshotMetadata(const std::string& path,
+								 SnapshotFileHeader& outHeader,
+								 SnapshotMetadata& outMetadata)
+{
+	VFS::VFD* vfd = nullptr;
+	VFS::Result result = Platform::getHostFS().open(
+		path, VFS::FileAccessMode::readOnly, VFS::FileCreateMode::openExisting, vfd);
+	if(result != VFS::Result::success)
+	{
+		Log::printf(Log::error,
+					"Error opening snapshot file '%s': %s\n",
+					path.c_str(),
+					VFS::describeResult(result));
+		return false;
+	}
+
+	// Read and validate the header and metadata.
+	bool succeeded = false;
+	std::vector<U8> metadataBytes;
+	VFS::FileInfo fileInfo;
+	Uptr numBytesRead = 0;
+	if(vfd->getFileInfo(fileInfo) == VFS::Result::success
+	   && vfd->read(&outHeader, sizeof(outHeader), &numBytesRead) == VFS::Result::success
+	   && numBytesRead == sizeof(outHeader) && outHeader.magic == snapshotFileMagic
+	   && outHeader.version == snapshotFileVersion
+	   && outHeader.numMetadataBytes <= fileInfo.numBytes - sizeof(outHeader)
+	   && outHeader.dataOffset
+			  == alignToWebAssemblyPage(sizeof(outHeader) + outHeader.numMetadataBytes)
+	   && outHeader.dataOffset <= fileInfo.numBytes
+	   && outHeader.numDataBytes <= fileInfo.numBytes - outHeader.dataOffset)
+	{
+		metadataBytes.resize(Uptr(outHeader.numMetadataBytes));
+		succeeded
+			= vfd->read(metadataBytes.data(), metadataBytes.size(), &numBytesRead)
+				  == VFS::Result::success
+			  && numBytesRead == metadataBytes.size()
+			  && XXH64(metadataBytes.data(), metadataBytes.size(), 0) == outHeader.metadataHash;
+	}
+	WAVM_ERROR_UNLESS(vfd->close() == VFS::Result::success);
+	if(!succeeded)
+	{
+		Log::printf(Log::error, "'%s' isn't a valid snapshot file.\n", path.c_str());
+		return false;
+	}
+
+	try
+	{
+		MemoryInputStream metadataStream(metadataBytes.data(), metadataBytes.size());
+		serialize(metadataStream, outMetadata);
+	}
+	catch(const FatalSerializationException& exception)
+	{
+		Log::printf(Log::error,
+					"Error reading snapshot file '%s': %s\n",
+					path.c_str(),
+					exception.message.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool Runtime::restoreCompartment(Compartment* compartment, const std::string& path)
+{
+	Timing::Timer timer;
+
+	SnapshotFileHeader header;
+	SnapshotMetadata metadata;
+	if(!readSnapshotMetadata(path, header, metadata)) { return false; }
+
+	auto reportMismatch = [&path](const std::string& difference) {
+		Log::printf(Log::error,
+					"The snapshot in '%s' doesn't match the compartment: %s differs.\n",
+					path.c_str(),
+					difference.c_str());
+		return false;
+	};
+
+	// Find the compartment's objects that correspond to the snapshot's, and check that they match.
+	std::vector<ModuleInstance*> moduleInstances;
+	std::vector<Memory*> memories;
+	std::vector<Table*> tables;
+	std::vector<Context*> contexts;
+	std::vector<std::vector<Object*>> tableElements;
+	std::vector<Global*> mutableReferenceGlobals;
+	std::vector<Object*> mutableReferenceGlobalValues;
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+
+		if(metadata.moduleInstances.size() != compartment->moduleInstances.size())
+		{ return reportMismatch("the number of module instances"); }
+		for(const SnapshotModuleInstance& snapshotModuleInstance : metadata.moduleInstances)
+		{
+			ModuleInstance* moduleInstance
+				= getObjectByID(compartment->moduleInstances, snapshotModuleInstance.id);
+			if(!moduleInstance || moduleInstance->debugName != snapshotModuleInstance.debugName
+			   || moduleInstance->dataSegments.size()
+					  != snapshotModuleInstance.isDataSegmentDropped.size()
+			   || moduleInstance->elemSegments.size()
+					  != snapshotModuleInstance.isElemSegmentDropped.size())
+			{
+				return reportMismatch("module instance "
+									  + std::to_string(snapshotModuleInstance.id));
+			}
+			moduleInstances.push_back(moduleInstance);
+		}
+
+		if(metadata.memories.size() != compartment->memories.size())
+		{ return reportMismatch("the number of memories"); }
+		for(const SnapshotMemory& snapshotMemory : metadata.memories)
+		{
+			Memory* memory = getObjectByID(compartment->memories, snapshotMemory.id);
+			if(!memory || memory->type != snapshotMemory.type
+			   || snapshotMemory.dataOffset + U64(snapshotMemory.numPages) * IR::numBytesPerPage
+					  > header.numDataBytes)
+			{ return reportMismatch("memory " + std::to_string(snapshotMemory.id)); }
+			for(const SnapshotMemoryRange& range : snapshotMemory.nonZeroRanges)
+			{
+				if(range.offset + range.numBytes < range.offset
+				   || range.offset + range.numBytes
+						  > U64(snapshotMemory.numPages) * IR::numBytesPerPage)
+				{ return reportMismatch("memory " + std::to_string(snapshotMemory.id)); }
+			}
+			memories.push_back(memory);
+		}
+
+		if(metadata.tables.size() != compartment->tables.size())
+		{ return reportMismatch("the number of tables"); }
+		for(const SnapshotTable& snapshotTable : metadata.tables)
+		{
+			Table* table = getObjectByID(compartment->tables, snapshotTable.id);
+			if(!table || table->type != snapshotTable.type
+			   || getTableNumElements(table) > snapshotTable.elements.size())
+			{ return reportMismatch("table " + std::to_string(snapshotTable.id)); }
+			tables.push_back(table);
+
+			// Find the objects identified by the table's elements.
+			std::vector<Object*> elements;
+			for(const SnapshotReference& element : snapshotTable.elements)
+			{
+				Object* object = nullptr;
+				if(!findReference(compartment, element, object))
+				{ return reportMismatch("table " + std::to_string(snapshotTable.id)); }
+				elements.push_back(object);
+			}
+			tableElements.push_back(std::move(elements));
+		}
+
+		if(metadata.globals.size() != compartment->globals.size())
+		{ return reportMismatch("the number of globals"); }
+		for(const SnapshotGlobal& snapshotGlobal : metadata.globals)
+		{
+			Global* global = getObjectByID(compartment->globals, snapshotGlobal.id);
+			if(!global || global->mutableGlobalIndex != snapshotGlobal.mutableGlobalIndex
+			   || isMutableReferenceGlobal(global) != (snapshotGlobal.isMutableReference != 0))
+			{ return reportMismatch("global " + std::to_string(snapshotGlobal.id)); }
+			if(isMutableReferenceGlobal(global)) { mutableReferenceGlobals.push_back(global); }
+		}
+
+		// Find the objects identified by the values of the mutable reference globals.
+		auto findGlobalValues = [&](const std::vector<SnapshotReference>& references) {
+			if(references.size() != mutableReferenceGlobals.size()) { return false; }
+			for(const SnapshotReference& reference : references)
+			{
+				Object* object = nullptr;
+				if(!findReference(compartment, reference, object)) { return false; }
+				mutableReferenceGlobalValues.push_back(object);
+			}
+			return true;
+		};
+		if(!findGlobalValues(metadata.initialContextMutableReferenceGlobals))
+		{ return reportMismatch("the value of a mutable reference global"); }
+
+		for(const SnapshotContext& snapshotContext : metadata.contexts)
+		{
+			Context* context = compartment->contexts.get(snapshotContext.id);
+			if(!context || snapshotContext.mutableGlobals.size() != maxGlobalBytes
+			   || !findGlobalValues(snapshotContext.mutableReferenceGlobals))
+			{ return reportMismatch("context " + std::to_string(snapshotContext.id)); }
+			contexts.push_back(context);
+		}
+
+		if(metadata.initialContextMutableGlobals.size()
+		   != sizeof(compartment->initialContextMutableGlobals))
+		{ return reportMismatch("the size of the mutable globals"); }
+	}
+
+	// Restore the memories, mapping their contents from the file if possible.
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
+	{
+		const SnapshotMemory& snapshotMemory = metadata.memories[memoryIndex];
+
+		// Convert the non-zero byte ranges to this platform's pages, which may be larger than the
+		// pages of the platform that wrote the snapshot.
+		std::vector<MemoryPageRange> nonZeroPageRanges;
+		for(const SnapshotMemoryRange& range : snapshotMemory.nonZeroRanges)
+		{
+			const Uptr firstPageIndex = Uptr(range.offset >> pageBytesLog2);
+			const Uptr endPageIndex = Uptr(
+				(range.offset + range.numBytes + (Uptr(1) << pageBytesLog2) - 1) >> pageBytesLog2);
+			nonZeroPageRanges.push_back({firstPageIndex, endPageIndex - firstPageIndex});
+		}
+
+		if(!restoreMemory(memories[memoryIndex],
+						  snapshotMemory.numPages,
+						  path,
+						  header.dataOffset + snapshotMemory.dataOffset,
+						  nonZeroPageRanges))
+		{
+			Log::printf(Log::error,
+						"Error restoring memory %" WAVM_PRIuPTR " from snapshot file '%s'.\n",
+						snapshotMemory.id,
+						path.c_str());
+			return false;
+		}
+	}
+
+	// Restore the tables.
+	for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
+	{
+		Table* table = tables[tableIndex];
+		const std::vector<Object*>& elements = tableElements[tableIndex];
+		const Uptr numElements = getTableNumElements(table);
+		if(elements.size() > numElements
+		   && !growTable(table, elements.size() - numElements, nullptr, nullptr))
+		{
+			Log::printf(Log::error,
+						"Error restoring table %" WAVM_PRIuPTR " from snapshot file '%s'.\n",
+						table->id,
+						path.c_str());
+			return false;
+		}
+		for(Uptr elementIndex = 0; elementIndex < elements.size(); ++elementIndex)
+		{ setTableElement(table, elementIndex, elements[elementIndex]); }
+	}
+
+	// Drop the passive data and elem segments that were dropped when the snapshot was written.
+	for(Uptr moduleInstanceIndex = 0; moduleInstanceIndex < moduleInstances.size();
+		++moduleInstanceIndex)
+	{
+		ModuleInstance* moduleInstance = moduleInstances[moduleInstanceIndex];
+		const SnapshotModuleInstance& snapshotModuleInstance
+			= metadata.moduleInstances[moduleInstanceIndex];
+		{
+			Lock<Platform::Mutex> dataSegmentsLock(moduleInstance->dataSegmentsMutex);
+			for(Uptr segmentIndex = 0; segmentIndex < moduleInstance->dataSegments.size();
+				++segmentIndex)
+			{
+				if(snapshotModuleInstance.isDataSegmentDropped[segmentIndex])
+				{ moduleInstance->dataSegments[segmentIndex].reset(); }
+			}
+		}
+		{
+			Lock<Platform::Mutex> elemSegmentsLock(moduleInstance->elemSegmentsMutex);
+			for(Uptr segmentIndex = 0; segmentIndex < moduleInstance->elemSegments.size();
+				++segmentIndex)
+			{
+				if(snapshotModuleInstance.isElemSegmentDropped[segmentIndex])
+				{ moduleInstance->elemSegments[segmentIndex].reset(); }
+			}
+		}
+	}
+
+	// Restore the values of the mutable globals, and then the references that were written
+	// separately from their bytes.
+	auto restoreMutableGlobals = [&](IR::UntaggedValue* mutableGlobals,
+									 const std::vector<U8>& mutableGlobalBytes,
+									 Uptr valuesBeginIndex) {
+		memcpy(mutableGlobals, mutableGlobalBytes.data(), maxGlobalBytes);
+		for(Uptr globalIndex = 0; globalIndex < mutableReferenceGlobals.size(); ++globalIndex)
+		{
+			mutableGlobals[mutableReferenceGlobals[globalIndex]->mutableGlobalIndex].object
+				= mutableReferenceGlobalValues[valuesBeginIndex + globalIndex];
+		}
+	};
+	{
+		Lock<Platform::Mutex> compartmentLock(compartment->mutex);
+		restoreMutableGlobals(
+			compartment->initialContextMutableGlobals, metadata.initialContextMutableGlobals, 0);
+
+		// Make contexts that are being created concurrently copy the restored initial values.
+		compartment->initialContextMutableGlobalsVersion.fetch_add(1, std::memory_order_seq_cst);
+	}
+	for(Uptr contextIndex = 0; contextIndex < contexts.size(); ++contextIndex)
+	{
+		restoreMutableGlobals(contexts[contextIndex]->runtimeData->mutableGlobals,
+							  metadata.contexts[contextIndex].mutableGlobals,
+							  (contextIndex + 1) * mutableReferenceGlobals.size());
+	}
+
+	Timing::logTimer("Restored compartment", timer);
+	return true;
+}
@@ -6,6 +6,7 @@
 #include "WAVM/IR/Types.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/ConcurrentIntervalMap.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
@@ -22,9 +23,9 @@ namespace WAVM { namespace Runtime {
 	WAVM_DEFINE_INTRINSIC_MODULE(wavmIntrinsicsTable)
 }}
 
-// Global lists of tables; used to query whether an address is reserved by one of them.
-static Platform::Mutex tablesMutex;
-static std::vector<Table*> tables;
+// A map from the address space reserved by each table to the table; used to find the table that
+// owns the address of an access violation.
+static ConcurrentIntervalMap<Table*> tableReservations;
 
 enum
 {
@@ -51,7 +52,7 @@ Object* Runtime::getOutOfBoundsElement()
 	return asObject(function);
 }
 
-static Object* getUninitializedElement()
+Object* Runtime::getUninitializedElement()
 {
 	static Function* function = makeDummyFunction("uninitialized table element");
 	return asObject(function);
@@ -91,11 +92,10 @@ static Table* createTableImpl(Compartment* compartment,
 		return nullptr;
 	}
 
-	// Add the table to the global array.
-	{
-		Lock<Platform::Mutex> tablesLock(tablesMutex);
-		tables.push_back(table);
-	}
+	// Add the table's address space to the global map.
+	tableReservations.addOrFail(reinterpret_cast<Uptr>(table->elements),
+								reinterpret_cast<Uptr>(table->elements) + table->numReservedBytes,
+								table);
 	return table;
 }
 
@@ -243,6 +243,33 @@ Table* Runtime::cloneTable(Table* table, Compartment* newCompartment)
 	return newTable;
 }
 
+void Runtime::resetTable(Table* table, Table* sourceTable)
+{
+	Lock<Platform::Mutex> resizingLock(table->resizingMutex);
+	const Uptr numElements = table->numElements.load(std::memory_order_acquire);
+	const Uptr sourceNumElements = sourceTable->numElements.load(std::memory_order_acquire);
+	WAVM_ERROR_UNLESS(numElements >= sourceNumElements);
+
+	// Shrink the table to the source's size. The elements past the end of the table must be zero,
+	// so they are interpreted as the out-of-bounds element.
+	if(numElements > sourceNumElements)
+	{
+		for(Uptr elementIndex = sourceNumElements; elementIndex < numElements; ++elementIndex)
+		{ table->elements[elementIndex].biasedValue.store(0, std::memory_order_release); }
+		if(table->resourceQuota)
+		{ table->resourceQuota->tableElems.free(numElements - sourceNumElements); }
+		table->numElements.store(sourceNumElements, std::memory_order_release);
+	}
+
+	// Copy the source's elements.
+	for(Uptr elementIndex = 0; elementIndex < sourceNumElements; ++elementIndex)
+	{
+		table->elements[elementIndex].biasedValue.store(
+			sourceTable->elements[elementIndex].biasedValue.load(std::memory_order_acquire),
+			std::memory_order_release);
+	}
+}
+
 Table::~Table()
 {
 	if(id != UINTPTR_MAX)
@@ -256,18 +283,8 @@ Table::~Table()
 		compartment->runtimeData->tableBases[id] = nullptr;
 	}
 
-	// Remove the table from the global array.
-	{
-		Lock<Platform::Mutex> tablesLock(tablesMutex);
-		for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
-		{
-			if(tables[tableIndex] == this)
-			{
-				tables.erase(tables.begin() + tableIndex);
-				break;
-			}
-		}
-	}
+	// Remove the table's address space from the global map.
+	if(elements) { tableReservations.removeOrFail(reinterpret_cast<Uptr>(elements)); }
 
 	// Free the virtual address space.
 	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
@@ -283,21 +300,11 @@ Table::~Table()
 
 bool Runtime::isAddressOwnedByTable(U8* address, Table*& outTable, Uptr& outTableIndex)
 {
-	// Iterate over all tables and check if the address is within the reserved address space for
-	// each.
-	Lock<Platform::Mutex> tablesLock(tablesMutex);
-	for(auto table : tables)
-	{
-		U8* startAddress = (U8*)table->elements;
-		U8* endAddress = ((U8*)table->elements) + table->numReservedBytes;
-		if(address >= startAddress && address < endAddress)
-		{
-			outTable = table;
-			outTableIndex = (address - startAddress) / sizeof(Table::Element);
-			return true;
-		}
-	}
-	return false;
+	Uptr elementsAddress = 0;
+	if(!tableReservations.get(reinterpret_cast<Uptr>(address), outTable, elementsAddress))
+	{ return false; }
+	outTableIndex = (reinterpret_cast<Uptr>(address) - elementsAddress) / sizeof(Table::Element);
+	return true;
 }
 
 static Object* setTableElementNonNull(Table* table, Uptr index, Object* object)
@@ -598,24 +605,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsTable,
 	});
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsTable,
-							   "callIndirectFail",
-							   void,
-							   callIndirectFail,
-							   U32 index,
-							   Uptr tableId,
-							   Function* function,
-							   Uptr expectedTypeEncoding)
+void Runtime::throwCallIndirectFailure(Table* table,
+										Uptr index,
+										Function* function,
+										Uptr expectedTypeEncoding)
 {
-	Table* table = getTableFromRuntimeData(contextRuntimeData, tableId);
 	if(asObject(function) == getOutOfBoundsElement())
 	{
-		Log::printf(Log::debug, "call_indirect: index %u is out-of-bounds\n", index);
+		Log::printf(Log::debug, "call_indirect: index %" WAVM_PRIuPTR " is out-of-bounds\n", index);
 		throwException(ExceptionTypes::outOfBoundsTableAccess, {table, U64(index)});
 	}
 	else if(asObject(function) == getUninitializedElement())
 	{
-		Log::printf(Log::debug, "call_indirect: index %u is uninitialized\n", index);
+		Log::printf(Log::debug, "call_indirect: index %" WAVM_PRIuPTR " is uninitialized\n", index);
 		throwException(ExceptionTypes::uninitializedTableElement, {table, U64(index)});
 	}
 	else
@@ -624,7 +626,8 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsTable,
 		std::string ipDescription = "<unknown>";
 		describeInstructionPointer(reinterpret_cast<Uptr>(function->code), ipDescription);
 		Log::printf(Log::debug,
-					"call_indirect: index %u has signature %s (%s), but was expecting %s\n",
+					"call_indirect: index %" WAVM_PRIuPTR
+					" has signature %s (%s), but was expecting %s\n",
 					index,
 					asString(IR::FunctionType{function->encodedType}).c_str(),
 					ipDescription.c_str(),
@@ -632,3 +635,16 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsTable,
 		throwException(ExceptionTypes::indirectCallSignatureMismatch);
 	}
 }
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsTable,
+							   "callIndirectFail",
+							   void,
+							   callIndirectFail,
+							   U32 index,
+							   Uptr tableId,
+							   Function* function,
+							   Uptr expectedTypeEncoding)
+{
+	Table* table = getTableFromRuntimeData(contextRuntimeData, tableId);
+	throwCallIndirectFailure(table, index, function, expectedTypeEncoding);
+}
@@ -10,6 +10,7 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/FloatComponents.h"
 #include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -35,6 +36,16 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "unreachableTrap", void, unreacha
 	throwException(ExceptionTypes::reachedUnreachable);
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "interruptTrap", void, interruptTrap)
+{
+	throwInterruptedException(contextRuntimeData);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "outOfFuel", void, outOfFuel)
+{
+	handleOutOfFuel(contextRuntimeData);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 							   "invalidFloatOperationTrap",
 							   void,
@@ -71,6 +82,27 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 				function->mutableData->debugName.c_str());
 }
 
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
+							   "requestTierUp",
+							   void,
+							   requestTierUp,
+							   const Function* function,
+							   U32 functionDefIndex)
+{
+	LLVMJIT::requestTierUp(function, functionDefIndex);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
+							   "compileLazyFunction",
+							   void,
+							   compileLazyFunction,
+							   const Function* function,
+							   U32 functionDefIndex,
+							   U32 shouldCompileDirectCallees)
+{
+	LLVMJIT::compileLazyFunction(function, functionDefIndex, shouldCompileDirectCallees != 0);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "debugBreak", void, debugBreak)
 {
 	Log::printf(Log::debug, "================== wavmIntrinsics.debugBreak\n");
@@ -48,6 +48,11 @@ struct SandboxFS : FileSystem
 		return innerFS->unlinkFile(getInnerPath(path));
 	}
 
+	virtual Result renameFile(const std::string& oldPath, const std::string& newPath) override
+	{
+		return innerFS->renameFile(getInnerPath(oldPath), getInnerPath(newPath));
+	}
+
 	virtual Result removeDir(const std::string& path) override
 	{
 		return innerFS->removeDir(getInnerPath(path));
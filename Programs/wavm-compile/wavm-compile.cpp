@@ -1,3 +1,5 @@
+#include <string.h>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -10,6 +12,7 @@
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Runtime/Runtime.h"
 #include "WAVM/WASM/WASM.h"
 #include "WAVM/WASTParse/WASTParse.h"
 
@@ -49,8 +52,10 @@ static bool loadModule(const char* filename, IR::Module& outModule)
 static const char* getOutputFormatHelpText()
 {
 	return "  unoptimized-llvmir          Unoptimized LLVM IR for the input module.\n"
-		   "  optimized-llvmir            Optimized LLVM IR for the input module.\n"
+		   "  optimized-llvmir            LLVM IR for the input module, optimized at the\n"
+		   "                              level given by --opt-level.\n"
 		   "  object                      The target platform's native object file format.\n"
+		   "                              The module is always compiled in a single shard.\n"
 		   "  precompiled-wasm (default)  The original WebAssembly module with object code\n"
 		   "                              embedded in the wavm.precompiled_object section.\n";
 }
@@ -68,6 +73,29 @@ static void showHelp()
 				"                            supported features below.\n"
 				"  --format=<format>         Specifies the format of the output file. See the\n"
 				"                            list of supported output formats below.\n"
+				"  --shards=<n>              Compile the module in <n> shards on parallel\n"
+				"                            threads. The default is based on the module size\n"
+				"                            and the number of hardware threads.\n"
+				"  --opt-level=<level>       Set the optimization level: O0, O1 (default), O2,\n"
+				"                            O3 or Os. O2 and above inline calls between\n"
+				"                            functions and remove unused globals.\n"
+				"  --instrument-profile      Instrument the compiled code to collect a profile,\n"
+				"                            which wavm-run --profile-out=<file> writes out.\n"
+				"  --profile-use=<file>      Optimize the compiled code using a profile written\n"
+				"                            by wavm-run --profile-out=<file>.\n"
+				"  --interruptible           Check for interrupts on function entry and in\n"
+				"                            loops, so the code can be stopped by\n"
+				"                            Runtime::interruptContext.\n"
+				"  --meter-fuel              Charge the cost of the code to the fuel of the\n"
+				"                            context it runs in, and trap when it runs out.\n"
+				"  --bounds-check-memories   Check the bounds of memory accesses explicitly,\n"
+				"                            so the code can use memories that don't reserve\n"
+				"                            the full 8GiB of address space.\n"
+				"  --preinit[=<export>]      Run the module's start function and the given\n"
+				"                            exported function at build time, and replace the\n"
+				"                            module's data segments and global initializers\n"
+				"                            with the resulting state. Fails if they call an\n"
+				"                            import.\n"
 				"\n"
 				"Output formats:\n"
 				"%s"
@@ -103,6 +131,9 @@ int main(int argc, char** argv)
 	LLVMJIT::TargetSpec targetSpec = LLVMJIT::getHostTargetSpec();
 	IR::FeatureSpec featureSpec;
 	OutputFormat outputFormat = OutputFormat::unspecified;
+	LLVMJIT::CompileOptions compileOptions;
+	bool preinit = false;
+	const char* preinitExportName = nullptr;
 	for(int argIndex = 1; argIndex < argc; ++argIndex)
 	{
 		if(!strcmp(argv[argIndex], "-h") || !strcmp(argv[argIndex], "--help"))
@@ -179,6 +210,66 @@ int main(int argc, char** argv)
 				return EXIT_FAILURE;
 			}
 		}
+		else if(stringStartsWith(argv[argIndex], "--shards="))
+		{
+			const char* numShardsString = argv[argIndex] + strlen("--shards=");
+			char* numShardsEnd = nullptr;
+			compileOptions.numShards = Uptr(strtoull(numShardsString, &numShardsEnd, 10));
+			if(!*numShardsString || *numShardsEnd || !compileOptions.numShards)
+			{
+				Log::printf(Log::error, "Invalid shard count: %s\n", numShardsString);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(stringStartsWith(argv[argIndex], "--opt-level="))
+		{
+			const char* optLevelString = argv[argIndex] + strlen("--opt-level=");
+			if(!LLVMJIT::parseOptLevel(optLevelString, compileOptions.optLevel))
+			{
+				Log::printf(Log::error, "Invalid optimization level: %s\n", optLevelString);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(argv[argIndex], "--instrument-profile"))
+		{
+			compileOptions.instrumentProfile = true;
+		}
+		else if(!strcmp(argv[argIndex], "--interruptible"))
+		{
+			compileOptions.interruptible = true;
+		}
+		else if(!strcmp(argv[argIndex], "--meter-fuel"))
+		{
+			compileOptions.meterFuel = true;
+		}
+		else if(!strcmp(argv[argIndex], "--bounds-check-memories"))
+		{
+			compileOptions.boundsCheckMemories = true;
+		}
+		else if(!strcmp(argv[argIndex], "--preinit"))
+		{
+			preinit = true;
+		}
+		else if(stringStartsWith(argv[argIndex], "--preinit="))
+		{
+			preinit = true;
+			preinitExportName = argv[argIndex] + strlen("--preinit=");
+		}
+		else if(stringStartsWith(argv[argIndex], "--profile-use="))
+		{
+			const char* profileFilename = argv[argIndex] + strlen("--profile-use=");
+			std::vector<U8> profileBytes;
+			if(!loadFile(profileFilename, profileBytes)) { return EXIT_FAILURE; }
+
+			auto profile = std::make_shared<LLVMJIT::ModuleProfile>();
+			if(!LLVMJIT::parseProfile(std::string(profileBytes.begin(), profileBytes.end()),
+									  *profile))
+			{
+				Log::printf(Log::error, "Invalid profile file: %s\n", profileFilename);
+				return EXIT_FAILURE;
+			}
+			compileOptions.profile = profile;
+		}
 		else if(!inputFilename)
 		{
 			inputFilename = argv[argIndex];
@@ -231,11 +322,19 @@ int main(int argc, char** argv)
 	IR::Module irModule(featureSpec);
 	if(!loadModule(inputFilename, irModule)) { return EXIT_FAILURE; }
 
+	// Run the module's initialization, and bake the resulting state into the module.
+	std::string preinitError;
+	if(preinit && !preinitializeModule(irModule, preinitExportName, preinitError))
+	{
+		Log::printf(Log::error, "%s\n", preinitError.c_str());
+		return EXIT_FAILURE;
+	}
+
 	switch(outputFormat)
 	{
 	case OutputFormat::precompiledModule: {
 		// Compile the module to object code.
-		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec);
+		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec, compileOptions);
 
 		// Extract the compiled object code and add it to the IR module as a user section.
 		irModule.userSections.push_back({"wavm.precompiled_object", objectCode});
@@ -266,8 +365,9 @@ int main(int argc, char** argv)
 																			: EXIT_FAILURE;
 	}
 	case OutputFormat::object: {
-		// Compile the module to object code.
-		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec);
+		// Compile the module to a single native object file.
+		compileOptions.numShards = 1;
+		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec, compileOptions);
 
 		// Write the object code to the output file.
 		return saveFile(outputFilename, objectCode.data(), objectCode.size()) ? EXIT_SUCCESS
@@ -276,8 +376,11 @@ int main(int argc, char** argv)
 	case OutputFormat::optimizedLLVMIR:
 	case OutputFormat::unoptimizedLLVMIR: {
 		// Compile the module to LLVM IR.
-		std::string llvmIR = LLVMJIT::emitLLVMIR(
-			irModule, targetSpec, outputFormat == OutputFormat::optimizedLLVMIR);
+		std::string llvmIR = LLVMJIT::emitLLVMIR(irModule,
+												 targetSpec,
+												 outputFormat == OutputFormat::optimizedLLVMIR
+													 ? compileOptions.optLevel
+													 : LLVMJIT::OptLevel::O0);
 
 		// Write the LLVM IR to the output file.
 		return saveFile(outputFilename, llvmIR.data(), llvmIR.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -1,6 +1,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -22,7 +23,9 @@
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Event.h"
 #include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Linker.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/VFS/SandboxFS.h"
@@ -98,11 +101,14 @@ static bool loadModule(const char* filename, IR::Module& outModule)
 	}
 }
 
-static bool compileModule(const IR::Module& irModule, ModuleRef& outModule, bool precompiled)
+static bool compileModule(const IR::Module& irModule,
+						  const LLVMJIT::CompileOptions& compileOptions,
+						  ModuleRef& outModule,
+						  bool precompiled)
 {
 	if(!precompiled)
 	{
-		outModule = Runtime::compileModule(irModule);
+		outModule = Runtime::compileModule(irModule, compileOptions);
 		return true;
 	}
 	else
@@ -188,7 +194,46 @@ static void showHelp()
 				"  -f|--function name    Specify function name to run in module (default:main)\n"
 				"  --precompiled         Use precompiled object code in program file\n"
 				"  --metrics             Write benchmarking information to stdout\n"
+				"  --shards=<n>          Compile the module in <n> shards on parallel threads.\n"
+				"                        The default is based on the module size and the\n"
+				"                        number of hardware threads.\n"
+				"  --opt-level=<level>   Set the optimization level: O0, O1 (default), O2, O3\n"
+				"                        or Os. With --tiered, this is the level frequently\n"
+				"                        called functions are recompiled at.\n"
+				"  --tiered              Compile the module quickly without optimization, and\n"
+				"                        recompile frequently called functions with\n"
+				"                        optimization in the background.\n"
+				"  --lazy                Only compile each function the first time it is\n"
+				"                        called.\n"
+				"  --lazy-callees        With --lazy, also compile the functions a function\n"
+				"                        calls directly when it is compiled.\n"
+				"  --interpret           Interpret the module instead of compiling it. Modules\n"
+				"                        that use SIMD, atomics, or exceptions are compiled.\n"
+				"  --profile-out=<file>  Instrument the compiled code to collect a profile, and\n"
+				"                        write it to <file> when the module exits. The profile\n"
+				"                        can be used by wavm-compile --profile-use=<file>.\n"
+				"  --cache-dir=<dir>     Cache compiled object code in <dir>, and reuse it if\n"
+				"                        the same module is run again.\n"
+				"  --cache-max-mb=<n>    Limit the object cache to <n> MiB (default: 1024).\n"
+				"  --snapshot-out=<file> After running the module's initializers, write the\n"
+				"                        state of its memories, tables and globals to <file>.\n"
+				"  --snapshot-in=<file>  Restore the state written by --snapshot-out from <file>\n"
+				"                        instead of running the module's initializers.\n"
 				"  --trace               Prints instructions to stdout as they are compiled.\n"
+				"  --timeout=<seconds>   Interrupt the module if it runs longer than <seconds>.\n"
+				"  --fuel=<n>            Trap if the module executes more than about <n>\n"
+				"                        WebAssembly operators.\n"
+				"  --max-memory-reservation=<n>\n"
+				"                        Check the bounds of memory accesses explicitly, so\n"
+				"                        each memory reserves at most <n> MiB of address\n"
+				"                        space instead of 8GiB.\n"
+				"  --perf-map            Write the addresses of JIT code to /tmp/perf-<pid>.map,\n"
+				"                        so Linux perf can symbolize it.\n"
+				"  --huge-pages          Back the module's memories and code with huge pages,\n"
+				"                        which reduces TLB misses for large working sets.\n"
+				"  --profile=<file>      Sample the WebAssembly call stacks that use CPU time,\n"
+				"                        and write them to <file> in the collapsed stack\n"
+				"                        format used by flame graph tools.\n"
 				"  --enable <feature>    Enable the specified feature. See the list of supported\n"
 				"                        features below.\n"
 				"  --sys=<system>        Specifies the system to host the module. See the list\n"
@@ -209,6 +254,36 @@ static void showHelp()
 				getFeatureListHelpText());
 }
 
+// Interrupts a context if it hasn't been stopped before a timeout.
+struct Watchdog
+{
+	Watchdog(Context* inContext, U64 timeoutSeconds)
+	: context(inContext), timeout{I128(timeoutSeconds) * I128(U64(1000000000))}
+	{
+		thread = Platform::createThread(64 * 1024, threadEntry, this);
+	}
+
+	~Watchdog()
+	{
+		stopEvent.signal();
+		Platform::joinThread(thread);
+	}
+
+private:
+	Context* context;
+	Time timeout;
+	Platform::Event stopEvent;
+	Platform::Thread* thread;
+
+	static I64 threadEntry(void* argument)
+	{
+		Watchdog* watchdog = (Watchdog*)argument;
+		if(!watchdog->stopEvent.wait(watchdog->timeout))
+		{ Runtime::interruptContext(watchdog->context); }
+		return 0;
+	}
+};
+
 template<Uptr numPrefixChars>
 static bool stringStartsWith(const char* string, const char (&prefix)[numPrefixChars])
 {
@@ -234,6 +309,17 @@ struct State
 	std::vector<std::string> runArgs;
 	System system = System::detect;
 	bool precompiled = false;
+	bool interpret = false;
+	LLVMJIT::CompileOptions compileOptions;
+	const char* profileOutFilename = nullptr;
+	const char* sampledCallStacksFilename = nullptr;
+	const char* objectCacheDir = nullptr;
+	U64 objectCacheMaxMB = 1024;
+	const char* snapshotOutFilename = nullptr;
+	const char* snapshotInFilename = nullptr;
+	U64 timeoutSeconds = 0;
+	U64 fuel = 0;
+	U64 maxMemoryReservationMB = 0;
 	WASI::SyscallTraceLevel wasiTraceLavel = WASI::SyscallTraceLevel::none;
 
 	// Objects that need to be cleaned up before exiting.
@@ -334,6 +420,153 @@ struct State
 			{
 				precompiled = true;
 			}
+			else if(stringStartsWith(*nextArg, "--shards="))
+			{
+				const char* numShardsString = *nextArg + strlen("--shards=");
+				char* numShardsEnd = nullptr;
+				compileOptions.numShards = Uptr(strtoull(numShardsString, &numShardsEnd, 10));
+				if(!*numShardsString || *numShardsEnd || !compileOptions.numShards)
+				{
+					Log::printf(Log::error, "Invalid shard count: %s\n", numShardsString);
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--opt-level="))
+			{
+				const char* optLevelString = *nextArg + strlen("--opt-level=");
+				if(!LLVMJIT::parseOptLevel(optLevelString, compileOptions.optLevel))
+				{
+					Log::printf(Log::error, "Invalid optimization level: %s\n", optLevelString);
+					return false;
+				}
+			}
+			else if(!strcmp(*nextArg, "--tiered"))
+			{
+				compileOptions.tiered = true;
+			}
+			else if(!strcmp(*nextArg, "--lazy"))
+			{
+				compileOptions.lazy = true;
+			}
+			else if(!strcmp(*nextArg, "--lazy-callees"))
+			{
+				compileOptions.lazyCompileDirectCallees = true;
+			}
+			else if(!strcmp(*nextArg, "--interpret"))
+			{
+				interpret = true;
+			}
+			else if(!strcmp(*nextArg, "--perf-map"))
+			{
+				if(!LLVMJIT::enablePerfMap())
+				{
+					Log::printf(Log::error, "Couldn't create the perf map file.\n");
+					return false;
+				}
+			}
+			else if(!strcmp(*nextArg, "--huge-pages"))
+			{
+				if(!LLVMJIT::enableHugePagesForCode())
+				{
+					Log::printf(Log::error, "Huge pages aren't supported on this platform.\n");
+					return false;
+				}
+				setCompartmentHugePages(compartment, true);
+			}
+			else if(stringStartsWith(*nextArg, "--profile="))
+			{
+				sampledCallStacksFilename = *nextArg + strlen("--profile=");
+				if(!*sampledCallStacksFilename)
+				{
+					Log::printf(Log::error, "--profile= must be followed by a file name.\n");
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--profile-out="))
+			{
+				profileOutFilename = *nextArg + strlen("--profile-out=");
+				if(!*profileOutFilename)
+				{
+					Log::printf(Log::error, "--profile-out= must be followed by a file name.\n");
+					return false;
+				}
+				compileOptions.instrumentProfile = true;
+			}
+			else if(stringStartsWith(*nextArg, "--cache-dir="))
+			{
+				objectCacheDir = *nextArg + strlen("--cache-dir=");
+				if(!*objectCacheDir)
+				{
+					Log::printf(Log::error, "--cache-dir= must be followed by a directory.\n");
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--cache-max-mb="))
+			{
+				const char* maxMBString = *nextArg + strlen("--cache-max-mb=");
+				char* maxMBEnd = nullptr;
+				objectCacheMaxMB = U64(strtoull(maxMBString, &maxMBEnd, 10));
+				if(!*maxMBString || *maxMBEnd)
+				{
+					Log::printf(Log::error, "Invalid object cache size: %s\n", maxMBString);
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--snapshot-out="))
+			{
+				snapshotOutFilename = *nextArg + strlen("--snapshot-out=");
+				if(!*snapshotOutFilename)
+				{
+					Log::printf(Log::error, "--snapshot-out= must be followed by a file name.\n");
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--snapshot-in="))
+			{
+				snapshotInFilename = *nextArg + strlen("--snapshot-in=");
+				if(!*snapshotInFilename)
+				{
+					Log::printf(Log::error, "--snapshot-in= must be followed by a file name.\n");
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--timeout="))
+			{
+				const char* timeoutString = *nextArg + strlen("--timeout=");
+				char* timeoutEnd = nullptr;
+				timeoutSeconds = U64(strtoull(timeoutString, &timeoutEnd, 10));
+				if(!*timeoutString || *timeoutEnd || !timeoutSeconds)
+				{
+					Log::printf(Log::error, "Invalid timeout: %s\n", timeoutString);
+					return false;
+				}
+				compileOptions.interruptible = true;
+			}
+			else if(stringStartsWith(*nextArg, "--fuel="))
+			{
+				const char* fuelString = *nextArg + strlen("--fuel=");
+				char* fuelEnd = nullptr;
+				fuel = U64(strtoull(fuelString, &fuelEnd, 10));
+				if(!*fuelString || *fuelEnd)
+				{
+					Log::printf(Log::error, "Invalid fuel: %s\n", fuelString);
+					return false;
+				}
+				compileOptions.meterFuel = true;
+			}
+			else if(stringStartsWith(*nextArg, "--max-memory-reservation="))
+			{
+				const char* reservationString = *nextArg + strlen("--max-memory-reservation=");
+				char* reservationEnd = nullptr;
+				maxMemoryReservationMB = U64(strtoull(reservationString, &reservationEnd, 10));
+				if(!*reservationString || *reservationEnd || !maxMemoryReservationMB)
+				{
+					Log::printf(
+						Log::error, "Invalid memory reservation: %s\n", reservationString);
+					return false;
+				}
+				compileOptions.boundsCheckMemories = true;
+			}
 			else if(stringStartsWith(*nextArg, "--mount-root="))
 			{
 				if(rootMountPath)
@@ -493,9 +726,51 @@ struct State
 		IR::Module irModule(featureSpec);
 		if(!loadModule(filename, irModule)) { return EXIT_FAILURE; }
 
-		// Compile the module.
+		// Enable the object cache.
+		if(objectCacheDir
+		   && !Runtime::enableObjectCache(objectCacheDir, objectCacheMaxMB * 1024 * 1024))
+		{ return EXIT_FAILURE; }
+
+		// Compile the module, or translate it for the interpreter.
 		Runtime::ModuleRef module = nullptr;
-		if(!compileModule(irModule, module, precompiled)) { return EXIT_FAILURE; }
+		if(interpret && compileOptions.meterFuel)
+		{
+			Log::printf(Log::error,
+						"The interpreter doesn't meter fuel, so --fuel can't be used with "
+						"--interpret.\n");
+			return EXIT_FAILURE;
+		}
+		if((interpret || precompiled) && compileOptions.boundsCheckMemories)
+		{
+			Log::printf(Log::error,
+						"--max-memory-reservation can't be used with --interpret or --precompiled, "
+						"which don't check the bounds of memory accesses.\n");
+			return EXIT_FAILURE;
+		}
+		if(compileOptions.boundsCheckMemories)
+		{
+			setCompartmentMaxMemoryReservation(compartment,
+											   Uptr(maxMemoryReservationMB) * 1024 * 1024);
+		}
+		if(interpret && !precompiled)
+		{
+			module = Runtime::createInterpretedModule(irModule);
+			if(!module)
+			{
+				Log::printf(Log::debug,
+							"The module uses features the interpreter doesn't support, so it will "
+							"be compiled.\n");
+			}
+		}
+		if(!module && !compileModule(irModule, compileOptions, module, precompiled))
+		{ return EXIT_FAILURE; }
+
+		// Start sampling the call stacks once the module has been compiled.
+		if(sampledCallStacksFilename && !Runtime::startSamplingProfiler())
+		{
+			Log::printf(Log::error, "The sampling profiler isn't supported on this platform.\n");
+			return EXIT_FAILURE;
+		}
 
 		// Initialize the system environment.
 		if(!initSystem(irModule)) { return EXIT_FAILURE; }
@@ -547,6 +822,17 @@ struct State
 		// Create a WASM execution context.
 		Context* context = Runtime::createContext(compartment);
 
+		// Restore the state of the compartment after running the module's initializers, which were
+		// run by an earlier invocation of wavm-run with --snapshot-out.
+		if(snapshotInFilename && !restoreCompartment(compartment, snapshotInFilename))
+		{ return EXIT_FAILURE; }
+
+		// If there's a timeout, start a thread that interrupts the context when it expires.
+		std::unique_ptr<Watchdog> watchdog;
+		if(timeoutSeconds) { watchdog.reset(new Watchdog(context, timeoutSeconds)); }
+
+		if(compileOptions.meterFuel) { setContextFuel(context, fuel); }
+
 		// Look up the function export to call, validate its type, and set up the invoke arguments.
 		Function* function = nullptr;
 		std::vector<Value> invokeArgs;
@@ -658,22 +944,35 @@ struct State
 		int result = EXIT_SUCCESS;
 		try
 		{
-			// Call the module start function, if it has one.
-			Function* startFunction = getStartFunction(moduleInstance);
-			if(startFunction) { invokeFunctionChecked(context, startFunction, {}); }
-
-			if(emscriptenInstance)
+			if(!snapshotInFilename)
 			{
-				// Call the Emscripten global initalizers.
-				Emscripten::initializeGlobals(
-					emscriptenInstance, context, irModule, moduleInstance);
+				// Call the module start function, if it has one.
+				Function* startFunction = getStartFunction(moduleInstance);
+				if(startFunction) { invokeFunctionChecked(context, startFunction, {}); }
+
+				if(emscriptenInstance)
+				{
+					// Call the Emscripten global initalizers.
+					Emscripten::initializeGlobals(
+						emscriptenInstance, context, irModule, moduleInstance);
+				}
 			}
 
+			// Write the state of the compartment after running the module's initializers.
+			if(snapshotOutFilename && !snapshotCompartment(compartment, snapshotOutFilename))
+			{ return EXIT_FAILURE; }
+
 			// Invoke the function.
 			Timing::Timer executionTimer;
 			IR::ValueTuple functionResults = invokeFunctionChecked(context, function, invokeArgs);
 			Timing::logTimer("Invoked function", executionTimer);
 
+			if(compileOptions.meterFuel)
+			{
+				Log::printf(
+					Log::debug, "Fuel used: %" PRIu64 "\n", fuel - getContextFuel(context));
+			}
+
 			if(functionName)
 			{
 				Log::printf(Log::debug,
@@ -699,6 +998,33 @@ struct State
 			result = int(exitException.exitCode);
 		}
 
+		// Write the sampled call stacks.
+		if(sampledCallStacksFilename)
+		{
+			Runtime::stopSamplingProfiler();
+			const std::string sampledCallStacks = Runtime::getSampledCallStacks();
+			if(!saveFile(
+				   sampledCallStacksFilename, sampledCallStacks.data(), sampledCallStacks.size()))
+			{ return EXIT_FAILURE; }
+		}
+
+		// Write the profile collected by the module's instrumented code.
+		if(profileOutFilename)
+		{
+			LLVMJIT::ModuleProfile profile;
+			if(!Runtime::getModuleProfile(module, profile))
+			{
+				Log::printf(Log::error,
+							"The module wasn't compiled with profile instrumentation, so no "
+							"profile was written.\n");
+				return EXIT_FAILURE;
+			}
+
+			const std::string profileString = LLVMJIT::serializeProfile(profile);
+			if(!saveFile(profileOutFilename, profileString.data(), profileString.size()))
+			{ return EXIT_FAILURE; }
+		}
+
 		// Log the peak memory usage.
 		Uptr peakMemoryUsage = Platform::getPeakMemoryUsageBytes();
 		Log::printf(
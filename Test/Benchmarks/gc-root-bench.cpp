@@ -0,0 +1,153 @@
+#include <inttypes.h>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Validate.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+enum
+{
+	numCopiesPerThread = 1000000
+};
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+struct ThreadArgs
+{
+	Function* function = nullptr;
+	Compartment* compartment = nullptr;
+	F64 elapsedNanoseconds = 0;
+	Platform::Thread* thread = nullptr;
+};
+
+// Runs threadFunc on numThreads threads, and returns the average nanoseconds per copy.
+static F64 runBenchmark(Compartment* compartment,
+						Function* function,
+						Uptr numThreads,
+						I64 (*threadFunc)(void*))
+{
+	std::vector<ThreadArgs*> threads;
+	for(Uptr threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+	{
+		ThreadArgs* threadArgs = new ThreadArgs;
+		threadArgs->function = function;
+		threadArgs->compartment = compartment;
+		threadArgs->thread = Platform::createThread(512 * 1024, threadFunc, threadArgs);
+		threads.push_back(threadArgs);
+	}
+
+	// Wait for the threads to exit, and sum the results from each thread.
+	F64 totalElapsedNanoseconds = 0;
+	for(ThreadArgs* threadArgs : threads)
+	{
+		Platform::joinThread(threadArgs->thread);
+		totalElapsedNanoseconds += threadArgs->elapsedNanoseconds;
+		delete threadArgs;
+	}
+
+	return totalElapsedNanoseconds / F64(U64(numCopiesPerThread) * numThreads);
+}
+
+// Runs threadFunc with root reference count changes applied directly to the counters, as they
+// were before they were deferred, and then with them deferred, and prints both times.
+static void runBeforeAfterBenchmark(Compartment* compartment,
+									Function* function,
+									Uptr numThreads,
+									const char* description,
+									I64 (*threadFunc)(void*))
+{
+	setGCRootReferenceCountsDeferred(false);
+	const F64 directNanoseconds = runBenchmark(compartment, function, numThreads, threadFunc);
+	setGCRootReferenceCountsDeferred(true);
+	const F64 deferredNanoseconds = runBenchmark(compartment, function, numThreads, threadFunc);
+
+	Log::printf(Log::output,
+				"ns/%s in %" WAVM_PRIuPTR " threads: %.2f before, %.2f after (%.2fx)\n",
+				description,
+				numThreads,
+				directNanoseconds,
+				deferredNanoseconds,
+				directNanoseconds / deferredNanoseconds);
+}
+
+static void runBenchmarkWithIncreasingThreads(Compartment* compartment,
+											  Function* function,
+											  const char* description,
+											  I64 (*threadFunc)(void*))
+{
+	const Uptr numHardwareThreads = Platform::getNumberOfHardwareThreads();
+	for(Uptr numThreads = 1; numThreads < numHardwareThreads; numThreads *= 2)
+	{ runBeforeAfterBenchmark(compartment, function, numThreads, description, threadFunc); }
+	runBeforeAfterBenchmark(compartment, function, numHardwareThreads, description, threadFunc);
+}
+
+int main(int argc, char** argv)
+{
+	// Generate a module containing a nop function.
+	Serialization::ArrayOutputStream codeStream;
+	OperatorEncoderStream encoder(codeStream);
+	encoder.end();
+
+	IR::Module irModule;
+	DisassemblyNames irModuleNames;
+	irModule.types.push_back(FunctionType());
+	irModule.functions.defs.push_back({{0}, {}, std::move(codeStream.getBytes()), {}});
+	irModule.exports.push_back({"nopFunction", IR::ExternKind::function, 0});
+	irModuleNames.functions.push_back({"nopFunction", {}, {}});
+	IR::setDisassemblyNames(irModule, irModuleNames);
+	IR::validatePreCodeSections(irModule);
+	IR::validatePostCodeSections(irModule);
+
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	auto moduleInstance = instantiateModule(compartment, compileModule(irModule), {}, "nopModule");
+	auto nopFunction = asFunction(getInstanceExport(moduleInstance, "nopFunction"));
+
+	// Benchmark creating and destroying GCPointers to the same function from every thread.
+	runBenchmarkWithIncreasingThreads(
+		compartment, nopFunction, "GCPointer<Function> copy", [](void* argument) -> I64 {
+			ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+			Timing::Timer timer;
+			for(Uptr copyIndex = 0; copyIndex < numCopiesPerThread; ++copyIndex)
+			{ GCPointer<Function> function = threadArgs->function; }
+			timer.stop();
+
+			threadArgs->elapsedNanoseconds = timer.getNanoseconds();
+			return 0;
+		});
+
+	// Benchmark creating and destroying GCPointers to the same compartment from every thread.
+	runBenchmarkWithIncreasingThreads(
+		compartment, nopFunction, "GCPointer<Compartment> copy", [](void* argument) -> I64 {
+			ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+			Timing::Timer timer;
+			for(Uptr copyIndex = 0; copyIndex < numCopiesPerThread; ++copyIndex)
+			{ GCPointer<Compartment> compartment = threadArgs->compartment; }
+			timer.stop();
+
+			threadArgs->elapsedNanoseconds = timer.getNanoseconds();
+			return 0;
+		});
+
+	// Benchmark collecting the compartment's garbage, which applies the deferred root counts.
+	Timing::Timer collectTimer;
+	collectCompartmentGarbage(compartment);
+	collectTimer.stop();
+	Log::printf(Log::output, "us/collect garbage: %.2f\n", collectTimer.getMicroseconds());
+
+	// Free the compartment.
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+
+	return 0;
+}
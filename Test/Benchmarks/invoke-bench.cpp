@@ -134,6 +134,22 @@ int main(int argc, char** argv)
 			return 0;
 		});
 
+	// Benchmark calling the function through a TypedFunction.
+	runBenchmarkSingleAndMultiThreaded(
+		compartment, nopFunction, "TypedFunction call", [](void* argument) -> I64 {
+			ThreadArgs* threadArgs = (ThreadArgs*)argument;
+			TypedFunction<I32()> typedNopFunction(threadArgs->nopFunction);
+
+			Timing::Timer timer;
+			for(Uptr repeatIndex = 0; repeatIndex < numInvokesPerThread; ++repeatIndex)
+			{ typedNopFunction(threadArgs->context); }
+			timer.stop();
+
+			threadArgs->elapsedNanoseconds = timer.getNanoseconds();
+
+			return 0;
+		});
+
 	// Benchmark invokeFunctionUnchecked.
 	runBenchmarkSingleAndMultiThreaded(
 		compartment, nopFunction, "invokeFunctionUnchecked", [](void* argument) -> I64 {
@@ -170,6 +186,29 @@ int main(int argc, char** argv)
 			return 0;
 		});
 
+	// Benchmark invokeFunctionBatch, invoking the function once for each of numInvokesPerThread
+	// rows of arguments.
+	runBenchmarkSingleAndMultiThreaded(
+		compartment, nopFunction, "invokeFunctionBatch", [](void* argument) -> I64 {
+			ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+			std::vector<UntaggedValue> argRows(numInvokesPerThread, UntaggedValue{I32(0)});
+			std::vector<UntaggedValue> resultRows(numInvokesPerThread);
+
+			Timing::Timer timer;
+			WAVM_ERROR_UNLESS(invokeFunctionBatch(threadArgs->context,
+												  threadArgs->nopFunction,
+												  argRows.data(),
+												  numInvokesPerThread,
+												  resultRows.data())
+							  == numInvokesPerThread);
+			timer.stop();
+
+			threadArgs->elapsedNanoseconds = timer.getNanoseconds();
+
+			return 0;
+		});
+
 	// Free the compartment.
 	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
 
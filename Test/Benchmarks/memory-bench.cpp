@@ -0,0 +1,280 @@
+#include <inttypes.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Validate.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Runtime/Runtime.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum
+{
+	numMemoryPages = 16,
+	numInstantiations = 1000,
+	numScans = 1000,
+
+	// A 256MiB memory that is loaded from at random addresses.
+	numRandomAccessMemoryPages = 4096,
+	numRandomAccesses = 64 * 1024 * 1024,
+
+	// The address space reserved for each memory when bounds checks are explicit.
+	maxMemoryReservationBytes = 64 * 1024 * 1024
+};
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Generates a module with a memory and a function that sums the I32s in the first numBytes of it.
+static void generateScanModule(IR::Module& irModule)
+{
+	Serialization::ArrayOutputStream codeStream;
+	OperatorEncoderStream encoder(codeStream);
+	encoder.loop({{IndexedBlockType::noParametersOrResult, {}}});
+	encoder.local_get({2});
+	encoder.local_get({1});
+	encoder.i32_load({2, 0});
+	encoder.i32_add();
+	encoder.local_set({2});
+	encoder.local_get({1});
+	encoder.i32_const({4});
+	encoder.i32_add();
+	encoder.local_tee({1});
+	encoder.local_get({0});
+	encoder.i32_lt_u();
+	encoder.br_if({0});
+	encoder.end();
+	encoder.local_get({2});
+	encoder.end();
+
+	DisassemblyNames irModuleNames;
+	irModule.types.push_back(FunctionType({ValueType::i32}, {ValueType::i32}));
+	irModule.functions.defs.push_back(
+		{{0}, {ValueType::i32, ValueType::i32}, std::move(codeStream.getBytes()), {}});
+	irModule.memories.defs.push_back({MemoryType(false, {numMemoryPages, UINT64_MAX})});
+	irModule.exports.push_back({"scan", IR::ExternKind::function, 0});
+	irModuleNames.functions.push_back({"scan", {}, {}});
+	IR::setDisassemblyNames(irModule, irModuleNames);
+	IR::validatePreCodeSections(irModule);
+	IR::validatePostCodeSections(irModule);
+}
+
+// Generates a module with a memory and a function that loads I32s from random addresses in it.
+// The function's parameters are the number of loads and a mask that is applied to the addresses.
+static void generateRandomAccessModule(IR::Module& irModule)
+{
+	Serialization::ArrayOutputStream codeStream;
+	OperatorEncoderStream encoder(codeStream);
+	encoder.loop({{IndexedBlockType::noParametersOrResult, {}}});
+
+	// Generate the next address with a linear congruential generator, and use its high bits.
+	encoder.local_get({2});
+	encoder.i32_const({1103515245});
+	encoder.i32_mul();
+	encoder.i32_const({12345});
+	encoder.i32_add();
+	encoder.local_tee({2});
+	encoder.i32_const({16});
+	encoder.i32_rotl();
+	encoder.local_get({1});
+	encoder.i32_and_();
+	encoder.i32_load({2, 0});
+	encoder.local_get({3});
+	encoder.i32_add();
+	encoder.local_set({3});
+
+	encoder.local_get({0});
+	encoder.i32_const({1});
+	encoder.i32_sub();
+	encoder.local_tee({0});
+	encoder.br_if({0});
+	encoder.end();
+	encoder.local_get({3});
+	encoder.end();
+
+	DisassemblyNames irModuleNames;
+	irModule.types.push_back(FunctionType({ValueType::i32}, {ValueType::i32, ValueType::i32}));
+	irModule.functions.defs.push_back(
+		{{0}, {ValueType::i32, ValueType::i32}, std::move(codeStream.getBytes()), {}});
+	irModule.memories.defs.push_back(
+		{MemoryType(false, {numRandomAccessMemoryPages, numRandomAccessMemoryPages})});
+	irModule.exports.push_back({"randomLoads", IR::ExternKind::function, 0});
+	irModuleNames.functions.push_back({"randomLoads", {}, {}});
+	IR::setDisassemblyNames(irModule, irModuleNames);
+	IR::validatePreCodeSections(irModule);
+	IR::validatePostCodeSections(irModule);
+}
+
+// Counts the data TLB misses of the calling thread, if the platform supports it.
+struct TLBMissCounter
+{
+	TLBMissCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+					  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+		if(fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	~TLBMissCounter()
+	{
+#ifdef __linux__
+		if(fd >= 0) { close(fd); }
+#endif
+	}
+
+	// Stops counting, and returns the number of misses, or false if they couldn't be counted.
+	bool stop(U64& outNumMisses)
+	{
+#ifdef __linux__
+		if(fd < 0) { return false; }
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		return read(fd, &outNumMisses, sizeof(outNumMisses)) == sizeof(outNumMisses);
+#else
+		return false;
+#endif
+	}
+
+private:
+	int fd = -1;
+};
+
+static GCPointer<Compartment> createBenchmarkCompartment(bool boundsCheckMemories)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	if(boundsCheckMemories)
+	{ setCompartmentMaxMemoryReservation(compartment, maxMemoryReservationBytes); }
+	return compartment;
+}
+
+static void runBenchmarks(const IR::Module& irModule, bool boundsCheckMemories)
+{
+	const char* mode = boundsCheckMemories ? "bounds-checked" : "guard pages";
+
+	LLVMJIT::CompileOptions compileOptions;
+	compileOptions.boundsCheckMemories = boundsCheckMemories;
+	ModuleRef module = compileModule(irModule, compileOptions);
+
+	// Benchmark instantiating the module in a new compartment and freeing it, which is dominated by
+	// reserving and freeing the memory's address space.
+	Timing::Timer instantiateTimer;
+	for(Uptr instantiationIndex = 0; instantiationIndex < numInstantiations; ++instantiationIndex)
+	{
+		GCPointer<Compartment> compartment = createBenchmarkCompartment(boundsCheckMemories);
+		instantiateModule(compartment, module, {}, "scanModule");
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	}
+	instantiateTimer.stop();
+	Log::printf(Log::output,
+				"us/instantiate (%s): %.2f\n",
+				mode,
+				instantiateTimer.getMicroseconds() / F64(numInstantiations));
+
+	// Benchmark loading every I32 in the memory.
+	GCPointer<Compartment> compartment = createBenchmarkCompartment(boundsCheckMemories);
+	ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "scanModule");
+	Function* scanFunction = asFunction(getInstanceExport(moduleInstance, "scan"));
+	Context* context = createContext(compartment);
+
+	const std::vector<Value> scanArgs{Value{I32(numMemoryPages * IR::numBytesPerPage)}};
+	invokeFunctionChecked(context, scanFunction, scanArgs);
+
+	Timing::Timer scanTimer;
+	for(Uptr scanIndex = 0; scanIndex < numScans; ++scanIndex)
+	{ invokeFunctionChecked(context, scanFunction, scanArgs); }
+	scanTimer.stop();
+	Log::printf(Log::output,
+				"ns/load (%s): %.3f\n",
+				mode,
+				scanTimer.getNanoseconds()
+					/ F64(U64(numScans) * numMemoryPages * IR::numBytesPerPage / sizeof(U32)));
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void runRandomAccessBenchmark(const IR::Module& irModule, bool useHugePages)
+{
+	const char* mode = useHugePages ? "huge pages" : "small pages";
+
+	GCPointer<Compartment> compartment = createCompartment();
+	setCompartmentHugePages(compartment, useHugePages);
+	ModuleInstance* moduleInstance
+		= instantiateModule(compartment, compileModule(irModule), {}, "randomAccessModule");
+	Function* randomLoadsFunction = asFunction(getInstanceExport(moduleInstance, "randomLoads"));
+	Context* context = createContext(compartment);
+
+	// Write to every page of the memory, so the loads don't all read the same zero page.
+	Memory* memory = getDefaultMemory(moduleInstance);
+	const Uptr numMemoryBytes = Uptr(numRandomAccessMemoryPages) * IR::numBytesPerPage;
+	memset(getMemoryBaseAddress(memory), 1, numMemoryBytes);
+
+	const std::vector<Value> randomLoadsArgs{Value{I32(numRandomAccesses)},
+											 Value{I32((numMemoryBytes - 1) & ~3)}};
+
+	TLBMissCounter tlbMissCounter;
+	Timing::Timer timer;
+	invokeFunctionChecked(context, randomLoadsFunction, randomLoadsArgs);
+	timer.stop();
+
+	U64 numTLBMisses = 0;
+	if(tlbMissCounter.stop(numTLBMisses))
+	{
+		Log::printf(Log::output,
+					"dTLB misses/load (%s): %.3f\n",
+					mode,
+					F64(numTLBMisses) / F64(numRandomAccesses));
+	}
+	Log::printf(Log::output,
+				"ns/random load (%s): %.3f\n",
+				mode,
+				timer.getNanoseconds() / F64(numRandomAccesses));
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+int main(int argc, char** argv)
+{
+	IR::Module irModule;
+	generateScanModule(irModule);
+
+	runBenchmarks(irModule, false);
+	runBenchmarks(irModule, true);
+
+	IR::Module randomAccessIRModule;
+	generateRandomAccessModule(randomAccessIRModule);
+
+	runRandomAccessBenchmark(randomAccessIRModule, false);
+	if(Platform::getBytesPerHugePageLog2())
+	{ runRandomAccessBenchmark(randomAccessIRModule, true); }
+
+	return 0;
+}
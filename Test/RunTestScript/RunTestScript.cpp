@@ -19,6 +19,7 @@
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Lock.h"
 #include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Memory.h"
 #include "WAVM/Platform/Mutex.h"
@@ -43,6 +44,9 @@ struct Config
 	bool strictAssertInvalid{false};
 	bool strictAssertMalformed{false};
 	bool testCloning{false};
+	bool interpret{false};
+	bool preinit{false};
+	LLVMJIT::CompileOptions compileOptions;
 };
 
 struct TestScriptState
@@ -70,6 +74,9 @@ struct TestScriptState
 			Intrinsics::instantiateModule(
 				compartment, {WAVM_INTRINSIC_MODULE_REF(spectest)}, "spectest"));
 		moduleNameToInstanceMap.set("threadTest", ThreadTest::instantiate(compartment));
+
+		// Contexts are created with no fuel, so give the context enough fuel to run any test.
+		if(config.compileOptions.meterFuel) { setContextFuel(context, UINT64_MAX); }
 	}
 
 	TestScriptState(const TestScriptState& copyee)
@@ -257,6 +264,19 @@ static bool isExpectedExceptionType(WAST::ExpectedTrapType expectedType,
 	}
 }
 
+// Compiles a test module with the script's compile options, or translates it for the interpreter
+// if the script is being run with --interpret. Modules that use features the interpreter doesn't
+// support are compiled.
+static ModuleRef compileTestModule(const TestScriptState& state, const IR::Module& irModule)
+{
+	if(state.config.interpret)
+	{
+		ModuleRef interpretedModule = createInterpretedModule(irModule);
+		if(interpretedModule) { return interpretedModule; }
+	}
+	return compileModule(irModule, state.config.compileOptions);
+}
+
 static bool processAction(TestScriptState& state, Action* action, IR::ValueTuple& outResults)
 {
 	outResults = IR::ValueTuple();
@@ -270,16 +290,30 @@ static bool processAction(TestScriptState& state, Action* action, IR::ValueTuple
 		state.lastModuleInstance = nullptr;
 		collectCompartmentGarbage(state.compartment);
 
+		// With --preinit, replace the module with its pre-initialized form if it can be
+		// pre-initialized, which mustn't change the results of the rest of the script.
+		std::unique_ptr<IR::Module> preinitializedIRModule;
+		if(state.config.preinit)
+		{
+			preinitializedIRModule.reset(new IR::Module(*moduleAction->module));
+			std::string preinitError;
+			if(!preinitializeModule(*preinitializedIRModule, nullptr, preinitError))
+			{ preinitializedIRModule.reset(); }
+		}
+		const IR::Module& irModule
+			= preinitializedIRModule ? *preinitializedIRModule : *moduleAction->module;
+
 		// Link and instantiate the module.
 		TestScriptResolver resolver(state);
-		LinkResult linkResult = linkModule(*moduleAction->module, resolver);
+		LinkResult linkResult = linkModule(irModule, resolver);
 		if(linkResult.success)
 		{
 			state.hasInstantiatedModule = true;
-			state.lastModuleInstance = instantiateModule(state.compartment,
-														 compileModule(*moduleAction->module),
-														 std::move(linkResult.resolvedImports),
-														 "test module");
+			state.lastModuleInstance
+				= instantiateModule(state.compartment,
+									compileTestModule(state, irModule),
+									std::move(linkResult.resolvedImports),
+									"test module");
 
 			// Call the module start function, if it has one.
 			Function* startFunction = getStartFunction(state.lastModuleInstance);
@@ -606,11 +640,11 @@ static void processCommand(TestScriptState& state, const Command* command)
 				LinkResult linkResult = linkModule(*assertCommand->moduleAction->module, resolver);
 				if(linkResult.success)
 				{
-					auto moduleInstance
-						= instantiateModule(state.compartment,
-											compileModule(*assertCommand->moduleAction->module),
-											std::move(linkResult.resolvedImports),
-											"test module");
+					auto moduleInstance = instantiateModule(
+						state.compartment,
+						compileTestModule(state, *assertCommand->moduleAction->module),
+						std::move(linkResult.resolvedImports),
+						"test module");
 
 					// Call the module start function, if it has one.
 					Function* startFunction = getStartFunction(moduleInstance);
@@ -870,6 +904,21 @@ static void showHelp()
 		"                             module was invalid\n"
 		"  --test-cloning             Run each test command in the original compartment\n"
 		"                             and a clone of it, and compare the resulting state\n"
+		"  --interpret                Interpret the test modules instead of compiling\n"
+		"                             them, unless they use features the interpreter\n"
+		"                             doesn't support\n"
+		"  --tiered                   Compile the test modules with the baseline tier,\n"
+		"                             and recompile each function with optimization\n"
+		"                             after its first call\n"
+		"  --lazy                     Compile each test function on its first call\n"
+		"  --interruptible            Compile the test modules to check for interrupts\n"
+		"  --fuel                     Compile the test modules to meter fuel, and give\n"
+		"                             the test contexts the maximum fuel\n"
+		"  --shards <N>               Split each test module into N shards that are\n"
+		"                             compiled on separate threads, or into one shard\n"
+		"                             per function if it has fewer than N functions\n"
+		"  --preinit                  Pre-initialize the test modules that can be, as\n"
+		"                             wavm-compile --preinit does\n"
 		"  --trace                    Prints instructions to stdout as they are compiled.\n");
 }
 
@@ -923,6 +972,48 @@ int main(int argc, char** argv)
 		{
 			config.testCloning = true;
 		}
+		else if(!strcmp(argv[argIndex], "--interpret"))
+		{
+			config.interpret = true;
+		}
+		else if(!strcmp(argv[argIndex], "--tiered"))
+		{
+			// Request the optimized code on the first call, so the tests run both tiers.
+			config.compileOptions.tiered = true;
+			config.compileOptions.tierUpCallThreshold = 1;
+		}
+		else if(!strcmp(argv[argIndex], "--lazy"))
+		{
+			config.compileOptions.lazy = true;
+		}
+		else if(!strcmp(argv[argIndex], "--interruptible"))
+		{
+			config.compileOptions.interruptible = true;
+		}
+		else if(!strcmp(argv[argIndex], "--fuel"))
+		{
+			config.compileOptions.meterFuel = true;
+		}
+		else if(!strcmp(argv[argIndex], "--shards"))
+		{
+			if(argIndex + 1 >= argc)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			++argIndex;
+			long int numShardsLongInt = strtol(argv[argIndex], nullptr, 10);
+			if(numShardsLongInt <= 0)
+			{
+				showHelp();
+				return EXIT_FAILURE;
+			}
+			config.compileOptions.numShards = Uptr(numShardsLongInt);
+		}
+		else if(!strcmp(argv[argIndex], "--preinit"))
+		{
+			config.preinit = true;
+		}
 		else if (!strcmp(argv[argIndex], "--trace"))
 		{
 			Log::setCategoryEnabled(Log::trace, true);
@@ -0,0 +1,85 @@
+#include <string>
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* importingModuleWAST
+	= "(module\n"
+	  "  (import \"env\" \"memory\" (memory 1 16))\n"
+	  "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+	  ")";
+
+static void testImportRequiresBoundsChecks()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	setCompartmentMaxMemoryReservation(compartment, 1024 * 1024);
+
+	// A memory created in a compartment that limits memory reservations requires bounds checks.
+	Memory* memory = createMemory(compartment, MemoryType(false, SizeConstraints{1, 16}), "memory");
+	WAVM_ERROR_UNLESS(memory);
+	WAVM_ERROR_UNLESS(getMemoryRequiresBoundsChecks(memory));
+
+	// Instantiating a module that doesn't check bounds with the memory must throw an exception
+	// instead of aborting.
+	ModuleRef uncheckedModule = compileWAST(importingModuleWAST);
+	ModuleInstance* uncheckedInstance = nullptr;
+	Runtime::ExceptionType* exceptionType = catchExceptionType([&] {
+		uncheckedInstance = instantiateModule(compartment, uncheckedModule, {asObject(memory)}, "");
+	});
+	WAVM_ERROR_UNLESS(exceptionType == ExceptionTypes::importRequiresBoundsChecks);
+	WAVM_ERROR_UNLESS(!uncheckedInstance);
+
+	// A module that checks bounds may import the memory, and traps on out-of-bounds accesses.
+	LLVMJIT::CompileOptions compileOptions;
+	compileOptions.boundsCheckMemories = true;
+	ModuleRef checkedModule = compileWAST(importingModuleWAST, compileOptions);
+	ModuleInstance* checkedInstance
+		= instantiateModule(compartment, checkedModule, {asObject(memory)}, "");
+	WAVM_ERROR_UNLESS(checkedInstance);
+
+	Function* loadFunction = asFunction(getInstanceExport(checkedInstance, "load"));
+	Context* context = createContext(compartment);
+	WAVM_ERROR_UNLESS(!catchExceptionType(
+		[&] { invokeFunctionChecked(context, loadFunction, {Value(I32(IR::numBytesPerPage - 4))}); }));
+	WAVM_ERROR_UNLESS(catchExceptionType([&] {
+		invokeFunctionChecked(context, loadFunction, {Value(I32(IR::numBytesPerPage))});
+	}) == ExceptionTypes::outOfBoundsMemoryAccess);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void testFullReservationDoesNotRequireBoundsChecks()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+
+	// A memory that reserves the full address space may be imported by any module.
+	Memory* memory = createMemory(compartment, MemoryType(false, SizeConstraints{1, 16}), "memory");
+	WAVM_ERROR_UNLESS(memory);
+	WAVM_ERROR_UNLESS(!getMemoryRequiresBoundsChecks(memory));
+
+	ModuleRef module = compileWAST(importingModuleWAST);
+	WAVM_ERROR_UNLESS(instantiateModule(compartment, module, {asObject(memory)}, ""));
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testImportRequiresBoundsChecks();
+	testFullReservationDoesNotRequireBoundsChecks();
+	Timing::logTimer("BoundsCheckTest", timer);
+	return 0;
+}
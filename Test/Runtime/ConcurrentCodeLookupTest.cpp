@@ -0,0 +1,135 @@
+#include <atomic>
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+// Loads and unloads modules on some threads while other threads look up the addresses of their
+// code, to check that looking up a function by address is safe while its module is unloaded.
+
+enum
+{
+	numLoaderThreads = 2,
+	numLookupThreads = 2,
+	numLoadsPerThread = 50,
+};
+
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (func (export \"f\") (param i32) (result i32) (i32.add (local.get 0) (i32.const 1)))\n"
+	  "  (func (export \"g\") (param i32) (result i32) (i32.mul (local.get 0) (i32.const 2)))\n"
+	  ")";
+
+struct SharedState
+{
+	IR::Module irModule;
+	std::vector<U8> objectCode;
+
+	// The code addresses of functions in loaded modules. Each loader thread publishes the
+	// addresses of the functions it loaded to its own slot, and clears it before unloading them,
+	// but lookup threads may still be looking up an address after it is cleared.
+	std::atomic<Uptr> codeAddresses[numLoaderThreads];
+
+	std::atomic<Uptr> numRunningLoaderThreads{numLoaderThreads};
+};
+
+struct LoaderThreadArgs
+{
+	SharedState* state;
+	Uptr threadIndex;
+};
+
+static I64 loaderThreadEntry(void* argument)
+{
+	LoaderThreadArgs* args = (LoaderThreadArgs*)argument;
+	SharedState* state = args->state;
+
+	for(Uptr loadIndex = 0; loadIndex < numLoadsPerThread; ++loadIndex)
+	{
+		ModuleRef module = loadPrecompiledModule(state->irModule, state->objectCode);
+		GCPointer<Compartment> compartment = createCompartment();
+		ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+
+		Function* function
+			= asFunction(getInstanceExport(moduleInstance, loadIndex & 1 ? "f" : "g"));
+		const Uptr codeAddress = reinterpret_cast<Uptr>(getFunctionCode(function));
+		WAVM_ERROR_UNLESS(LLVMJIT::getFunctionByAddress(codeAddress) == function);
+
+		state->codeAddresses[args->threadIndex].store(codeAddress, std::memory_order_release);
+		Platform::yieldToAnotherThread();
+		state->codeAddresses[args->threadIndex].store(0, std::memory_order_release);
+
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+		module.reset();
+	}
+
+	state->numRunningLoaderThreads.fetch_sub(1, std::memory_order_release);
+	return 0;
+}
+
+static I64 lookupThreadEntry(void* argument)
+{
+	SharedState* state = (SharedState*)argument;
+
+	// Keep looking up the most recently published addresses until the loader threads are done.
+	Uptr lastCodeAddresses[numLoaderThreads] = {0};
+	while(state->numRunningLoaderThreads.load(std::memory_order_acquire))
+	{
+		for(Uptr loaderIndex = 0; loaderIndex < numLoaderThreads; ++loaderIndex)
+		{
+			const Uptr codeAddress
+				= state->codeAddresses[loaderIndex].load(std::memory_order_acquire);
+			if(codeAddress) { lastCodeAddresses[loaderIndex] = codeAddress; }
+
+			// The address may be in a module that was unloaded, or in a module that was loaded
+			// at the same address since, so the result can't be checked, but the lookup must not
+			// read a freed module.
+			if(lastCodeAddresses[loaderIndex])
+			{
+				LLVMJIT::getFunctionByAddress(lastCodeAddresses[loaderIndex]);
+				LLVMJIT::getFunctionByAddress(lastCodeAddresses[loaderIndex] + 1);
+			}
+		}
+	}
+
+	return 0;
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	SharedState state;
+	parseWAST(testModuleWAST, state.irModule);
+	state.objectCode = getObjectCode(compileModule(state.irModule));
+	for(Uptr loaderIndex = 0; loaderIndex < numLoaderThreads; ++loaderIndex)
+	{ state.codeAddresses[loaderIndex].store(0, std::memory_order_relaxed); }
+
+	std::vector<Platform::Thread*> threads;
+	LoaderThreadArgs loaderThreadArgs[numLoaderThreads];
+	for(Uptr threadIndex = 0; threadIndex < numLoaderThreads; ++threadIndex)
+	{
+		loaderThreadArgs[threadIndex].state = &state;
+		loaderThreadArgs[threadIndex].threadIndex = threadIndex;
+		threads.push_back(
+			Platform::createThread(1024 * 1024, loaderThreadEntry, &loaderThreadArgs[threadIndex]));
+	}
+	for(Uptr threadIndex = 0; threadIndex < numLookupThreads; ++threadIndex)
+	{ threads.push_back(Platform::createThread(1024 * 1024, lookupThreadEntry, &state)); }
+
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	Timing::logTimer("ConcurrentCodeLookupTest", timer);
+	return 0;
+}
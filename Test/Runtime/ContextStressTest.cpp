@@ -0,0 +1,163 @@
+#include <atomic>
+#include <vector>
+
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Lock.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// Creates contexts on some threads while another thread creates and initializes mutable globals,
+// and another collects garbage, which deletes the contexts that are no longer used and lets their
+// IDs be reused. Contexts are created without locking the compartment, so this checks that the
+// threads that visit every context in the compartment don't see a context that is being added
+// before it is initialized, and that each context gets the values of every global.
+
+enum
+{
+	numCreatorThreads = 4,
+	numContextsPerThread = 1000,
+	numLiveContextsPerThread = 250,
+	numGlobals = 200,
+};
+
+static I32 getExpectedGlobalValue(Uptr globalIndex) { return I32(globalIndex * 7 + 1); }
+
+struct SharedState
+{
+	GCPointer<Compartment> compartment;
+
+	// The globals are created by one thread, which publishes the number it has initialized.
+	GCPointer<Global> globals[numGlobals];
+	std::atomic<Uptr> numInitializedGlobals{0};
+
+	// Each thread that creates objects holds its mutex from creating an object until the object is
+	// referenced by a GCPointer. The garbage collection thread locks all of them while it collects
+	// garbage, so it can't delete an object before it is referenced.
+	Platform::Mutex threadMutexes[numCreatorThreads + 1];
+
+	std::atomic<Uptr> numRunningThreads{numCreatorThreads + 1};
+};
+
+struct CreatorThreadArgs
+{
+	SharedState* state;
+	Uptr threadIndex;
+};
+
+static void checkGlobals(SharedState* state, Context* context, Uptr numGlobalsToCheck)
+{
+	for(Uptr globalIndex = 0; globalIndex < numGlobalsToCheck; ++globalIndex)
+	{
+		WAVM_ERROR_UNLESS(getGlobalValue(context, state->globals[globalIndex]).i32
+						  == getExpectedGlobalValue(globalIndex));
+	}
+}
+
+static I64 creatorThreadEntry(void* argument)
+{
+	CreatorThreadArgs* args = (CreatorThreadArgs*)argument;
+	SharedState* state = args->state;
+
+	// Keep some contexts alive, so new context IDs are allocated while the other threads visit
+	// every context, and replace the oldest with each new context.
+	std::vector<GCPointer<Context>> liveContexts(numLiveContextsPerThread);
+	for(Uptr contextIndex = 0; contextIndex < numContextsPerThread; ++contextIndex)
+	{
+		// The globals that were initialized before the context is created must have their initial
+		// values in it.
+		const Uptr numGlobalsBefore = state->numInitializedGlobals.load(std::memory_order_acquire);
+		GCPointer<Context>& context = liveContexts[contextIndex % numLiveContextsPerThread];
+		{
+			Lock<Platform::Mutex> threadLock(state->threadMutexes[args->threadIndex]);
+			context = createContext(state->compartment);
+		}
+		WAVM_ERROR_UNLESS(context);
+		checkGlobals(state, context, numGlobalsBefore);
+
+		// The globals that were initialized while the oldest context existed must have been
+		// written to it.
+		const Uptr numGlobalsAfter = state->numInitializedGlobals.load(std::memory_order_acquire);
+		const GCPointer<Context>& oldestContext
+			= liveContexts[(contextIndex + 1) % numLiveContextsPerThread];
+		if(oldestContext) { checkGlobals(state, oldestContext, numGlobalsAfter); }
+	}
+
+	state->numRunningThreads.fetch_sub(1, std::memory_order_release);
+	return 0;
+}
+
+static I64 globalThreadEntry(void* argument)
+{
+	SharedState* state = (SharedState*)argument;
+	for(Uptr globalIndex = 0; globalIndex < numGlobals; ++globalIndex)
+	{
+		{
+			Lock<Platform::Mutex> threadLock(state->threadMutexes[numCreatorThreads]);
+			state->globals[globalIndex]
+				= createGlobal(state->compartment, GlobalType(ValueType::i32, true));
+		}
+		WAVM_ERROR_UNLESS(state->globals[globalIndex]);
+		initializeGlobal(state->globals[globalIndex],
+						 Value(getExpectedGlobalValue(globalIndex)));
+		state->numInitializedGlobals.store(globalIndex + 1, std::memory_order_release);
+		Platform::yieldToAnotherThread();
+	}
+
+	state->numRunningThreads.fetch_sub(1, std::memory_order_release);
+	return 0;
+}
+
+static I64 collectorThreadEntry(void* argument)
+{
+	SharedState* state = (SharedState*)argument;
+	while(state->numRunningThreads.load(std::memory_order_acquire))
+	{
+		for(Platform::Mutex& threadMutex : state->threadMutexes) { threadMutex.lock(); }
+		collectCompartmentGarbage(state->compartment);
+		for(Platform::Mutex& threadMutex : state->threadMutexes) { threadMutex.unlock(); }
+		Platform::yieldToAnotherThread();
+	}
+	return 0;
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	SharedState state;
+	state.compartment = createCompartment();
+
+	std::vector<Platform::Thread*> threads;
+	CreatorThreadArgs creatorThreadArgs[numCreatorThreads];
+	for(Uptr threadIndex = 0; threadIndex < numCreatorThreads; ++threadIndex)
+	{
+		creatorThreadArgs[threadIndex].state = &state;
+		creatorThreadArgs[threadIndex].threadIndex = threadIndex;
+		threads.push_back(Platform::createThread(
+			1024 * 1024, creatorThreadEntry, &creatorThreadArgs[threadIndex]));
+	}
+	threads.push_back(Platform::createThread(1024 * 1024, globalThreadEntry, &state));
+	threads.push_back(Platform::createThread(1024 * 1024, collectorThreadEntry, &state));
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	// A context created after all the globals were initialized must have all their values.
+	{
+		GCPointer<Context> context = createContext(state.compartment);
+		checkGlobals(&state, context, numGlobals);
+	}
+
+	for(GCPointer<Global>& global : state.globals) { global = nullptr; }
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(state.compartment)));
+
+	Timing::logTimer("ContextStressTest", timer);
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdint.h>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (func $square (param i32) (result i32) (i32.mul (local.get 0) (local.get 0)))\n"
+	  "  (func (export \"sumSquares\") (param $n i32) (result i32) (local $sum i32)\n"
+	  "    (block $done\n"
+	  "      (loop $l\n"
+	  "        (br_if $done (i32.eqz (local.get $n)))\n"
+	  "        (local.set $sum (i32.add (local.get $sum) (call $square (local.get $n))))\n"
+	  "        (local.set $n (i32.sub (local.get $n) (i32.const 1)))\n"
+	  "        (br $l)))\n"
+	  "    (local.get $sum))\n"
+	  "  (func (export \"spin\") (loop $l (br $l)))\n"
+	  ")";
+
+static const U64 initialFuel = 1000000;
+
+struct FuelTestInstance
+{
+	GCPointer<Compartment> compartment;
+	Context* context;
+	Function* sumSquares;
+	Function* spin;
+
+	FuelTestInstance(ModuleRef module)
+	{
+		compartment = createCompartment();
+		ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+		context = createContext(compartment);
+		sumSquares = asFunction(getInstanceExport(moduleInstance, "sumSquares"));
+		spin = asFunction(getInstanceExport(moduleInstance, "spin"));
+	}
+
+	~FuelTestInstance()
+	{
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	}
+
+	// Calls sumSquares, and returns the fuel it used.
+	U64 measureSumSquares(I32 n)
+	{
+		setContextFuel(context, initialFuel);
+		ValueTuple results = invokeFunctionChecked(context, sumSquares, {Value(n)});
+		WAVM_ERROR_UNLESS(results.size() == 1 && results[0].i32 == n * (n + 1) * (2 * n + 1) / 6);
+		const U64 remainingFuel = getContextFuel(context);
+		WAVM_ERROR_UNLESS(remainingFuel < initialFuel);
+		return initialFuel - remainingFuel;
+	}
+};
+
+// Checks that the fuel used by a call doesn't depend on how the module was compiled, and grows
+// with the number of loop iterations.
+static void testDeterministicFuel(const IR::Module& irModule)
+{
+	LLVMJIT::CompileOptions defaultOptions;
+	defaultOptions.meterFuel = true;
+
+	LLVMJIT::CompileOptions unoptimizedOptions = defaultOptions;
+	unoptimizedOptions.optLevel = LLVMJIT::OptLevel::O0;
+
+	LLVMJIT::CompileOptions optimizedOptions = defaultOptions;
+	optimizedOptions.optLevel = LLVMJIT::OptLevel::O2;
+
+	LLVMJIT::CompileOptions tieredOptions = defaultOptions;
+	tieredOptions.tiered = true;
+	tieredOptions.tierUpCallThreshold = 1;
+
+	LLVMJIT::CompileOptions lazyOptions = defaultOptions;
+	lazyOptions.lazy = true;
+
+	FuelTestInstance defaultInstance(compileModule(irModule, defaultOptions));
+	const U64 fuelFor10 = defaultInstance.measureSumSquares(10);
+	const U64 fuelFor20 = defaultInstance.measureSumSquares(20);
+	WAVM_ERROR_UNLESS(fuelFor20 > fuelFor10);
+	WAVM_ERROR_UNLESS(defaultInstance.measureSumSquares(10) == fuelFor10);
+
+	for(const LLVMJIT::CompileOptions* options :
+		{&unoptimizedOptions, &optimizedOptions, &tieredOptions, &lazyOptions})
+	{
+		FuelTestInstance instance(compileModule(irModule, *options));
+
+		// Call the function more than once, so the tiered module uses its optimized code.
+		for(Uptr callIndex = 0; callIndex < 3; ++callIndex)
+		{
+			WAVM_ERROR_UNLESS(instance.measureSumSquares(10) == fuelFor10);
+			WAVM_ERROR_UNLESS(instance.measureSumSquares(20) == fuelFor20);
+		}
+	}
+}
+
+static void testOutOfFuel(const IR::Module& irModule)
+{
+	LLVMJIT::CompileOptions compileOptions;
+	compileOptions.meterFuel = true;
+	FuelTestInstance instance(compileModule(irModule, compileOptions));
+
+	// Contexts are created with no fuel.
+	WAVM_ERROR_UNLESS(
+		catchExceptionType([&] { invokeFunctionChecked(instance.context, instance.spin, {}); })
+		== ExceptionTypes::outOfFuel);
+
+	// The out-of-fuel callback may add fuel to keep running. If it doesn't add enough, the code
+	// traps.
+	Uptr numCallbacks = 0;
+	setContextOutOfFuelCallback(instance.context, [&numCallbacks](Context* context) {
+		if(++numCallbacks < 5) { addContextFuel(context, 1000); }
+	});
+	setContextFuel(instance.context, 1000);
+	WAVM_ERROR_UNLESS(
+		catchExceptionType([&] { invokeFunctionChecked(instance.context, instance.spin, {}); })
+		== ExceptionTypes::outOfFuel);
+	WAVM_ERROR_UNLESS(numCallbacks == 5);
+
+	// addContextFuel saturates instead of overflowing.
+	setContextFuel(instance.context, UINT64_MAX);
+	addContextFuel(instance.context, UINT64_MAX);
+	WAVM_ERROR_UNLESS(getContextFuel(instance.context) == U64(INT64_MAX));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule(FeatureSpec(true));
+	parseWAST(testModuleWAST, irModule);
+
+	testDeterministicFuel(irModule);
+	testOutOfFuel(irModule);
+
+	Timing::logTimer("FuelTest", timer);
+	return 0;
+}
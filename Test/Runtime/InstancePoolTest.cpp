@@ -0,0 +1,226 @@
+#include <string.h>
+#include <utility>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+// A module with an empty memory. When an instance pool is created, its memory has no pages, so
+// on Linux the pooled copies of it are mapped from a memfd, and are reset by truncating the memfd
+// and growing it again.
+static const char* emptyMemoryModuleWAST
+	= "(module\n"
+	  "  (memory 0)\n"
+	  "  (func (export \"grow\") (param i32) (result i32) (memory.grow (local.get 0)))\n"
+	  "  (func (export \"size\") (result i32) (memory.size))\n"
+	  "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+	  "  (func (export \"store\") (param i32 i32) (i32.store (local.get 0) (local.get 1)))\n"
+	  ")";
+
+// A module with an initialized memory. When an instance pool is created, its memory becomes an
+// image that the pooled copies map copy-on-write, and they are reset with MADV_DONTNEED on Linux.
+static const char* mainModuleWAST
+	= "(module\n"
+	  "  (import \"empty\" \"grow\" (func $growEmpty (param i32) (result i32)))\n"
+	  "  (import \"empty\" \"size\" (func $sizeEmpty (result i32)))\n"
+	  "  (import \"empty\" \"load\" (func $loadEmpty (param i32) (result i32)))\n"
+	  "  (import \"empty\" \"store\" (func $storeEmpty (param i32 i32)))\n"
+	  "  (memory (export \"memory\") 1)\n"
+	  "  (data (i32.const 16) \"hello\")\n"
+	  "  (data \"passive\")\n"
+	  "  (table (export \"table\") 2 funcref)\n"
+	  "  (elem (i32.const 0) $f)\n"
+	  "  (global (export \"g\") (mut i32) (i32.const 7))\n"
+	  "  (func $f (export \"f\"))\n"
+	  "  (func (export \"growEmpty\") (param i32) (result i32) (call $growEmpty (local.get 0)))\n"
+	  "  (func (export \"sizeEmpty\") (result i32) (call $sizeEmpty))\n"
+	  "  (func (export \"loadEmpty\") (param i32) (result i32) (call $loadEmpty (local.get 0)))\n"
+	  "  (func (export \"grow\") (param i32) (result i32) (memory.grow (local.get 0)))\n"
+	  "  (func $initPassive (export \"initPassive\")\n"
+	  "    (memory.init 1 (i32.const 1024) (i32.const 0) (i32.const 7))\n"
+	  "    (data.drop 1))\n"
+	  "  (func (export \"dirty\")\n"
+	  "    (i32.store (i32.const 16) (i32.const -1))\n"
+	  "    (i32.store (i32.const 12288) (i32.const 1))\n"
+	  "    (drop (memory.grow (i32.const 1)))\n"
+	  "    (i32.store (i32.const 65544) (i32.const 2))\n"
+	  "    (call $initPassive)\n"
+	  "    (table.set (i32.const 1) (ref.func $f))\n"
+	  "    (drop (table.grow (ref.func $f) (i32.const 1)))\n"
+	  "    (global.set 0 (i32.const 9))\n"
+	  "    (drop (call $growEmpty (i32.const 1)))\n"
+	  "    (call $storeEmpty (i32.const 100) (i32.const 42)))\n"
+	  ")";
+
+static ModuleInstance* instantiateTestModules(Compartment* compartment,
+											  ModuleRef emptyMemoryModule,
+											  ModuleRef mainModule)
+{
+	ModuleInstance* emptyMemoryInstance
+		= instantiateModule(compartment, emptyMemoryModule, {}, "empty");
+	return instantiateModule(compartment,
+							 mainModule,
+							 {getInstanceExport(emptyMemoryInstance, "grow"),
+							  getInstanceExport(emptyMemoryInstance, "size"),
+							  getInstanceExport(emptyMemoryInstance, "load"),
+							  getInstanceExport(emptyMemoryInstance, "store")},
+							 "main");
+}
+
+static ValueTuple invokeExport(Context* context,
+							   ModuleInstance* moduleInstance,
+							   const char* name,
+							   const std::vector<Value>& arguments = {})
+{
+	return invokeFunctionChecked(
+		context, asFunction(getInstanceExport(moduleInstance, name)), arguments);
+}
+
+static I32 invokeI32Export(Context* context,
+						   ModuleInstance* moduleInstance,
+						   const char* name,
+						   const std::vector<Value>& arguments = {})
+{
+	ValueTuple results = invokeExport(context, moduleInstance, name, arguments);
+	WAVM_ERROR_UNLESS(results.size() == 1 && results[0].type == ValueType::i32);
+	return results[0].i32;
+}
+
+// Checks that the memories, table, and global of two instances of the test modules are equal.
+static void checkStateMatches(Context* context,
+							  ModuleInstance* moduleInstance,
+							  Context* expectedContext,
+							  ModuleInstance* expectedModuleInstance)
+{
+	Memory* memory = asMemory(getInstanceExport(moduleInstance, "memory"));
+	Memory* expectedMemory = asMemory(getInstanceExport(expectedModuleInstance, "memory"));
+	const Uptr numPages = getMemoryNumPages(memory);
+	WAVM_ERROR_UNLESS(numPages == getMemoryNumPages(expectedMemory));
+	WAVM_ERROR_UNLESS(!memcmp(getMemoryBaseAddress(memory),
+							  getMemoryBaseAddress(expectedMemory),
+							  numPages * IR::numBytesPerPage));
+
+	// The tables' elements are functions in different compartments, so check that each element is
+	// the same export of its instance.
+	Table* table = asTable(getInstanceExport(moduleInstance, "table"));
+	Table* expectedTable = asTable(getInstanceExport(expectedModuleInstance, "table"));
+	Object* f = getInstanceExport(moduleInstance, "f");
+	Object* expectedF = getInstanceExport(expectedModuleInstance, "f");
+	const Uptr numElements = getTableNumElements(table);
+	WAVM_ERROR_UNLESS(numElements == getTableNumElements(expectedTable));
+	for(Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex)
+	{
+		Object* element = getTableElement(table, elementIndex);
+		Object* expectedElement = getTableElement(expectedTable, elementIndex);
+		WAVM_ERROR_UNLESS(!element == !expectedElement);
+		WAVM_ERROR_UNLESS((element == f) == (expectedElement == expectedF));
+	}
+
+	Global* global = asGlobal(getInstanceExport(moduleInstance, "g"));
+	Global* expectedGlobal = asGlobal(getInstanceExport(expectedModuleInstance, "g"));
+	WAVM_ERROR_UNLESS(getGlobalValue(context, global).i32
+					  == getGlobalValue(expectedContext, expectedGlobal).i32);
+
+	// The empty memory isn't exported, so check it with the functions that access it.
+	const I32 numEmptyMemoryPages = invokeI32Export(context, moduleInstance, "sizeEmpty");
+	WAVM_ERROR_UNLESS(numEmptyMemoryPages
+					  == invokeI32Export(expectedContext, expectedModuleInstance, "sizeEmpty"));
+	if(numEmptyMemoryPages)
+	{
+		const std::vector<Value> arguments = {Value(I32(100))};
+		WAVM_ERROR_UNLESS(
+			invokeI32Export(context, moduleInstance, "loadEmpty", arguments)
+			== invokeI32Export(expectedContext, expectedModuleInstance, "loadEmpty", arguments));
+	}
+}
+
+// Checks that a pooled instance matches a fresh instance of the test modules, and that the pages
+// it gains by growing its memories are zeroed.
+static void checkMatchesFreshInstance(Context* context,
+									  ModuleInstance* moduleInstance,
+									  ModuleRef emptyMemoryModule,
+									  ModuleRef mainModule)
+{
+	GCPointer<Compartment> freshCompartment = createCompartment();
+	ModuleInstance* freshModuleInstance
+		= instantiateTestModules(freshCompartment, emptyMemoryModule, mainModule);
+	Context* freshContext = createContext(freshCompartment);
+
+	checkStateMatches(context, moduleInstance, freshContext, freshModuleInstance);
+
+	auto growAndInitPassive = [](Context* growContext, ModuleInstance* growModuleInstance) {
+		WAVM_ERROR_UNLESS(
+			invokeI32Export(growContext, growModuleInstance, "grow", {Value(I32(1))}) == 1);
+		WAVM_ERROR_UNLESS(
+			invokeI32Export(growContext, growModuleInstance, "growEmpty", {Value(I32(1))}) == 0);
+
+		// The passive data segment must not have been dropped.
+		invokeExport(growContext, growModuleInstance, "initPassive");
+	};
+	growAndInitPassive(context, moduleInstance);
+	growAndInitPassive(freshContext, freshModuleInstance);
+	checkStateMatches(context, moduleInstance, freshContext, freshModuleInstance);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(freshCompartment)));
+}
+
+static void testResetPooledInstance()
+{
+	IR::Module emptyMemoryIRModule(FeatureSpec(true));
+	parseWAST(emptyMemoryModuleWAST, emptyMemoryIRModule);
+	ModuleRef emptyMemoryModule = compileModule(emptyMemoryIRModule);
+
+	IR::Module mainIRModule(FeatureSpec(true));
+	parseWAST(mainModuleWAST, mainIRModule);
+	ModuleRef mainModule = compileModule(mainIRModule);
+
+	GCPointer<Compartment> compartment = createCompartment();
+	ModuleInstance* moduleInstance
+		= instantiateTestModules(compartment, emptyMemoryModule, mainModule);
+	Context* context = createContext(compartment);
+	InstancePool* pool = createInstancePool(moduleInstance, context, 1);
+
+	// Change every kind of state that is reset, and check the change was made.
+	Context* pooledContext = nullptr;
+	ModuleInstance* pooledModuleInstance = acquirePooledInstance(pool, pooledContext);
+	invokeExport(pooledContext, pooledModuleInstance, "dirty");
+	WAVM_ERROR_UNLESS(
+		getGlobalValue(pooledContext, asGlobal(getInstanceExport(pooledModuleInstance, "g"))).i32
+		== 9);
+	WAVM_ERROR_UNLESS(invokeI32Export(pooledContext, pooledModuleInstance, "sizeEmpty") == 1);
+	releasePooledInstance(pool, pooledModuleInstance);
+
+	// The pool only has one instance, so acquiring an instance gets the same one back. Check it
+	// twice, since checking it grows its memories.
+	for(Uptr acquireIndex = 0; acquireIndex < 2; ++acquireIndex)
+	{
+		Context* reacquiredContext = nullptr;
+		WAVM_ERROR_UNLESS(acquirePooledInstance(pool, reacquiredContext) == pooledModuleInstance);
+		WAVM_ERROR_UNLESS(reacquiredContext == pooledContext);
+		checkMatchesFreshInstance(
+			pooledContext, pooledModuleInstance, emptyMemoryModule, mainModule);
+		releasePooledInstance(pool, pooledModuleInstance);
+	}
+
+	destroyInstancePool(pool);
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testResetPooledInstance();
+	Timing::logTimer("InstancePoolTest", timer);
+	return 0;
+}
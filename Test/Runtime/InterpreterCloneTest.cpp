@@ -0,0 +1,87 @@
+#include <utility>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (import \"env\" \"ref\" (global $ref anyref))\n"
+	  "  (global $i64 i64 (i64.const 0x123456789abcdef))\n"
+	  "  (global $f64 f64 (f64.const 1.5))\n"
+	  "  (global $func funcref (ref.func $getI64))\n"
+	  "  (global $mut (mut i32) (i32.const 7))\n"
+	  "  (func $getI64 (export \"getI64\") (result i64) (global.get $i64))\n"
+	  "  (func (export \"getF64\") (result f64) (global.get $f64))\n"
+	  "  (func (export \"getFunc\") (result funcref) (global.get $func))\n"
+	  "  (func (export \"getRef\") (result anyref) (global.get $ref))\n"
+	  "  (func (export \"getMut\") (result i32) (global.get $mut))\n"
+	  "  (func (export \"setMut\") (param i32) (global.set $mut (local.get 0)))\n"
+	  ")";
+
+static Value invokeExport(Context* context, ModuleInstance* moduleInstance, const char* name)
+{
+	Function* function = asFunction(getInstanceExport(moduleInstance, name));
+	ValueTuple results = invokeFunctionChecked(context, function, {});
+	WAVM_ERROR_UNLESS(results.size() == 1);
+	return results[0];
+}
+
+// The clones of an interpreted module instance share its translated code with the original, so
+// check that a clone still reads the right global values after the original is freed.
+static void testCloneOutlivesOriginal()
+{
+	IR::Module irModule(FeatureSpec(true));
+	parseWAST(testModuleWAST, irModule);
+	ModuleRef module = createInterpretedModule(irModule);
+	WAVM_ERROR_UNLESS(module);
+
+	GCPointer<Compartment> compartment = createCompartment();
+	Table* table = createTable(
+		compartment, TableType(ReferenceType::anyref, false, SizeConstraints{1, 1}), nullptr, "t");
+	Global* refGlobal = createGlobal(compartment, GlobalType(ValueType::anyref, false));
+	initializeGlobal(refGlobal, Value(asObject(table)));
+	ModuleInstance* moduleInstance
+		= instantiateModule(compartment, module, {asObject(refGlobal)}, "test");
+	Context* context = createContext(compartment);
+	invokeFunctionChecked(
+		context, asFunction(getInstanceExport(moduleInstance, "setMut")), {Value(I32(9))});
+
+	GCPointer<Compartment> clonedCompartment = cloneCompartment(compartment);
+	ModuleInstance* clonedInstance = remapToClonedCompartment(moduleInstance, clonedCompartment);
+	Table* clonedTable = remapToClonedCompartment(table, clonedCompartment);
+	Context* clonedContext = cloneContext(context, clonedCompartment);
+	WAVM_ERROR_UNLESS(clonedTable && clonedTable != table);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+
+	WAVM_ERROR_UNLESS(invokeExport(clonedContext, clonedInstance, "getI64").i64
+					  == 0x123456789abcdef);
+	WAVM_ERROR_UNLESS(invokeExport(clonedContext, clonedInstance, "getF64").f64 == 1.5);
+	WAVM_ERROR_UNLESS(invokeExport(clonedContext, clonedInstance, "getFunc").function
+					  == asFunction(getInstanceExport(clonedInstance, "getI64")));
+	WAVM_ERROR_UNLESS(invokeExport(clonedContext, clonedInstance, "getRef").object
+					  == asObject(clonedTable));
+	WAVM_ERROR_UNLESS(invokeExport(clonedContext, clonedInstance, "getMut").i32 == 9);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testCloneOutlivesOriginal();
+	Timing::logTimer("InterpreterCloneTest", timer);
+	return 0;
+}
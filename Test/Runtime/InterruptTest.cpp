@@ -0,0 +1,114 @@
+#include <atomic>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (func $nop)\n"
+	  "  (func (export \"spin\") (loop $l (br $l)))\n"
+	  "  (func (export \"spinCalling\") (loop $l (call $nop) (br $l)))\n"
+	  "  (func (export \"add\") (param i32 i32) (result i32)\n"
+	  "    (i32.add (local.get 0) (local.get 1)))\n"
+	  ")";
+
+struct InterrupterState
+{
+	Context* context;
+	std::atomic<bool> isDone{false};
+};
+
+// Interrupts the context until the test is done. Code that was running when the context was
+// interrupted traps, and so does the next call if no code was running.
+static I64 interrupterThreadEntry(void* stateVoid)
+{
+	InterrupterState* state = (InterrupterState*)stateVoid;
+	while(!state->isDone.load(std::memory_order_acquire))
+	{
+		interruptContext(state->context);
+		Platform::yieldToAnotherThread();
+	}
+	return 0;
+}
+
+static void testInterruptRunningCode(Context* context,
+									 ModuleInstance* moduleInstance,
+									 const char* exportName)
+{
+	Function* function = asFunction(getInstanceExport(moduleInstance, exportName));
+
+	InterrupterState state;
+	state.context = context;
+	Platform::Thread* interrupterThread
+		= Platform::createThread(1024 * 1024, interrupterThreadEntry, &state);
+	const Runtime::ExceptionType* exceptionType
+		= catchExceptionType([&] { invokeFunctionChecked(context, function, {}); });
+	state.isDone.store(true, std::memory_order_release);
+	Platform::joinThread(interrupterThread);
+
+	WAVM_ERROR_UNLESS(exceptionType == ExceptionTypes::interrupted);
+}
+
+static void testInterruptBeforeCall(Context* context, ModuleInstance* moduleInstance)
+{
+	Function* addFunction = asFunction(getInstanceExport(moduleInstance, "add"));
+
+	// An interrupt requested while no code is running makes the next call trap.
+	interruptContext(context);
+	WAVM_ERROR_UNLESS(catchExceptionType([&] {
+						  invokeFunctionChecked(context, addFunction, {Value(I32(1)), Value(I32(2))});
+					  })
+					  == ExceptionTypes::interrupted);
+
+	// The trap clears the request, so the call after it runs normally.
+	ValueTuple results
+		= invokeFunctionChecked(context, addFunction, {Value(I32(1)), Value(I32(2))});
+	WAVM_ERROR_UNLESS(results.size() == 1 && results[0].i32 == 3);
+}
+
+static void testInterrupts(ModuleRef module)
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+	Context* context = createContext(compartment);
+
+	testInterruptRunningCode(context, moduleInstance, "spin");
+	testInterruptRunningCode(context, moduleInstance, "spinCalling");
+	testInterruptBeforeCall(context, moduleInstance);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	IR::Module irModule(FeatureSpec(true));
+	parseWAST(testModuleWAST, irModule);
+
+	// Test code compiled with CompileOptions::interruptible.
+	LLVMJIT::CompileOptions compileOptions;
+	compileOptions.interruptible = true;
+	testInterrupts(compileModule(irModule, compileOptions));
+
+	// The interpreter always checks for interrupts.
+	ModuleRef interpretedModule = createInterpretedModule(irModule);
+	WAVM_ERROR_UNLESS(interpretedModule);
+	testInterrupts(interpretedModule);
+
+	Timing::logTimer("InterruptTest", timer);
+	return 0;
+}
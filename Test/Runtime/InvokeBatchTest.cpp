@@ -0,0 +1,111 @@
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (func (export \"div\") (param i32 i32) (result i32)\n"
+	  "    (i32.div_s (local.get 0) (local.get 1)))\n"
+	  "  (func (export \"add\") (param i64 f64) (result f64)\n"
+	  "    (f64.add (f64.convert_i64_s (local.get 0)) (local.get 1)))\n"
+	  ")";
+
+static void testBatchWithoutTraps(Context* context, ModuleInstance* moduleInstance)
+{
+	Function* addFunction = asFunction(getInstanceExport(moduleInstance, "add"));
+
+	enum
+	{
+		numRows = 100
+	};
+	std::vector<UntaggedValue> argRows;
+	for(Uptr rowIndex = 0; rowIndex < numRows; ++rowIndex)
+	{
+		argRows.push_back(I64(rowIndex));
+		argRows.push_back(F64(rowIndex) * 0.5);
+	}
+	std::vector<UntaggedValue> resultRows(numRows);
+
+	WAVM_ERROR_UNLESS(
+		invokeFunctionBatch(context, addFunction, argRows.data(), numRows, resultRows.data())
+		== numRows);
+	for(Uptr rowIndex = 0; rowIndex < numRows; ++rowIndex)
+	{ WAVM_ERROR_UNLESS(resultRows[rowIndex].f64 == F64(rowIndex) * 1.5); }
+}
+
+static void testBatchWithTrappingRow(Context* context, ModuleInstance* moduleInstance)
+{
+	Function* divFunction = asFunction(getInstanceExport(moduleInstance, "div"));
+
+	// Row 3 divides by zero, so it should trap, and rows 4 and 5 shouldn't be invoked.
+	const I32 dividends[] = {10, 9, -8, 7, 6, 5};
+	const I32 divisors[] = {2, 3, 4, 0, 1, 1};
+	const Uptr numRows = 6;
+	const Uptr trappingRowIndex = 3;
+
+	std::vector<UntaggedValue> argRows;
+	for(Uptr rowIndex = 0; rowIndex < numRows; ++rowIndex)
+	{
+		argRows.push_back(dividends[rowIndex]);
+		argRows.push_back(divisors[rowIndex]);
+	}
+	std::vector<UntaggedValue> resultRows(numRows, UntaggedValue(I32(-1)));
+
+	Exception* exception = nullptr;
+	WAVM_ERROR_UNLESS(invokeFunctionBatch(
+						  context, divFunction, argRows.data(), numRows, resultRows.data(), &exception)
+					  == trappingRowIndex);
+	WAVM_ERROR_UNLESS(exception);
+	WAVM_ERROR_UNLESS(getExceptionType(exception)
+					  == ExceptionTypes::integerDivideByZeroOrOverflow);
+	destroyException(exception);
+
+	// The rows before the trapping row must have their results.
+	for(Uptr rowIndex = 0; rowIndex < trappingRowIndex; ++rowIndex)
+	{ WAVM_ERROR_UNLESS(resultRows[rowIndex].i32 == dividends[rowIndex] / divisors[rowIndex]); }
+
+	// The rows after the trapping row must not have been written.
+	for(Uptr rowIndex = trappingRowIndex + 1; rowIndex < numRows; ++rowIndex)
+	{ WAVM_ERROR_UNLESS(resultRows[rowIndex].i32 == -1); }
+
+	// Without outException, the exception is destroyed, but the trapping row is still returned.
+	WAVM_ERROR_UNLESS(
+		invokeFunctionBatch(context, divFunction, argRows.data(), numRows, resultRows.data())
+		== trappingRowIndex);
+
+	// A batch that starts at the trapping row traps on its first row.
+	WAVM_ERROR_UNLESS(invokeFunctionBatch(context,
+										  divFunction,
+										  argRows.data() + trappingRowIndex * 2,
+										  numRows - trappingRowIndex,
+										  resultRows.data())
+					  == 0);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	GCPointer<Compartment> compartment = createCompartment();
+	ModuleRef module = compileWAST(testModuleWAST);
+	ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+	Context* context = createContext(compartment);
+
+	testBatchWithoutTraps(context, moduleInstance);
+	testBatchWithTrappingRow(context, moduleInstance);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+
+	Timing::logTimer("InvokeBatchTest", timer);
+	return 0;
+}
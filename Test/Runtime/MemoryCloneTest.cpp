@@ -0,0 +1,174 @@
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// A memory, and a copy of the contents it should have.
+struct TestMemory
+{
+	Memory* memory;
+	std::vector<U8> expectedContents;
+};
+
+static void writeByte(TestMemory& testMemory, Uptr offset, U8 value)
+{
+	memoryRef<U8>(testMemory.memory, offset) = value;
+	testMemory.expectedContents[offset] = value;
+}
+
+static void growTestMemory(TestMemory& testMemory, Uptr numPages)
+{
+	WAVM_ERROR_UNLESS(growMemory(testMemory.memory, numPages));
+	testMemory.expectedContents.resize(getMemoryNumPages(testMemory.memory) * numBytesPerPage);
+}
+
+static void checkContents(const TestMemory& testMemory)
+{
+	WAVM_ERROR_UNLESS(getMemoryNumPages(testMemory.memory) * numBytesPerPage
+					  == testMemory.expectedContents.size());
+	WAVM_ERROR_UNLESS(!memcmp(getMemoryBaseAddress(testMemory.memory),
+							  testMemory.expectedContents.data(),
+							  testMemory.expectedContents.size()));
+}
+
+static TestMemory cloneTestMemory(const TestMemory& testMemory, Compartment* clonedCompartment)
+{
+	TestMemory clonedTestMemory;
+	clonedTestMemory.memory = remapToClonedCompartment(testMemory.memory, clonedCompartment);
+	clonedTestMemory.expectedContents = testMemory.expectedContents;
+	WAVM_ERROR_UNLESS(clonedTestMemory.memory && clonedTestMemory.memory != testMemory.memory);
+	return clonedTestMemory;
+}
+
+// On Linux, a memory's pages are mapped from a memfd, which becomes an image that the memory and
+// its clones map copy-on-write when it is first cloned. Check that writes to a memory or its
+// clones, and the pages they gain by growing, are never visible in the other memories.
+static void testCloneCopyOnWrite()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	TestMemory original;
+	original.memory = createMemory(compartment, MemoryType(false, SizeConstraints{2, 16}), "mem");
+	WAVM_ERROR_UNLESS(original.memory);
+	original.expectedContents.resize(2 * numBytesPerPage);
+	writeByte(original, 0, 1);
+	writeByte(original, 5000, 2);
+	writeByte(original, numBytesPerPage + 100, 3);
+	checkContents(original);
+
+	// The first clone turns the original's pages into an image.
+	GCPointer<Compartment> clonedCompartment = cloneCompartment(compartment);
+	TestMemory clone = cloneTestMemory(original, clonedCompartment);
+	checkContents(clone);
+
+	// Writes to pages that are shared with the image are private to the memory that writes them.
+	writeByte(original, 0, 10);
+	writeByte(clone, 5000, 20);
+	writeByte(clone, 8000, 21);
+	checkContents(original);
+	checkContents(clone);
+
+	// Pages past the end of the image are private to each memory, and zeroed.
+	growTestMemory(original, 1);
+	growTestMemory(clone, 2);
+	writeByte(original, 2 * numBytesPerPage + 1, 30);
+	writeByte(clone, 2 * numBytesPerPage + 1, 40);
+	writeByte(clone, 3 * numBytesPerPage + 2, 41);
+	checkContents(original);
+	checkContents(clone);
+
+	// Cloning a memory that already maps an image shares the same image, and copies the pages that
+	// differ from it and the pages past its end.
+	GCPointer<Compartment> secondClonedCompartment = cloneCompartment(clonedCompartment);
+	TestMemory secondClone = cloneTestMemory(clone, secondClonedCompartment);
+	checkContents(secondClone);
+	writeByte(secondClone, 1, 50);
+	writeByte(secondClone, 5000, 51);
+	writeByte(secondClone, 3 * numBytesPerPage + 2, 52);
+	writeByte(clone, 3 * numBytesPerPage + 3, 42);
+	checkContents(original);
+	checkContents(clone);
+	checkContents(secondClone);
+
+	// The image must outlive the memory it was created from.
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	checkContents(clone);
+	checkContents(secondClone);
+	writeByte(clone, 0, 60);
+	checkContents(clone);
+	checkContents(secondClone);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartment)));
+	checkContents(secondClone);
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(secondClonedCompartment)));
+}
+
+// A memory with no pages doesn't have an image when it is cloned, so check that the clone can
+// grow independently of the original.
+static void testCloneEmptyMemory()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	TestMemory original;
+	original.memory = createMemory(compartment, MemoryType(false, SizeConstraints{0, 16}), "mem");
+	WAVM_ERROR_UNLESS(original.memory);
+
+	GCPointer<Compartment> clonedCompartment = cloneCompartment(compartment);
+	TestMemory clone = cloneTestMemory(original, clonedCompartment);
+	checkContents(clone);
+
+	growTestMemory(original, 1);
+	growTestMemory(clone, 1);
+	writeByte(original, 100, 1);
+	writeByte(clone, 100, 2);
+	checkContents(original);
+	checkContents(clone);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartment)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// A memory that uses huge pages may be backed by anonymous pages instead of a memfd, so check that
+// it is cloned by copying its pages.
+static void testCloneHugePageMemory()
+{
+	GCPointer<Compartment> compartment = createCompartment();
+	setCompartmentHugePages(compartment, true);
+	TestMemory original;
+	original.memory = createMemory(compartment, MemoryType(false, SizeConstraints{2, 16}), "mem");
+	WAVM_ERROR_UNLESS(original.memory);
+	original.expectedContents.resize(2 * numBytesPerPage);
+	writeByte(original, 0, 1);
+	writeByte(original, numBytesPerPage + 100, 2);
+
+	GCPointer<Compartment> clonedCompartment = cloneCompartment(compartment);
+	TestMemory clone = cloneTestMemory(original, clonedCompartment);
+	checkContents(clone);
+
+	writeByte(original, 0, 10);
+	writeByte(clone, numBytesPerPage + 100, 20);
+	growTestMemory(clone, 1);
+	writeByte(clone, 2 * numBytesPerPage, 21);
+	checkContents(original);
+	checkContents(clone);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartment)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testCloneCopyOnWrite();
+	testCloneEmptyMemory();
+	testCloneHugePageMemory();
+	Timing::logTimer("MemoryCloneTest", timer);
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/I128.h"
+#include "WAVM/Inline/Time.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Clock.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/VFS/VFS.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* cachePath = "ObjectCacheTest.cache";
+static const char* scratchCachePath = "ObjectCacheTest.scratch";
+static constexpr U64 unlimitedCacheBytes = U64(1024) * 1024 * 1024;
+
+struct CacheEntry
+{
+	std::string path;
+	VFS::FileInfo fileInfo;
+};
+
+// Lists the entries in an object cache directory, sorted by path.
+static std::vector<CacheEntry> getCacheEntries(const char* directoryPath)
+{
+	VFS::FileSystem& hostFS = Platform::getHostFS();
+	std::vector<CacheEntry> entries;
+
+	VFS::DirEntStream* dirEntStream = nullptr;
+	WAVM_ERROR_UNLESS(hostFS.openDir(directoryPath, dirEntStream) == VFS::Result::success);
+	VFS::DirEnt dirEnt;
+	while(dirEntStream->getNext(dirEnt))
+	{
+		CacheEntry entry;
+		entry.path = std::string(directoryPath) + '/' + dirEnt.name;
+		WAVM_ERROR_UNLESS(hostFS.getFileInfo(entry.path, entry.fileInfo) == VFS::Result::success);
+		if(entry.fileInfo.type == VFS::FileType::file) { entries.push_back(std::move(entry)); }
+	}
+	dirEntStream->close();
+
+	std::sort(entries.begin(), entries.end(), [](const CacheEntry& left, const CacheEntry& right) {
+		return left.path < right.path;
+	});
+	return entries;
+}
+
+// Deletes an object cache directory and its entries, if it exists.
+static void removeCacheDirectory(const char* directoryPath)
+{
+	VFS::FileSystem& hostFS = Platform::getHostFS();
+	VFS::FileInfo fileInfo;
+	if(hostFS.getFileInfo(directoryPath, fileInfo) != VFS::Result::success) { return; }
+
+	for(const CacheEntry& entry : getCacheEntries(directoryPath))
+	{ WAVM_ERROR_UNLESS(hostFS.unlinkFile(entry.path) == VFS::Result::success); }
+	WAVM_ERROR_UNLESS(hostFS.removeDir(directoryPath) == VFS::Result::success);
+}
+
+// Sets the last write time of a cache entry, which the cache uses to find the least recently used
+// entries, to some number of seconds ago.
+static void setCacheEntryAge(const CacheEntry& entry, I64 ageSeconds)
+{
+	const Time now = Platform::getClockTime(Platform::Clock::realtime);
+	const Time lastWriteTime{now.ns - I128(ageSeconds) * I128(I64(1000000000))};
+	WAVM_ERROR_UNLESS(Platform::getHostFS().setFileTimes(
+						  entry.path, false, Time(), true, lastWriteTime)
+					  == VFS::Result::success);
+}
+
+// Compiles a module whose function returns value, and checks that the compiled code, which may
+// have been loaded from the cache, returns it.
+static void compileTestModule(I32 value,
+							  const LLVMJIT::CompileOptions& compileOptions
+							  = LLVMJIT::CompileOptions())
+{
+	const std::string wast = "(module (func (export \"f\") (result i32) (i32.const "
+							 + std::to_string(value) + ")))";
+	ModuleRef module = compileWAST(wast.c_str(), compileOptions);
+
+	GCPointer<Compartment> compartment = createCompartment();
+	ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+	Context* context = createContext(compartment);
+	ValueTuple results = invokeFunctionChecked(
+		context, asFunction(getInstanceExport(moduleInstance, "f")), {});
+	WAVM_ERROR_UNLESS(results.size() == 1 && results[0].i32 == value);
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// Checks that compiling a module the first time adds an entry to the cache, and compiling it again
+// loads the entry without rewriting it.
+static void testHitAndMiss()
+{
+	WAVM_ERROR_UNLESS(enableObjectCache(cachePath, unlimitedCacheBytes));
+	WAVM_ERROR_UNLESS(getCacheEntries(cachePath).empty());
+
+	compileTestModule(1);
+	std::vector<CacheEntry> entries = getCacheEntries(cachePath);
+	WAVM_ERROR_UNLESS(entries.size() == 1);
+	const CacheEntry missEntry = entries[0];
+
+	// A hit marks the entry as recently used by updating its last write time, but doesn't replace
+	// the file like a miss that compiles and saves the module again would.
+	setCacheEntryAge(missEntry, 60 * 60);
+	const Time hitTime = Platform::getClockTime(Platform::Clock::realtime);
+	compileTestModule(1);
+	entries = getCacheEntries(cachePath);
+	WAVM_ERROR_UNLESS(entries.size() == 1);
+	WAVM_ERROR_UNLESS(entries[0].path == missEntry.path);
+	WAVM_ERROR_UNLESS(entries[0].fileInfo.fileNumber == missEntry.fileInfo.fileNumber);
+	const I128 halfHourNs = I128(I64(30 * 60)) * I128(I64(1000000000));
+	WAVM_ERROR_UNLESS(entries[0].fileInfo.lastWriteTime.ns > hitTime.ns - halfHourNs);
+
+	// A different module is a miss.
+	compileTestModule(2);
+	WAVM_ERROR_UNLESS(getCacheEntries(cachePath).size() == 2);
+
+	disableObjectCache();
+	removeCacheDirectory(cachePath);
+}
+
+// Checks that changing any of several compile options changes the module's cache key, so the
+// module is compiled again instead of loading the object code compiled with other options.
+static void testCompileOptionsChangeKey()
+{
+	WAVM_ERROR_UNLESS(enableObjectCache(cachePath, unlimitedCacheBytes));
+
+	LLVMJIT::CompileOptions optimizedOptions;
+	optimizedOptions.optLevel = LLVMJIT::OptLevel::O2;
+	LLVMJIT::CompileOptions interruptibleOptions;
+	interruptibleOptions.interruptible = true;
+	LLVMJIT::CompileOptions boundsCheckedOptions;
+	boundsCheckedOptions.boundsCheckMemories = true;
+	const LLVMJIT::CompileOptions optionVariants[]
+		= {LLVMJIT::CompileOptions(), optimizedOptions, interruptibleOptions, boundsCheckedOptions};
+
+	Uptr numExpectedEntries = 0;
+	for(const LLVMJIT::CompileOptions& compileOptions : optionVariants)
+	{
+		compileTestModule(1, compileOptions);
+		WAVM_ERROR_UNLESS(getCacheEntries(cachePath).size() == ++numExpectedEntries);
+	}
+
+	// Compiling with each of the options again hits the entries that were already added.
+	for(const LLVMJIT::CompileOptions& compileOptions : optionVariants)
+	{
+		compileTestModule(1, compileOptions);
+		WAVM_ERROR_UNLESS(getCacheEntries(cachePath).size() == numExpectedEntries);
+	}
+
+	disableObjectCache();
+	removeCacheDirectory(cachePath);
+}
+
+// Checks that when adding an entry makes the cache exceed its size limit, the least recently used
+// entries are evicted, where a hit counts as a use.
+static void testLRUEviction()
+{
+	// Find the size of the entry for the module that will be added last.
+	WAVM_ERROR_UNLESS(enableObjectCache(scratchCachePath, unlimitedCacheBytes));
+	compileTestModule(3);
+	const std::vector<CacheEntry> scratchEntries = getCacheEntries(scratchCachePath);
+	WAVM_ERROR_UNLESS(scratchEntries.size() == 1);
+	const U64 lastEntryNumBytes = scratchEntries[0].fileInfo.numBytes;
+	removeCacheDirectory(scratchCachePath);
+
+	// Add two entries, and make the first one less recently used than the second.
+	WAVM_ERROR_UNLESS(enableObjectCache(cachePath, unlimitedCacheBytes));
+	compileTestModule(1);
+	const CacheEntry firstEntry = getCacheEntries(cachePath)[0];
+	compileTestModule(2);
+	std::vector<CacheEntry> entries = getCacheEntries(cachePath);
+	WAVM_ERROR_UNLESS(entries.size() == 2);
+	const CacheEntry secondEntry = entries[0].path == firstEntry.path ? entries[1] : entries[0];
+	setCacheEntryAge(firstEntry, 2 * 60 * 60);
+	setCacheEntryAge(secondEntry, 60 * 60);
+
+	// Using the first entry makes the second the least recently used.
+	compileTestModule(1);
+
+	// Limit the cache to the first entry and the one that will be added, and add it, which must
+	// evict only the second entry.
+	WAVM_ERROR_UNLESS(
+		enableObjectCache(cachePath, firstEntry.fileInfo.numBytes + lastEntryNumBytes));
+	compileTestModule(3);
+	entries = getCacheEntries(cachePath);
+	WAVM_ERROR_UNLESS(entries.size() == 2);
+	WAVM_ERROR_UNLESS(entries[0].path != secondEntry.path && entries[1].path != secondEntry.path);
+	WAVM_ERROR_UNLESS(entries[0].path == firstEntry.path || entries[1].path == firstEntry.path);
+
+	disableObjectCache();
+	removeCacheDirectory(cachePath);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	// Start with empty caches, in case an earlier run failed before it deleted them.
+	removeCacheDirectory(cachePath);
+	removeCacheDirectory(scratchCachePath);
+
+	testHitAndMiss();
+	testCompileOptionsChangeKey();
+	testLRUEviction();
+
+	Timing::logTimer("ObjectCacheTest", timer);
+	return 0;
+}
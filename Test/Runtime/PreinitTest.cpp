@@ -0,0 +1,196 @@
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Serialization.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASM/WASM.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+// A module whose start function and init function change its memory and globals. The init
+// function overwrites the start of the data segment with zeroes, and writes values far enough
+// apart that they are written to the pre-initialized module as separate data segments.
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (memory (export \"memory\") 1 4)\n"
+	  "  (data (i32.const 0) \"data segment\")\n"
+	  "  (table 1 funcref)\n"
+	  "  (elem (i32.const 0) $start)\n"
+	  "  (global $g (export \"g\") (mut i32) (i32.const 1))\n"
+	  "  (global $h (export \"h\") (mut i64) (i64.const 0))\n"
+	  "  (global $unchanged (export \"unchanged\") (mut f32) (f32.const 1.5))\n"
+	  "  (func $start\n"
+	  "    (global.set $g (i32.add (global.get $g) (i32.const 1)))\n"
+	  "    (i32.store (i32.const 100) (i32.const 0x12345678)))\n"
+	  "  (start $start)\n"
+	  "  (func (export \"init\")\n"
+	  "    (drop (memory.grow (i32.const 1)))\n"
+	  "    (i32.store (i32.const 65540) (i32.const 0x9abc))\n"
+	  "    (i32.store (i32.const 0) (i32.const 0))\n"
+	  "    (global.set $h (i64.const 7)))\n"
+	  "  (func (export \"getG\") (result i32) (global.get $g))\n"
+	  ")";
+
+// Instantiates a module in a new compartment, and runs its start function and the named function.
+struct TestInstance
+{
+	GCPointer<Compartment> compartment;
+	ModuleInstance* moduleInstance;
+	Context* context;
+
+	TestInstance(const IR::Module& irModule, const char* initExportName)
+	{
+		compartment = createCompartment();
+		moduleInstance = instantiateModule(compartment, compileModule(irModule), {}, "test");
+		context = createContext(compartment);
+
+		Function* startFunction = getStartFunction(moduleInstance);
+		if(startFunction) { invokeFunctionChecked(context, startFunction, {}); }
+		if(initExportName)
+		{
+			invokeFunctionChecked(
+				context, asFunction(getInstanceExport(moduleInstance, initExportName)), {});
+		}
+	}
+
+	~TestInstance() { WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment))); }
+
+	Value getGlobalExportValue(const char* name)
+	{
+		return getGlobalValue(context, asGlobal(getInstanceExport(moduleInstance, name)));
+	}
+};
+
+// Checks that instantiating the pre-initialized module produces the same memory and globals as
+// instantiating the original module and running its initialization.
+static void testPreinitMatchesInitialization()
+{
+	IR::Module irModule(FeatureSpec(true));
+	parseWAST(testModuleWAST, irModule);
+
+	IR::Module preinitializedIRModule = irModule;
+	std::string preinitError;
+	if(!preinitializeModule(preinitializedIRModule, "init", preinitError))
+	{ Errors::fatalf("Pre-initialization failed: %s", preinitError.c_str()); }
+
+	// The pre-initialized module must be valid, so round-trip it through the binary format, as
+	// wavm-compile --preinit does when it writes it.
+	Serialization::ArrayOutputStream stream;
+	WASM::serialize(stream, preinitializedIRModule);
+	std::vector<U8> wasmBytes = stream.getBytes();
+	IR::Module loadedIRModule(FeatureSpec(true));
+	WAVM_ERROR_UNLESS(WASM::loadBinaryModule(wasmBytes.data(), wasmBytes.size(), loadedIRModule));
+
+	// The initialization has already run, so it isn't run again.
+	WAVM_ERROR_UNLESS(loadedIRModule.startFunctionIndex == UINTPTR_MAX);
+
+	TestInstance original(irModule, "init");
+	TestInstance preinitialized(loadedIRModule, nullptr);
+	WAVM_ERROR_UNLESS(!getInstanceExport(preinitialized.moduleInstance, "init"));
+
+	Memory* originalMemory = asMemory(getInstanceExport(original.moduleInstance, "memory"));
+	Memory* memory = asMemory(getInstanceExport(preinitialized.moduleInstance, "memory"));
+	WAVM_ERROR_UNLESS(getMemoryNumPages(memory) == 2);
+	WAVM_ERROR_UNLESS(getMemoryNumPages(memory) == getMemoryNumPages(originalMemory));
+	WAVM_ERROR_UNLESS(!memcmp(getMemoryBaseAddress(memory),
+							  getMemoryBaseAddress(originalMemory),
+							  getMemoryNumPages(memory) * numBytesPerPage));
+	WAVM_ERROR_UNLESS(memoryRef<U32>(memory, 100) == 0x12345678);
+	WAVM_ERROR_UNLESS(memoryRef<U32>(memory, 65540) == 0x9abc);
+
+	for(const char* globalName : {"g", "h", "unchanged"})
+	{
+		const Value value = preinitialized.getGlobalExportValue(globalName);
+		const Value originalValue = original.getGlobalExportValue(globalName);
+		WAVM_ERROR_UNLESS(value.type == originalValue.type);
+		WAVM_ERROR_UNLESS(!memcmp(&value, &originalValue, sizeof(UntaggedValue)));
+	}
+	WAVM_ERROR_UNLESS(preinitialized.getGlobalExportValue("g").i32 == 2);
+	WAVM_ERROR_UNLESS(preinitialized.getGlobalExportValue("h").i64 == 7);
+
+	ValueTuple results = invokeFunctionChecked(
+		preinitialized.context,
+		asFunction(getInstanceExport(preinitialized.moduleInstance, "getG")),
+		{});
+	WAVM_ERROR_UNLESS(results.size() == 1 && results[0].i32 == 2);
+}
+
+// Checks that modules whose initialization can't be written to the module are rejected, and left
+// unchanged.
+static void testPreinitRejected()
+{
+	const char* rejectedModuleWASTs[] = {
+		// The start function calls an import.
+		"(module\n"
+		"  (import \"env\" \"f\" (func $f))\n"
+		"  (memory 1)\n"
+		"  (func $start (i32.store (i32.const 0) (i32.const 1)) (call $f))\n"
+		"  (start $start)\n"
+		")",
+		// The start function changes a table.
+		"(module\n"
+		"  (table 1 funcref)\n"
+		"  (func $start (table.set (i32.const 0) (ref.func $start)))\n"
+		"  (start $start)\n"
+		")",
+		// The start function traps.
+		"(module\n"
+		"  (func $start (unreachable))\n"
+		"  (start $start)\n"
+		")",
+		// A data segment is out of bounds.
+		"(module\n"
+		"  (memory 1)\n"
+		"  (data (i32.const 65535) \"ab\")\n"
+		")",
+		// The module has a passive data segment.
+		"(module\n"
+		"  (memory 1)\n"
+		"  (data \"passive\")\n"
+		")",
+	};
+
+	for(const char* wast : rejectedModuleWASTs)
+	{
+		IR::Module irModule(FeatureSpec(true));
+		parseWAST(wast, irModule);
+		const Uptr startFunctionIndex = irModule.startFunctionIndex;
+		const Uptr numDataSegments = irModule.dataSegments.size();
+
+		std::string preinitError;
+		WAVM_ERROR_UNLESS(!preinitializeModule(irModule, nullptr, preinitError));
+		WAVM_ERROR_UNLESS(preinitError.size());
+		WAVM_ERROR_UNLESS(irModule.startFunctionIndex == startFunctionIndex);
+		WAVM_ERROR_UNLESS(irModule.dataSegments.size() == numDataSegments);
+	}
+
+	// The init function must be exported, and take no parameters.
+	IR::Module irModule(FeatureSpec(true));
+	parseWAST("(module (func (export \"init\") (param i32)))", irModule);
+	std::string preinitError;
+	WAVM_ERROR_UNLESS(!preinitializeModule(irModule, "init", preinitError));
+	WAVM_ERROR_UNLESS(!preinitializeModule(irModule, "missing", preinitError));
+	WAVM_ERROR_UNLESS(irModule.exports.size() == 1);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+	testPreinitMatchesInitialization();
+	testPreinitRejected();
+	Timing::logTimer("PreinitTest", timer);
+	return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string.h>
+#include <functional>
+#include <vector>
+
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/WASTParse/WASTParse.h"
+
+namespace WAVM { namespace RuntimeTest {
+
+	// Parses a module from WAST text, and exits the process if it fails.
+	inline void parseWAST(const char* wast, IR::Module& outModule)
+	{
+		std::vector<WAST::Error> parseErrors;
+		if(!WAST::parseModule(wast, strlen(wast) + 1, outModule, parseErrors))
+		{
+			WAST::reportParseErrors("test module", parseErrors);
+			Errors::fatal("Failed to parse test module");
+		}
+	}
+
+	// Parses and compiles a module from WAST text. The module may use any proposed extension.
+	inline Runtime::ModuleRef compileWAST(const char* wast,
+										  const LLVMJIT::CompileOptions& compileOptions
+										  = LLVMJIT::CompileOptions())
+	{
+		IR::Module irModule(IR::FeatureSpec(true));
+		parseWAST(wast, irModule);
+		return Runtime::compileModule(irModule, compileOptions);
+	}
+
+	// Calls a thunk, and returns the type of the runtime exception it threw, or null if it
+	// didn't throw one.
+	inline Runtime::ExceptionType* catchExceptionType(const std::function<void()>& thunk)
+	{
+		Runtime::ExceptionType* exceptionType = nullptr;
+		Runtime::catchRuntimeExceptions(thunk, [&](Runtime::Exception* exception) {
+			exceptionType = Runtime::getExceptionType(exception);
+			Runtime::destroyException(exception);
+		});
+		return exceptionType;
+	}
+}}
@@ -0,0 +1,221 @@
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/VFS/VFS.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+static const char* snapshotPath = "SnapshotTest.snapshot";
+
+// The objects of a compartment that is built the same way for each test.
+struct HostObjects
+{
+	GCPointer<Compartment> compartment;
+	Memory* memory;
+	Table* table;
+	Global* global;
+	Global* referenceGlobal;
+	Context* context;
+
+	HostObjects(const MemoryType& memoryType = MemoryType(false, SizeConstraints{1, 4}))
+	{
+		compartment = createCompartment();
+		memory = createMemory(compartment, memoryType, "memory");
+		table = createTable(compartment,
+							TableType(ReferenceType::anyref, false, SizeConstraints{2, 8}),
+							nullptr,
+							"table");
+		global = createGlobal(compartment, GlobalType(ValueType::i32, true));
+		initializeGlobal(global, Value(I32(1)));
+		referenceGlobal = createGlobal(compartment, GlobalType(ValueType::anyref, true));
+		initializeGlobal(referenceGlobal, Value(asObject(memory)));
+		context = createContext(compartment);
+		WAVM_ERROR_UNLESS(memory && table && global && referenceGlobal && context);
+	}
+
+	~HostObjects() { WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment))); }
+};
+
+static void checkMemoryContents(Memory* memory, const std::vector<U8>& expectedContents)
+{
+	WAVM_ERROR_UNLESS(getMemoryNumPages(memory) * numBytesPerPage == expectedContents.size());
+	WAVM_ERROR_UNLESS(
+		!memcmp(getMemoryBaseAddress(memory), expectedContents.data(), expectedContents.size()));
+}
+
+// Checks that the state of memories, tables, and globals created by the host survives a snapshot
+// and restore, and that table elements and reference globals are restored to the corresponding
+// objects.
+static void testRestoreHostObjects()
+{
+	// Create the compartment to restore while the original still exists, so their objects can't
+	// have the same addresses.
+	HostObjects restored;
+	std::vector<U8> expectedContents;
+	{
+		HostObjects original;
+		WAVM_ERROR_UNLESS(growMemory(original.memory, 1));
+		memoryRef<U32>(original.memory, 8) = 0x12345678;
+		memoryRef<U32>(original.memory, numBytesPerPage + 4) = 0x9abcdef0;
+		WAVM_ERROR_UNLESS(growTable(original.table, 1));
+		setTableElement(original.table, 0, asObject(original.memory));
+		setTableElement(original.table, 2, asObject(original.global));
+		setGlobalValue(original.context, original.global, Value(I32(2)));
+		setGlobalValue(original.context, original.referenceGlobal, Value(asObject(original.table)));
+
+		const U8* baseAddress = getMemoryBaseAddress(original.memory);
+		expectedContents.assign(baseAddress, baseAddress + 2 * numBytesPerPage);
+
+		WAVM_ERROR_UNLESS(snapshotCompartment(original.compartment, snapshotPath));
+	}
+
+	WAVM_ERROR_UNLESS(restoreCompartment(restored.compartment, snapshotPath));
+	checkMemoryContents(restored.memory, expectedContents);
+	WAVM_ERROR_UNLESS(getTableNumElements(restored.table) == 3);
+	WAVM_ERROR_UNLESS(getTableElement(restored.table, 0) == asObject(restored.memory));
+	WAVM_ERROR_UNLESS(getTableElement(restored.table, 1) == nullptr);
+	WAVM_ERROR_UNLESS(getTableElement(restored.table, 2) == asObject(restored.global));
+	WAVM_ERROR_UNLESS(getGlobalValue(restored.context, restored.global).i32 == 2);
+	WAVM_ERROR_UNLESS(getGlobalValue(restored.context, restored.referenceGlobal).object
+					  == asObject(restored.table));
+
+	// Contexts created after the restore get the restored initial values of the globals.
+	Context* newContext = createContext(restored.compartment);
+	WAVM_ERROR_UNLESS(getGlobalValue(newContext, restored.referenceGlobal).object
+					  == asObject(restored.memory));
+
+	// A restored memory may map the file copy-on-write, so check that writing to it doesn't change
+	// what is restored from the file, or the memory's clones.
+	memoryRef<U32>(restored.memory, 8) = 0;
+	memoryRef<U32>(restored.memory, 3 * numBytesPerPage / 2) = 1;
+	GCPointer<Compartment> clonedCompartment = cloneCompartment(restored.compartment);
+	Memory* clonedMemory = remapToClonedCompartment(restored.memory, clonedCompartment);
+	memoryRef<U32>(restored.memory, 12) = 2;
+	std::vector<U8> restoredContents = expectedContents;
+	memset(restoredContents.data() + 8, 0, 4);
+	restoredContents[3 * numBytesPerPage / 2] = 1;
+	checkMemoryContents(clonedMemory, restoredContents);
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartment)));
+
+	HostObjects restoredAgain;
+	WAVM_ERROR_UNLESS(restoreCompartment(restoredAgain.compartment, snapshotPath));
+	checkMemoryContents(restoredAgain.memory, expectedContents);
+
+	// A compartment that doesn't match the snapshot isn't changed.
+	HostObjects mismatched(MemoryType(false, SizeConstraints{1, 8}));
+	WAVM_ERROR_UNLESS(!restoreCompartment(mismatched.compartment, snapshotPath));
+	WAVM_ERROR_UNLESS(getMemoryNumPages(mismatched.memory) == 1);
+	WAVM_ERROR_UNLESS(getTableElement(mismatched.table, 0) == nullptr);
+	WAVM_ERROR_UNLESS(getGlobalValue(mismatched.context, mismatched.global).i32 == 1);
+	WAVM_ERROR_UNLESS(getGlobalValue(mismatched.context, mismatched.referenceGlobal).object
+					  == asObject(mismatched.memory));
+}
+
+static const char* testModuleWAST
+	= "(module\n"
+	  "  (memory 1 4)\n"
+	  "  (data (i32.const 0) \"data\")\n"
+	  "  (data \"passive\")\n"
+	  "  (table 2 4 funcref)\n"
+	  "  (elem (i32.const 0) $f)\n"
+	  "  (global $g (mut i32) (i32.const 1))\n"
+	  "  (global $fg (export \"fg\") (mut funcref) (ref.null))\n"
+	  "  (func $f (export \"f\") (result i32) (i32.const 5))\n"
+	  "  (func (export \"getG\") (result i32) (global.get $g))\n"
+	  "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+	  "  (func (export \"size\") (result i32) (memory.size))\n"
+	  "  (func (export \"callIndirect\") (param i32) (result i32)\n"
+	  "    (call_indirect (result i32) (local.get 0)))\n"
+	  "  (func (export \"initPassive\")\n"
+	  "    (memory.init 1 (i32.const 0) (i32.const 0) (i32.const 7)))\n"
+	  "  (func (export \"init\")\n"
+	  "    (global.set $g (i32.const 2))\n"
+	  "    (global.set $fg (ref.func $f))\n"
+	  "    (i32.store (i32.const 8) (i32.const 0x1234))\n"
+	  "    (drop (memory.grow (i32.const 1)))\n"
+	  "    (i32.store (i32.const 65540) (i32.const 0x5678))\n"
+	  "    (table.set (i32.const 1) (ref.func $f))\n"
+	  "    (data.drop 1))\n"
+	  ")";
+
+static I32 invokeI32Export(Context* context,
+						   ModuleInstance* moduleInstance,
+						   const char* name,
+						   const std::vector<Value>& arguments = {})
+{
+	ValueTuple results = invokeFunctionChecked(
+		context, asFunction(getInstanceExport(moduleInstance, name)), arguments);
+	WAVM_ERROR_UNLESS(results.size() == 1 && results[0].type == ValueType::i32);
+	return results[0].i32;
+}
+
+// Checks that restoring a snapshot taken after a module's initialization runs restores the state
+// it initialized, in a compartment where the module was instantiated without running it.
+static void testRestoreModuleInstance()
+{
+	IR::Module irModule(FeatureSpec(true));
+	parseWAST(testModuleWAST, irModule);
+	ModuleRef module = compileModule(irModule);
+
+	{
+		GCPointer<Compartment> compartment = createCompartment();
+		ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+		Context* context = createContext(compartment);
+		invokeFunctionChecked(context, asFunction(getInstanceExport(moduleInstance, "init")), {});
+		WAVM_ERROR_UNLESS(snapshotCompartment(compartment, snapshotPath));
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	}
+
+	GCPointer<Compartment> compartment = createCompartment();
+	ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+	Context* context = createContext(compartment);
+	WAVM_ERROR_UNLESS(restoreCompartment(compartment, snapshotPath));
+
+	WAVM_ERROR_UNLESS(invokeI32Export(context, moduleInstance, "getG") == 2);
+	WAVM_ERROR_UNLESS(
+		getGlobalValue(context, asGlobal(getInstanceExport(moduleInstance, "fg"))).function
+		== asFunction(getInstanceExport(moduleInstance, "f")));
+	WAVM_ERROR_UNLESS(invokeI32Export(context, moduleInstance, "size") == 2);
+	WAVM_ERROR_UNLESS(invokeI32Export(context, moduleInstance, "load", {Value(I32(0))})
+					  == I32(0x61746164));
+	WAVM_ERROR_UNLESS(invokeI32Export(context, moduleInstance, "load", {Value(I32(8))}) == 0x1234);
+	WAVM_ERROR_UNLESS(invokeI32Export(context, moduleInstance, "load", {Value(I32(65540))})
+					  == 0x5678);
+	WAVM_ERROR_UNLESS(invokeI32Export(context, moduleInstance, "callIndirect", {Value(I32(1))})
+					  == 5);
+
+	// The passive data segment was dropped before the snapshot.
+	Function* initPassive = asFunction(getInstanceExport(moduleInstance, "initPassive"));
+	WAVM_ERROR_UNLESS(
+		catchExceptionType([&] { invokeFunctionChecked(context, initPassive, {}); })
+		== ExceptionTypes::invalidArgument);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	testRestoreHostObjects();
+	testRestoreModuleInstance();
+	WAVM_ERROR_UNLESS(Platform::getHostFS().unlinkFile(snapshotPath) == VFS::Result::success);
+
+	Timing::logTimer("SnapshotTest", timer);
+	return 0;
+}
@@ -0,0 +1,183 @@
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "RuntimeTestUtils.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Runtime/Runtime.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+using namespace WAVM::RuntimeTest;
+
+enum
+{
+	numManyI64Params = 8,
+	numManyF64Params = 10
+};
+
+// Generates a module with functions of various signatures. The "many" function has more
+// parameters than fit in the argument registers, and returns a sum of its parameters weighted by
+// their position, so passing any parameter in the wrong place changes its result.
+static std::string generateTestModuleWAST()
+{
+	std::string manyParams;
+	std::string manySum = "(f64.const 0)";
+	for(Uptr paramIndex = 0; paramIndex < numManyI64Params + numManyF64Params; ++paramIndex)
+	{
+		const bool isI64 = paramIndex < numManyI64Params;
+		manyParams += isI64 ? " i64" : " f64";
+
+		const std::string param = "(local.get " + std::to_string(paramIndex) + ")";
+		manySum = "(f64.add " + manySum + " (f64.mul "
+				  + (isI64 ? "(f64.convert_i64_s " + param + ")" : param) + " (f64.const "
+				  + std::to_string(paramIndex + 1) + ")))";
+	}
+
+	return "(module\n"
+		   "  (global $global (mut i64) (i64.const 0))\n"
+		   "  (func (export \"const\") (result i32) (i32.const -2147483647))\n"
+		   "  (func (export \"not\") (param i32) (result i32)\n"
+		   "    (i32.xor (local.get 0) (i32.const -1)))\n"
+		   "  (func (export \"addI64\") (param i64 i32) (result i64)\n"
+		   "    (i64.add (local.get 0) (i64.extend_i32_s (local.get 1))))\n"
+		   "  (func (export \"mulF32\") (param f32 i32) (result f32)\n"
+		   "    (f32.mul (local.get 0) (f32.convert_i32_s (local.get 1))))\n"
+		   "  (func (export \"mixed\") (param i32 i64 f32 f64) (result f64)\n"
+		   "    (f64.add (f64.add (f64.convert_i32_s (local.get 0))\n"
+		   "                      (f64.mul (f64.convert_i64_s (local.get 1)) (f64.const 2)))\n"
+		   "             (f64.add (f64.mul (f64.promote_f32 (local.get 2)) (f64.const 3))\n"
+		   "                      (f64.mul (local.get 3) (f64.const 4)))))\n"
+		   "  (func (export \"many\") (param"
+		   + manyParams + ") (result f64)\n    " + manySum
+		   + ")\n"
+			 "  (func (export \"addV128\") (param v128) (result v128)\n"
+			 "    (i32x4.add (local.get 0) (local.get 0)))\n"
+			 "  (func (export \"ref\") (param anyref) (result anyref) (local.get 0))\n"
+			 "  (func (export \"setGlobal\") (param i64) (global.set $global (local.get 0)))\n"
+			 "  (func (export \"getGlobal\") (result i64) (global.get $global))\n"
+			 "  (func (export \"pair\") (result i32 i32) (i32.const 1) (i32.const 2))\n"
+			 ")";
+}
+
+// Calls a function through a TypedFunction and through invokeFunctionChecked, and checks that
+// both return the same bits.
+template<typename Result, typename... Args>
+static Result testCall(Context* context,
+					   ModuleInstance* moduleInstance,
+					   const char* exportName,
+					   Args... args)
+{
+	Function* function = asFunction(getInstanceExport(moduleInstance, exportName));
+	TypedFunction<Result(Args...)> typedFunction(function);
+	const Result typedResult = typedFunction(context, args...);
+
+	const ValueTuple checkedResults = invokeFunctionChecked(context, function, {Value(args)...});
+	WAVM_ERROR_UNLESS(checkedResults.size() == 1);
+	const UntaggedValue& checkedResult = checkedResults[0];
+	WAVM_ERROR_UNLESS(!memcmp(&typedResult, &checkedResult, sizeof(Result)));
+
+	return typedResult;
+}
+
+static void testSignatures(Context* context, ModuleInstance* moduleInstance)
+{
+	WAVM_ERROR_UNLESS(testCall<I32>(context, moduleInstance, "const") == -2147483647);
+	WAVM_ERROR_UNLESS(testCall<U32>(context, moduleInstance, "not", U32(0x7fffffff))
+					  == 0x80000000u);
+	WAVM_ERROR_UNLESS(testCall<I64>(context, moduleInstance, "addI64", I64(1) << 40, I32(-1))
+					  == (I64(1) << 40) - 1);
+	WAVM_ERROR_UNLESS(testCall<F32>(context, moduleInstance, "mulF32", F32(1.5f), I32(-3))
+					  == -4.5f);
+	WAVM_ERROR_UNLESS(
+		testCall<F64>(context, moduleInstance, "mixed", I32(-1), I64(1) << 33, F32(0.5f), F64(0.25))
+		== -1.0 + F64(I64(1) << 34) + 1.5 + 1.0);
+
+	const F64 manyResult = testCall<F64>(context,
+										 moduleInstance,
+										 "many",
+										 I64(1),
+										 I64(2),
+										 I64(3),
+										 I64(4),
+										 I64(5),
+										 I64(6),
+										 I64(7),
+										 I64(8),
+										 F64(9),
+										 F64(10),
+										 F64(11),
+										 F64(12),
+										 F64(13),
+										 F64(14),
+										 F64(15),
+										 F64(16),
+										 F64(17),
+										 F64(18));
+	F64 expectedManyResult = 0;
+	for(Uptr paramIndex = 0; paramIndex < numManyI64Params + numManyF64Params; ++paramIndex)
+	{ expectedManyResult += F64(paramIndex + 1) * F64(paramIndex + 1); }
+	WAVM_ERROR_UNLESS(manyResult == expectedManyResult);
+
+	V128 v128;
+	v128.i32[0] = 1;
+	v128.i32[1] = -2;
+	v128.i32[2] = 0x40000000;
+	v128.i32[3] = 4;
+	const V128 v128Result = testCall<V128>(context, moduleInstance, "addV128", v128);
+	WAVM_ERROR_UNLESS(v128Result.i32[0] == 2 && v128Result.i32[1] == -4
+					  && v128Result.i32[2] == I32(0x80000000u) && v128Result.i32[3] == 8);
+
+	Object* object = getInstanceExport(moduleInstance, "ref");
+	WAVM_ERROR_UNLESS(testCall<Object*>(context, moduleInstance, "ref", object) == object);
+}
+
+static void testVoidResult(Context* context, ModuleInstance* moduleInstance)
+{
+	TypedFunction<void(I64)> setGlobal(
+		asFunction(getInstanceExport(moduleInstance, "setGlobal")));
+	TypedFunction<I64()> getGlobal(asFunction(getInstanceExport(moduleInstance, "getGlobal")));
+
+	setGlobal(context, I64(0x123456789abcdef));
+	WAVM_ERROR_UNLESS(getGlobal(context) == I64(0x123456789abcdef));
+}
+
+static void testSignatureMismatch(ModuleInstance* moduleInstance)
+{
+	// Binding a function to a signature that doesn't match its type must throw.
+	Function* mixedFunction = asFunction(getInstanceExport(moduleInstance, "mixed"));
+	WAVM_ERROR_UNLESS(
+		catchExceptionType([&] { TypedFunction<I64(I32, I64, F32, F64)> typed(mixedFunction); })
+		== ExceptionTypes::invokeSignatureMismatch);
+	WAVM_ERROR_UNLESS(
+		catchExceptionType([&] { TypedFunction<F64(I32, I64, F32)> typed(mixedFunction); })
+		== ExceptionTypes::invokeSignatureMismatch);
+
+	// Functions with more than one result can't be bound.
+	Function* pairFunction = asFunction(getInstanceExport(moduleInstance, "pair"));
+	WAVM_ERROR_UNLESS(catchExceptionType([&] { TypedFunction<I32()> typed(pairFunction); })
+					  == ExceptionTypes::invokeSignatureMismatch);
+}
+
+I32 main()
+{
+	Timing::Timer timer;
+
+	GCPointer<Compartment> compartment = createCompartment();
+	ModuleRef module = compileWAST(generateTestModuleWAST().c_str());
+	ModuleInstance* moduleInstance = instantiateModule(compartment, module, {}, "test");
+	Context* context = createContext(compartment);
+
+	testSignatures(context, moduleInstance);
+	testVoidResult(context, moduleInstance);
+	testSignatureMismatch(moduleInstance);
+
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+
+	Timing::logTimer("TypedFunctionTest", timer);
+	return 0;
+}